@@ -0,0 +1,112 @@
+// Compile time vs threads for the JIT's parallel unit compilation (runJIT with
+// jobs > 1). A generated program with many function literals and integrals is
+// compiled with 1, 2, 4, ... threads up to the core count. IR generation is the
+// same sequential frontend in every run, only optimization and codegen scale.
+//
+// Usage: CompileBench [functions] [max threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/jit/jit.h"
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Every function gets a polynomial-ish body worth optimizing and an integral of
+    // its own, so the module has two functions per literal to spread over units
+    std::string generate(int functions) {
+        std::string src = "double total = 0;\n";
+        for (int k = 1; k <= functions; ++k) {
+            std::string n = std::to_string(k);
+            src += "function f" + n + " = (a, b) -> ";
+            for (int term = 1; term <= 8; ++term) {
+                std::string c = std::to_string(term) + "." + n;
+                if (term > 1) src += " + ";
+                src += "sin(a * " + c + ") * exp(b / " + c + ") - sqrt(a * a + " + c + ") * cos(b - " + c + ")";
+            }
+            src += ";\n";
+            src += "double v" + n + " = f" + n + "(" + n + ".5, 2) + integral(sin(t" + n + " * " + n + ") * exp(t" + n +
+                   ") + log(t" + n + " + " + n + "), t" + n + ", 0, 1);\n";
+            src += "total = total + v" + n + ";\n";
+        }
+        return src;
+    }
+
+    struct Sample {
+        double frontend, optimize, link;
+        unsigned units;
+        double total() const { return frontend + optimize + link; }
+    };
+
+    bool compileOnce(const std::string& path, unsigned jobs, Sample& sample) {
+        auto start = std::chrono::steady_clock::now();
+        Lexer lexer(path);
+        lexer.setDebug(false);
+        lexer.tokenize();
+        Parser parser(lexer.getTokens());
+
+        codegen_ctx ctx("bench");
+        if (!parser.getProgram()->codegenEntry(ctx)) return false;
+        sample.frontend = msSince(start);
+
+        JITTimings timings;
+        if (runJIT(ctx, timings, OptimizerOptions(), nullptr, jobs) < 0) return false;
+        sample.optimize = timings.optimize;
+        sample.link = timings.compile;
+        sample.units = timings.units;
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    int functions = argc > 1 ? std::atoi(argv[1]) : 200;
+    const std::string path = "compile_bench.crunch";
+    {
+        std::ofstream out(path);
+        out << generate(functions);
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned maxJobs = argc > 2 ? std::max(1, std::atoi(argv[2])) : cores;
+    std::vector<unsigned> jobs;
+    for (unsigned j = 1; j < maxJobs; j *= 2) jobs.push_back(j);
+    jobs.push_back(maxJobs);
+
+    std::printf("%d function literals, %u cores, best of 3\n", functions, cores);
+    std::printf("%6s %6s %14s %16s %10s %10s %8s\n", "jobs", "units", "frontend(ms)", "opt+codegen(ms)", "link(ms)", "total(ms)", "speedup");
+
+    double baseline = 0.0;
+    for (unsigned j : jobs) {
+        Sample best{};
+        best.frontend = best.optimize = best.link = 1e300;
+        for (int rep = 0; rep < 3; ++rep) {
+            Sample s;
+            try {
+                if (!compileOnce(path, j, s)) { std::cerr << "compilation failed" << std::endl; return 1; }
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            if (s.total() < best.total()) best = s;
+        }
+
+        // Single unit compiles optimize and codegen separately, compare the sum
+        double work = best.optimize + best.link;
+        if (j == 1) baseline = work;
+        std::printf("%6u %6u %14.1f %16.1f %10.1f %10.1f %7.2fx\n", j, best.units, best.frontend,
+            best.units > 1 ? best.optimize : work, best.units > 1 ? best.link : 0.0, best.total(), baseline / work);
+    }
+    return 0;
+}
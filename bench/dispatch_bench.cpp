@@ -0,0 +1,175 @@
+// Executed bytecode instructions (dispatches) and run time of the interpreter
+// with quickening and superinstructions switched on one after the other. The
+// corpus scripts are tiny, a generated loop program stands in for real work.
+// --pairs lists the most frequent opcode pairs of the plain bytecode, which is
+// how the superinstructions in vm/fuse.h were picked.
+//
+// Usage: DispatchBench [--pairs] [runs] [file.crunch ...]  (default: corpus + loops)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/runtime/print.h"
+#include "../src/vm/compiler.h"
+#include "../src/vm/vm.h"
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Sends stdout to /dev/null while alive
+    struct Silence {
+        int saved;
+        Silence() {
+            std::fflush(stdout);
+            saved = dup(1);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, 1);
+            close(null);
+        }
+        ~Silence() {
+            crunch_flush();
+            std::fflush(stdout);
+            dup2(saved, 1);
+            close(saved);
+        }
+    };
+
+    // Counting loops, branches on constants and prints, the patterns scripts are made of
+    const char* loops =
+        "int n = 300000;\n"
+        "double sum = 0;\n"
+        "int evens = 0;\n"
+        "for (int i = 0; i < n; i = i + 1) {\n"
+        "    if (i % 2 == 0) evens = evens + 1;\n"
+        "    sum = sum + i * 0.5;\n"
+        "}\n"
+        "int j = 0;\n"
+        "while (j < 20000) {\n"
+        "    j = j + 1;\n"
+        "    if (j % 1000 == 0) print(j);\n"
+        "}\n"
+        "print(sum, \" \", evens);\n";
+
+    struct Config {
+        const char* name;
+        bool superinstructions;
+        bool quicken;
+    };
+
+    const Config configs[] = {
+        { "plain", false, false },
+        { "quickened", false, true },
+        { "+superinstr", true, true },
+    };
+
+    // Stands for loops in the file list, lexed from memory
+    const char* LOOPS_NAME = "(generated loops)";
+
+    std::unique_ptr<Parser> parse(const std::string& path, std::unique_ptr<Lexer>& lexer) {
+        if (path == LOOPS_NAME) lexer = Lexer::fromSource(loops);
+        else lexer.reset(new Lexer(path));
+        lexer->setDebug(false);
+        lexer->tokenize();
+        return std::unique_ptr<Parser>(new Parser(lexer->getTokens()));
+    }
+
+    // Dispatch count of one profiled run and the best time of unprofiled ones
+    bool measure(const Program* program, const Config& config, int runs, DispatchProfile& profile, double& best) {
+        Silence quiet;
+        {
+            auto image = BytecodeImage::link(compileBytecode(program, config.superinstructions));
+            VMOptions options;
+            options.quicken = config.quicken;
+            options.profile = &profile;
+            if (VM(*image, options).run() < 0) return false;
+        }
+
+        best = 1e300;
+        for (int r = 0; r < runs; ++r) {
+            auto image = BytecodeImage::link(compileBytecode(program, config.superinstructions));
+            VMOptions options;
+            options.quicken = config.quicken;
+            auto start = std::chrono::steady_clock::now();
+            if (VM(*image, options).run() < 0) return false;
+            best = std::min(best, msSince(start));
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    int argi = 1;
+    bool pairs = argi < argc && std::strcmp(argv[argi], "--pairs") == 0;
+    if (pairs) ++argi;
+    int runs = argi < argc ? std::max(1, std::atoi(argv[argi++])) : 5;
+
+    std::vector<std::string> files(argv + std::min(argc, argi), argv + argc);
+    if (files.empty()) {
+        for (const char* name : {"arithmetic", "basic", "if"}) files.push_back(std::string("src/crunch_files/") + name + ".crunch");
+        files.push_back(LOOPS_NAME);
+    }
+
+    std::unique_ptr<DispatchProfile> plainPairs(new DispatchProfile());
+    std::printf("best of %d runs, execution only\n", runs);
+    std::printf("%-36s %-13s %14s %9s %12s %9s\n", "script", "bytecode", "dispatches", "of plain", "execute(ms)", "speedup");
+
+    for (const std::string& file : files) {
+        std::unique_ptr<Lexer> lexer;
+        std::unique_ptr<Parser> parser;
+        try { parser = parse(file, lexer); }
+        catch (const std::runtime_error& e) {
+            std::printf("%-36s skipped: %s\n", file.c_str(), e.what());
+            continue;
+        }
+
+        uint64_t base = 0;
+        double baseMs = 0.0;
+        for (const Config& config : configs) {
+            std::unique_ptr<DispatchProfile> profile(new DispatchProfile());
+            double ms = 0.0;
+            try {
+                if (!measure(parser->getProgram(), config, runs, *profile, ms)) throw std::runtime_error("runtime error");
+            } catch (const std::runtime_error& e) {
+                std::printf("%-36s skipped: %s\n", file.c_str(), e.what());
+                break;
+            }
+
+            if (&config == &configs[0]) {
+                base = profile->total;
+                baseMs = ms;
+                for (size_t a = 0; a < (size_t)Op::Count; ++a)
+                    for (size_t b = 0; b < (size_t)Op::Count; ++b) plainPairs->pairs[a][b] += profile->pairs[a][b];
+            }
+            std::printf("%-36s %-13s %14llu %8.1f%% %12.3f %8.2fx\n", &config == &configs[0] ? file.c_str() : "", config.name,
+                (unsigned long long)profile->total, 100.0 * profile->total / std::max<uint64_t>(base, 1), ms, baseMs / ms);
+        }
+    }
+
+    if (pairs) {
+        std::vector<std::pair<uint64_t, std::pair<size_t, size_t>>> ranked;
+        for (size_t a = 0; a < (size_t)Op::Count; ++a)
+            for (size_t b = 0; b < (size_t)Op::Count; ++b)
+                if (plainPairs->pairs[a][b]) ranked.push_back({ plainPairs->pairs[a][b], { a, b } });
+        std::sort(ranked.rbegin(), ranked.rend());
+
+        std::printf("\nmost frequent opcode pairs (plain bytecode, all scripts)\n");
+        for (size_t i = 0; i < std::min<size_t>(ranked.size(), 15); ++i) {
+            std::printf("%14llu  %s -> %s\n", (unsigned long long)ranked[i].first,
+                opName((Op)ranked[i].second.first), opName((Op)ranked[i].second.second));
+        }
+    }
+    return 0;
+}
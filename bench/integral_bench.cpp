@@ -0,0 +1,117 @@
+// Accuracy vs time for the G7K15 integration engine on standard test integrals.
+// Each integrand is a batch function with the same ABI the compiler emits for
+// integral(expr, var, a, b). A fixed-step midpoint rule is reported alongside
+// as the "Riemann loop in a script" baseline.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/runtime/quadrature.h"
+
+namespace {
+
+    const double PI = 3.14159265358979323846;
+
+    void fSquare(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = xs[i] * xs[i]; }
+    void fSin(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = std::sin(xs[i]); }
+    void fExp(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = std::exp(xs[i]); }
+    void fArctan(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = 1.0 / (1.0 + xs[i] * xs[i]); }
+    void fSqrt(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = std::sqrt(xs[i]); }
+    void fLog(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = std::log(xs[i]); }
+    void fInvSqrt(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = 1.0 / std::sqrt(xs[i]); }
+    void fRunge(const double* xs, double* ys, int64_t n, const double*) { for (int64_t i = 0; i < n; ++i) ys[i] = 1.0 / (1.0 + 25.0 * xs[i] * xs[i]); }
+
+    // env[0] = frequency
+    void fOscillating(const double* xs, double* ys, int64_t n, const double* env) {
+        for (int64_t i = 0; i < n; ++i) ys[i] = std::cos(env[0] * xs[i]);
+    }
+
+    // Expensive integrand, exercises the parallel refinement path
+    void fFourier(const double* xs, double* ys, int64_t n, const double*) {
+        for (int64_t i = 0; i < n; ++i) {
+            double s = 0.0;
+            for (int k = 1; k <= 400; ++k) s += std::sin(k * xs[i]) / k;
+            ys[i] = s;
+        }
+    }
+
+    double fourierExact() {
+        double s = 0.0;
+        for (int k = 1; k <= 400; ++k) s += (1.0 - std::cos((double)k)) / ((double)k * k);
+        return s;
+    }
+
+    struct Case {
+        const char* name;
+        crunch_integrand f;
+        std::vector<double> env;
+        double a, b;
+        double exact;
+    };
+
+    double elapsedUs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Repeats fn until at least ~20ms have passed, returns microseconds per call
+    template <typename Fn>
+    double timeUs(Fn fn) {
+        int reps = 0;
+        auto start = std::chrono::steady_clock::now();
+        do { fn(); reps++; } while (elapsedUs(start) < 20000.0);
+        return elapsedUs(start) / reps;
+    }
+
+    double midpoint(const Case& c, int64_t steps) {
+        std::vector<double> xs(steps), ys(steps);
+        double h = (c.b - c.a) / steps;
+        for (int64_t i = 0; i < steps; ++i) xs[i] = c.a + (i + 0.5) * h;
+        c.f(xs.data(), ys.data(), steps, c.env.data());
+
+        double sum = 0.0;
+        for (int64_t i = 0; i < steps; ++i) sum += ys[i];
+        return sum * h;
+    }
+}
+
+int main() {
+    std::vector<Case> cases = {
+        {"x^2 on [0,1]", fSquare, {}, 0.0, 1.0, 1.0 / 3.0},
+        {"sin(x) on [0,pi]", fSin, {}, 0.0, PI, 2.0},
+        {"exp(x) on [0,1]", fExp, {}, 0.0, 1.0, std::exp(1.0) - 1.0},
+        {"1/(1+x^2) on [0,1]", fArctan, {}, 0.0, 1.0, PI / 4.0},
+        {"sqrt(x) on [0,1]", fSqrt, {}, 0.0, 1.0, 2.0 / 3.0},
+        {"log(x) on [0,1]", fLog, {}, 0.0, 1.0, -1.0},
+        {"1/sqrt(x) on [0,1]", fInvSqrt, {}, 0.0, 1.0, 2.0},
+        {"Runge on [-1,1]", fRunge, {}, -1.0, 1.0, 0.4 * std::atan(5.0)},
+        {"cos(50x) on [0,1]", fOscillating, {50.0}, 0.0, 1.0, std::sin(50.0) / 50.0},
+        {"400 term sine sum on [0,1]", fFourier, {}, 0.0, 1.0, fourierExact()},
+    };
+
+    const double tolerances[] = {1e-6, 1e-10, 1e-13};
+
+    std::printf("%-28s %8s %12s %10s %8s %10s %s\n", "integral", "tol", "abs error", "evals", "ivals", "time(us)", "");
+    for (const Case& c : cases) {
+        for (double tol : tolerances) {
+            QuadratureOptions opts;
+            opts.epsabs = tol;
+            opts.epsrel = tol;
+
+            QuadratureResult r;
+            double us = timeUs([&]() { r = integrateGK15(c.f, c.env.data(), c.a, c.b, opts); });
+
+            std::printf("%-28s %8.0e %12.3e %10ld %8d %10.2f %s%s\n",
+                c.name, tol, std::fabs(r.value - c.exact), r.evaluations, r.intervals, us,
+                r.converged ? "" : "[not converged] ", r.parallel ? "[parallel]" : "");
+        }
+
+        // Fixed-step baseline
+        const int64_t steps = 100000;
+        double value = 0.0;
+        double us = timeUs([&]() { value = midpoint(c, steps); });
+        std::printf("%-28s %8s %12.3e %10ld %8s %10.2f\n", "  midpoint rule, 1e5 steps", "-", std::fabs(value - c.exact), (long)steps, "-", us);
+    }
+
+    return 0;
+}
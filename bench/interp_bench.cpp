@@ -0,0 +1,112 @@
+// Startup to finish time of the bytecode interpreter (--interp) against the JIT
+// (--jit) on small scripts, where compiling dominates running. Every sample is
+// the whole pipeline from source file to program exit, with the program's own
+// output sent to /dev/null. "jit first" is the first JIT run of each script,
+// for the first script that includes LLVM's one time target setup.
+//
+// Usage: InterpBench [runs] [file.crunch ...]  (default: the src/crunch_files corpus)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/jit/jit.h"
+#include "../src/runtime/print.h"
+#include "../src/vm/compiler.h"
+#include "../src/vm/vm.h"
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Sends stdout to /dev/null while alive, stderr stays for diagnostics
+    struct Silence {
+        int saved;
+        Silence() {
+            std::fflush(stdout);
+            saved = dup(1);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, 1);
+            close(null);
+        }
+        ~Silence() {
+            crunch_flush();
+            std::fflush(stdout);
+            dup2(saved, 1);
+            close(saved);
+        }
+    };
+
+    // Milliseconds for one run, negative on failure
+    double interpret(const std::string& path) {
+        auto start = std::chrono::steady_clock::now();
+        Lexer lexer(path);
+        lexer.setDebug(false);
+        lexer.tokenize();
+        Parser parser(lexer.getTokens());
+
+        auto image = BytecodeImage::link(compileBytecode(parser.getProgram()));
+        if (VM(*image).run() < 0) return -1;
+        return msSince(start);
+    }
+
+    double jit(const std::string& path) {
+        auto start = std::chrono::steady_clock::now();
+        Lexer lexer(path);
+        lexer.setDebug(false);
+        lexer.tokenize();
+        Parser parser(lexer.getTokens());
+
+        codegen_ctx ctx("bench");
+        if (!parser.getProgram()->codegenEntry(ctx)) return -1;
+        JITTimings timings;
+        if (runJIT(ctx, timings, OptimizerOptions(), nullptr, 1) < 0) return -1;
+        return msSince(start);
+    }
+}
+
+int main(int argc, char** argv) {
+    int runs = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+    std::vector<std::string> files(argv + std::min(argc, 2), argv + argc);
+    if (files.empty()) {
+        for (const char* name : {"arithmetic", "basic", "if", "test"}) files.push_back(std::string("src/crunch_files/") + name + ".crunch");
+    }
+
+    std::printf("best of %d runs, source to exit\n", runs);
+    std::printf("%-40s %12s %12s %12s %9s\n", "script", "interp(ms)", "jit(ms)", "jit first", "speedup");
+
+    for (const std::string& file : files) {
+        double bestInterp = 1e300, bestJit = 1e300, firstJit = 0.0;
+        try {
+            Silence quiet;
+            for (int r = 0; r < runs; ++r) {
+                double t = interpret(file);
+                if (t < 0) throw std::runtime_error("runtime error");
+                bestInterp = std::min(bestInterp, t);
+            }
+            for (int r = 0; r < runs; ++r) {
+                double t = jit(file);
+                if (t < 0) throw std::runtime_error("compilation failed");
+                if (r == 0) firstJit = t;
+                bestJit = std::min(bestJit, t);
+            }
+        } catch (const std::runtime_error& e) {
+            // Scripts either tier rejects (or the interpreter hands to the JIT) are skipped
+            std::printf("%-40s skipped: %s\n", file.c_str(), e.what());
+            continue;
+        }
+
+        std::printf("%-40s %12.3f %12.3f %12.3f %8.1fx\n", file.c_str(), bestInterp, bestJit,
+            firstJit, bestJit / bestInterp);
+    }
+    return 0;
+}
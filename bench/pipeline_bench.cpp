@@ -0,0 +1,96 @@
+// Front end time of a large generated program: lexing, parsing and codegen one
+// after another, and pipelined on three threads (--pipeline, see
+// pipeline/pipeline.h). The pipeline's floor is its slowest stage, reached
+// when the other two overlap with it completely; it needs three cores to get there.
+//
+// Usage: PipelineBench [statements] [runs]  (default: 20000, 5)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/pipeline/pipeline.h"
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Declarations, branches and prints in equal parts, no deriv (it would regenerate)
+    std::string generate(int statements) {
+        std::string src;
+        for (int k = 0; k < statements / 4; ++k) {
+            std::string n = std::to_string(k);
+            src += "double v" + n + " = " + n + ".5 * 2.0 + sin(" + n + ".0) / 3.0;\n";
+            src += "int k" + n + " = " + n + " % 7 + 3;\n";
+            src += "if (k" + n + " > 5) { v" + n + " = v" + n + " + 1.0; } else { v" + n + " = v" + n + " - 1.0; }\n";
+            src += "print(v" + n + ", k" + n + ");\n";
+        }
+        return src;
+    }
+
+    struct Sequential {
+        double lex = 1e300, parse = 1e300, codegen = 1e300;
+        double total() const { return lex + parse + codegen; }
+    };
+
+    void sequential(const std::string& path, Sequential& best) {
+        auto start = std::chrono::steady_clock::now();
+        Lexer lexer(path);
+        lexer.setDebug(false);
+        lexer.tokenize();
+        double lex = msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        Parser parser(lexer.getTokens());
+        double parse = msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        codegen_ctx ctx("bench");
+        parser.getProgram()->codegenEntry(ctx);
+        double codegen = msSince(start);
+
+        if (lex + parse + codegen < best.total()) best = { lex, parse, codegen };
+    }
+}
+
+int main(int argc, char** argv) {
+    int statements = argc > 1 ? std::max(4, std::atoi(argv[1])) : 20000;
+    int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+    std::string path = "pipeline_bench.crunch";
+    {
+        std::ofstream file(path);
+        file << generate(statements);
+    }
+
+    Sequential seq;
+    PipelineStats best;
+    best.ms = 1e300;
+    for (int r = 0; r < runs; ++r) {
+        sequential(path, seq);
+
+        PipelineStats stats;
+        PipelinedProgram program;
+        if (!runPipeline(path, "bench", PipelineOptions(), program, stats)) return 1;
+        if (stats.ms < best.ms) best = stats;
+    }
+    std::remove(path.c_str());
+
+    std::printf("%d statements, %zu tokens, %u hardware threads, best of %d\n", statements, best.lexer.items,
+                std::thread::hardware_concurrency(), runs);
+    std::printf("%-12s %12s %12s %12s\n", "", "sequential", "pipelined", "busy");
+    std::printf("%-12s %12.2f %12s %11.0f%%\n", "lex", seq.lex, "", best.utilization(best.lexer) * 100);
+    std::printf("%-12s %12.2f %12s %11.0f%%\n", "parse", seq.parse, "", best.utilization(best.parser) * 100);
+    std::printf("%-12s %12.2f %12s %11.0f%%\n", "codegen", seq.codegen, "", best.utilization(best.codegen) * 100);
+    std::printf("%-12s %12.2f %12.2f\n", "front end", seq.total(), best.ms);
+    std::printf("slowest stage %s, %.2f ms busy: the pipeline runs at %.0f%% of its throughput, %.2fx the sequential front end\n",
+                best.slowest().name, best.slowest().busyMs(), best.slowest().busyMs() / best.ms * 100, seq.total() / best.ms);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "aot.h"
+
+#include <cstdlib>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+// Toolchain used to link executables, set by the build (see CMakeLists.txt)
+#ifndef CRUNCH_CXX
+#define CRUNCH_CXX "c++"
+#endif
+#ifndef CRUNCH_RUNTIME_LIB
+#define CRUNCH_RUNTIME_LIB "libcrunch_rt.a"
+#endif
+
+namespace {
+
+    llvm::CodeGenOpt::Level codegenLevel(int optLevel) {
+        switch (optLevel) {
+            case 0: return llvm::CodeGenOpt::None;
+            case 1: return llvm::CodeGenOpt::Less;
+            case 3: return llvm::CodeGenOpt::Aggressive;
+            default: return llvm::CodeGenOpt::Default;
+        }
+    }
+
+    // int main() { return crunch_main(); }
+    void emitMain(codegen_ctx& ctx) {
+        llvm::Function* entry = ctx.module->getFunction("crunch_main");
+        llvm::Function* main = llvm::Function::Create(
+            entry->getFunctionType(), llvm::Function::ExternalLinkage, "main", ctx.module.get()
+        );
+
+        llvm::IRBuilder<> B(llvm::BasicBlock::Create(ctx.context, "entry", main));
+        B.CreateRet(B.CreateCall(entry, {}, "result"));
+    }
+
+    std::string quote(const std::string& arg) {
+        std::string out = "'";
+        for (char c : arg) {
+            if (c == '\'') out += "'\\''";
+            else out += c;
+        }
+        return out + "'";
+    }
+}
+
+bool emitObject(codegen_ctx& ctx, const std::string& path, const AOTOptions& opts) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    if (!ctx.module->getFunction("crunch_main")) {
+        std::cerr << "Module has no entry function." << std::endl;
+        return false;
+    }
+    if (!ctx.module->getFunction("main")) emitMain(ctx);
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        std::cerr << "Unsupported target " << triple << ": " << error << std::endl;
+        return false;
+    }
+
+    // Generic CPU unless -march=native
+    std::string cpu = "generic";
+    llvm::SubtargetFeatures features;
+    if (opts.nativeCPU) {
+        cpu = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> host;
+        if (llvm::sys::getHostCPUFeatures(host)) {
+            for (auto& f : host) features.AddFeature(f.getKey(), f.getValue());
+        }
+    }
+
+    llvm::TargetOptions options;
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+        triple, cpu, features.getString(), options, llvm::Reloc::PIC_, llvm::None, codegenLevel(opts.optimizer.level)
+    ));
+
+    ctx.module->setTargetTriple(triple);
+    ctx.module->setDataLayout(machine->createDataLayout());
+
+    if (llvm::verifyModule(*ctx.module, &llvm::errs())) {
+        std::cerr << "Generated module is invalid." << std::endl;
+        return false;
+    }
+
+    if (!optimizeModule(*ctx.module, opts.optimizer, machine.get())) return false;
+
+    std::error_code ec;
+    llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        std::cerr << "Could not open " << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    llvm::legacy::PassManager pm;
+    if (machine->addPassesToEmitFile(pm, out, nullptr, llvm::CGFT_ObjectFile)) {
+        std::cerr << "Target can't emit object files." << std::endl;
+        return false;
+    }
+    pm.run(*ctx.module);
+    out.flush();
+    return true;
+}
+
+bool linkExecutable(const std::string& object, const std::string& output, const AOTOptions& opts) {
+    std::string command = quote(CRUNCH_CXX) + " " + quote(object) + " " + quote(CRUNCH_RUNTIME_LIB) +
+                          (opts.optimizer.vecLib == "libmvec" ? " -lmvec" : "") + " -lm -pthread -o " + quote(output);
+
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "Linking failed: " << command << std::endl;
+        return false;
+    }
+    return true;
+}
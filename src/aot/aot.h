@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include "../ast/ast.h"
+#include "../opt/optimizer.h"
+
+// Ahead-of-time compilation: codegen_ctx module -> object file -> executable
+
+struct AOTOptions {
+    OptimizerOptions optimizer; // IR pipeline, its level also sets the machine code generation level
+    bool nativeCPU = false; // -march=native: tune for and use every feature of the host CPU
+};
+
+// Lowers the module of ctx (which must contain crunch_main) to a relocatable
+// object file. A main() calling crunch_main is added so the object only needs
+// the runtime library (crunch_rt) to become a program. Returns false on failure.
+bool emitObject(codegen_ctx& ctx, const std::string& path, const AOTOptions& opts);
+
+// Links an object from emitObject against the static runtime into an executable
+bool linkExecutable(const std::string& object, const std::string& output, const AOTOptions& opts);
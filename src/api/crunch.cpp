@@ -0,0 +1,27 @@
+#include "crunch.h"
+#include "../columns/columns.h"
+
+namespace crunch {
+
+    Formula::Formula() = default;
+    Formula::~Formula() = default;
+
+    std::shared_ptr<const Formula> Formula::compile(const std::string& source, std::string& error, const Options& options) {
+        ColumnOptions columnOptions;
+        columnOptions.optimizer.level = options.optimizationLevel;
+        columnOptions.threads = options.threads;
+
+        std::shared_ptr<Formula> formula(new Formula());
+        formula->kernel = ColumnKernel::compile(source, options.variables, columnOptions, error);
+        if (!formula->kernel) return nullptr;
+
+        formula->text = source;
+        formula->names = formula->kernel->columns();
+        formula->row = formula->kernel->rowCode();
+        return formula;
+    }
+
+    void Formula::evaluate(const double* const* columns, double* out, size_t rows) const {
+        kernel->evaluate(columns, out, rows);
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// libcrunch: Crunch formulas inside C++ programs, linked as the `crunch` library
+//
+//     std::string error;
+//     std::shared_ptr<const crunch::Formula> f = crunch::Formula::compile("x * sin(y) + sqrt(x)", error);
+//     if (!f) ...
+//
+//     crunch::Bindings vars(*f); // once per thread or request
+//     vars.set("x", 2.0).set("y", 0.5);
+//     double r = f->evaluate(vars);
+//
+// A formula is one expression. Its free variables, doubles, are what gets
+// bound. Compiling parses it and generates native code, which takes
+// milliseconds. Evaluating is a call into that code: no heap allocation, no
+// locks. Formulas are immutable once compiled, so any number of threads can
+// evaluate the same one at once, each with its own Bindings. This header
+// doesn't pull in LLVM.
+
+class ColumnKernel;
+
+namespace crunch {
+
+    class Bindings;
+
+    struct Options {
+        // Variable order (indices, column order); empty takes the free variables, sorted.
+        // Names that the expression doesn't use are allowed
+        std::vector<std::string> variables;
+
+        int optimizationLevel = 2; // -O0 .. -O3
+        unsigned threads = 1; // for column evaluation, 0 = one per hardware thread
+    };
+
+    class Formula {
+        public:
+            ~Formula();
+
+            // nullptr with the reason in error for syntax errors, unknown
+            // names and expressions that aren't numeric
+            static std::shared_ptr<const Formula> compile(const std::string& source, std::string& error, const Options& options = Options());
+
+            const std::string& source() const { return text; }
+            size_t variableCount() const { return names.size(); }
+            const std::string& variable(size_t index) const { return names[index]; }
+
+            // Index of the named variable, -1 if there is none
+            int index(const char* name) const {
+                for (size_t i = 0; i < names.size(); ++i) if (std::strcmp(names[i].c_str(), name) == 0) return (int)i;
+                return -1;
+            }
+            int index(const std::string& name) const { return index(name.c_str()); }
+
+            // values holds variableCount() doubles in variable order
+            double evaluate(const double* values) const { return row(values); }
+
+            // Bindings made for this formula
+            double evaluate(const Bindings& bindings) const;
+
+            // out[i] for row i of columns (one array per variable, in variable
+            // order), i in [0, rows). Vectorized and blocked, see columns/columns.h
+            void evaluate(const double* const* columns, double* out, size_t rows) const;
+
+        private:
+            typedef double (*RowCode)(const double* values);
+
+            std::string text;
+            std::vector<std::string> names;
+            RowCode row = nullptr;
+            std::unique_ptr<ColumnKernel> kernel; // owns the code
+
+            Formula();
+            Formula(const Formula&) = delete;
+            Formula& operator=(const Formula&) = delete;
+    };
+
+    // Values of a formula's variables for one evaluation, all 0 at first.
+    // Sizing happens in the constructor; set() and evaluate() don't allocate
+    class Bindings {
+        public:
+            explicit Bindings(const Formula& formula) : formula(&formula), values(formula.variableCount(), 0.0) {}
+
+            Bindings& set(int index, double value) { values.at(index) = value; return *this; }
+
+            // Throws std::out_of_range for names that aren't variables of the formula
+            Bindings& set(const char* name, double value) {
+                int i = formula->index(name);
+                if (i < 0) throw std::out_of_range(std::string("not a variable of the formula: ") + name);
+                values[i] = value;
+                return *this;
+            }
+            Bindings& set(const std::string& name, double value) { return set(name.c_str(), value); }
+
+            double get(int index) const { return values.at(index); }
+            const double* data() const { return values.data(); }
+            const Formula& target() const { return *formula; }
+
+        private:
+            const Formula* formula;
+            std::vector<double> values;
+    };
+
+    inline double Formula::evaluate(const Bindings& bindings) const {
+        if (&bindings.target() != this) throw std::invalid_argument("bindings belong to another formula");
+        return row(bindings.data());
+    }
+}
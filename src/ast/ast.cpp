@@ -0,0 +1,1150 @@
+#include "ast.h"
+#include "../calculus/deriv.h"
+#include "../calculus/integral.h"
+#include "../calculus/dual.h"
+#include "../runtime/error.h"
+#include <set>
+#include <llvm/Support/raw_ostream.h>
+
+// Out-of-line codegen for nodes that depend on other compiler modules
+
+namespace {
+
+    // print(a, b, c) parses as the comma expression ((a, b), c)
+    void flattenCommas(ExprNode* expr, std::vector<ExprNode*>& items) {
+        auto b = dynamic_cast<BinaryExpr*>(expr);
+        if (b && b->op == BinaryOp::Comma) {
+            flattenCommas(b->left, items);
+            flattenCommas(b->right, items);
+            return;
+        }
+        items.push_back(expr);
+    }
+
+    // Operand type x opcode dispatch for BinaryExpr, columns follow BinaryOp
+    enum OperandKind { INT_OPERANDS, DOUBLE_OPERANDS, OPERAND_KINDS };
+
+    const llvm::Instruction::BinaryOps arithmeticOps[OPERAND_KINDS][5] = {
+        { llvm::Instruction::Add, llvm::Instruction::Sub, llvm::Instruction::Mul, llvm::Instruction::SDiv, llvm::Instruction::SRem },
+        { llvm::Instruction::FAdd, llvm::Instruction::FSub, llvm::Instruction::FMul, llvm::Instruction::FDiv, llvm::Instruction::FRem },
+    };
+
+    const llvm::CmpInst::Predicate comparisonOps[OPERAND_KINDS][6] = {
+        { llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE, llvm::CmpInst::ICMP_SLT, llvm::CmpInst::ICMP_SGT, llvm::CmpInst::ICMP_SLE, llvm::CmpInst::ICMP_SGE },
+        { llvm::CmpInst::FCMP_OEQ, llvm::CmpInst::FCMP_UNE, llvm::CmpInst::FCMP_OLT, llvm::CmpInst::FCMP_OGT, llvm::CmpInst::FCMP_OLE, llvm::CmpInst::FCMP_OGE },
+    };
+
+    // Range transfer per arithmetic opcode, the same for both operand kinds
+    ValueRange (* const arithmeticRanges[5])(const ValueRange&, const ValueRange&) = {
+        ranges::add, ranges::sub, ranges::mul, ranges::div, ranges::rem
+    };
+
+    const char* const arithmeticNames[5] = { "addtmp", "subtmp", "multmp", "divtmp", "modtmp" };
+
+    // Doubles win, otherwise both sides become i32 (bools count as 0 and 1).
+    // Returns false for non numeric operands
+    bool promote(codegen_ctx& ctx, llvm::Value*& l, llvm::Value*& r, OperandKind& kind) {
+        if (l->getType()->isDoubleTy() || r->getType()->isDoubleTy()) {
+            l = ctx.toDouble(l);
+            r = ctx.toDouble(r);
+            kind = DOUBLE_OPERANDS;
+            return l && r;
+        }
+        if (!l->getType()->isIntegerTy() || !r->getType()->isIntegerTy()) return false;
+
+        llvm::Type* i32 = ctx.builder.getInt32Ty();
+        if (l->getType()->isIntegerTy(1)) l = ctx.builder.CreateZExt(l, i32, "bool_to_int");
+        if (r->getType()->isIntegerTy(1)) r = ctx.builder.CreateZExt(r, i32, "bool_to_int");
+        kind = INT_OPERANDS;
+        return true;
+    }
+
+    // Calls into runtime/str.h. A string argument is passed as its two i64 halves,
+    // like the C ABI passes the 16 byte struct
+    llvm::Value* callStringRuntime(codegen_ctx& ctx, const char* name, llvm::Type* result, const std::vector<llvm::Value*>& args) {
+        std::vector<llvm::Value*> flat;
+        for (llvm::Value* arg : args) {
+            if (!ctx.isString(arg)) { flat.push_back(arg); continue; }
+            flat.push_back(ctx.builder.CreateExtractValue(arg, 0));
+            flat.push_back(ctx.builder.CreateExtractValue(arg, 1));
+        }
+
+        std::vector<llvm::Type*> params;
+        for (llvm::Value* arg : flat) params.push_back(arg->getType());
+        llvm::FunctionCallee callee = ctx.module->getOrInsertFunction(name, llvm::FunctionType::get(result, params, false));
+        if (auto fn = llvm::dyn_cast<llvm::Function>(callee.getCallee())) fn->setDoesNotThrow();
+        if (result == ctx.stringType()) ctx.stringCalls++;
+        return ctx.builder.CreateCall(callee, flat);
+    }
+
+    // crunch_str_collect with the string variables of every open scope as roots,
+    // at a loop's back edge no temporary string is alive
+    void collectStrings(codegen_ctx& ctx) {
+        llvm::IRBuilder<>& B = ctx.builder;
+        llvm::StructType* type = ctx.stringType();
+
+        std::vector<llvm::Value*> roots;
+        for (Symbol* sym : ctx.symTable->openSymbols()) {
+            if (!sym->isFunction() && sym->type == type) roots.push_back(ctx.readVariable(sym->variable));
+        }
+
+        llvm::Type* ptr = type->getPointerTo();
+        llvm::Value* array = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ptr));
+        if (!roots.empty()) {
+            llvm::Function* fn = B.GetInsertBlock()->getParent();
+            llvm::IRBuilder<> entry(&fn->getEntryBlock(), fn->getEntryBlock().begin());
+            array = entry.CreateAlloca(type, B.getInt64(roots.size()), "str.roots");
+            for (size_t k = 0; k < roots.size(); ++k) B.CreateStore(roots[k], B.CreateConstInBoundsGEP1_64(type, array, k));
+        }
+
+        llvm::FunctionCallee collect = ctx.module->getOrInsertFunction("crunch_str_collect", B.getVoidTy(), ptr, B.getInt64Ty());
+        if (auto fn = llvm::dyn_cast<llvm::Function>(collect.getCallee())) fn->setDoesNotThrow();
+        B.CreateCall(collect, {array, B.getInt64(roots.size())});
+    }
+
+    // The text print would produce for v, nullptr for values without one
+    llvm::Value* toStringValue(codegen_ctx& ctx, llvm::Value* v) {
+        llvm::IRBuilder<>& B = ctx.builder;
+        llvm::Type* t = v->getType();
+        if (ctx.isString(v)) return v;
+        if (t->isIntegerTy(1)) return callStringRuntime(ctx, "crunch_str_from_bool", ctx.stringType(), {B.CreateZExt(v, B.getInt32Ty())});
+        if (t->isIntegerTy()) return callStringRuntime(ctx, "crunch_str_from_int", ctx.stringType(), {B.CreateSExtOrTrunc(v, B.getInt32Ty())});
+        if (t->isDoubleTy()) return callStringRuntime(ctx, "crunch_str_from_double", ctx.stringType(), {v});
+        return nullptr;
+    }
+
+    // Variables assigned anywhere in a loop. Function literal bodies only assign their own copies
+    void collectAssigned(const ExprNode* e, std::set<std::string>& names) {
+        if (!e) return;
+
+        if (auto b = dynamic_cast<const BinaryExpr*>(e)) { collectAssigned(b->left, names); collectAssigned(b->right, names); return; }
+        if (auto u = dynamic_cast<const UnaryExpr*>(e)) { collectAssigned(u->operand, names); return; }
+        if (auto d = dynamic_cast<const DerivExpr*>(e)) { collectAssigned(d->expr, names); return; }
+
+        if (auto a = dynamic_cast<const AssignmentExpr*>(e)) {
+            names.insert(a->name);
+            collectAssigned(a->expr, names);
+            return;
+        }
+
+        if (auto c = dynamic_cast<const CallExpr*>(e)) {
+            for (auto arg : c->args) collectAssigned(arg, names);
+            return;
+        }
+
+        if (auto ie = dynamic_cast<const IntegralExpr*>(e)) {
+            collectAssigned(ie->lower, names);
+            collectAssigned(ie->upper, names);
+        }
+    }
+
+    void collectAssigned(const StmtNode* s, std::set<std::string>& names) {
+        if (!s) return;
+
+        if (auto es = dynamic_cast<const ExprStmt*>(s)) { collectAssigned(es->expr, names); return; }
+        if (auto vd = dynamic_cast<const VarDeclStmt*>(s)) { collectAssigned(vd->init, names); return; }
+        if (auto ps = dynamic_cast<const PrintStmt*>(s)) { collectAssigned(ps->value, names); return; }
+
+        if (auto bs = dynamic_cast<const BlockStmt*>(s)) {
+            for (auto stmt : bs->statements) collectAssigned(stmt, names);
+            return;
+        }
+
+        if (auto is = dynamic_cast<const IfStmt*>(s)) {
+            collectAssigned(is->condition, names);
+            collectAssigned(is->thenBranch, names);
+            collectAssigned(is->elseBranch, names);
+            return;
+        }
+
+        if (auto ws = dynamic_cast<const WhileStmt*>(s)) {
+            collectAssigned(ws->condition, names);
+            collectAssigned(ws->body, names);
+            return;
+        }
+
+        if (auto fs = dynamic_cast<const ForStmt*>(s)) {
+            collectAssigned(fs->init, names);
+            collectAssigned(fs->condition, names);
+            collectAssigned(fs->step, names);
+            collectAssigned(fs->body, names);
+        }
+    }
+
+    // Self referencing loop id with the hints from ctx.loopHints, attached to the latch branch
+    llvm::MDNode* loopMetadata(codegen_ctx& ctx) {
+        llvm::LLVMContext& C = ctx.context;
+        std::vector<llvm::Metadata*> ops = { nullptr };
+        auto hint = [&](const char* name, llvm::Metadata* value) {
+            std::vector<llvm::Metadata*> node = { llvm::MDString::get(C, name) };
+            if (value) node.push_back(value);
+            ops.push_back(llvm::MDNode::get(C, node));
+        };
+        auto constant = [&](llvm::Constant* c) { return llvm::ConstantAsMetadata::get(c); };
+
+        const LoopHints& hints = ctx.loopHints;
+        if (hints.vectorizeWidth == 1) {
+            hint("llvm.loop.vectorize.width", constant(ctx.builder.getInt32(1)));
+        } else if (hints.vectorizeWidth > 1) {
+            hint("llvm.loop.vectorize.enable", constant(ctx.builder.getTrue()));
+            hint("llvm.loop.vectorize.width", constant(ctx.builder.getInt32(hints.vectorizeWidth)));
+        }
+        if (hints.unrollCount == 1) hint("llvm.loop.unroll.disable", nullptr);
+        else if (hints.unrollCount > 1) hint("llvm.loop.unroll.count", constant(ctx.builder.getInt32(hints.unrollCount)));
+
+        llvm::MDNode* id = llvm::MDNode::getDistinct(C, ops);
+        id->replaceOperandWith(0, id);
+        return id;
+    }
+
+    // Loops in the canonical shape LoopSimplify, LoopRotate and the vectorizer expect:
+    // the current block is the preheader, the header tests the condition and is the
+    // only exit besides break, the body falls into a single latch (continue target)
+    // that runs the step and branches back. Variables assigned in the loop become
+    // header phis through the SSA builder.
+    llvm::Value* emitLoop(codegen_ctx& ctx, ExprNode* condition, ExprNode* step, StmtNode* body, const std::string& name) {
+        llvm::IRBuilder<>& B = ctx.builder;
+        SSABuilder& ssa = ctx.symTable->ssa();
+        int line = ctx.line;
+        size_t stringCalls = ctx.stringCalls;
+
+        // Ranges seen so far only hold for the first iteration
+        std::set<std::string> assigned;
+        collectAssigned(condition, assigned);
+        collectAssigned(step, assigned);
+        collectAssigned(body, assigned);
+        for (const std::string& var : assigned) {
+            Symbol* sym = ctx.symTable->lookup(var);
+            if (!sym || sym->isFunction()) continue;
+            if (sym->type->isIntegerTy(32)) sym->range = ValueRange::fullInt();
+            else if (sym->type->isDoubleTy()) sym->range = ValueRange::fullDouble();
+            else sym->range = ValueRange();
+        }
+
+        llvm::Function* fn = B.GetInsertBlock()->getParent();
+        llvm::BasicBlock* header = llvm::BasicBlock::Create(ctx.context, name + ".cond", fn);
+        llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(ctx.context, name + ".body", fn);
+        llvm::BasicBlock* latch = llvm::BasicBlock::Create(ctx.context, name + ".latch", fn);
+        llvm::BasicBlock* exit = llvm::BasicBlock::Create(ctx.context, name + ".end", fn);
+
+        // Predecessors still to come: the back edge, continues and breaks
+        ssa.markUnsealed(header);
+        ssa.markUnsealed(latch);
+        ssa.markUnsealed(exit);
+
+        B.CreateBr(header);
+        bool failed = false;
+        ctx.conditionalDepth++;
+
+        B.SetInsertPoint(header);
+        llvm::Value* cond = condition ? condition->codegen(ctx) : B.getTrue();
+        if (cond) cond = ctx.toBool(cond);
+        if (!cond) {
+            std::cerr << "Unsupported condition in " << name << " loop." << std::endl;
+            cond = B.getFalse();
+            failed = true;
+        }
+        B.CreateCondBr(cond, bodyBlock, exit);
+
+        B.SetInsertPoint(bodyBlock);
+        ctx.loops.push_back({exit, latch});
+        ctx.symTable->pushScope();
+        if (!body->codegen(ctx)) failed = true;
+        ctx.symTable->popScope();
+        ctx.loops.pop_back();
+        if (!B.GetInsertBlock()->getTerminator()) B.CreateBr(latch);
+        ssa.seal(latch);
+
+        // The step belongs to the loop statement, not to the body's last one
+        B.SetInsertPoint(latch);
+        ctx.line = line;
+        if (step && !step->codegen(ctx)) failed = true;
+        if (ctx.collectStrings && ctx.stringCalls != stringCalls) collectStrings(ctx);
+        B.CreateBr(header)->setMetadata(llvm::LLVMContext::MD_loop, loopMetadata(ctx));
+        ssa.seal(header);
+        ssa.seal(exit);
+
+        ctx.conditionalDepth--;
+
+        B.SetInsertPoint(exit);
+        return failed ? nullptr : exit;
+    }
+
+    // Code after break or continue can't run, it goes to a block without predecessors
+    llvm::Value* jumpTo(codegen_ctx& ctx, llvm::BasicBlock* target, const char* name) {
+        llvm::IRBuilder<>& B = ctx.builder;
+        B.CreateBr(target);
+        llvm::BasicBlock* unreachable = llvm::BasicBlock::Create(ctx.context, name, B.GetInsertBlock()->getParent());
+        B.SetInsertPoint(unreachable);
+        return unreachable;
+    }
+}
+
+llvm::Value* StringLiteral::codegen(codegen_ctx& ctx) {
+    llvm::Type* i64 = ctx.builder.getInt64Ty();
+    llvm::StructType* type = ctx.stringType();
+
+    // Inline: the chars in little endian byte order, the length in the last byte
+    if (value.size() <= 15) {
+        uint64_t halves[2] = {0, 0};
+        for (size_t i = 0; i < value.size(); ++i) halves[i / 8] |= uint64_t((unsigned char)value[i]) << (8 * (i % 8));
+        halves[1] |= uint64_t(value.size()) << 56;
+        return llvm::ConstantStruct::get(type, {llvm::ConstantInt::get(i64, halves[0]), llvm::ConstantInt::get(i64, halves[1])});
+    }
+
+    llvm::GlobalVariable*& chars = ctx.stringLiterals[value];
+    if (!chars) {
+        llvm::Constant* data = llvm::ConstantDataArray::getString(ctx.context, value, false);
+        chars = new llvm::GlobalVariable(*ctx.module, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data, "str");
+        chars->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+        chars->setAlignment(llvm::Align(1));
+    }
+
+    // Literal: pointer, then the length with the literal tag (0x80) in the last byte
+    return llvm::ConstantStruct::get(type, {
+        llvm::ConstantExpr::getPtrToInt(chars, i64),
+        llvm::ConstantInt::get(i64, uint64_t(value.size()) | (uint64_t(0x80) << 56))
+    });
+}
+
+llvm::Value* Program::codegen(codegen_ctx& ctx) {
+
+    // Variables differentiated with deriv(...) become forward-mode AD seeds
+    ctx.adSeeds = calculus::collectDerivVars(this);
+
+    // Last statement value, nullptr if any statement failed
+    llvm::Value* last = ctx.builder.GetInsertBlock();
+    bool failed = false;
+    for (auto stmt : statements) {
+        last = stmt->codegen(ctx);
+        if (!last) failed = true;
+    }
+    return failed ? nullptr : last;
+}
+
+llvm::Function* Program::codegenEntry(codegen_ctx& ctx) {
+    llvm::Function* entry = beginEntry(ctx);
+    return finishEntry(ctx, entry, !codegen(ctx));
+}
+
+llvm::Function* Program::beginEntry(codegen_ctx& ctx) {
+    llvm::FunctionType* type = llvm::FunctionType::get(ctx.builder.getInt32Ty(), false);
+    llvm::Function* entry = llvm::Function::Create(type, llvm::Function::ExternalLinkage, "crunch_main", ctx.module.get());
+    ctx.builder.SetInsertPoint(llvm::BasicBlock::Create(ctx.context, "entry", entry));
+    return entry;
+}
+
+llvm::Function* Program::finishEntry(codegen_ctx& ctx, llvm::Function* entry, bool failed) {
+    if (failed) {
+        std::cerr << "Failed to generate code for program." << std::endl;
+        return nullptr;
+    }
+    ctx.builder.CreateRet(ctx.builder.getInt32(0));
+
+    if (llvm::verifyFunction(*entry, &llvm::errs())) {
+        std::cerr << "Generated code for program is invalid." << std::endl;
+        return nullptr;
+    }
+    return entry;
+}
+
+llvm::Value* IfStmt::codegen(codegen_ctx& ctx) {
+    llvm::IRBuilder<>& B = ctx.builder;
+    markLine(ctx);
+
+    llvm::Value* cond = condition->codegen(ctx);
+    if (cond) cond = ctx.toBool(cond);
+    if (!cond) {
+        std::cerr << "Unsupported condition in if statement." << std::endl;
+        return nullptr;
+    }
+
+    llvm::Function* fn = B.GetInsertBlock()->getParent();
+    llvm::BasicBlock* thenBlock = llvm::BasicBlock::Create(ctx.context, "if.then", fn);
+    llvm::BasicBlock* elseBlock = elseBranch ? llvm::BasicBlock::Create(ctx.context, "if.else", fn) : nullptr;
+    llvm::BasicBlock* merge = llvm::BasicBlock::Create(ctx.context, "if.end", fn);
+
+    B.CreateCondBr(cond, thenBlock, elseBlock ? elseBlock : merge);
+
+    // Each branch gets its own scope, even without braces
+    bool failed = false;
+    ctx.conditionalDepth++;
+
+    B.SetInsertPoint(thenBlock);
+    ctx.symTable->pushScope();
+    if (!thenBranch->codegen(ctx)) failed = true;
+    ctx.symTable->popScope();
+    if (!B.GetInsertBlock()->getTerminator()) B.CreateBr(merge);
+
+    if (elseBranch) {
+        B.SetInsertPoint(elseBlock);
+        ctx.symTable->pushScope();
+        if (!elseBranch->codegen(ctx)) failed = true;
+        ctx.symTable->popScope();
+        if (!B.GetInsertBlock()->getTerminator()) B.CreateBr(merge);
+    }
+
+    ctx.conditionalDepth--;
+
+    B.SetInsertPoint(merge);
+    return failed ? nullptr : merge;
+}
+
+llvm::Value* WhileStmt::codegen(codegen_ctx& ctx) {
+    markLine(ctx);
+    return emitLoop(ctx, condition, nullptr, body, "while");
+}
+
+llvm::Value* ForStmt::codegen(codegen_ctx& ctx) {
+    markLine(ctx);
+    ctx.symTable->pushScope();
+    llvm::Value* result = nullptr;
+    if (!init || init->codegen(ctx)) result = codegenLoop(ctx);
+    ctx.symTable->popScope();
+    return result;
+}
+
+llvm::Value* ForStmt::codegenLoop(codegen_ctx& ctx) {
+    return emitLoop(ctx, condition, step, body, "for");
+}
+
+llvm::Value* BreakStmt::codegen(codegen_ctx& ctx) {
+    if (ctx.loops.empty()) {
+        std::cerr << "break outside of a loop." << std::endl;
+        return nullptr;
+    }
+    return jumpTo(ctx, ctx.loops.back().breakTarget, "break.after");
+}
+
+llvm::Value* ContinueStmt::codegen(codegen_ctx& ctx) {
+    if (ctx.loops.empty()) {
+        std::cerr << "continue outside of a loop." << std::endl;
+        return nullptr;
+    }
+    return jumpTo(ctx, ctx.loops.back().continueTarget, "continue.after");
+}
+
+// One crunch_print call per statement: string literals go into the format text,
+// every other value gets a directive and its 8 byte slots (see runtime/print.h)
+llvm::Value* PrintStmt::codegen(codegen_ctx& ctx) {
+    llvm::IRBuilder<>& B = ctx.builder;
+    markLine(ctx);
+    llvm::Type* i64 = B.getInt64Ty();
+
+    std::vector<ExprNode*> items;
+    flattenCommas(value, items);
+
+    std::string format;
+    std::vector<llvm::Value*> args;
+    for (ExprNode* item : items) {
+        if (auto str = dynamic_cast<StringLiteral*>(item)) {
+            for (char c : str->value) format += c == '%' ? "%%" : std::string(1, c);
+            continue;
+        }
+
+        llvm::Value* v = item->codegen(ctx);
+        if (!v) {
+            std::cerr << "Failed to generate code for print value." << std::endl;
+            return nullptr;
+        }
+
+        llvm::Type* t = v->getType();
+        if (t->isIntegerTy(1)) {
+            format += "%b";
+            args.push_back(B.CreateZExt(v, i64));
+        } else if (t->isIntegerTy()) {
+            format += "%i";
+            args.push_back(B.CreateSExt(v, i64));
+        } else if (t->isDoubleTy()) {
+            format += "%d";
+            args.push_back(B.CreateBitCast(v, i64));
+        } else if (ctx.isString(v)) {
+            format += "%s";
+            args.push_back(B.CreateExtractValue(v, 0));
+            args.push_back(B.CreateExtractValue(v, 1));
+        } else {
+            std::cerr << "Unsupported type in print statement." << std::endl;
+            return nullptr;
+        }
+    }
+
+    // print("x = ", x, "\n") already ends the line
+    auto last = dynamic_cast<StringLiteral*>(items.back());
+    if (!last || last->value.empty() || last->value.back() != '\n') format += '\n';
+
+    llvm::Value* slots = llvm::ConstantPointerNull::get(i64->getPointerTo());
+    if (!args.empty()) {
+        llvm::AllocaInst* array = ctx.createEntryAlloca(llvm::ArrayType::get(i64, args.size()), "print_args");
+        for (size_t i = 0; i < args.size(); ++i) {
+            B.CreateStore(args[i], B.CreateConstInBoundsGEP2_32(array->getAllocatedType(), array, 0, i));
+        }
+        slots = B.CreateConstInBoundsGEP2_32(array->getAllocatedType(), array, 0, 0);
+    }
+
+    auto callee = ctx.module->getOrInsertFunction("crunch_print", B.getVoidTy(), B.getInt8PtrTy(), i64->getPointerTo());
+    return B.CreateCall(callee, {B.CreateGlobalStringPtr(format, "fmt"), slots});
+}
+
+llvm::Value* BinaryExpr::codegenLogical(codegen_ctx& ctx) {
+    llvm::IRBuilder<>& B = ctx.builder;
+    bool isAnd = op == BinaryOp::And;
+    range = ValueRange();
+
+    llvm::Value* l = left->codegen(ctx);
+    if (l) l = ctx.toBool(l);
+    if (!l) {
+        std::cerr << "Unsupported operand for logical operator: " << opName(op) << std::endl;
+        return nullptr;
+    }
+
+    llvm::BasicBlock* lhsEnd = B.GetInsertBlock();
+    llvm::Function* fn = lhsEnd->getParent();
+    llvm::BasicBlock* rhs = llvm::BasicBlock::Create(ctx.context, isAnd ? "and.rhs" : "or.rhs", fn);
+    llvm::BasicBlock* merge = llvm::BasicBlock::Create(ctx.context, isAnd ? "and.end" : "or.end", fn);
+
+    // false && ... and true || ... skip the right side
+    if (isAnd) B.CreateCondBr(l, rhs, merge);
+    else B.CreateCondBr(l, merge, rhs);
+
+    B.SetInsertPoint(rhs);
+    ctx.conditionalDepth++;
+    llvm::Value* r = right->codegen(ctx);
+    ctx.conditionalDepth--;
+    if (r) r = ctx.toBool(r);
+    if (!r) {
+        std::cerr << "Unsupported operand for logical operator: " << opName(op) << std::endl;
+        return nullptr;
+    }
+    llvm::BasicBlock* rhsEnd = B.GetInsertBlock();
+    B.CreateBr(merge);
+
+    B.SetInsertPoint(merge);
+    llvm::PHINode* phi = B.CreatePHI(B.getInt1Ty(), 2, isAnd ? "andtmp" : "ortmp");
+    phi->addIncoming(B.getInt1(!isAnd), lhsEnd);
+    phi->addIncoming(r, rhsEnd);
+    return phi;
+}
+
+DualValue ExprNode::codegenDual(codegen_ctx& ctx) {
+    return calculus::dualOpaque(ctx, this);
+}
+
+DualValue IdentifierExpr::codegenDual(codegen_ctx& ctx) {
+    DualValue result;
+    result.primal = codegen(ctx);
+    if (!result.primal) return result;
+
+    Symbol* sym = ctx.symTable->lookup(name);
+    for (size_t j = 0; j < sym->tangents.size(); ++j) {
+        result.tangents.push_back(ctx.readVariable(sym->tangents[j]));
+    }
+    return result;
+}
+
+DualValue BinaryExpr::codegenDual(codegen_ctx& ctx) {
+    if (op != BinaryOp::Add && op != BinaryOp::Sub && op != BinaryOp::Mul && op != BinaryOp::Div) return ExprNode::codegenDual(ctx);
+
+    DualValue l = left->codegenDual(ctx);
+    DualValue r = right->codegenDual(ctx);
+    if (!l.primal || !r.primal) {
+        std::cerr << "Failed to generate code for binary expression operands." << std::endl;
+        return {};
+    }
+
+    DualValue result;
+    result.primal = emitOp(ctx, l.primal, r.primal);
+    if (!result.primal || !result.primal->getType()->isDoubleTy()) return result;
+    if (l.tangents.empty() && r.tangents.empty()) return result;
+
+    llvm::IRBuilder<>& B = ctx.builder;
+    llvm::Value* lv = ctx.toDouble(l.primal);
+    llvm::Value* rv = ctx.toDouble(r.primal);
+
+    for (size_t j = 0; j < ctx.adSeeds.size(); ++j) {
+        llvm::Value* tl = l.tangents.empty() ? nullptr : l.tangents[j];
+        llvm::Value* tr = r.tangents.empty() ? nullptr : r.tangents[j];
+        llvm::Value* t = nullptr;
+
+        if (op == BinaryOp::Add) {
+            t = !tl ? tr : !tr ? tl : B.CreateFAdd(tl, tr, "d.addtmp");
+        } else if (op == BinaryOp::Sub) {
+            t = !tr ? tl : !tl ? B.CreateFNeg(tr, "d.negtmp") : B.CreateFSub(tl, tr, "d.subtmp");
+        } else if (op == BinaryOp::Mul) {
+            // l' * r + l * r'
+            llvm::Value* a = tl ? B.CreateFMul(tl, rv, "d.multmp") : nullptr;
+            llvm::Value* b = tr ? B.CreateFMul(lv, tr, "d.multmp") : nullptr;
+            t = !a ? b : !b ? a : B.CreateFAdd(a, b, "d.addtmp");
+        } else {
+            // (l' - q * r') / r with q = l / r
+            llvm::Value* num = tl;
+            if (tr) {
+                llvm::Value* qt = B.CreateFMul(result.primal, tr, "d.multmp");
+                num = num ? B.CreateFSub(num, qt, "d.subtmp") : B.CreateFNeg(qt, "d.negtmp");
+            }
+            t = B.CreateFDiv(num, rv, "d.divtmp");
+        }
+
+        result.tangents.push_back(t);
+    }
+    return result;
+}
+
+llvm::Value* BinaryExpr::emitArithmetic(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r) {
+    OperandKind kind;
+    if (!promote(ctx, l, r, kind)) {
+        std::cerr << "Unsupported operand types for " << opName(op) << "." << std::endl;
+        return nullptr;
+    }
+
+    int column = static_cast<int>(op);
+    bool isInt = kind == INT_OPERANDS;
+    ValueRange lr = isInt ? ranges::toInt32(left->range) : ranges::toDouble(left->range);
+    ValueRange rr = isInt ? ranges::toInt32(right->range) : ranges::toDouble(right->range);
+    ValueRange exact = arithmeticRanges[column](lr, rr);
+
+    if (isInt && (op == BinaryOp::Div || op == BinaryOp::Mod)) checkDivisor(ctx, l, r, lr, rr);
+
+    llvm::Value* result = ctx.builder.CreateBinOp(arithmeticOps[kind][column], l, r, arithmeticNames[column]);
+    if (!isInt) {
+        range = exact;
+        return result;
+    }
+
+    range = ranges::toInt32(exact);
+
+    // + - * cannot wrap when the exact result fits, nor unsigned wrap when everything stays non negative
+    auto inst = llvm::dyn_cast<llvm::BinaryOperator>(result);
+    if (inst && op <= BinaryOp::Mul && exact.fitsInt32()) {
+        inst->setHasNoSignedWrap();
+        if (lr.lo >= 0 && rr.lo >= 0 && exact.lo >= 0) inst->setHasNoUnsignedWrap();
+    }
+    return result;
+}
+
+llvm::Value* BinaryExpr::emitString(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r) {
+    if (op == BinaryOp::Add) {
+        l = toStringValue(ctx, l);
+        r = toStringValue(ctx, r);
+        if (!l || !r) {
+            std::cerr << "Unsupported operand types for string concatenation." << std::endl;
+            return nullptr;
+        }
+        return callStringRuntime(ctx, "crunch_str_concat", ctx.stringType(), {l, r});
+    }
+
+    if ((op == BinaryOp::Eq || op == BinaryOp::Ne) && ctx.isString(l) && ctx.isString(r)) {
+        llvm::Value* equal = callStringRuntime(ctx, "crunch_str_equal", ctx.builder.getInt32Ty(), {l, r});
+        if (auto fn = ctx.module->getFunction("crunch_str_equal")) fn->setOnlyReadsMemory();
+        return op == BinaryOp::Eq ? ctx.builder.CreateIsNotNull(equal, "cmptmp") : ctx.builder.CreateIsNull(equal, "cmptmp");
+    }
+
+    std::cerr << "Unsupported operand types for " << opName(op) << " on strings." << std::endl;
+    return nullptr;
+}
+
+llvm::Value* BinaryExpr::emitComparison(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r) {
+    OperandKind kind;
+    if (!promote(ctx, l, r, kind)) {
+        std::cerr << "Unsupported operand types for comparison: " << opName(op) << std::endl;
+        return nullptr;
+    }
+
+    int column = static_cast<int>(op) - static_cast<int>(BinaryOp::Eq);
+    return ctx.builder.CreateCmp(comparisonOps[kind][column], l, r, "cmptmp");
+}
+
+void BinaryExpr::checkDivisor(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r, const ValueRange& lr, const ValueRange& rr) {
+    if (!l->getType()->isIntegerTy(32) || !r->getType()->isIntegerTy(32)) return;
+
+    bool mayBeZero = rr.contains(0);
+    bool mayOverflow = lr.contains(INT32_MIN) && rr.contains(-1);
+    if (!mayBeZero && !mayOverflow) return; // proven safe, no check
+
+    llvm::IRBuilder<>& B = ctx.builder;
+    llvm::BasicBlock* current = B.GetInsertBlock();
+    if (!current || !current->getParent()) return;
+
+    llvm::Type* i32 = B.getInt32Ty();
+    llvm::Value* bad = nullptr;
+    if (mayBeZero) bad = B.CreateICmpEQ(r, llvm::ConstantInt::get(i32, 0), "div.zero");
+    if (mayOverflow) {
+        llvm::Value* overflow = B.CreateAnd(
+            B.CreateICmpEQ(l, llvm::ConstantInt::get(i32, INT32_MIN)),
+            B.CreateICmpEQ(r, llvm::ConstantInt::get(i32, -1)),
+            "div.overflow"
+        );
+        bad = bad ? B.CreateOr(bad, overflow, "div.bad") : overflow;
+    }
+
+    llvm::Function* fn = current->getParent();
+    llvm::BasicBlock* error = llvm::BasicBlock::Create(ctx.context, "div.error", fn);
+    llvm::BasicBlock* ok = llvm::BasicBlock::Create(ctx.context, "div.ok", fn);
+
+    llvm::MDBuilder md(ctx.context);
+    B.CreateCondBr(bad, error, ok, md.createBranchWeights(1, 1 << 20));
+
+    // Reported like the VM does, the runtime flushes the output and exits
+    B.SetInsertPoint(error);
+    llvm::Value* kind = llvm::ConstantInt::get(i32, mayBeZero ? CRUNCH_DIVISION_BY_ZERO : CRUNCH_DIVISION_OVERFLOW);
+    if (mayBeZero && mayOverflow) {
+        kind = B.CreateSelect(B.CreateICmpEQ(r, llvm::ConstantInt::get(i32, 0)),
+                              llvm::ConstantInt::get(i32, CRUNCH_DIVISION_BY_ZERO),
+                              llvm::ConstantInt::get(i32, CRUNCH_DIVISION_OVERFLOW), "div.fault");
+    }
+    llvm::FunctionCallee report = ctx.module->getOrInsertFunction("crunch_runtime_error", B.getVoidTy(), i32, i32);
+    if (auto f = llvm::dyn_cast<llvm::Function>(report.getCallee())) {
+        f->setDoesNotReturn();
+        f->addFnAttr(llvm::Attribute::Cold);
+    }
+    B.CreateCall(report, {llvm::ConstantInt::get(i32, ctx.line), kind});
+    B.CreateUnreachable();
+
+    B.SetInsertPoint(ok);
+}
+
+llvm::Value* UnaryExpr::emitMath(codegen_ctx& ctx, llvm::Value* val) {
+    llvm::IRBuilder<>& B = ctx.builder;
+
+    llvm::Value* x = ctx.toDouble(val);
+    if (!x) {
+        std::cerr << "Unsupported type for " << opName(op) << "." << std::endl;
+        return nullptr;
+    }
+
+    if (op == UnaryOp::Tan) {
+        // No intrinsic for tan. errno is never read, so the call can be treated as pure
+        llvm::Type* dbl = B.getDoubleTy();
+        llvm::FunctionCallee tanFn = ctx.module->getOrInsertFunction("tan", dbl, dbl);
+        if (auto fn = llvm::dyn_cast<llvm::Function>(tanFn.getCallee())) {
+            fn->setDoesNotAccessMemory();
+            fn->setDoesNotThrow();
+            fn->setWillReturn();
+        }
+        range = ValueRange();
+        return B.CreateCall(tanFn, {x}, "tantmp");
+    }
+
+    ValueRange xr = ranges::toDouble(operand->range);
+    llvm::Intrinsic::ID id;
+    switch (op) {
+        case UnaryOp::Sin: id = llvm::Intrinsic::sin; range = ranges::sinCos(xr); break;
+        case UnaryOp::Cos: id = llvm::Intrinsic::cos; range = ranges::sinCos(xr); break;
+        case UnaryOp::Exp: id = llvm::Intrinsic::exp; range = ranges::exp(xr); break;
+        case UnaryOp::Log: id = llvm::Intrinsic::log; range = ranges::log(xr); break;
+        default: id = llvm::Intrinsic::sqrt; range = ranges::sqrt(xr); break;
+    }
+
+    llvm::CallInst* call = B.CreateUnaryIntrinsic(id, x, nullptr, std::string(opName(op)) + "tmp");
+
+    // Domain facts: the argument is known to be in range (and not NaN), so is the result
+    if (!range.maybeNaN) {
+        llvm::FastMathFlags flags;
+        flags.setNoNaNs();
+        call->setFastMathFlags(flags);
+    }
+    return call;
+}
+
+DualValue UnaryExpr::codegenDual(codegen_ctx& ctx) {
+    if ((op != UnaryOp::Neg && !isMathFunction(op)) || powerArgs()) return ExprNode::codegenDual(ctx);
+
+    DualValue val = operand->codegenDual(ctx);
+    if (!val.primal) {
+        std::cerr << "Failed to generate code for unary expression operand." << std::endl;
+        return {};
+    }
+
+    DualValue result;
+    result.primal = emitOp(ctx, val.primal);
+    if (!result.primal || val.tangents.empty()) return result;
+
+    llvm::IRBuilder<>& B = ctx.builder;
+    if (op == UnaryOp::Neg) {
+        for (llvm::Value* t : val.tangents) result.tangents.push_back(B.CreateFNeg(t, "d.negtmp"));
+        return result;
+    }
+
+    // Chain rule: f(u)' = f'(u) * u'
+    llvm::Value* u = ctx.toDouble(val.primal);
+    llvm::Value* y = result.primal;
+    llvm::Value* one = llvm::ConstantFP::get(B.getDoubleTy(), 1.0);
+    llvm::Value* outer;
+    switch (op) {
+        case UnaryOp::Sin: outer = B.CreateUnaryIntrinsic(llvm::Intrinsic::cos, u, nullptr, "d.cos"); break;
+        case UnaryOp::Cos: outer = B.CreateFNeg(B.CreateUnaryIntrinsic(llvm::Intrinsic::sin, u, nullptr, "d.sin"), "d.negtmp"); break;
+        case UnaryOp::Tan: outer = B.CreateFAdd(one, B.CreateFMul(y, y, "d.multmp"), "d.addtmp"); break; // 1 + tan^2
+        case UnaryOp::Exp: outer = y; break;
+        case UnaryOp::Log: outer = B.CreateFDiv(one, u, "d.divtmp"); break;
+        default: outer = B.CreateFDiv(llvm::ConstantFP::get(B.getDoubleTy(), 0.5), y, "d.divtmp"); break; // sqrt
+    }
+
+    for (llvm::Value* t : val.tangents) result.tangents.push_back(B.CreateFMul(outer, t, "d.multmp"));
+    return result;
+}
+
+llvm::Value* AssignmentExpr::codegen(codegen_ctx& ctx) {
+    return codegenDual(ctx).primal;
+}
+
+DualValue AssignmentExpr::codegenDual(codegen_ctx& ctx) {
+
+    Symbol* sym = ctx.symTable->lookup(name);
+    if (!sym) {
+        std::cerr << "Undefined variable: " << name << std::endl;
+        return {};
+    }
+    if (sym->isFunction()) {
+        std::cerr << "Cannot assign to function: " << name << std::endl;
+        return {};
+    }
+
+    // Only targets with tangent slots need the dual form of the value
+    DualValue val;
+    if (sym->tangents.empty()) val.primal = expr->codegen(ctx);
+    else val = expr->codegenDual(ctx);
+
+    if (!val.primal) {
+        std::cerr << "Failed to generate code for assignment to: " << name << std::endl;
+        return {};
+    }
+
+    ValueRange valRange = expr->range;
+
+    // Type Checking and Promotion
+    if (val.primal->getType() != sym->type) {
+        if (sym->type->isDoubleTy() && val.primal->getType()->isIntegerTy()) {
+            val.primal = ctx.builder.CreateSIToFP(val.primal, sym->type, "int_to_double");
+        } else if (sym->type->isIntegerTy() && val.primal->getType()->isDoubleTy()) {
+            val.primal = ctx.builder.CreateFPToSI(val.primal, sym->type, "double_to_int");
+        } else {
+            std::cerr << "Type mismatch in assignment to variable: " << name << std::endl;
+            return {};
+        }
+    }
+
+    ctx.writeVariable(sym->variable, val.primal);
+
+    if (sym->type->isIntegerTy(32)) valRange = ranges::toInt32(valRange);
+    else if (sym->type->isDoubleTy()) valRange = ranges::toDouble(valRange);
+    else valRange = ValueRange();
+
+    // Code that may not run can only widen what is known about the variable
+    sym->range = ctx.conditionalDepth > 0 ? ranges::hull(sym->range, valRange) : valRange;
+    range = valRange;
+
+    for (size_t j = 0; j < sym->tangents.size(); ++j) {
+        ctx.writeVariable(sym->tangents[j], calculus::tangentAt(ctx, val, j));
+    }
+    return val;
+}
+
+void VarDeclStmt::declareTangents(codegen_ctx& ctx, const DualValue& dual) {
+    Symbol* sym = ctx.symTable->lookup(name);
+    int seed = calculus::seedIndex(ctx, name);
+    llvm::Type* dbl = ctx.builder.getDoubleTy();
+
+    for (size_t j = 0; j < ctx.adSeeds.size(); ++j) {
+        SSAVariable* tangent = ctx.symTable->ssa().declare(dbl, name + ".d." + ctx.adSeeds[j]);
+
+        // A seed is an independent input: d(seed)/d(seed) = 1, whatever its initializer
+        llvm::Value* t = seed >= 0 ? llvm::ConstantFP::get(dbl, (int)j == seed ? 1.0 : 0.0) : calculus::tangentAt(ctx, dual, j);
+        ctx.writeVariable(tangent, t);
+        sym->tangents.push_back(tangent);
+    }
+}
+
+ExprNode* DerivExpr::getDerivative() {
+    if (!derivative) derivative = calculus::differentiate(expr, var);
+    return derivative;
+}
+
+llvm::Value* DerivExpr::codegen(codegen_ctx& ctx) {
+
+    // Forward mode when expr reads variables that carry tangents for var
+    int seed = calculus::seedIndex(ctx, var);
+    if (seed >= 0 && calculus::hasTangents(ctx, expr, var)) {
+        DualValue dual = expr->codegenDual(ctx);
+        if (!dual.primal) return nullptr;
+        return calculus::tangentAt(ctx, dual, seed);
+    }
+
+    // Calls to function values are inlined first so the engine sees their bodies
+    if (!derivative) {
+        ExprNode* inlined = nullptr;
+        try {
+            inlined = calculus::inlineCalls(expr, *ctx.symTable);
+            derivative = calculus::differentiate(inlined, var);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << "Failed to differentiate with respect to " << var << ": " << e.what() << std::endl;
+        }
+        delete inlined;
+        if (!derivative) return nullptr;
+    }
+
+    return derivative->codegen(ctx);
+}
+
+llvm::Value* IntegralExpr::codegen(codegen_ctx& ctx) {
+
+    // Every variable of the integrand besides var is captured by value
+    std::vector<Symbol> captures;
+    for (const std::string& name : calculus::freeVariables(expr)) {
+        if (name == var) continue;
+
+        Symbol* sym = ctx.symTable->lookup(name);
+        if (!sym) {
+            std::cerr << "Undefined variable: " << name << std::endl;
+            return nullptr;
+        }
+        if (sym->isFunction() || (!sym->type->isIntegerTy() && !sym->type->isDoubleTy())) {
+            std::cerr << "Unsupported type for variable used in integral: " << name << std::endl;
+            return nullptr;
+        }
+        captures.push_back(*sym);
+    }
+
+    llvm::Value* a = lower->codegen(ctx);
+    llvm::Value* b = upper->codegen(ctx);
+    if (!a || !b) {
+        std::cerr << "Failed to generate code for integral bounds." << std::endl;
+        return nullptr;
+    }
+
+    a = ctx.toDouble(a);
+    b = ctx.toDouble(b);
+    if (!a || !b) {
+        std::cerr << "Integral bounds must be numeric." << std::endl;
+        return nullptr;
+    }
+
+    llvm::Function* integrand = calculus::emitIntegrand(ctx, expr, var, captures);
+    if (!integrand) {
+        std::cerr << "Failed to generate code for integrand." << std::endl;
+        return nullptr;
+    }
+
+    // Pack the captured values
+    llvm::Type* dbl = llvm::Type::getDoubleTy(ctx.context);
+    llvm::Value* env = llvm::ConstantPointerNull::get(dbl->getPointerTo());
+
+    if (!captures.empty()) {
+        llvm::ArrayType* envType = llvm::ArrayType::get(dbl, captures.size());
+        llvm::AllocaInst* envAlloca = ctx.createEntryAlloca(envType, "integral.env");
+        env = ctx.builder.CreateConstInBoundsGEP2_64(envType, envAlloca, 0, 0, "env");
+
+        for (size_t k = 0; k < captures.size(); ++k) {
+            llvm::Value* val = ctx.readVariable(captures[k].variable);
+            ctx.builder.CreateStore(ctx.toDouble(val), ctx.builder.CreateConstInBoundsGEP1_64(dbl, env, k));
+        }
+    }
+
+    // double crunch_integrate(integrand, env, a, b)
+    llvm::FunctionType* calleeType = llvm::FunctionType::get(
+        dbl,
+        {integrand->getType(), dbl->getPointerTo(), dbl, dbl},
+        false
+    );
+    llvm::FunctionCallee callee = ctx.module->getOrInsertFunction("crunch_integrate", calleeType);
+
+    return ctx.builder.CreateCall(callee, {integrand, env, a, b}, "integral");
+}
+
+bool FunctionLiteral::emit(codegen_ctx& ctx, const std::string& name, llvm::Function*& scalar, llvm::Function*& batch) {
+    llvm::LLVMContext& C = ctx.context;
+    llvm::IRBuilder<>& B = ctx.builder;
+    llvm::Type* dbl = llvm::Type::getDoubleTy(C);
+    llvm::Type* i64 = llvm::Type::getInt64Ty(C);
+
+    std::string base = "crunch.fn." + name;
+
+    // Captures: snapshot every outside variable into a private global at declaration time
+    std::vector<std::pair<Symbol, llvm::GlobalVariable*>> captures;
+    for (const std::string& var : calculus::freeVariables(this)) {
+        Symbol* sym = ctx.symTable->lookup(var);
+        if (!sym) {
+            std::cerr << "Undefined variable: " << var << std::endl;
+            return false;
+        }
+        if (sym->isFunction() || (!sym->type->isIntegerTy() && !sym->type->isDoubleTy())) {
+            std::cerr << "Unsupported type for variable used in function " << name << ": " << var << std::endl;
+            return false;
+        }
+
+        llvm::GlobalVariable* global = new llvm::GlobalVariable(
+            *ctx.module, sym->type, false, llvm::GlobalValue::InternalLinkage,
+            llvm::Constant::getNullValue(sym->type), base + "." + var
+        );
+        B.CreateStore(ctx.readVariable(sym->variable), global);
+        captures.push_back({*sym, global});
+    }
+
+    llvm::IRBuilderBase::InsertPoint savedIP = B.saveIP();
+
+    // double f(double p0, ..., double pk)
+    std::vector<llvm::Type*> paramTypes(params.size(), dbl);
+    llvm::FunctionType* scalarType = llvm::FunctionType::get(dbl, paramTypes, false);
+    scalar = llvm::Function::Create(scalarType, llvm::Function::ExternalLinkage, base, ctx.module.get());
+    scalar->addFnAttr(llvm::Attribute::AlwaysInline);
+
+    ctx.symTable->pushScope();
+    B.SetInsertPoint(llvm::BasicBlock::Create(C, "entry", scalar));
+
+    for (auto& cap : captures) {
+        Symbol* local = ctx.symTable->declare(cap.first.name, cap.first.type);
+        ctx.writeVariable(local->variable, B.CreateLoad(cap.first.type, cap.second, cap.first.name));
+    }
+
+    auto arg = scalar->arg_begin();
+    for (const std::string& param : params) {
+        arg->setName(param);
+        Symbol* local = ctx.symTable->declare(param, dbl);
+        if (!local) {
+            std::cerr << "Duplicate parameter in function " << name << ": " << param << std::endl;
+            ctx.symTable->popScope();
+            scalar->eraseFromParent();
+            B.restoreIP(savedIP);
+            return false;
+        }
+        ctx.writeVariable(local->variable, &*arg);
+        ++arg;
+    }
+
+    llvm::Value* result = body->codegen(ctx);
+    if (result) result = ctx.toDouble(result);
+    ctx.symTable->popScope();
+
+    if (!result) {
+        std::cerr << "Failed to generate code for function " << name << "." << std::endl;
+        scalar->eraseFromParent();
+        B.restoreIP(savedIP);
+        return false;
+    }
+    B.CreateRet(result);
+
+    // void f.batch(const double** cols, double* out, i64 n)
+    llvm::Type* dblPtr = dbl->getPointerTo();
+    llvm::FunctionType* batchType = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(C), {dblPtr->getPointerTo(), dblPtr, i64}, false
+    );
+    batch = llvm::Function::Create(batchType, llvm::Function::ExternalLinkage, scalar->getName() + ".batch", ctx.module.get());
+
+    auto bargs = batch->arg_begin();
+    llvm::Argument* cols = &*bargs++;
+    llvm::Argument* out = &*bargs++;
+    llvm::Argument* n = &*bargs++;
+    cols->setName("cols");
+    out->setName("out");
+    n->setName("n");
+    cols->addAttr(llvm::Attribute::ReadOnly);
+    out->addAttr(llvm::Attribute::NoAlias);
+
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(C, "entry", batch);
+    llvm::BasicBlock* header = llvm::BasicBlock::Create(C, "loop", batch);
+    llvm::BasicBlock* loopBody = llvm::BasicBlock::Create(C, "body", batch);
+    llvm::BasicBlock* exit = llvm::BasicBlock::Create(C, "exit", batch);
+
+    // Column pointers are loop invariant, load them once
+    B.SetInsertPoint(entry);
+    std::vector<llvm::Value*> columns;
+    for (size_t k = 0; k < params.size(); ++k) {
+        llvm::Value* slot = B.CreateConstInBoundsGEP1_64(dblPtr, cols, k);
+        columns.push_back(B.CreateLoad(dblPtr, slot, params[k] + ".col"));
+    }
+    B.CreateBr(header);
+
+    B.SetInsertPoint(header);
+    llvm::PHINode* i = B.CreatePHI(i64, 2, "i");
+    i->addIncoming(llvm::ConstantInt::get(i64, 0), entry);
+    B.CreateCondBr(B.CreateICmpSLT(i, n, "cond"), loopBody, exit);
+
+    B.SetInsertPoint(loopBody);
+    std::vector<llvm::Value*> callArgs;
+    for (size_t k = 0; k < params.size(); ++k) {
+        callArgs.push_back(B.CreateLoad(dbl, B.CreateInBoundsGEP(dbl, columns[k], i), params[k]));
+    }
+    llvm::Value* y = B.CreateCall(scalar, callArgs, "y");
+    B.CreateStore(y, B.CreateInBoundsGEP(dbl, out, i));
+    llvm::Value* next = B.CreateAdd(i, llvm::ConstantInt::get(i64, 1), "i.next", true, true);
+    i->addIncoming(next, loopBody);
+    B.CreateBr(header);
+
+    B.SetInsertPoint(exit);
+    B.CreateRetVoid();
+
+    B.restoreIP(savedIP);
+    return true;
+}
+
+llvm::Value* VarDeclStmt::codegenFunction(codegen_ctx& ctx) {
+
+    llvm::Function* scalar = nullptr;
+    llvm::Function* batch = nullptr;
+    FunctionLiteral* literal = nullptr;
+
+    // function g = f; names an existing function value
+    if (auto id = dynamic_cast<IdentifierExpr*>(init)) {
+        Symbol* sym = ctx.symTable->lookup(id->name);
+        if (!sym || !sym->isFunction()) {
+            std::cerr << "Undefined function: " << id->name << std::endl;
+            return nullptr;
+        }
+        scalar = sym->function;
+        batch = sym->batch;
+        literal = sym->literal;
+    }
+    else if ((literal = dynamic_cast<FunctionLiteral*>(init))) {
+        if (!literal->emit(ctx, name, scalar, batch)) return nullptr;
+    }
+    else {
+        std::cerr << "Function declaration needs a function literal (x -> expr): " << name << std::endl;
+        return nullptr;
+    }
+
+    if (!ctx.symTable->declareFunction(name, scalar, batch, literal)) {
+        std::cerr << "Variable already declared in scope: " << name << std::endl;
+        if (literal == init) {
+            batch->eraseFromParent();
+            scalar->eraseFromParent();
+        }
+        return nullptr;
+    }
+    return scalar;
+}
+
+llvm::Value* CallExpr::codegen(codegen_ctx& ctx) {
+
+    auto id = dynamic_cast<IdentifierExpr*>(callee);
+    if (!id) {
+        std::cerr << "Only named functions can be called." << std::endl;
+        return nullptr;
+    }
+
+    Symbol* sym = ctx.symTable->lookup(id->name);
+    if (!sym) {
+        std::cerr << "Undefined function: " << id->name << std::endl;
+        return nullptr;
+    }
+    if (!sym->isFunction()) {
+        std::cerr << id->name << " is not a function." << std::endl;
+        return nullptr;
+    }
+    if (sym->function->arg_size() != args.size()) {
+        std::cerr << "Function " << id->name << " expects " << sym->function->arg_size()
+                  << " arguments, got " << args.size() << "." << std::endl;
+        return nullptr;
+    }
+
+    std::vector<llvm::Value*> argv;
+    for (auto arg : args) {
+        llvm::Value* v = arg->codegen(ctx);
+        if (v) v = ctx.toDouble(v);
+        if (!v) {
+            std::cerr << "Failed to generate code for argument of " << id->name << "." << std::endl;
+            return nullptr;
+        }
+        argv.push_back(v);
+    }
+
+    return ctx.builder.CreateCall(sym->function, argv, "calltmp");
+}
@@ -6,27 +6,103 @@
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Intrinsics.h>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 #include "../lexer/lexer.h"
 #include "../semantics/symbol_table.h"
+#include "../opt/optimizer.h"
+#include "opcode.h"
 
 // Context Structure
 struct codegen_ctx {
-    llvm::LLVMContext context;
+    std::unique_ptr<llvm::LLVMContext> ownedContext = std::make_unique<llvm::LLVMContext>(); // handed to the JIT with the module
+    llvm::LLVMContext& context = *ownedContext;
     llvm::IRBuilder<> builder;
     std::unique_ptr<llvm::Module> module;
 
     // Symbol Table
     SymbolTable* symTable = new SymbolTable();
+
+    // Forward-mode AD: double variables carry one tangent per seed variable
+    std::vector<std::string> adSeeds;
+
+    // > 0 while emitting code that may not run (if branches), assignments
+    // there widen the variable's range instead of replacing it
+    int conditionalDepth = 0;
+
+    // Enclosing loops, innermost last
+    struct LoopTargets {
+        llvm::BasicBlock* breakTarget;
+        llvm::BasicBlock* continueTarget;
+    };
+    std::vector<LoopTargets> loops;
+
+    // llvm.loop hints attached to every loop
+    LoopHints loopHints;
+
+    // Source line of the statement being generated, reported by runtime errors
+    int line = 0;
+
+    // Runtime calls emitted so far that make a string buffer. Loops with any
+    // collect the buffers at their back edge (runtime/str.h), unless
+    // collectStrings is off: the tiered VM holds strings the loop can't see
+    size_t stringCalls = 0;
+    bool collectStrings = true;
+
+    // Chars of long string literals, one constant per distinct literal
+    std::unordered_map<std::string, llvm::GlobalVariable*> stringLiterals;
     
     codegen_ctx(const std::string &moduleName) : builder(context) {
         module = std::make_unique<llvm::Module>(moduleName, context);
     }
 
     ~codegen_ctx() { delete symTable; }
+
+    // Numeric promotion to double, nullptr for non numeric values
+    llvm::Value* toDouble(llvm::Value* v) {
+        llvm::Type* dbl = llvm::Type::getDoubleTy(context);
+        if (v->getType()->isDoubleTy()) return v;
+        if (v->getType()->isIntegerTy(1)) return builder.CreateUIToFP(v, dbl, "bool_to_double");
+        if (v->getType()->isIntegerTy()) return builder.CreateSIToFP(v, dbl, "int_to_double");
+        return nullptr;
+    }
+
+    // Strings are 16 byte values only the runtime looks into (see runtime/str.h)
+    llvm::StructType* stringType() {
+        if (llvm::StructType* t = llvm::StructType::getTypeByName(context, "crunch.string")) return t;
+        return llvm::StructType::create(context, {builder.getInt64Ty(), builder.getInt64Ty()}, "crunch.string");
+    }
+    bool isString(llvm::Value* v) { return v->getType() == stringType(); }
+
+    // Variables are SSA values (see SSABuilder), read and written at the insertion point
+    llvm::Value* readVariable(SSAVariable* var) { return symTable->ssa().read(var, builder.GetInsertBlock()); }
+    void writeVariable(SSAVariable* var, llvm::Value* value) { symTable->ssa().write(var, builder.GetInsertBlock(), value); }
+
+    // Stack memory goes in the entry block, allocated once per call however often the code runs
+    llvm::AllocaInst* createEntryAlloca(llvm::Type* type, const std::string& name) {
+        llvm::BasicBlock& entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+        llvm::IRBuilder<> entryBuilder(&entry, entry.getFirstInsertionPt());
+        return entryBuilder.CreateAlloca(type, nullptr, name);
+    }
+
+    // Truth value of a condition (non zero is true), nullptr for non numeric values
+    llvm::Value* toBool(llvm::Value* v) {
+        if (v->getType()->isIntegerTy(1)) return v;
+        if (v->getType()->isIntegerTy()) return builder.CreateICmpNE(v, llvm::ConstantInt::get(v->getType(), 0), "tobool");
+        if (v->getType()->isDoubleTy()) return builder.CreateFCmpUNE(v, llvm::ConstantFP::get(v->getType(), 0.0), "tobool");
+        return nullptr;
+    }
+};
+
+// Dual number: primal value plus d(value)/d(seed) for every AD seed
+struct DualValue {
+    llvm::Value* primal = nullptr;
+    std::vector<llvm::Value*> tangents; // empty when every tangent is zero
 };
 
 // Base Classes
@@ -46,13 +122,27 @@ class ExprNode : public ASTNode {
         virtual ~ExprNode() = default; 
 
         virtual llvm::Value* codegen(codegen_ctx& ctx) override = 0;
+
+        // Values the last generated code for this node can produce, set by codegen
+        // for the nodes range analysis understands (full range otherwise)
+        ValueRange range;
+
+        // Forward-mode AD codegen, primal and tangents together.
+        // Default (ast.cpp) treats the node as opaque and uses symbolic partials
+        virtual DualValue codegenDual(codegen_ctx& ctx);
 };
 
 class StmtNode : public ASTNode {
     public:
         virtual ~StmtNode() = default; 
 
+        int line = 0; // 1-based source line of the first token, 0 when unknown
+
         virtual llvm::Value* codegen(codegen_ctx& ctx) override = 0;
+
+    protected:
+        // Runtime errors in the code generated from here on report this statement's line
+        void markLine(codegen_ctx& ctx) const { if (line > 0) ctx.line = line; }
 };
 
 // Root Wrapper
@@ -68,14 +158,21 @@ class Program : public ASTNode {
 
         // void print(int indent = 0) const override = 0;
 
-        llvm::Value* codegen(codegen_ctx& ctx) override {
-            
-            llvm::Value* last = nullptr;
-            for (auto stmt : statements) {
-                last = stmt->codegen(ctx);
-            }
-            return last;
-        }
+        // Defined in ast.cpp, selects the AD seeds before emitting statements
+        llvm::Value* codegen(codegen_ctx& ctx) override;
+
+        // Defined in ast.cpp. Wraps the top level statements in the entry function
+        //
+        //     i32 crunch_main()
+        //
+        // which returns 0. Returns nullptr if any statement failed to compile.
+        llvm::Function* codegenEntry(codegen_ctx& ctx);
+
+        // The same in steps, for statements generated as they are parsed
+        // (pipeline/pipeline.h): beginEntry, codegen of each statement with
+        // ctx.adSeeds already set, then finishEntry
+        static llvm::Function* beginEntry(codegen_ctx& ctx);
+        static llvm::Function* finishEntry(codegen_ctx& ctx, llvm::Function* entry, bool failed);
 
 };
 
@@ -83,11 +180,11 @@ class Program : public ASTNode {
 // Expression Nodes
 class BinaryExpr : public ExprNode {
     public:
-        std::string op;
+        BinaryOp op;
         ExprNode* left;
         ExprNode* right;
 
-        BinaryExpr(ExprNode* left, const std::string& op, ExprNode* right) : left(left), op(op), right(right) {}
+        BinaryExpr(ExprNode* left, BinaryOp op, ExprNode* right) : left(left), op(op), right(right) {}
         
         ~BinaryExpr() {
             delete left;
@@ -96,6 +193,9 @@ class BinaryExpr : public ExprNode {
 
         llvm::Value* codegen(codegen_ctx& ctx) override {
 
+            // && and || only evaluate the right side when needed
+            if (op == BinaryOp::And || op == BinaryOp::Or) return codegenLogical(ctx);
+
             llvm::Value* l = left->codegen(ctx);
             llvm::Value* r = right->codegen(ctx);
 
@@ -104,101 +204,65 @@ class BinaryExpr : public ExprNode {
                 return nullptr;
             }
 
-            // Type Promotions between operations
-            
-            if (op == "+") {
-                
-                // TODO Add String type promos
-                
-                if (l->getType()->isDoubleTy() || r->getType()->isDoubleTy()) {
-                    if (l->getType()->isIntegerTy()) {
-                        l = ctx.builder.CreateSIToFP(l, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    if (r->getType()->isIntegerTy()) {
-                        r = ctx.builder.CreateSIToFP(r, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    return ctx.builder.CreateFAdd(l, r, "addtmp");
-                } else {
-                    return ctx.builder.CreateAdd(l, r, "addtmp");
-                }
-            
-            } else if (op == "-") {
-                
-                if (l->getType()->isDoubleTy() || r->getType()->isDoubleTy()) {
-                    if (l->getType()->isIntegerTy()) {
-                        l = ctx.builder.CreateSIToFP(l, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    if (r->getType()->isIntegerTy()) {
-                        r = ctx.builder.CreateSIToFP(r, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    return ctx.builder.CreateFSub(l, r, "subtmp");
-                } else {
-                    return ctx.builder.CreateSub(l, r, "subtmp");
-                }
+            return emitOp(ctx, l, r);
+        }
 
-            } else if (op == "*") {
-                
-                if (l->getType()->isDoubleTy() || r->getType()->isDoubleTy()) {
-                    if (l->getType()->isIntegerTy()) {
-                        l = ctx.builder.CreateSIToFP(l, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    if (r->getType()->isIntegerTy()) {
-                        r = ctx.builder.CreateSIToFP(r, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    return ctx.builder.CreateFMul(l, r, "multmp");
-                } else {
-                    return ctx.builder.CreateMul(l, r, "multmp");
-                }
+        // Defined in ast.cpp, tangent rules for + - * /
+        DualValue codegenDual(codegen_ctx& ctx) override;
 
-            } else if (op == "/") {
-                
-                if (l->getType()->isDoubleTy() || r->getType()->isDoubleTy()) {
-                    if (l->getType()->isIntegerTy()) {
-                        l = ctx.builder.CreateSIToFP(l, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    if (r->getType()->isIntegerTy()) {
-                        r = ctx.builder.CreateSIToFP(r, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    return ctx.builder.CreateFDiv(l, r, "divtmp");
-                } else {
-                    // Using signed division for integers - POTENTIAL BUG
-                    return ctx.builder.CreateSDiv(l, r, "divtmp");
-                }
-            } else if (op == "%") {
-                
-                if (l->getType()->isDoubleTy() || r->getType()->isDoubleTy()) {
-                    if (l->getType()->isIntegerTy()) {
-                        l = ctx.builder.CreateSIToFP(l, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    if (r->getType()->isIntegerTy()) {
-                        r = ctx.builder.CreateSIToFP(r, llvm::Type::getDoubleTy(ctx.context), "int_to_double");
-                    }
-                    return ctx.builder.CreateSRem(l, r, "modtmp");
-                } else {
-                    return ctx.builder.CreateSRem(l, r, "modtmp");
-                }
-            }
+        // Defined in ast.cpp, short circuit && and ||
+        llvm::Value* codegenLogical(codegen_ctx& ctx);
 
-            // TODO Add logical comparisons, equality, and commas
+        // Applies op to already generated operands
+        llvm::Value* emitOp(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r) {
+
+            range = ValueRange();
+
+            if (op != BinaryOp::Comma && (ctx.isString(l) || ctx.isString(r))) return emitString(ctx, l, r);
+            if (isArithmetic(op)) return emitArithmetic(ctx, l, r);
+            if (isComparison(op)) return emitComparison(ctx, l, r);
+
+            if (op == BinaryOp::Comma) {
+                // Both sides are evaluated, the right one is the value
+                range = right->range;
+                return r;
+            }
 
             // Unknown operator error
-            std::cerr << "Unsupported binary operator: " << op << std::endl;
+            std::cerr << "Unsupported binary operator: " << opName(op) << std::endl;
             return nullptr;
         }
+
+        // Defined in ast.cpp, + - * / % through the operand type x opcode table. Operand
+        // ranges prove when int ops cannot wrap (nsw/nuw) and when divisors are non zero
+        llvm::Value* emitArithmetic(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r);
+
+        // Defined in ast.cpp, + concatenates (other operand converted to its printed
+        // text), == and != compare contents, through the string runtime
+        llvm::Value* emitString(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r);
+
+        // Defined in ast.cpp, comparisons produce a bool (i1), ints are compared signed and doubles ordered
+        llvm::Value* emitComparison(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r);
+
+        // Defined in ast.cpp. Integer division traps on a zero divisor or INT_MIN / -1,
+        // the check is only emitted when the operand ranges cannot rule those out
+        void checkDivisor(codegen_ctx& ctx, llvm::Value* l, llvm::Value* r, const ValueRange& lr, const ValueRange& rr);
 };
 
 class UnaryExpr : public ExprNode {
     public:
-        std::string op;
+        UnaryOp op;
         ExprNode* operand;
 
-        UnaryExpr(const std::string& op, ExprNode* operand) : op(op), operand(operand) {}
+        UnaryExpr(UnaryOp op, ExprNode* operand) : op(op), operand(operand) {}
         
         ~UnaryExpr() {
             delete operand;
         }
 
         llvm::Value* codegen(codegen_ctx& ctx) override {
+
+            if (BinaryExpr* args = powerArgs()) return codegenPower(ctx, args);
             
             llvm::Value* val = operand->codegen(ctx);
 
@@ -207,33 +271,78 @@ class UnaryExpr : public ExprNode {
                 return nullptr;
             }
 
-            if (op == "-") {
+            return emitOp(ctx, val);
+        }
+
+        // exp(base, exponent) parses as exp applied to the comma expression (base, exponent)
+        BinaryExpr* powerArgs() const {
+            auto args = dynamic_cast<BinaryExpr*>(operand);
+            return op == UnaryOp::Exp && args && args->op == BinaryOp::Comma ? args : nullptr;
+        }
+
+        // base^exponent through llvm.pow, both sides as doubles
+        llvm::Value* codegenPower(codegen_ctx& ctx, BinaryExpr* args) {
+            llvm::Value* base = args->left->codegen(ctx);
+            llvm::Value* exponent = args->right->codegen(ctx);
+            if (base) base = ctx.toDouble(base);
+            if (exponent) exponent = ctx.toDouble(exponent);
+
+            if (!base || !exponent) {
+                std::cerr << "Failed to generate code for power operands." << std::endl;
+                return nullptr;
+            }
+
+            range = ValueRange();
+            return ctx.builder.CreateBinaryIntrinsic(llvm::Intrinsic::pow, base, exponent, nullptr, "powtmp");
+        }
+
+        // Defined in ast.cpp. sin, cos, exp, log and sqrt lower to LLVM intrinsics so they
+        // can be folded, hoisted and vectorized, tan is a libm call
+        llvm::Value* emitMath(codegen_ctx& ctx, llvm::Value* val);
+
+        // Applies op to an already generated operand
+        llvm::Value* emitOp(codegen_ctx& ctx, llvm::Value* val) {
+
+            range = ValueRange();
+
+            if (op == UnaryOp::Neg) {
                 
                 if (val->getType()->isDoubleTy()) {
+                    range = ranges::neg(ranges::toDouble(operand->range));
                     return ctx.builder.CreateFNeg(val, "negtmp");
                 } else if (val->getType()->isIntegerTy()) {
-                    return ctx.builder.CreateNeg(val, "negtmp");
+                    // -INT_MIN is the only i32 negation that wraps
+                    bool nsw = val->getType()->isIntegerTy(32) && !ranges::toInt32(operand->range).contains(INT32_MIN);
+                    if (nsw) range = ranges::neg(ranges::toInt32(operand->range));
+                    return ctx.builder.CreateNeg(val, "negtmp", false, nsw);
                 } else {
                     std::cerr << "Unsupported type for unary negation." << std::endl;
                     return nullptr;
                 }
 
-            } else if (op == "!") {
+            } else if (op == UnaryOp::Not) {
                 
-                // Boolean type
-                if (val->getType()->isIntegerTy(1)) { 
-                    return ctx.builder.CreateNot(val, "nottmp");
+                // Boolean type, numbers are true when non zero
+                if (llvm::Value* cond = ctx.toBool(val)) { 
+                    return ctx.builder.CreateNot(cond, "nottmp");
                 } else {
                     std::cerr << "Unsupported type for logical NOT." << std::endl;
                     return nullptr;
                 }
 
+            } else if (isMathFunction(op)) {
+
+                return emitMath(ctx, val);
+
             }
 
             // Unknown operator error
-            std::cerr << "Unsupported unary operator: " << op << std::endl;
+            std::cerr << "Unsupported unary operator: " << opName(op) << std::endl;
             return nullptr;
         }
+
+        // Defined in ast.cpp, negation and math functions propagate tangents directly
+        DualValue codegenDual(codegen_ctx& ctx) override;
 };
 
 class LiteralExpr : public ExprNode {
@@ -255,6 +364,8 @@ class IdentifierExpr : public ExprNode {
 
         IdentifierExpr(const Token& t) : name(t.getLexeme()) {}
 
+        IdentifierExpr(const std::string& name) : name(name) {}
+
         ~IdentifierExpr() {}
 
         llvm::Value* codegen(codegen_ctx& ctx) override {
@@ -266,10 +377,19 @@ class IdentifierExpr : public ExprNode {
                 return nullptr;
             }
 
-            // Variable value
-            return ctx.builder.CreateLoad(sym->type, sym->llvmValue, sym->name);
+            if (sym->isFunction()) {
+                std::cerr << "Function " << name << " can only be called." << std::endl;
+                return nullptr;
+            }
+
+            // Reaching definition, no memory access
+            range = sym->type->isIntegerTy(32) ? ranges::toInt32(sym->range) : sym->range;
+            return ctx.readVariable(sym->variable);
 
         }
+
+        // Defined in ast.cpp, reads the tangents along with the value
+        DualValue codegenDual(codegen_ctx& ctx) override;
 };
 
 class AssignmentExpr : public ExprNode {
@@ -282,9 +402,9 @@ class AssignmentExpr : public ExprNode {
 
         ~AssignmentExpr() { delete expr; }
 
-        llvm::Value* codegen(codegen_ctx& ctx) {
-            return nullptr; // TODO
-        }
+        // Defined in ast.cpp, stores tangents too when the target carries them
+        llvm::Value* codegen(codegen_ctx& ctx) override;
+        DualValue codegenDual(codegen_ctx& ctx) override;
 
 };
 
@@ -300,9 +420,81 @@ class CallExpr : public ExprNode {
             for (auto arg : args) { delete arg; }
         }
 
-        llvm::Value* codegen(codegen_ctx& ctx) override {
-            return nullptr; // TODO
+        // Defined in ast.cpp, calls a function value
+        llvm::Value* codegen(codegen_ctx& ctx) override;
+};
+
+// x -> expr, (x, y) -> expr: math function value, only valid as the initializer
+// of a function declaration. Parameters and the result are doubles.
+class FunctionLiteral : public ExprNode {
+    public:
+        std::vector<std::string> params;
+        ExprNode* body;
+
+        FunctionLiteral(const std::vector<std::string>& params, ExprNode* body) : params(params), body(body) {}
+
+        ~FunctionLiteral() { delete body; }
+
+        // Emits the scalar and batch entry points for the function value `name`:
+        //
+        //     double crunch.fn.<name>(double p0, ..., double pk)
+        //     void crunch.fn.<name>.batch(const double** cols, double* out, i64 n)
+        //
+        // The batch form evaluates out[i] = f(cols[0][i], ..., cols[k][i]) in one loop.
+        // Other variables used by the body are captured by value at declaration time.
+        // Defined in ast.cpp. Returns false on failure.
+        bool emit(codegen_ctx& ctx, const std::string& name, llvm::Function*& scalar, llvm::Function*& batch);
+
+        // Function literals are not standalone values
+        llvm::Value* codegen(codegen_ctx&) override {
+            std::cerr << "Function literals are only allowed in function declarations." << std::endl;
+            return nullptr;
+        }
+};
+
+// deriv(expr, var): symbolic derivative, built once from the expression tree
+// and then compiled like any other expression. When expr reads variables that
+// carry tangents for var (forward-mode AD), the tangent is used instead
+class DerivExpr : public ExprNode {
+    public:
+        ExprNode* expr;
+        std::string var;
+        ExprNode* derivative = nullptr; // cached result of the calculus engine
+
+        DerivExpr(ExprNode* expr, const std::string& var) : expr(expr), var(var) {}
+
+        ~DerivExpr() {
+            delete expr;
+            delete derivative;
+        }
+
+        // Builds (and caches) the simplified derivative tree, throws if expr is not differentiable
+        ExprNode* getDerivative();
+
+        // Defined in ast.cpp, needs the calculus engine
+        llvm::Value* codegen(codegen_ctx& ctx) override;
+};
+
+// integral(expr, var, a, b): definite integral, the integrand is compiled into a
+// batch function and handed to the native quadrature runtime (runtime/quadrature.h)
+class IntegralExpr : public ExprNode {
+    public:
+        ExprNode* expr;
+        std::string var;
+        ExprNode* lower;
+        ExprNode* upper;
+
+        IntegralExpr(ExprNode* expr, const std::string& var, ExprNode* lower, ExprNode* upper)
+            : expr(expr), var(var), lower(lower), upper(upper) {}
+
+        ~IntegralExpr() {
+            delete expr;
+            delete lower;
+            delete upper;
         }
+
+        // Defined in ast.cpp, needs the calculus engine
+        llvm::Value* codegen(codegen_ctx& ctx) override;
 };
 
 class BoolLiteral : public ExprNode {
@@ -319,8 +511,10 @@ class IntLiteral : public ExprNode {
     public:
         int value;
         IntLiteral(const Token& t) : value(std::stoi(t.getLexeme())) {}
+        IntLiteral(int v) : value(v) {}
 
         llvm::Value* codegen(codegen_ctx& ctx) override {
+            range = ValueRange::constant(value, true);
             return llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx.context), value);
         }
 };
@@ -329,8 +523,10 @@ class DoubleLiteral : public ExprNode {
     public:
         double value;
         DoubleLiteral(const Token& t) : value(std::stod(t.getLexeme())) {}
+        DoubleLiteral(double v) : value(v) {}
 
         llvm::Value* codegen(codegen_ctx& ctx) override {
+            range = ValueRange::constant(value, false);
             return llvm::ConstantFP::get(llvm::Type::getDoubleTy(ctx.context), value);
         }
 };
@@ -338,10 +534,27 @@ class DoubleLiteral : public ExprNode {
 class StringLiteral : public ExprNode {
     public:
         std::string value;
-        StringLiteral(const Token& t) : value(t.getLexeme()) {}
+        StringLiteral(const Token& t) : value(unquote(t.getLexeme())) {}
         
-        llvm::Value* codegen(codegen_ctx& ctx) override {
-            return llvm::ConstantDataArray::getString(ctx.context, value, true);
+        // Defined in ast.cpp, a constant string value: short literals are stored
+        // inline, longer ones point to an interned constant
+        llvm::Value* codegen(codegen_ctx& ctx) override;
+
+        // Lexeme to contents: drops the quotes and resolves \n \t \" \\ escapes
+        static std::string unquote(const std::string& lexeme) {
+            std::string out;
+            size_t end = lexeme.size() >= 2 && lexeme.back() == '"' ? lexeme.size() - 1 : lexeme.size();
+            for (size_t i = lexeme.empty() || lexeme[0] != '"' ? 0 : 1; i < end; ++i) {
+                char c = lexeme[i];
+                if (c == '\\' && i + 1 < end) {
+                    char n = lexeme[++i];
+                    if (n == 'n') c = '\n';
+                    else if (n == 't') c = '\t';
+                    else c = n;
+                }
+                out.push_back(c);
+            }
+            return out;
         }
 };
 
@@ -356,6 +569,7 @@ class ExprStmt : public StmtNode {
         ~ExprStmt() { delete expr; }
 
         llvm::Value* codegen(codegen_ctx& ctx) override {
+            markLine(ctx);
             return expr->codegen(ctx);
         }
 };
@@ -371,12 +585,22 @@ class VarDeclStmt : public StmtNode {
 
         ~VarDeclStmt() { delete init; }
 
+        // Defined in ast.cpp, declares a function value
+        llvm::Value* codegenFunction(codegen_ctx& ctx);
+
+        // Defined in ast.cpp, tangent slots of a double variable under AD
+        void declareTangents(codegen_ctx& ctx, const DualValue& dual);
+
         llvm::Value* codegen(codegen_ctx& ctx) override {
+            markLine(ctx);
             
             llvm::Type* var_type = nullptr;
             
             // Assign var_type to token type
             switch(type) {
+
+                case TokenType::KW_FUNCTION:
+                    return codegenFunction(ctx);
                 
                 case TokenType::KW_INT:
                     var_type = llvm::Type::getInt32Ty(ctx.context); break;
@@ -387,31 +611,40 @@ class VarDeclStmt : public StmtNode {
                 case TokenType::KW_BOOL:
                     var_type = llvm::Type::getInt1Ty(ctx.context); break; // 1 bit
                 
-                case TokenType::KW_STRING: { 
-                    
-                    var_type = llvm::Type::getInt8PtrTy(ctx.context);
-                    break;
-                }
+                case TokenType::KW_STRING:
+                    var_type = ctx.stringType(); break;
 
                 default:
                     std::cerr << "Unsupported variable type" << std::endl;
                     return nullptr;
             }
             
-            // Create allocation instance
-            llvm::AllocaInst* alloca = ctx.builder.CreateAlloca(var_type, nullptr, name);
-
             // Add to symbol table and check if no repeated declaration in scope
-            if (!ctx.symTable->declare(name, var_type, alloca)) {
+            Symbol* sym = ctx.symTable->declare(name, var_type);
+            if (!sym) {
                 std::cerr << "Variable already declared in scope: " << name << std::endl;
                 return nullptr;
             }
 
             // Handle initialization if initalizer is present
             llvm::Value* init_val = nullptr;
+            ValueRange init_range = ValueRange::constant(0, var_type->isIntegerTy());
+            DualValue dual;
+            bool tracked = !ctx.adSeeds.empty() && var_type->isDoubleTy(); // doubles carry tangents under AD
             if (init) {
                 
-                init_val = init->codegen(ctx);
+                if (tracked) {
+                    dual = init->codegenDual(ctx);
+                    init_val = dual.primal;
+                } else {
+                    init_val = init->codegen(ctx);
+                }
+
+                if (!init_val) {
+                    std::cerr << "Failed to generate code for initializer of variable: " << name << std::endl;
+                    return nullptr;
+                }
+                init_range = init->range;
                 
                 // Type Checking and Promotion
                 if (init_val && init_val->getType() != var_type) {
@@ -438,6 +671,7 @@ class VarDeclStmt : public StmtNode {
                     case llvm::Type::DoubleTyID:
                         init_val = llvm::ConstantFP::get(var_type, 0.0); break;
                     case llvm::Type::ArrayTyID:
+                    case llvm::Type::StructTyID: // all zero is the empty string
                         init_val = llvm::ConstantAggregateZero::get(var_type); break;
                     default:
                         std::cerr << "Unsupported variable type for default initialization" << std::endl;
@@ -446,8 +680,14 @@ class VarDeclStmt : public StmtNode {
 
             }
             
-            ctx.builder.CreateStore(init_val, alloca);
-            return alloca;
+            ctx.writeVariable(sym->variable, init_val);
+
+            // Range facts for later reads of the variable
+            if (var_type->isIntegerTy(32)) sym->range = ranges::toInt32(init_range);
+            else if (var_type->isDoubleTy()) sym->range = ranges::toDouble(init_range);
+
+            if (tracked) declareTangents(ctx, dual);
+            return init_val;
 
         }
 };
@@ -467,15 +707,18 @@ class BlockStmt : public StmtNode {
             // Push scope
             ctx.symTable->pushScope();
 
-            llvm::Value* last = nullptr;
+            // Last statement value, nullptr if any statement failed
+            llvm::Value* last = ctx.builder.GetInsertBlock();
+            bool failed = false;
             for (auto stmt: statements) {
                 last = stmt->codegen(ctx);
+                if (!last) failed = true;
             }
 
             // Pop scope 
             ctx.symTable->popScope();
 
-            return last;
+            return failed ? nullptr : last;
         }
 };
 
@@ -494,9 +737,8 @@ class IfStmt : public StmtNode {
             if (elseBranch) delete elseBranch; 
         }
 
-        llvm::Value* codegen(codegen_ctx& ctx) override {
-            return nullptr; // TODO
-        }
+        // Defined in ast.cpp, returns the block where codegen continues
+        llvm::Value* codegen(codegen_ctx& ctx) override;
 };
 
 class PrintStmt : public StmtNode { 
@@ -507,25 +749,63 @@ class PrintStmt : public StmtNode {
 
         ~PrintStmt() { delete value; }
 
-        llvm::Value* codegen(codegen_ctx& ctx) override {
-            return nullptr; // TODO
-        }
+        // Defined in ast.cpp. print(a, b, ...) writes the items back to back through
+        // the print runtime (runtime/print.h), then a newline unless the last item
+        // is a string literal ending in one
+        llvm::Value* codegen(codegen_ctx& ctx) override;
 };
 
-class WhileStmt :public StmtNode { 
-    // Unsupported for now
+class WhileStmt : public StmtNode { 
+    public:
+        ExprNode* condition;
+        StmtNode* body;
+
+        WhileStmt(ExprNode* condition, StmtNode* body) : condition(condition), body(body) {}
+
+        ~WhileStmt() {
+            delete condition;
+            delete body;
+        }
+
+        // Defined in ast.cpp, returns the block after the loop
+        llvm::Value* codegen(codegen_ctx& ctx) override;
 };
 
 class ForStmt : public StmtNode { 
-    // Unsupported for now
+    public:
+        StmtNode* init; // declaration or expression statement, can be nullptr
+        ExprNode* condition; // nullptr loops until break
+        ExprNode* step; // can be nullptr
+        StmtNode* body;
+
+        ForStmt(StmtNode* init, ExprNode* condition, ExprNode* step, StmtNode* body) 
+            : init(init), condition(condition), step(step), body(body) {}
+
+        ~ForStmt() {
+            delete init;
+            delete condition;
+            delete step;
+            delete body;
+        }
+
+        // Defined in ast.cpp, variables declared in init are scoped to the loop
+        llvm::Value* codegen(codegen_ctx& ctx) override;
+
+        // Defined in ast.cpp, the loop without init, entered at the condition
+        // (tiered execution compiles loops the interpreter already started)
+        llvm::Value* codegenLoop(codegen_ctx& ctx);
 };
 
 class BreakStmt : public StmtNode { 
-    // Unsupported for now
+    public:
+        // Defined in ast.cpp, leaves the innermost loop
+        llvm::Value* codegen(codegen_ctx& ctx) override;
 };
 
-class ContinueStmt :public StmtNode { 
-    // Unsupported for now
+class ContinueStmt : public StmtNode { 
+    public:
+        // Defined in ast.cpp, jumps to the step of the innermost loop
+        llvm::Value* codegen(codegen_ctx& ctx) override;
 };
 
 class FunctionDeclStmt : public StmtNode { 
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include "../lexer/token.h"
+
+// Operator opcodes, decoded from the token once at parse time
+
+enum class BinaryOp : uint8_t {
+    // Arithmetic, in the column order of the codegen dispatch tables
+    Add, Sub, Mul, Div, Mod,
+    // Comparisons, same
+    Eq, Ne, Lt, Gt, Le, Ge,
+    And, Or,
+    Comma
+};
+
+enum class UnaryOp : uint8_t {
+    Neg, Not,
+    Sin, Cos, Tan, Exp, Log, Sqrt
+};
+
+inline BinaryOp binaryOpFromToken(TokenType type) {
+    switch (type) {
+        case TokenType::PLUS: return BinaryOp::Add;
+        case TokenType::MINUS: return BinaryOp::Sub;
+        case TokenType::MULTI: return BinaryOp::Mul;
+        case TokenType::DIV: return BinaryOp::Div;
+        case TokenType::MOD: return BinaryOp::Mod;
+        case TokenType::EQ: return BinaryOp::Eq;
+        case TokenType::NEQ: return BinaryOp::Ne;
+        case TokenType::LT: return BinaryOp::Lt;
+        case TokenType::GT: return BinaryOp::Gt;
+        case TokenType::LEQ: return BinaryOp::Le;
+        case TokenType::GEQ: return BinaryOp::Ge;
+        case TokenType::AND: return BinaryOp::And;
+        case TokenType::OR: return BinaryOp::Or;
+        case TokenType::COMMA: return BinaryOp::Comma;
+        default: throw std::runtime_error("Token is not a binary operator.");
+    }
+}
+
+inline UnaryOp unaryOpFromToken(TokenType type) {
+    switch (type) {
+        case TokenType::MINUS: return UnaryOp::Neg;
+        case TokenType::NOT: return UnaryOp::Not;
+        case TokenType::SIN: return UnaryOp::Sin;
+        case TokenType::COS: return UnaryOp::Cos;
+        case TokenType::TAN: return UnaryOp::Tan;
+        case TokenType::EXP: return UnaryOp::Exp;
+        case TokenType::LOG: return UnaryOp::Log;
+        case TokenType::SQRT: return UnaryOp::Sqrt;
+        default: throw std::runtime_error("Token is not a unary operator.");
+    }
+}
+
+inline bool isArithmetic(BinaryOp op) { return op <= BinaryOp::Mod; }
+inline bool isComparison(BinaryOp op) { return op >= BinaryOp::Eq && op <= BinaryOp::Ge; }
+inline bool isMathFunction(UnaryOp op) { return op >= UnaryOp::Sin; }
+
+// Source spelling, for the tree printer and diagnostics
+inline const char* opName(BinaryOp op) {
+    static const char* const names[] = { "+", "-", "*", "/", "%", "==", "!=", "<", ">", "<=", ">=", "&&", "||", "," };
+    return names[static_cast<int>(op)];
+}
+
+inline const char* opName(UnaryOp op) {
+    static const char* const names[] = { "-", "!", "sin", "cos", "tan", "exp", "log", "sqrt" };
+    return names[static_cast<int>(op)];
+}
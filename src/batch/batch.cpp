@@ -0,0 +1,272 @@
+#include "batch.h"
+#include "../lexer/lexer.h"
+#include "../parser/parser.h"
+#include "../jit/jit.h"
+#include "../vm/compiler.h"
+#include "../vm/vm.h"
+#include "../runtime/print.h"
+#include "../runtime/quadrature.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <thread>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Where std::cerr goes on this thread while a script runs, nullptr for the real stderr
+    thread_local std::string* diagnostics = nullptr;
+
+    // Installed as std::cerr's buffer for the batch: the compiler's and the
+    // interpreter's messages about a script end up with that script. Unbuffered,
+    // every write is routed on its own
+    class RoutedBuffer : public std::streambuf {
+        public:
+            explicit RoutedBuffer(std::streambuf* fallback) : fallback(fallback) {}
+
+        protected:
+            std::streamsize xsputn(const char* s, std::streamsize n) override {
+                if (diagnostics) { diagnostics->append(s, n); return n; }
+                std::lock_guard<std::mutex> guard(lock);
+                return fallback->sputn(s, n);
+            }
+
+            int overflow(int c) override {
+                if (c == traits_type::eof()) return traits_type::not_eof(c);
+                char ch = (char)c;
+                return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+            }
+
+            int sync() override {
+                if (diagnostics) return 0;
+                std::lock_guard<std::mutex> guard(lock);
+                return fallback->pubsync();
+            }
+
+        private:
+            std::streambuf* fallback;
+            std::mutex lock;
+    };
+
+    // crunch_output collecting a script's print(...) output
+    void appendOutput(void* target, const char* data, size_t size) {
+        static_cast<std::string*>(target)->append(data, size);
+    }
+
+    struct Script {
+        std::string output;
+        std::string diagnostics;
+        int result = 0; // crunch_main's, -1 if it didn't compile or failed at runtime
+        bool done = false;
+    };
+
+    // The parser owns the tree, the lexer the tokens it came from
+    struct Frontend {
+        std::unique_ptr<Lexer> lexer;
+        std::unique_ptr<Parser> parser;
+    };
+
+    bool parse(const std::string& path, Frontend& front) {
+        try {
+            front.lexer.reset(new Lexer(path));
+            front.lexer->setDebug(false);
+            front.lexer->tokenize();
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+
+        try { front.parser.reset(new Parser(front.lexer->getTokens())); }
+        catch (const std::runtime_error& e) {
+            std::cerr << "Syntax error: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // One script start to end on the calling thread, like --interp or --jit would run it
+    int runScript(const std::string& path, const BatchOptions& opts) {
+        Frontend front;
+        if (!parse(path, front)) return -1;
+
+        if (opts.interpret) {
+            std::unique_ptr<BytecodeImage> image;
+            try { image = BytecodeImage::link(compileBytecode(front.parser->getProgram())); }
+            catch (const BytecodeUnsupported& e) {
+                std::cerr << "[interp] " << e.what() << ", running with --jit" << std::endl;
+            }
+            catch (const BytecodeError& e) {
+                std::cerr << e.what() << std::endl;
+                std::cerr << "Failed to generate code for program." << std::endl;
+                return -1;
+            }
+            if (image) return VM(*image).run();
+
+            // Bytecode compilation may have left marks on the tree, the JIT gets a fresh one
+            front = Frontend();
+            if (!parse(path, front)) return -1;
+        }
+
+        codegen_ctx ctx("crunch");
+        ctx.loopHints = opts.optimizer.loops;
+        if (!front.parser->getProgram()->codegenEntry(ctx)) return -1;
+
+        JITTimings timings;
+        return runJIT(ctx, timings, opts.optimizer);
+    }
+}
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 0; t < threads; ++t) queues.emplace_back(new Queue());
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t, unsigned)>& task) {
+    // Dealt round robin, so tasks finish roughly in order
+    for (size_t i = 0; i < count; ++i) queues[i % queues.size()]->tasks.push_back(i);
+
+    std::atomic<size_t> steals{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threadCount(); ++t) {
+        workers.emplace_back([&, t]() {
+            size_t i = 0, mine = 0;
+            while (next(t, i, mine)) task(i, t);
+            steals += mine;
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    stolen += steals;
+}
+
+// Own tasks from the front, stolen ones from the back of another worker's
+// deque, the work its owner would get to last. No tasks are added while the
+// pool runs, so when every deque is empty the worker is done
+bool WorkStealingPool::next(unsigned worker, size_t& task, size_t& steals) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t k = 1; k < queues.size(); ++k) {
+        Queue& victim = *queues[(worker + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            ++steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool batchScripts(const std::string& target, std::vector<std::string>& scripts, std::string& error) {
+    if (llvm::sys::fs::is_directory(target)) {
+        std::error_code ec;
+        for (llvm::sys::fs::recursive_directory_iterator it(target, ec), end; it != end && !ec; it.increment(ec)) {
+            if (llvm::sys::path::extension(it->path()) == ".crunch" && llvm::sys::fs::is_regular_file(it->path())) scripts.push_back(it->path());
+        }
+        if (ec) {
+            error = "can't list " + target + ": " + ec.message();
+            return false;
+        }
+        std::sort(scripts.begin(), scripts.end());
+        return true;
+    }
+
+    std::ifstream manifest(target);
+    if (!manifest) {
+        error = "can't read " + target;
+        return false;
+    }
+    std::string base = llvm::sys::path::parent_path(target).str();
+    std::string line;
+    while (std::getline(manifest, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t first = line.find_first_not_of(" \t\r"), last = line.find_last_not_of(" \t\r");
+        if (first == std::string::npos) continue;
+
+        llvm::SmallString<128> path(line.substr(first, last - first + 1));
+        if (llvm::sys::path::is_relative(path) && !base.empty()) {
+            llvm::SmallString<128> relative = path;
+            path = base;
+            llvm::sys::path::append(path, relative);
+        }
+        scripts.push_back(path.str().str());
+    }
+    return true;
+}
+
+BatchStats runBatch(const std::vector<std::string>& scripts, const BatchOptions& opts, std::ostream& out, std::ostream& err) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Script> results(scripts.size());
+    std::mutex lock;
+    std::condition_variable finished;
+
+    RoutedBuffer routed(std::cerr.rdbuf());
+    std::streambuf* stderrBuffer = std::cerr.rdbuf(&routed);
+
+    // Writes each script's output once it and every script before it are done,
+    // then lets go of it
+    BatchStats stats;
+    std::thread writer([&]() {
+        for (size_t i = 0; i < results.size(); ++i) {
+            Script script;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                finished.wait(guard, [&]() { return results[i].done; });
+                script = std::move(results[i]);
+            }
+
+            out << "==> " << scripts[i] << " <==\n" << script.output;
+            out.flush();
+            err << script.diagnostics;
+            if (script.result < 0) err << "[batch] " << scripts[i] << " failed" << std::endl;
+            else if (script.result > 0) err << "[batch] " << scripts[i] << " exited with " << script.result << std::endl;
+            if (script.result) stats.failed++;
+        }
+    });
+
+    // Integrals in the scripts split what the workers leave over
+    WorkStealingPool pool(opts.threads);
+    unsigned integralThreads = std::max(1u, std::thread::hardware_concurrency() / pool.threadCount());
+    pool.run(scripts.size(), [&](size_t i, unsigned) {
+        setIntegralThreads(integralThreads);
+        Script script;
+        diagnostics = &script.diagnostics;
+        crunch_set_output(appendOutput, &script.output);
+        script.result = runScript(scripts[i], opts);
+        crunch_set_output(nullptr, nullptr);
+        diagnostics = nullptr;
+
+        std::lock_guard<std::mutex> guard(lock);
+        results[i] = std::move(script);
+        results[i].done = true;
+        finished.notify_one();
+    });
+    writer.join();
+    std::cerr.rdbuf(stderrBuffer);
+
+    stats.scripts = scripts.size();
+    stats.steals = pool.steals();
+    stats.threads = pool.threadCount();
+    stats.ms = msSince(start);
+    return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../opt/optimizer.h"
+
+// Batch mode (--batch): many scripts compiled and run in one process
+//
+// Scripts are tasks on a work-stealing pool. The scripts are dealt to the
+// workers' deques round robin, each worker takes its own from the front and,
+// once that is empty, steals from the back of the others'. Every script
+// gets a fresh codegen_ctx (and LLVMContext) on the worker running it, so
+// nothing LLVM is shared between threads.
+//
+// A script's output (print) and diagnostics are collected while it runs and
+// written in script order, each under a "==> path <==" header, as soon as the
+// scripts before it are done.
+
+class WorkStealingPool {
+    public:
+        explicit WorkStealingPool(unsigned threads);
+
+        // Calls task(i, worker) for every i in [0, count), returns when all are done
+        void run(size_t count, const std::function<void(size_t, unsigned)>& task);
+
+        unsigned threadCount() const { return (unsigned)queues.size(); }
+        size_t steals() const { return stolen; }
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<size_t> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        size_t stolen = 0;
+
+        bool next(unsigned worker, size_t& task, size_t& steals);
+};
+
+struct BatchOptions {
+    bool interpret = false; // --interp, otherwise --jit
+    OptimizerOptions optimizer;
+    unsigned threads = 0; // 0 = one per hardware thread
+};
+
+struct BatchStats {
+    size_t scripts = 0;
+    size_t failed = 0; // didn't compile, runtime errors, nonzero exit
+    size_t steals = 0;
+    unsigned threads = 0;
+    double ms = 0.0;
+};
+
+// The scripts of a --batch argument: the .crunch files under a directory
+// (sorted), or the paths listed in a manifest file, one per line, relative to
+// the manifest's directory ('#' starts a comment). False with the reason in error
+bool batchScripts(const std::string& target, std::vector<std::string>& scripts, std::string& error);
+
+// Runs scripts, their output goes to out and their diagnostics to err, in script order
+BatchStats runBatch(const std::vector<std::string>& scripts, const BatchOptions& opts, std::ostream& out, std::ostream& err);
@@ -0,0 +1,730 @@
+#include "deriv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <set>
+#include <stdexcept>
+
+namespace calculus {
+
+namespace {
+
+    // --- Tree building helpers ---
+
+    ExprNode* num(double v) { return new DoubleLiteral(v); }
+
+    ExprNode* bin(ExprNode* l, BinaryOp op, ExprNode* r) { return new BinaryExpr(l, op, r); }
+
+    ExprNode* un(UnaryOp op, ExprNode* operand) { return new UnaryExpr(op, operand); }
+
+    // Detach a child from its parent so the parent can be deleted safely
+    ExprNode* take(ExprNode*& slot) {
+        ExprNode* e = slot;
+        slot = nullptr;
+        return e;
+    }
+
+    // Numeric literal inspection
+    bool constValue(const ExprNode* e, double& out, bool& isInt) {
+        if (auto i = dynamic_cast<const IntLiteral*>(e)) { out = i->value; isInt = true; return true; }
+        if (auto d = dynamic_cast<const DoubleLiteral*>(e)) { out = d->value; isInt = false; return true; }
+        return false;
+    }
+
+    bool isConst(const ExprNode* e, double v) {
+        double c; bool isInt;
+        return constValue(e, c, isInt) && c == v;
+    }
+
+    // True if expr is statically known to produce an int: int literals and int
+    // arithmetic on them. Variables aren't, their type isn't known here
+    bool isIntegral(const ExprNode* expr) {
+        if (dynamic_cast<const IntLiteral*>(expr)) return true;
+        if (auto u = dynamic_cast<const UnaryExpr*>(expr)) return u->op == UnaryOp::Neg && isIntegral(u->operand);
+        if (auto b = dynamic_cast<const BinaryExpr*>(expr)) {
+            switch (b->op) {
+                case BinaryOp::Add: case BinaryOp::Sub: case BinaryOp::Mul: case BinaryOp::Div: case BinaryOp::Mod:
+                    return isIntegral(b->left) && isIntegral(b->right);
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    ExprNode* makeConst(double v, bool isInt) {
+        if (isInt) return new IntLiteral(static_cast<int>(v));
+        return num(v);
+    }
+
+    // Folds l op r following the same int/double rules as BinaryExpr::codegen.
+    // Returns false when the fold would change runtime behaviour (div by zero, int overflow, ...)
+    bool foldBinary(BinaryOp op, double l, bool lInt, double r, bool rInt, double& out, bool& outInt) {
+        outInt = lInt && rInt;
+
+        if (outInt) {
+            long long a = static_cast<long long>(l), b = static_cast<long long>(r), v;
+            switch (op) {
+                case BinaryOp::Add: v = a + b; break;
+                case BinaryOp::Sub: v = a - b; break;
+                case BinaryOp::Mul: v = a * b; break;
+                case BinaryOp::Div: if (b == 0) return false; v = a / b; break;
+                case BinaryOp::Mod: if (b == 0) return false; v = a % b; break;
+                default: return false;
+            }
+
+            if (v < INT_MIN || v > INT_MAX) return false;
+            out = static_cast<double>(v);
+            return true;
+        }
+
+        switch (op) {
+            case BinaryOp::Add: out = l + r; return true;
+            case BinaryOp::Sub: out = l - r; return true;
+            case BinaryOp::Mul: out = l * r; return true;
+            case BinaryOp::Div: out = l / r; return true;
+            default: return false;
+        }
+    }
+
+    bool foldUnary(UnaryOp op, double v, double& out) {
+        switch (op) {
+            case UnaryOp::Sin: out = std::sin(v); return true;
+            case UnaryOp::Cos: out = std::cos(v); return true;
+            case UnaryOp::Tan: out = std::tan(v); return true;
+            case UnaryOp::Exp: out = std::exp(v); return true;
+            case UnaryOp::Log: if (v <= 0) return false; out = std::log(v); return true;
+            case UnaryOp::Sqrt: if (v < 0) return false; out = std::sqrt(v); return true;
+            default: return false;
+        }
+    }
+
+    ExprNode* simplifyBinary(BinaryExpr* b);
+    ExprNode* simplifyUnary(UnaryExpr* u);
+
+    // Replaces b by one of its children
+    ExprNode* keepLeft(BinaryExpr* b) { ExprNode* e = take(b->left); delete b; return e; }
+    ExprNode* keepRight(BinaryExpr* b) { ExprNode* e = take(b->right); delete b; return e; }
+
+    ExprNode* simplifyBinary(BinaryExpr* b) {
+        b->left = simplify(b->left);
+        b->right = simplify(b->right);
+
+        BinaryOp op = b->op;
+        if (op == BinaryOp::Comma) return b;
+
+        double lv = 0, rv = 0; bool lInt = false, rInt = false;
+        bool lConst = constValue(b->left, lv, lInt);
+        bool rConst = constValue(b->right, rv, rInt);
+
+        // Constant folding
+        if (lConst && rConst) {
+            double v; bool vInt;
+            if (foldBinary(op, lv, lInt, rv, rInt, v, vInt)) { delete b; return makeConst(v, vInt); }
+            return b;
+        }
+
+        // Dropping an identity literal is only safe if the other side keeps the literal's type
+        bool real = !(lConst && lInt) && !(rConst && rInt);
+        auto dropsType = [&](const ExprNode* kept, bool litInt) { return !litInt && !isReal(kept); };
+
+        if (op == BinaryOp::Add) {
+            if (lConst && lv == 0 && !dropsType(b->right, lInt)) return keepRight(b);
+            if (rConst && rv == 0 && !dropsType(b->left, rInt)) return keepLeft(b);
+
+            // a + (-b) -> a - b
+            if (auto n = dynamic_cast<UnaryExpr*>(b->right)) {
+                if (n->op == UnaryOp::Neg) {
+                    ExprNode* r = take(n->operand);
+                    ExprNode* l = take(b->left);
+                    delete b;
+                    return simplify(bin(l, BinaryOp::Sub, r));
+                }
+            }
+
+            // x + x -> 2 * x
+            if (equals(b->left, b->right)) {
+                ExprNode* l = take(b->left);
+                delete b;
+                return simplify(bin(new IntLiteral(2), BinaryOp::Mul, l));
+            }
+            return b;
+        }
+
+        if (op == BinaryOp::Sub) {
+            if (rConst && rv == 0 && !dropsType(b->left, rInt)) return keepLeft(b);
+
+            // 0 - x -> -x
+            if (lConst && lv == 0 && !dropsType(b->right, lInt)) {
+                ExprNode* r = take(b->right);
+                delete b;
+                return simplify(un(UnaryOp::Neg, r));
+            }
+
+            // a - (-b) -> a + b
+            if (auto n = dynamic_cast<UnaryExpr*>(b->right)) {
+                if (n->op == UnaryOp::Neg) {
+                    ExprNode* r = take(n->operand);
+                    ExprNode* l = take(b->left);
+                    delete b;
+                    return simplify(bin(l, BinaryOp::Add, r));
+                }
+            }
+
+            if (equals(b->left, b->right)) { delete b; return makeConst(0, !real); }
+            return b;
+        }
+
+        if (op == BinaryOp::Mul) {
+            // An int 0 only if the product was int arithmetic, 0 * x may be real
+            if ((lConst && lv == 0) || (rConst && rv == 0)) {
+                bool zeroInt = isIntegral(b->left) && isIntegral(b->right);
+                delete b;
+                return makeConst(0, zeroInt);
+            }
+
+            if (lConst && lv == 1 && !dropsType(b->right, lInt)) return keepRight(b);
+            if (rConst && rv == 1 && !dropsType(b->left, rInt)) return keepLeft(b);
+
+            // Canonical form keeps the constant on the left
+            if (rConst) {
+                std::swap(b->left, b->right);
+                std::swap(lConst, rConst); std::swap(lv, rv); std::swap(lInt, rInt);
+            }
+
+            if (lConst) {
+                // -1 * x -> -x
+                if (lv == -1 && !dropsType(b->right, lInt)) {
+                    ExprNode* r = take(b->right);
+                    delete b;
+                    return simplify(un(UnaryOp::Neg, r));
+                }
+
+                // c1 * (c2 * x) -> (c1 * c2) * x
+                if (auto inner = dynamic_cast<BinaryExpr*>(b->right)) {
+                    double iv; bool iInt;
+                    if (inner->op == BinaryOp::Mul && constValue(inner->left, iv, iInt)) {
+                        double v; bool vInt;
+                        if (foldBinary(BinaryOp::Mul, lv, lInt, iv, iInt, v, vInt)) {
+                            ExprNode* x = take(inner->right);
+                            delete b;
+                            return simplify(bin(makeConst(v, vInt), BinaryOp::Mul, x));
+                        }
+                    }
+                }
+            }
+
+            // (1 / a) * b -> b / a, as long as the division stays real
+            for (int side = 0; side < 2; ++side) {
+                ExprNode*& recip = side == 0 ? b->left : b->right;
+                ExprNode*& other = side == 0 ? b->right : b->left;
+
+                auto q = dynamic_cast<BinaryExpr*>(recip);
+                if (q && q->op == BinaryOp::Div && isConst(q->left, 1) && (isReal(other) || isReal(q->right))) {
+                    ExprNode* den = take(q->right);
+                    ExprNode* numer = take(other);
+                    delete b;
+                    return simplify(bin(numer, BinaryOp::Div, den));
+                }
+            }
+
+            // (-a) * b -> -(a * b), a * (-b) -> -(a * b)
+            auto nl = dynamic_cast<UnaryExpr*>(b->left);
+            auto nr = dynamic_cast<UnaryExpr*>(b->right);
+            if ((nl && nl->op == UnaryOp::Neg) || (nr && nr->op == UnaryOp::Neg)) {
+                bool negL = nl && nl->op == UnaryOp::Neg;
+                bool negR = nr && nr->op == UnaryOp::Neg;
+                ExprNode* l = negL ? take(nl->operand) : take(b->left);
+                ExprNode* r = negR ? take(nr->operand) : take(b->right);
+                delete b;
+                ExprNode* prod = bin(l, BinaryOp::Mul, r);
+                if (negL != negR) prod = un(UnaryOp::Neg, prod);
+                return simplify(prod);
+            }
+            return b;
+        }
+
+        if (op == BinaryOp::Div) {
+            if (lConst && lv == 0 && !(rConst && rv == 0)) {
+                bool zeroInt = lInt && isIntegral(b->right);
+                delete b;
+                return makeConst(0, zeroInt);
+            }
+            if (rConst && rv == 1 && !dropsType(b->left, rInt)) return keepLeft(b);
+            if (equals(b->left, b->right) && isReal(b->left)) { delete b; return num(1.0); }
+            return b;
+        }
+
+        return b;
+    }
+
+    ExprNode* simplifyUnary(UnaryExpr* u) {
+        u->operand = simplify(u->operand);
+
+        double v; bool vInt;
+        UnaryOp op = u->op;
+
+        if (op == UnaryOp::Neg) {
+            if (constValue(u->operand, v, vInt) && !(vInt && v == INT_MIN)) {
+                delete u;
+                return makeConst(-v, vInt);
+            }
+
+            // -(-x) -> x
+            if (auto inner = dynamic_cast<UnaryExpr*>(u->operand)) {
+                if (inner->op == UnaryOp::Neg) {
+                    ExprNode* x = take(inner->operand);
+                    delete u;
+                    return x;
+                }
+            }
+            return u;
+        }
+
+        if (isPower(u)) {
+            auto p = static_cast<BinaryExpr*>(u->operand);
+            double bv, ev; bool bInt, eInt;
+            bool bConst = constValue(p->left, bv, bInt);
+            bool eConst = constValue(p->right, ev, eInt);
+
+            if (eConst && ev == 0) { delete u; return num(1.0); }
+            if (eConst && ev == 1) {
+                ExprNode* base = take(p->left);
+                delete u;
+                return isReal(base) ? base : simplify(bin(num(1.0), BinaryOp::Mul, base));
+            }
+            if (bConst && eConst && !(bv < 0 && ev != std::floor(ev))) {
+                delete u;
+                return num(std::pow(bv, ev));
+            }
+
+            // (a ^ c1) ^ c2 -> a ^ (c1 * c2)
+            if (eConst && isPower(p->left)) {
+                auto innerPow = static_cast<BinaryExpr*>(static_cast<UnaryExpr*>(p->left)->operand);
+                double iv; bool iInt;
+                if (constValue(innerPow->right, iv, iInt)) {
+                    ExprNode* base = take(innerPow->left);
+                    delete u;
+                    return simplify(makePower(base, num(iv * ev)));
+                }
+            }
+            return u;
+        }
+
+        if (isMathFunction(op) && constValue(u->operand, v, vInt)) {
+            double out;
+            if (foldUnary(op, v, out)) { delete u; return num(out); }
+        }
+
+        return u;
+    }
+
+    // --- Differentiation rules ---
+
+    ExprNode* d(const ExprNode* e, const std::string& var);
+
+    ExprNode* dBinary(const BinaryExpr* b, const std::string& var) {
+        BinaryOp op = b->op;
+        const ExprNode* l = b->left;
+        const ExprNode* r = b->right;
+
+        if (op == BinaryOp::Add || op == BinaryOp::Sub) return bin(d(l, var), op, d(r, var));
+
+        // Product rule: l' * r + l * r'
+        if (op == BinaryOp::Mul) {
+            return bin(
+                bin(d(l, var), BinaryOp::Mul, clone(r)),
+                BinaryOp::Add,
+                bin(clone(l), BinaryOp::Mul, d(r, var))
+            );
+        }
+
+        // Quotient rule: (l' * r - l * r') / (r * r)
+        if (op == BinaryOp::Div) {
+            if (!dependsOn(r, var)) return bin(d(l, var), BinaryOp::Div, clone(r));
+
+            return bin(
+                bin(
+                    bin(d(l, var), BinaryOp::Mul, clone(r)),
+                    BinaryOp::Sub,
+                    bin(clone(l), BinaryOp::Mul, d(r, var))
+                ),
+                BinaryOp::Div,
+                bin(clone(r), BinaryOp::Mul, clone(r))
+            );
+        }
+
+        throw std::runtime_error(std::string("operator '") + opName(op) + "' is not differentiable");
+    }
+
+    ExprNode* dPower(const BinaryExpr* p, const std::string& var) {
+        const ExprNode* base = p->left;
+        const ExprNode* ex = p->right;
+
+        bool baseVar = dependsOn(base, var);
+        bool expVar = dependsOn(ex, var);
+
+        // c * base^(c - 1) * base'
+        if (!expVar) {
+            return bin(
+                bin(clone(ex), BinaryOp::Mul, makePower(clone(base), bin(clone(ex), BinaryOp::Sub, num(1.0)))),
+                BinaryOp::Mul,
+                d(base, var)
+            );
+        }
+
+        // a^u * log(a) * u'
+        if (!baseVar) {
+            return bin(
+                bin(makePower(clone(base), clone(ex)), BinaryOp::Mul, un(UnaryOp::Log, clone(base))),
+                BinaryOp::Mul,
+                d(ex, var)
+            );
+        }
+
+        // General case: base^ex * (ex' * log(base) + ex * base' / base)
+        return bin(
+            makePower(clone(base), clone(ex)),
+            BinaryOp::Mul,
+            bin(
+                bin(d(ex, var), BinaryOp::Mul, un(UnaryOp::Log, clone(base))),
+                BinaryOp::Add,
+                bin(bin(clone(ex), BinaryOp::Mul, d(base, var)), BinaryOp::Div, clone(base))
+            )
+        );
+    }
+
+    ExprNode* dUnary(const UnaryExpr* u, const std::string& var) {
+        UnaryOp op = u->op;
+        const ExprNode* x = u->operand;
+
+        if (isPower(u)) return dPower(static_cast<const BinaryExpr*>(x), var);
+
+        if (op == UnaryOp::Neg) return un(UnaryOp::Neg, d(x, var));
+
+        // Chain rule: f'(x) * x'
+        ExprNode* outer = nullptr;
+        if (op == UnaryOp::Sin) outer = un(UnaryOp::Cos, clone(x));
+        else if (op == UnaryOp::Cos) outer = un(UnaryOp::Neg, un(UnaryOp::Sin, clone(x)));
+        else if (op == UnaryOp::Tan) outer = bin(num(1.0), BinaryOp::Div, bin(un(UnaryOp::Cos, clone(x)), BinaryOp::Mul, un(UnaryOp::Cos, clone(x))));
+        else if (op == UnaryOp::Exp) outer = un(UnaryOp::Exp, clone(x));
+        else if (op == UnaryOp::Log) outer = bin(num(1.0), BinaryOp::Div, clone(x));
+        else if (op == UnaryOp::Sqrt) outer = bin(num(1.0), BinaryOp::Div, bin(num(2.0), BinaryOp::Mul, un(UnaryOp::Sqrt, clone(x))));
+        else throw std::runtime_error(std::string("operator '") + opName(op) + "' is not differentiable");
+
+        return bin(outer, BinaryOp::Mul, d(x, var));
+    }
+
+    ExprNode* d(const ExprNode* e, const std::string& var) {
+        if (!dependsOn(e, var)) return num(0.0);
+
+        if (auto id = dynamic_cast<const IdentifierExpr*>(e)) return num(id->name == var ? 1.0 : 0.0);
+        if (auto b = dynamic_cast<const BinaryExpr*>(e)) return dBinary(b, var);
+        if (auto u = dynamic_cast<const UnaryExpr*>(e)) return dUnary(u, var);
+
+        // Higher order derivatives
+        if (auto de = dynamic_cast<const DerivExpr*>(e)) {
+            ExprNode* inner = differentiate(de->expr, de->var);
+            ExprNode* result = nullptr;
+            try { result = d(inner, var); }
+            catch (...) { delete inner; throw; }
+            delete inner;
+            return result;
+        }
+
+        // Leibniz rule: f(b) * b' - f(a) * a' + integral(df/dvar, t, a, b)
+        if (auto ie = dynamic_cast<const IntegralExpr*>(e)) {
+            ExprNode* result = num(0.0);
+
+            if (dependsOn(ie->upper, var)) {
+                result = bin(result, BinaryOp::Add, bin(substitute(ie->expr, ie->var, ie->upper), BinaryOp::Mul, d(ie->upper, var)));
+            }
+            if (dependsOn(ie->lower, var)) {
+                result = bin(result, BinaryOp::Sub, bin(substitute(ie->expr, ie->var, ie->lower), BinaryOp::Mul, d(ie->lower, var)));
+            }
+            if (ie->var != var && dependsOn(ie->expr, var)) {
+                result = bin(result, BinaryOp::Add, new IntegralExpr(d(ie->expr, var), ie->var, clone(ie->lower), clone(ie->upper)));
+            }
+            return result;
+        }
+
+        if (dynamic_cast<const CallExpr*>(e)) throw std::runtime_error("function calls must be inlined before differentiating");
+
+        throw std::runtime_error("expression is not differentiable");
+    }
+
+    void collectFree(const ExprNode* e, std::set<std::string>& out) {
+        if (!e) return;
+
+        if (auto id = dynamic_cast<const IdentifierExpr*>(e)) { out.insert(id->name); return; }
+        if (auto b = dynamic_cast<const BinaryExpr*>(e)) { collectFree(b->left, out); collectFree(b->right, out); return; }
+        if (auto u = dynamic_cast<const UnaryExpr*>(e)) { collectFree(u->operand, out); return; }
+        if (auto de = dynamic_cast<const DerivExpr*>(e)) { collectFree(de->expr, out); return; }
+
+        // The callee names a function value, not a variable
+        if (auto c = dynamic_cast<const CallExpr*>(e)) {
+            for (auto arg : c->args) collectFree(arg, out);
+            return;
+        }
+
+        if (auto fl = dynamic_cast<const FunctionLiteral*>(e)) {
+            std::set<std::string> inner;
+            collectFree(fl->body, inner);
+            for (auto& p : fl->params) inner.erase(p);
+            out.insert(inner.begin(), inner.end());
+            return;
+        }
+
+        if (auto ie = dynamic_cast<const IntegralExpr*>(e)) {
+            std::set<std::string> inner;
+            collectFree(ie->expr, inner);
+            inner.erase(ie->var);
+            out.insert(inner.begin(), inner.end());
+            collectFree(ie->lower, out);
+            collectFree(ie->upper, out);
+        }
+    }
+}
+
+ExprNode* differentiate(const ExprNode* expr, const std::string& var) {
+    return simplify(d(expr, var));
+}
+
+ExprNode* simplify(ExprNode* expr) {
+    if (auto b = dynamic_cast<BinaryExpr*>(expr)) return simplifyBinary(b);
+    if (auto u = dynamic_cast<UnaryExpr*>(expr)) return simplifyUnary(u);
+    return expr;
+}
+
+ExprNode* clone(const ExprNode* expr) {
+    if (!expr) return nullptr;
+
+    if (auto b = dynamic_cast<const BinaryExpr*>(expr)) return bin(clone(b->left), b->op, clone(b->right));
+    if (auto u = dynamic_cast<const UnaryExpr*>(expr)) return un(u->op, clone(u->operand));
+    if (auto id = dynamic_cast<const IdentifierExpr*>(expr)) return new IdentifierExpr(id->name);
+    if (auto i = dynamic_cast<const IntLiteral*>(expr)) return new IntLiteral(i->value);
+    if (auto dl = dynamic_cast<const DoubleLiteral*>(expr)) return new DoubleLiteral(dl->value);
+    if (auto bl = dynamic_cast<const BoolLiteral*>(expr)) return new BoolLiteral(bl->value);
+    if (auto de = dynamic_cast<const DerivExpr*>(expr)) return new DerivExpr(clone(de->expr), de->var);
+    if (auto ie = dynamic_cast<const IntegralExpr*>(expr)) {
+        return new IntegralExpr(clone(ie->expr), ie->var, clone(ie->lower), clone(ie->upper));
+    }
+    if (auto c = dynamic_cast<const CallExpr*>(expr)) {
+        std::vector<ExprNode*> args;
+        for (auto arg : c->args) args.push_back(clone(arg));
+        return new CallExpr(clone(c->callee), args);
+    }
+    if (auto fl = dynamic_cast<const FunctionLiteral*>(expr)) return new FunctionLiteral(fl->params, clone(fl->body));
+
+    throw std::runtime_error("cannot copy expression");
+}
+
+ExprNode* substitute(const ExprNode* expr, const std::string& var, const ExprNode* value) {
+    if (!expr) return nullptr;
+
+    if (auto id = dynamic_cast<const IdentifierExpr*>(expr)) {
+        return id->name == var ? clone(value) : new IdentifierExpr(id->name);
+    }
+    if (auto b = dynamic_cast<const BinaryExpr*>(expr)) {
+        return bin(substitute(b->left, var, value), b->op, substitute(b->right, var, value));
+    }
+    if (auto u = dynamic_cast<const UnaryExpr*>(expr)) return un(u->op, substitute(u->operand, var, value));
+
+    // d/dvar evaluated at var = value: differentiate first, then substitute
+    if (auto de = dynamic_cast<const DerivExpr*>(expr)) {
+        if (de->var != var) return new DerivExpr(substitute(de->expr, var, value), de->var);
+
+        ExprNode* derivative = differentiate(de->expr, de->var);
+        ExprNode* result = substitute(derivative, var, value);
+        delete derivative;
+        return result;
+    }
+
+    if (auto c = dynamic_cast<const CallExpr*>(expr)) {
+        std::vector<ExprNode*> args;
+        for (auto arg : c->args) args.push_back(substitute(arg, var, value));
+        return new CallExpr(clone(c->callee), args);
+    }
+
+    // The integration variable shadows var inside the integrand
+    if (auto ie = dynamic_cast<const IntegralExpr*>(expr)) {
+        ExprNode* body = ie->var == var ? clone(ie->expr) : substitute(ie->expr, var, value);
+        return new IntegralExpr(body, ie->var, substitute(ie->lower, var, value), substitute(ie->upper, var, value));
+    }
+
+    return clone(expr);
+}
+
+namespace {
+
+    ExprNode* inlineCallsRec(const ExprNode* expr, const FunctionLookup& lookup, int depth);
+
+    // Rebuilds a node with every child passed through inlineCallsRec
+    ExprNode* inlineChildren(const ExprNode* expr, const FunctionLookup& lookup, int depth) {
+        if (auto b = dynamic_cast<const BinaryExpr*>(expr)) {
+            return bin(inlineCallsRec(b->left, lookup, depth), b->op, inlineCallsRec(b->right, lookup, depth));
+        }
+        if (auto u = dynamic_cast<const UnaryExpr*>(expr)) return un(u->op, inlineCallsRec(u->operand, lookup, depth));
+        if (auto de = dynamic_cast<const DerivExpr*>(expr)) return new DerivExpr(inlineCallsRec(de->expr, lookup, depth), de->var);
+        if (auto ie = dynamic_cast<const IntegralExpr*>(expr)) {
+            return new IntegralExpr(
+                inlineCallsRec(ie->expr, lookup, depth), ie->var,
+                inlineCallsRec(ie->lower, lookup, depth), inlineCallsRec(ie->upper, lookup, depth)
+            );
+        }
+        return clone(expr);
+    }
+
+    ExprNode* inlineCallsRec(const ExprNode* expr, const FunctionLookup& lookup, int depth) {
+        auto c = dynamic_cast<const CallExpr*>(expr);
+        if (!c) return inlineChildren(expr, lookup, depth);
+
+        auto id = dynamic_cast<const IdentifierExpr*>(c->callee);
+        const FunctionLiteral* fl = id ? lookup(id->name) : nullptr;
+        if (!fl) throw std::runtime_error("call to an unknown function");
+
+        if (depth > 64) throw std::runtime_error("function calls nest too deeply to inline");
+        if (fl->params.size() != c->args.size()) throw std::runtime_error("wrong number of arguments for " + id->name);
+
+        std::vector<std::string> captured = freeVariables(fl);
+        if (!captured.empty()) throw std::runtime_error(id->name + " uses variable " + captured.front() + " from its enclosing scope");
+
+        // Substitute one parameter at a time through fresh placeholder names,
+        // so an argument mentioning another parameter name is left alone
+        ExprNode* body = clone(fl->body);
+        for (size_t k = 0; k < fl->params.size(); ++k) {
+            IdentifierExpr placeholder(" arg" + std::to_string(k));
+            ExprNode* next = substitute(body, fl->params[k], &placeholder);
+            delete body;
+            body = next;
+        }
+        for (size_t k = 0; k < fl->params.size(); ++k) {
+            ExprNode* arg = inlineCallsRec(c->args[k], lookup, depth);
+            ExprNode* next = substitute(body, " arg" + std::to_string(k), arg);
+            delete arg;
+            delete body;
+            body = next;
+        }
+
+        // The body may call other function values
+        ExprNode* result = inlineCallsRec(body, lookup, depth + 1);
+        delete body;
+        return result;
+    }
+}
+
+ExprNode* inlineCalls(const ExprNode* expr, SymbolTable& symbols) {
+    return inlineCalls(expr, [&](const std::string& name) -> const FunctionLiteral* {
+        Symbol* sym = symbols.lookup(name);
+        return sym ? sym->literal : nullptr;
+    });
+}
+
+ExprNode* inlineCalls(const ExprNode* expr, const FunctionLookup& lookup) {
+    return inlineCallsRec(expr, lookup, 0);
+}
+
+std::vector<std::string> freeVariables(const ExprNode* expr) {
+    std::set<std::string> names;
+    collectFree(expr, names);
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
+bool equals(const ExprNode* a, const ExprNode* b) {
+    if (a == b) return true;
+    if (!a || !b) return false;
+
+    if (auto x = dynamic_cast<const BinaryExpr*>(a)) {
+        auto y = dynamic_cast<const BinaryExpr*>(b);
+        return y && x->op == y->op && equals(x->left, y->left) && equals(x->right, y->right);
+    }
+    if (auto x = dynamic_cast<const UnaryExpr*>(a)) {
+        auto y = dynamic_cast<const UnaryExpr*>(b);
+        return y && x->op == y->op && equals(x->operand, y->operand);
+    }
+    if (auto x = dynamic_cast<const IdentifierExpr*>(a)) {
+        auto y = dynamic_cast<const IdentifierExpr*>(b);
+        return y && x->name == y->name;
+    }
+    if (auto x = dynamic_cast<const IntLiteral*>(a)) {
+        auto y = dynamic_cast<const IntLiteral*>(b);
+        return y && x->value == y->value;
+    }
+    if (auto x = dynamic_cast<const DoubleLiteral*>(a)) {
+        auto y = dynamic_cast<const DoubleLiteral*>(b);
+        return y && x->value == y->value;
+    }
+    if (auto x = dynamic_cast<const BoolLiteral*>(a)) {
+        auto y = dynamic_cast<const BoolLiteral*>(b);
+        return y && x->value == y->value;
+    }
+    if (auto x = dynamic_cast<const DerivExpr*>(a)) {
+        auto y = dynamic_cast<const DerivExpr*>(b);
+        return y && x->var == y->var && equals(x->expr, y->expr);
+    }
+    if (auto x = dynamic_cast<const CallExpr*>(a)) {
+        auto y = dynamic_cast<const CallExpr*>(b);
+        if (!y || !equals(x->callee, y->callee) || x->args.size() != y->args.size()) return false;
+        for (size_t k = 0; k < x->args.size(); ++k) {
+            if (!equals(x->args[k], y->args[k])) return false;
+        }
+        return true;
+    }
+    if (auto x = dynamic_cast<const IntegralExpr*>(a)) {
+        auto y = dynamic_cast<const IntegralExpr*>(b);
+        return y && x->var == y->var && equals(x->expr, y->expr) && equals(x->lower, y->lower) && equals(x->upper, y->upper);
+    }
+    return false;
+}
+
+bool dependsOn(const ExprNode* expr, const std::string& var) {
+    if (!expr) return false;
+
+    if (auto id = dynamic_cast<const IdentifierExpr*>(expr)) return id->name == var;
+    if (auto b = dynamic_cast<const BinaryExpr*>(expr)) return dependsOn(b->left, var) || dependsOn(b->right, var);
+    if (auto u = dynamic_cast<const UnaryExpr*>(expr)) return dependsOn(u->operand, var);
+    if (auto de = dynamic_cast<const DerivExpr*>(expr)) return dependsOn(de->expr, var);
+    if (auto ie = dynamic_cast<const IntegralExpr*>(expr)) {
+        return (ie->var != var && dependsOn(ie->expr, var)) || dependsOn(ie->lower, var) || dependsOn(ie->upper, var);
+    }
+    if (auto c = dynamic_cast<const CallExpr*>(expr)) {
+        for (auto arg : c->args) {
+            if (dependsOn(arg, var)) return true;
+        }
+    }
+    return false;
+}
+
+bool isReal(const ExprNode* expr) {
+    if (dynamic_cast<const DoubleLiteral*>(expr)) return true;
+    if (dynamic_cast<const DerivExpr*>(expr)) return true;
+    if (dynamic_cast<const IntegralExpr*>(expr)) return true;
+    if (dynamic_cast<const CallExpr*>(expr)) return true; // function values return doubles
+
+    if (auto u = dynamic_cast<const UnaryExpr*>(expr)) {
+        if (isMathFunction(u->op)) return true;
+        if (u->op == UnaryOp::Neg) return isReal(u->operand);
+        return false;
+    }
+
+    if (auto b = dynamic_cast<const BinaryExpr*>(expr)) {
+        if (isArithmetic(b->op)) {
+            return isReal(b->left) || isReal(b->right);
+        }
+    }
+    return false;
+}
+
+bool isPower(const ExprNode* expr) {
+    auto u = dynamic_cast<const UnaryExpr*>(expr);
+    if (!u || u->op != UnaryOp::Exp) return false;
+
+    auto b = dynamic_cast<const BinaryExpr*>(u->operand);
+    return b && b->op == BinaryOp::Comma;
+}
+
+ExprNode* makePower(ExprNode* base, ExprNode* exponent) {
+    return un(UnaryOp::Exp, bin(base, BinaryOp::Comma, exponent));
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "../ast/ast.h"
+
+// Symbolic differentiation engine over ExprNode trees
+//
+// Powers are written exp(base, exponent), which the parser turns into
+// UnaryExpr(UnaryOp::Exp, BinaryExpr(base, BinaryOp::Comma, exponent)).
+// Every function returning an ExprNode* hands back a fresh tree owned by the caller.
+namespace calculus {
+
+    // d(expr)/d(var), simplified. Throws std::runtime_error on non differentiable input
+    ExprNode* differentiate(const ExprNode* expr, const std::string& var);
+
+    // Algebraic simplifier (constant folding and identities), takes ownership of expr
+    ExprNode* simplify(ExprNode* expr);
+
+    // Deep copy of an expression tree
+    ExprNode* clone(const ExprNode* expr);
+
+    // Structural equality
+    bool equals(const ExprNode* a, const ExprNode* b);
+
+    // True if var appears free in expr
+    bool dependsOn(const ExprNode* expr, const std::string& var);
+
+    // True if expr is statically known to produce a double (used to keep
+    // simplifications from turning real arithmetic back into int arithmetic)
+    bool isReal(const ExprNode* expr);
+
+    // Names referenced by expr that are not bound inside it (sorted, no duplicates)
+    std::vector<std::string> freeVariables(const ExprNode* expr);
+
+    // Copy of expr with every free occurrence of var replaced by a copy of value
+    ExprNode* substitute(const ExprNode* expr, const std::string& var, const ExprNode* value);
+
+    // Copy of expr with calls to function values replaced by their bodies,
+    // so deriv can see through them. Throws for functions with captured variables
+    ExprNode* inlineCalls(const ExprNode* expr, SymbolTable& symbols);
+
+    // Same, with function values resolved by lookup (nullptr for unknown names)
+    typedef std::function<const FunctionLiteral*(const std::string&)> FunctionLookup;
+    ExprNode* inlineCalls(const ExprNode* expr, const FunctionLookup& lookup);
+
+    // Power helpers: exp(base, exponent)
+    bool isPower(const ExprNode* expr);
+    ExprNode* makePower(ExprNode* base, ExprNode* exponent);
+}
@@ -0,0 +1,194 @@
+#include "dual.h"
+#include "deriv.h"
+
+#include <algorithm>
+#include <set>
+
+namespace {
+
+    void add(std::vector<std::string>& seeds, const std::string& var) {
+        if (std::find(seeds.begin(), seeds.end(), var) == seeds.end()) seeds.push_back(var);
+    }
+
+    void collect(const ExprNode* e, std::vector<std::string>& seeds) {
+        if (!e) return;
+
+        if (auto b = dynamic_cast<const BinaryExpr*>(e)) { collect(b->left, seeds); collect(b->right, seeds); return; }
+        if (auto u = dynamic_cast<const UnaryExpr*>(e)) { collect(u->operand, seeds); return; }
+        if (auto a = dynamic_cast<const AssignmentExpr*>(e)) { collect(a->expr, seeds); return; }
+        if (auto fl = dynamic_cast<const FunctionLiteral*>(e)) { collect(fl->body, seeds); return; }
+
+        if (auto de = dynamic_cast<const DerivExpr*>(e)) {
+            collect(de->expr, seeds);
+            add(seeds, de->var);
+            return;
+        }
+
+        if (auto c = dynamic_cast<const CallExpr*>(e)) {
+            for (auto arg : c->args) collect(arg, seeds);
+            return;
+        }
+
+        if (auto ie = dynamic_cast<const IntegralExpr*>(e)) {
+            collect(ie->expr, seeds);
+            collect(ie->lower, seeds);
+            collect(ie->upper, seeds);
+        }
+    }
+
+    void collect(const StmtNode* s, std::vector<std::string>& seeds) {
+        if (!s) return;
+
+        if (auto es = dynamic_cast<const ExprStmt*>(s)) { collect(es->expr, seeds); return; }
+        if (auto vd = dynamic_cast<const VarDeclStmt*>(s)) { collect(vd->init, seeds); return; }
+        if (auto ps = dynamic_cast<const PrintStmt*>(s)) { collect(ps->value, seeds); return; }
+
+        if (auto bs = dynamic_cast<const BlockStmt*>(s)) {
+            for (auto stmt : bs->statements) collect(stmt, seeds);
+            return;
+        }
+
+        if (auto is = dynamic_cast<const IfStmt*>(s)) {
+            collect(is->condition, seeds);
+            collect(is->thenBranch, seeds);
+            collect(is->elseBranch, seeds);
+            return;
+        }
+
+        if (auto ws = dynamic_cast<const WhileStmt*>(s)) {
+            collect(ws->condition, seeds);
+            collect(ws->body, seeds);
+            return;
+        }
+
+        if (auto fs = dynamic_cast<const ForStmt*>(s)) {
+            collect(fs->init, seeds);
+            collect(fs->condition, seeds);
+            collect(fs->step, seeds);
+            collect(fs->body, seeds);
+        }
+    }
+
+    // Names of the function values expr calls
+    void collectCallees(const ExprNode* e, std::set<std::string>& out) {
+        if (!e) return;
+
+        if (auto b = dynamic_cast<const BinaryExpr*>(e)) { collectCallees(b->left, out); collectCallees(b->right, out); return; }
+        if (auto u = dynamic_cast<const UnaryExpr*>(e)) { collectCallees(u->operand, out); return; }
+        if (auto de = dynamic_cast<const DerivExpr*>(e)) { collectCallees(de->expr, out); return; }
+
+        if (auto c = dynamic_cast<const CallExpr*>(e)) {
+            if (auto id = dynamic_cast<const IdentifierExpr*>(c->callee)) out.insert(id->name);
+            for (auto arg : c->args) collectCallees(arg, out);
+            return;
+        }
+
+        if (auto ie = dynamic_cast<const IntegralExpr*>(e)) {
+            collectCallees(ie->expr, out);
+            collectCallees(ie->lower, out);
+            collectCallees(ie->upper, out);
+        }
+    }
+
+    // The variables expr reads, directly or as captures of the functions it calls
+    std::vector<std::string> readVariables(codegen_ctx& ctx, const ExprNode* expr) {
+        std::set<std::string> names;
+        for (const std::string& name : calculus::freeVariables(expr)) names.insert(name);
+
+        std::set<std::string> pending, seen;
+        collectCallees(expr, pending);
+        while (!pending.empty()) {
+            std::string callee = *pending.begin();
+            pending.erase(pending.begin());
+            if (!seen.insert(callee).second) continue;
+
+            Symbol* sym = ctx.symTable->lookup(callee);
+            if (!sym || !sym->literal) continue;
+            for (const std::string& name : calculus::freeVariables(sym->literal)) names.insert(name);
+            collectCallees(sym->literal->body, pending);
+        }
+        return std::vector<std::string>(names.begin(), names.end());
+    }
+}
+
+namespace calculus {
+
+std::vector<std::string> collectDerivVars(const Program* program) {
+    std::vector<std::string> seeds;
+    for (auto stmt : program->statements) collect(stmt, seeds);
+    return seeds;
+}
+
+void collectDerivVars(const StmtNode* stmt, std::vector<std::string>& seeds) {
+    collect(stmt, seeds);
+}
+
+int seedIndex(const codegen_ctx& ctx, const std::string& var) {
+    auto it = std::find(ctx.adSeeds.begin(), ctx.adSeeds.end(), var);
+    return it == ctx.adSeeds.end() ? -1 : static_cast<int>(it - ctx.adSeeds.begin());
+}
+
+bool hasTangents(codegen_ctx& ctx, const ExprNode* expr, const std::string& except) {
+    for (const std::string& name : freeVariables(expr)) {
+        if (name == except) continue;
+        Symbol* sym = ctx.symTable->lookup(name);
+        if (sym && !sym->tangents.empty()) return true;
+    }
+    return false;
+}
+
+DualValue dualOpaque(codegen_ctx& ctx, ExprNode* expr) {
+    DualValue result;
+    result.primal = expr->codegen(ctx);
+    if (!result.primal || !result.primal->getType()->isDoubleTy()) return result;
+
+    llvm::IRBuilder<>& B = ctx.builder;
+    std::vector<llvm::Value*> sums(ctx.adSeeds.size(), nullptr);
+
+    // Captures count too: inlining reports them rather than leaving their tangent out
+    for (const std::string& name : readVariables(ctx, expr)) {
+        Symbol* sym = ctx.symTable->lookup(name);
+        if (!sym || sym->tangents.empty()) continue;
+
+        // d(expr)/d(name) with every other variable held constant
+        ExprNode* inlined = nullptr;
+        ExprNode* partial = nullptr;
+        try {
+            inlined = inlineCalls(expr, *ctx.symTable);
+            partial = differentiate(inlined, name);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << "Failed to differentiate with respect to " << name << ": " << e.what() << std::endl;
+        }
+        delete inlined;
+        if (!partial) return {};
+
+        auto lit = dynamic_cast<DoubleLiteral*>(partial);
+        if (lit && lit->value == 0.0) { delete partial; continue; }
+
+        llvm::Value* p = partial->codegen(ctx);
+        delete partial;
+        if (p) p = ctx.toDouble(p);
+        if (!p) {
+            std::cerr << "Failed to generate code for partial derivative with respect to " << name << "." << std::endl;
+            return {};
+        }
+
+        for (size_t j = 0; j < sums.size(); ++j) {
+            llvm::Value* t = ctx.readVariable(sym->tangents[j]);
+            llvm::Value* term = (lit && lit->value == 1.0) ? t : B.CreateFMul(p, t, "d.multmp");
+            sums[j] = sums[j] ? B.CreateFAdd(sums[j], term, "d.addtmp") : term;
+        }
+    }
+
+    if (sums.empty() || !sums[0]) return result;
+    result.tangents = sums;
+    return result;
+}
+
+llvm::Value* tangentAt(codegen_ctx& ctx, const DualValue& dual, size_t j) {
+    if (dual.tangents.empty()) return llvm::ConstantFP::get(ctx.builder.getDoubleTy(), 0.0);
+    return dual.tangents[j];
+}
+
+}
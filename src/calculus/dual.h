@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../ast/ast.h"
+
+// Forward-mode automatic differentiation
+//
+// Every variable named as the second argument of a deriv(...) in the program is a
+// seed. Under AD each double variable carries one tangent slot per seed next to its
+// value, and expressions are compiled to dual numbers (ExprNode::codegenDual), so
+// d(y)/d(seed) survives through assignments instead of being expanded symbolically.
+namespace calculus {
+
+    // Seed variables of a program, in order of first use
+    std::vector<std::string> collectDerivVars(const Program* program);
+
+    // Adds the seeds of one statement to seeds, for programs seen a statement at a time
+    void collectDerivVars(const StmtNode* stmt, std::vector<std::string>& seeds);
+
+    // Position of var in ctx.adSeeds, -1 if var is not a seed
+    int seedIndex(const codegen_ctx& ctx, const std::string& var);
+
+    // True if a free variable of expr (other than except) carries tangents
+    bool hasTangents(codegen_ctx& ctx, const ExprNode* expr, const std::string& except = "");
+
+    // Dual value of a node without a dedicated tangent rule: the primal is the
+    // normal codegen and the tangents come from symbolic partials of expr with
+    // respect to each of its variables that carry tangents (chain rule)
+    DualValue dualOpaque(codegen_ctx& ctx, ExprNode* expr);
+
+    // Tangent j of a dual value, 0.0 when the value has no tangents
+    llvm::Value* tangentAt(codegen_ctx& ctx, const DualValue& dual, size_t j);
+
+}
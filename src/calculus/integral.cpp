@@ -0,0 +1,96 @@
+#include "integral.h"
+
+namespace calculus {
+
+llvm::Function* emitIntegrand(codegen_ctx& ctx, ExprNode* body, const std::string& var, const std::vector<Symbol>& captures) {
+    llvm::LLVMContext& C = ctx.context;
+    llvm::IRBuilder<>& B = ctx.builder;
+
+    llvm::Type* dbl = llvm::Type::getDoubleTy(C);
+    llvm::Type* dblPtr = dbl->getPointerTo();
+    llvm::Type* i64 = llvm::Type::getInt64Ty(C);
+
+    llvm::FunctionType* fnType = llvm::FunctionType::get(llvm::Type::getVoidTy(C), {dblPtr, dblPtr, i64, dblPtr}, false);
+    llvm::Function* fn = llvm::Function::Create(fnType, llvm::Function::InternalLinkage, "integrand", ctx.module.get());
+
+    auto args = fn->arg_begin();
+    llvm::Argument* xs = &*args++;
+    llvm::Argument* ys = &*args++;
+    llvm::Argument* n = &*args++;
+    llvm::Argument* env = &*args++;
+    xs->setName("xs");
+    ys->setName("ys");
+    n->setName("n");
+    env->setName("env");
+
+    // Distinct node and result buffers, lets the loop vectorize without runtime checks
+    xs->addAttr(llvm::Attribute::NoAlias);
+    xs->addAttr(llvm::Attribute::ReadOnly);
+    ys->addAttr(llvm::Attribute::NoAlias);
+    env->addAttr(llvm::Attribute::ReadOnly);
+
+    llvm::IRBuilderBase::InsertPoint savedIP = B.saveIP();
+
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(C, "entry", fn);
+    llvm::BasicBlock* header = llvm::BasicBlock::Create(C, "loop", fn);
+    llvm::BasicBlock* loopBody = llvm::BasicBlock::Create(C, "body", fn);
+    llvm::BasicBlock* exit = llvm::BasicBlock::Create(C, "exit", fn);
+
+    // Captures and the integration variable are locals of the integrand,
+    // the new scope hides every variable of the enclosing function
+    ctx.symTable->pushScope();
+    B.SetInsertPoint(entry);
+
+    for (size_t k = 0; k < captures.size(); ++k) {
+        const Symbol& cap = captures[k];
+
+        llvm::Value* slot = B.CreateConstInBoundsGEP1_64(dbl, env, k, cap.name + ".env");
+        llvm::Value* val = B.CreateLoad(dbl, slot, cap.name);
+
+        if (cap.type->isIntegerTy(1)) val = B.CreateFCmpUNE(val, llvm::ConstantFP::get(dbl, 0.0), cap.name);
+        else if (cap.type->isIntegerTy()) val = B.CreateFPToSI(val, cap.type, cap.name);
+
+        Symbol* local = ctx.symTable->declare(cap.name, cap.type);
+        ctx.writeVariable(local->variable, val);
+    }
+
+    SSAVariable* x = ctx.symTable->declare(var, dbl)->variable;
+    B.CreateBr(header);
+
+    // for (i = 0; i < n; ++i) ys[i] = body(xs[i]), the back edge is added after the body
+    ctx.symTable->ssa().markUnsealed(header);
+    B.SetInsertPoint(header);
+    llvm::PHINode* i = B.CreatePHI(i64, 2, "i");
+    i->addIncoming(llvm::ConstantInt::get(i64, 0), entry);
+    B.CreateCondBr(B.CreateICmpSLT(i, n, "cond"), loopBody, exit);
+
+    B.SetInsertPoint(loopBody);
+    ctx.writeVariable(x, B.CreateLoad(dbl, B.CreateInBoundsGEP(dbl, xs, i, "x.addr"), var));
+
+    llvm::Value* y = body->codegen(ctx);
+
+    if (y && y->getType()->isIntegerTy() && !y->getType()->isIntegerTy(1)) y = B.CreateSIToFP(y, dbl, "int_to_double");
+    if (!y || !y->getType()->isDoubleTy()) {
+        if (y) std::cerr << "Integrand must be numeric." << std::endl;
+        ctx.symTable->popScope();
+        ctx.symTable->ssa().seal(header);
+        fn->eraseFromParent();
+        B.restoreIP(savedIP);
+        return nullptr;
+    }
+
+    B.CreateStore(y, B.CreateInBoundsGEP(dbl, ys, i, "y.addr"));
+    llvm::Value* next = B.CreateAdd(i, llvm::ConstantInt::get(i64, 1), "i.next", true, true);
+    i->addIncoming(next, B.GetInsertBlock());
+    B.CreateBr(header);
+    ctx.symTable->ssa().seal(header);
+
+    B.SetInsertPoint(exit);
+    B.CreateRetVoid();
+
+    ctx.symTable->popScope();
+    B.restoreIP(savedIP);
+    return fn;
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../ast/ast.h"
+
+namespace calculus {
+
+    // Emits the batch integrand for integral(body, var, a, b):
+    //
+    //     void integrand(const double* xs, double* ys, i64 n, const double* env)
+    //
+    // ys[i] = body evaluated at var = xs[i]. Every other variable the body uses is
+    // a capture, read from env[k] in the order given (values are passed as doubles).
+    // The insertion point of ctx.builder is preserved. Returns nullptr on failure.
+    llvm::Function* emitIntegrand(codegen_ctx& ctx, ExprNode* body, const std::string& var, const std::vector<Symbol>& captures);
+
+}
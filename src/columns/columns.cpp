@@ -0,0 +1,124 @@
+#include "columns.h"
+#include "../calculus/deriv.h"
+#include "../parser/parser.h"
+#include "../runtime/quadrature.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <llvm/Support/ThreadPool.h>
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+ColumnKernel::~ColumnKernel() = default;
+
+std::unique_ptr<ColumnKernel> ColumnKernel::compile(const std::string& expression, const std::vector<std::string>& columns,
+                                                    const ColumnOptions& opts, std::string& error) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Parsed as the initializer of a declaration, the only statement allowed
+    std::unique_ptr<Lexer> lexer = Lexer::fromSource("double kernel = " + expression + ";");
+    lexer->setDebug(false);
+    std::unique_ptr<Parser> parser;
+    try {
+        lexer->tokenize();
+        parser.reset(new Parser(lexer->getTokens()));
+    } catch (const std::runtime_error& e) {
+        error = std::string("syntax error: ") + e.what();
+        return nullptr;
+    }
+
+    Program* program = parser->getProgram();
+    auto decl = program->statements.size() == 1 ? dynamic_cast<VarDeclStmt*>(program->statements[0]) : nullptr;
+    if (!decl || !decl->init) {
+        error = "not a single expression: " + expression;
+        return nullptr;
+    }
+
+    std::unique_ptr<ColumnKernel> kernel(new ColumnKernel());
+    kernel->options = opts;
+    kernel->names = columns;
+    std::vector<std::string> free = calculus::freeVariables(decl->init);
+    if (kernel->names.empty()) kernel->names = free;
+    for (const std::string& var : free) {
+        if (std::find(kernel->names.begin(), kernel->names.end(), var) == kernel->names.end()) {
+            error = "no column for variable " + var;
+            return nullptr;
+        }
+    }
+
+    // The columns are the parameters of a function value, the literal takes the expression over
+    FunctionLiteral literal(kernel->names, decl->init);
+    decl->init = nullptr;
+
+    codegen_ctx ctx("crunch.columns");
+    llvm::Function* scalar = nullptr;
+    llvm::Function* batch = nullptr;
+    if (!literal.emit(ctx, "kernel", scalar, batch)) {
+        error = "can't compile " + expression;
+        return nullptr;
+    }
+
+    // double crunch.fn.kernel.row(const double* values), the scalar entry with its arguments in memory
+    llvm::IRBuilder<>& B = ctx.builder;
+    llvm::Type* dbl = B.getDoubleTy();
+    llvm::FunctionType* rowType = llvm::FunctionType::get(dbl, {dbl->getPointerTo()}, false);
+    llvm::Function* row = llvm::Function::Create(rowType, llvm::Function::ExternalLinkage, scalar->getName() + ".row", ctx.module.get());
+    llvm::Argument* values = row->getArg(0);
+    values->setName("values");
+    values->addAttr(llvm::Attribute::ReadOnly);
+    B.SetInsertPoint(llvm::BasicBlock::Create(ctx.context, "entry", row));
+    std::vector<llvm::Value*> args;
+    for (size_t k = 0; k < kernel->names.size(); ++k) {
+        args.push_back(B.CreateLoad(dbl, B.CreateConstInBoundsGEP1_64(dbl, values, k), kernel->names[k]));
+    }
+    B.CreateRet(B.CreateCall(scalar, args));
+
+    std::vector<std::string> symbols = { batch->getName().str(), row->getName().str() };
+    std::vector<void*> addresses;
+    kernel->jit = IncrementalJIT::create(opts.optimizer, error);
+    if (!kernel->jit || !kernel->jit->compile(ctx, symbols, addresses, error)) return nullptr;
+    kernel->code = (BatchCode)addresses[0];
+    kernel->row = (RowCode)addresses[1];
+
+    // The calling thread works too
+    unsigned threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (threads > 1) kernel->pool.reset(new llvm::ThreadPool(llvm::hardware_concurrency(threads - 1)));
+
+    kernel->compileTime = msSince(start);
+    return kernel;
+}
+
+void ColumnKernel::evaluate(const double* const* cols, double* out, size_t rows) const {
+    size_t block = std::max<size_t>(options.blockRows, 1);
+    size_t blocks = (rows + block - 1) / block;
+
+    std::vector<std::shared_future<void>> helpers;
+    size_t workers = pool ? std::min<size_t>(pool->getThreadCount() + 1, blocks) : 1;
+    unsigned integralThreads = std::max<unsigned>(1, std::thread::hardware_concurrency() / std::max<size_t>(workers, 1));
+
+    // Threads claim blocks in row order until none are left, integrals in the
+    // expression split what the threads leave over
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        setIntegralThreads(integralThreads);
+        std::vector<const double*> shifted(names.size());
+        for (size_t b = next++; b < blocks; b = next++) {
+            size_t first = b * block;
+            for (size_t k = 0; k < names.size(); ++k) shifted[k] = cols[k] + first;
+            code(shifted.data(), out + first, (int64_t)std::min(block, rows - first));
+        }
+    };
+
+    for (size_t t = 1; t < workers; ++t) helpers.push_back(pool->async(work));
+    work();
+    for (auto& helper : helpers) helper.wait();
+    setIntegralThreads(0);
+}
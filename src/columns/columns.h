@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "../jit/jit.h"
+
+namespace llvm { class ThreadPool; }
+
+// Columnar evaluation: one Crunch expression over arrays of inputs (--eval)
+//
+// The expression's free variables are bound to input columns, contiguous
+// arrays of doubles with one entry per row. It is compiled once as the batch
+// entry of a function value (see FunctionLiteral::emit),
+//
+//     void crunch.fn.kernel.batch(const double** cols, double* out, i64 n)
+//     double crunch.fn.kernel.row(const double* values)
+//
+// whose loop LLVM vectorizes. evaluate() runs the kernel over cache-sized
+// blocks of rows, spread over a thread pool. The row entry evaluates a single
+// set of values, for callers with one row at a time (api/crunch.h).
+
+struct ColumnOptions {
+    OptimizerOptions optimizer;
+    unsigned threads = 0; // 0 = one per hardware thread
+    size_t blockRows = 4096; // rows per kernel call, sized so a block's columns stay in cache
+};
+
+class ColumnKernel {
+    public:
+        typedef void (*BatchCode)(const double* const* cols, double* out, int64_t n);
+        typedef double (*RowCode)(const double* values);
+
+        ~ColumnKernel();
+
+        // Compiles expression with columns as its variables, in this order.
+        // Without columns, the expression's free variables (sorted) are the
+        // columns. nullptr with the reason in error
+        static std::unique_ptr<ColumnKernel> compile(const std::string& expression, const std::vector<std::string>& columns,
+                                                     const ColumnOptions& opts, std::string& error);
+
+        const std::vector<std::string>& columns() const { return names; }
+        double compileMs() const { return compileTime; }
+
+        // out[i] = the expression on row i of cols (one pointer per column), for i
+        // in [0, rows). Safe to call from several threads at once
+        void evaluate(const double* const* cols, double* out, size_t rows) const;
+
+        // One block of rows on the calling thread, no pool
+        void evaluateBlock(const double* const* cols, double* out, size_t rows) const { code(cols, out, (int64_t)rows); }
+
+        // One row, values in column order
+        double evaluateRow(const double* values) const { return row(values); }
+        RowCode rowCode() const { return row; }
+
+    private:
+        std::vector<std::string> names;
+        ColumnOptions options;
+        BatchCode code = nullptr;
+        RowCode row = nullptr;
+        double compileTime = 0.0;
+        std::unique_ptr<IncrementalJIT> jit; // owns the code
+        std::unique_ptr<llvm::ThreadPool> pool;
+
+        ColumnKernel() = default;
+};
@@ -0,0 +1,283 @@
+#include "jit.h"
+#include "partition.h"
+#include "../runtime/error.h"
+#include "../runtime/print.h"
+#include "../runtime/quadrature.h"
+#include "../runtime/str.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Runtime entry points referenced by generated code. They live in this
+    // executable, which does not export its symbols, so they are defined by address
+    llvm::orc::SymbolMap runtimeSymbols(llvm::orc::LLJIT& jit) {
+        llvm::orc::SymbolMap symbols;
+        auto add = [&](const char* name, void* address) {
+            symbols[jit.mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(
+                llvm::pointerToJITTargetAddress(address), llvm::JITSymbolFlags::Exported
+            );
+        };
+
+        add("crunch_print", (void*)&crunch_print);
+        add("crunch_str_concat", (void*)&crunch_str_concat);
+        add("crunch_str_equal", (void*)&crunch_str_equal);
+        add("crunch_str_from_int", (void*)&crunch_str_from_int);
+        add("crunch_str_from_double", (void*)&crunch_str_from_double);
+        add("crunch_str_from_bool", (void*)&crunch_str_from_bool);
+        add("crunch_str_collect", (void*)&crunch_str_collect);
+        add("crunch_integrate", (void*)&crunch_integrate);
+        add("crunch_runtime_error", (void*)&crunch_runtime_error);
+        return symbols;
+    }
+
+    int fail(llvm::Error err) {
+        std::cerr << "JIT error: " << llvm::toString(std::move(err)) << std::endl;
+        return -1;
+    }
+
+    // Host target, used by the optimizer's cost models and for machine code
+    llvm::Expected<llvm::orc::JITTargetMachineBuilder> hostTarget(int level) {
+        // Once per process, formulas may be compiled on several threads (see api/crunch.h)
+        static std::once_flag initialized;
+        std::call_once(initialized, []() {
+            llvm::InitializeNativeTarget();
+            llvm::InitializeNativeTargetAsmPrinter();
+        });
+
+        auto target = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if (!target) return target.takeError();
+        target->setCodeGenOptLevel(level == 0 ? llvm::CodeGenOpt::None :
+                                   level == 1 ? llvm::CodeGenOpt::Less :
+                                   level == 3 ? llvm::CodeGenOpt::Aggressive : llvm::CodeGenOpt::Default);
+        return target;
+    }
+
+    // Vectorized math calls resolve into libmvec, which this process does not link
+    bool loadVectorMath() {
+        return !llvm::sys::DynamicLibrary::LoadLibraryPermanently("libmvec.so.1");
+    }
+
+    // JIT with the runtime and the host's libc/libm visible to generated code
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> createJIT(llvm::orc::JITTargetMachineBuilder target, DiskObjectCache* cache) {
+        llvm::orc::LLJITBuilder builder;
+        builder.setJITTargetMachineBuilder(std::move(target));
+        if (cache) {
+            // Compiled objects are handed to the cache before linking
+            builder.setCompileFunctionCreator([cache](llvm::orc::JITTargetMachineBuilder jtmb)
+                    -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                return std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(jtmb), cache);
+            });
+        }
+
+        auto jit = builder.create();
+        if (!jit) return jit.takeError();
+
+        llvm::orc::JITDylib& lib = (*jit)->getMainJITDylib();
+        if (auto err = lib.define(llvm::orc::absoluteSymbols(runtimeSymbols(**jit)))) return err;
+
+        // libc and libm (sin, memcpy, ...) come from the host process
+        auto host = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess((*jit)->getDataLayout().getGlobalPrefix());
+        if (!host) return host.takeError();
+        lib.addGenerator(std::move(*host));
+        return jit;
+    }
+
+    // Optimizes and compiles the units of module concurrently, every worker in its own
+    // LLVMContext parsed from the module's bitcode. Objects are in unit order
+    llvm::Expected<std::vector<std::unique_ptr<llvm::MemoryBuffer>>> compileUnits(
+            llvm::Module& module, const OptimizerOptions& opts, const llvm::orc::JITTargetMachineBuilder& target, unsigned jobs) {
+        std::vector<std::set<std::string>> units = partitionModule(module, jobs);
+
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream stream(bitcode);
+        llvm::WriteBitcodeToFile(module, stream);
+        llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), module.getModuleIdentifier());
+
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects(units.size());
+        std::vector<std::string> errors(units.size());
+
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t k = 0; k < units.size(); ++k) {
+            pool.async([&, k]() {
+                llvm::LLVMContext context;
+                auto unit = llvm::parseBitcodeFile(buffer, context);
+                if (!unit) { errors[k] = llvm::toString(unit.takeError()); return; }
+                extractUnit(**unit, units[k], k == 0);
+
+                llvm::orc::JITTargetMachineBuilder unitTarget = target;
+                auto machine = unitTarget.createTargetMachine();
+                if (!machine) { errors[k] = llvm::toString(machine.takeError()); return; }
+                if (!optimizeModule(**unit, opts, machine->get())) { errors[k] = "optimization failed"; return; }
+
+                auto object = llvm::orc::SimpleCompiler(**machine)(**unit);
+                if (!object) { errors[k] = llvm::toString(object.takeError()); return; }
+                objects[k] = std::move(*object);
+            });
+        }
+        pool.wait();
+
+        for (size_t k = 0; k < units.size(); ++k) {
+            if (!errors[k].empty()) {
+                return llvm::make_error<llvm::StringError>("unit " + std::to_string(k) + ": " + errors[k], llvm::inconvertibleErrorCode());
+            }
+        }
+        return objects;
+    }
+
+    // Lookup materializes whatever was added: this is where machine code is generated or linked
+    int runEntry(llvm::orc::LLJIT& jit, JITTimings& timings, std::chrono::steady_clock::time_point compileStart) {
+        auto entry = jit.lookup("crunch_main");
+        if (!entry) return fail(entry.takeError());
+        timings.compile = msSince(compileStart);
+
+        auto main = reinterpret_cast<int (*)()>(entry->getAddress());
+
+        auto executeStart = std::chrono::steady_clock::now();
+        int result = crunch_run_main(main);
+        crunch_flush();
+        crunch_str_reset();
+        timings.execute = msSince(executeStart);
+
+        return result;
+    }
+}
+
+int runJIT(codegen_ctx& ctx, JITTimings& timings, const OptimizerOptions& opts, DiskObjectCache* cache, unsigned jobs) {
+    auto target = hostTarget(opts.level);
+    if (!target) return fail(target.takeError());
+
+    if (llvm::verifyModule(*ctx.module, &llvm::errs())) {
+        std::cerr << "Generated module is invalid." << std::endl;
+        return -1;
+    }
+
+    auto machine = target->createTargetMachine();
+    if (!machine) return fail(machine.takeError());
+    ctx.module->setTargetTriple((*machine)->getTargetTriple().str());
+    ctx.module->setDataLayout((*machine)->createDataLayout());
+
+    // Without libmvec loops keep the scalar calls
+    OptimizerOptions pipeline = opts;
+    if (pipeline.vecLib == "libmvec" && !loadVectorMath()) pipeline.vecLib = "none";
+
+    // The cache keeps one object per program
+    if (cache) jobs = 1;
+
+    if (jobs > 1) {
+        auto unitsStart = std::chrono::steady_clock::now();
+        auto objects = compileUnits(*ctx.module, pipeline, *target, jobs);
+        if (!objects) return fail(objects.takeError());
+        timings.optimize = msSince(unitsStart);
+        timings.units = objects->size();
+        timings.split = true;
+
+        auto linkStart = std::chrono::steady_clock::now();
+        auto jit = createJIT(std::move(*target), nullptr);
+        if (!jit) return fail(jit.takeError());
+        for (auto& object : *objects) {
+            if (auto err = (*jit)->addObjectFile(std::move(object))) return fail(std::move(err));
+        }
+        return runEntry(**jit, timings, linkStart);
+    }
+
+    auto optimizeStart = std::chrono::steady_clock::now();
+    if (!optimizeModule(*ctx.module, pipeline, machine->get())) return -1;
+    timings.optimize = msSince(optimizeStart);
+
+    auto compileStart = std::chrono::steady_clock::now();
+
+    auto jit = createJIT(std::move(*target), cache);
+    if (!jit) return fail(jit.takeError());
+
+    ctx.builder.ClearInsertionPoint();
+    llvm::orc::ThreadSafeModule tsm(std::move(ctx.module), llvm::orc::ThreadSafeContext(std::move(ctx.ownedContext)));
+    if (auto err = (*jit)->addIRModule(std::move(tsm))) return fail(std::move(err));
+
+    return runEntry(**jit, timings, compileStart);
+}
+
+int runCachedObject(std::unique_ptr<llvm::MemoryBuffer> object, JITTimings& timings) {
+    auto target = hostTarget(2);
+    if (!target) return fail(target.takeError());
+    loadVectorMath(); // the object may call libmvec
+
+    auto compileStart = std::chrono::steady_clock::now();
+
+    auto jit = createJIT(std::move(*target), nullptr);
+    if (!jit) return fail(jit.takeError());
+    if (auto err = (*jit)->addObjectFile(std::move(object))) return fail(std::move(err));
+
+    return runEntry(**jit, timings, compileStart);
+}
+
+IncrementalJIT::~IncrementalJIT() = default;
+
+std::unique_ptr<IncrementalJIT> IncrementalJIT::create(const OptimizerOptions& opts, std::string& error) {
+    auto target = hostTarget(opts.level);
+    if (!target) { error = llvm::toString(target.takeError()); return nullptr; }
+
+    std::unique_ptr<IncrementalJIT> result(new IncrementalJIT());
+    result->opts = opts;
+    if (result->opts.vecLib == "libmvec" && !loadVectorMath()) result->opts.vecLib = "none";
+
+    auto machine = target->createTargetMachine();
+    if (!machine) { error = llvm::toString(machine.takeError()); return nullptr; }
+    result->machine = std::move(*machine);
+
+    auto jit = createJIT(std::move(*target), nullptr);
+    if (!jit) { error = llvm::toString(jit.takeError()); return nullptr; }
+    result->jit = std::move(*jit);
+    return result;
+}
+
+void* IncrementalJIT::compile(codegen_ctx& ctx, const std::string& symbol, std::string& error) {
+    std::vector<void*> addresses;
+    return compile(ctx, {symbol}, addresses, error) ? addresses[0] : nullptr;
+}
+
+bool IncrementalJIT::compile(codegen_ctx& ctx, const std::vector<std::string>& symbols, std::vector<void*>& addresses, std::string& error) {
+    llvm::Module& module = *ctx.module;
+    std::string message;
+    llvm::raw_string_ostream verify(message);
+    if (llvm::verifyModule(module, &verify)) { error = "invalid module: " + verify.str(); return false; }
+
+    module.setTargetTriple(machine->getTargetTriple().str());
+    module.setDataLayout(machine->createDataLayout());
+
+    // Every module defines crunch.fn.* of its own, only the entry points are visible
+    for (llvm::GlobalValue& g : module.global_values()) {
+        bool entry = std::find(symbols.begin(), symbols.end(), g.getName().str()) != symbols.end();
+        if (!g.isDeclaration() && !entry) g.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+    if (!optimizeModule(module, opts, machine.get())) { error = "optimization failed"; return false; }
+
+    ctx.builder.ClearInsertionPoint();
+    llvm::orc::ThreadSafeModule tsm(std::move(ctx.module), llvm::orc::ThreadSafeContext(std::move(ctx.ownedContext)));
+    if (auto err = jit->addIRModule(std::move(tsm))) { error = llvm::toString(std::move(err)); return false; }
+
+    addresses.clear();
+    for (const std::string& symbol : symbols) {
+        auto address = jit->lookup(symbol);
+        if (!address) { error = llvm::toString(address.takeError()); return false; }
+        addresses.push_back((void*)address->getAddress());
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../ast/ast.h"
+#include "../opt/optimizer.h"
+#include "object_cache.h"
+
+namespace llvm { namespace orc { class LLJIT; } }
+
+// Native execution of compiled programs through LLVM ORC LLJIT
+
+struct JITTimings {
+    double optimize = 0.0; // IR pass pipeline (ms), with units also their machine code
+    double compile = 0.0; // IR to machine code (ms), with units linking only
+    double execute = 0.0; // crunch_main (ms)
+    unsigned units = 1; // compilation units built concurrently
+    bool split = false; // compiled as units (jobs > 1), even if there was just one
+};
+
+// Optimizes the module of ctx (which must contain crunch_main, see
+// Program::codegenEntry), compiles it to native code for the host and runs it. The module and its context
+// are handed over to the JIT, ctx can't generate code afterwards.
+// Returns the result of crunch_main, -1 if the module could not be compiled.
+// With a cache the machine code is stored under the module identifier (the cache key).
+// jobs > 1 splits the module into up to that many units optimized and compiled on a
+// thread pool (see partition.h), programs with a cache are compiled as one unit.
+int runJIT(codegen_ctx& ctx, JITTimings& timings, const OptimizerOptions& opts = OptimizerOptions(),
+           DiskObjectCache* cache = nullptr, unsigned jobs = 1);
+
+// Links an object from the cache and runs its crunch_main, nothing is compiled
+int runCachedObject(std::unique_ptr<llvm::MemoryBuffer> object, JITTimings& timings);
+
+// One JIT session that modules are added to one at a time, for tiered execution
+// (tier/tier.h) and column kernels (columns/columns.h). Not thread safe, use it
+// from one thread; the code it returns can run on any
+class IncrementalJIT {
+    public:
+        ~IncrementalJIT();
+
+        // nullptr with the reason in error if the host target isn't available
+        static std::unique_ptr<IncrementalJIT> create(const OptimizerOptions& opts, std::string& error);
+
+        // Optimizes the module of ctx, in which everything but symbol is made
+        // internal, compiles it and returns the address of symbol. The module
+        // and its context are handed over, like with runJIT. nullptr on failure
+        void* compile(codegen_ctx& ctx, const std::string& symbol, std::string& error);
+
+        // Same for modules with several entry points, addresses in symbols order. False on failure
+        bool compile(codegen_ctx& ctx, const std::vector<std::string>& symbols, std::vector<void*>& addresses, std::string& error);
+
+    private:
+        OptimizerOptions opts;
+        std::unique_ptr<llvm::TargetMachine> machine; // for the optimizer's cost models
+        std::unique_ptr<llvm::orc::LLJIT> jit;
+
+        IncrementalJIT() = default;
+};
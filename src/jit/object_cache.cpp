@@ -0,0 +1,211 @@
+#include "object_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace {
+
+    struct CachedFile {
+        std::string path;
+        uint64_t size;
+        llvm::sys::TimePoint<> used;
+    };
+
+    // *.o files in directory, the cache only ever creates those
+    std::vector<CachedFile> listObjects(const std::string& directory) {
+        std::vector<CachedFile> files;
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(directory, ec), end; it != end && !ec; it.increment(ec)) {
+            if (llvm::sys::path::extension(it->path()) != ".o") continue;
+
+            llvm::sys::fs::file_status status;
+            if (llvm::sys::fs::status(it->path(), status)) continue;
+            files.push_back({ it->path(), status.getSize(), status.getLastModificationTime() });
+        }
+        return files;
+    }
+
+    // Writes through a temporary file and a rename, so concurrent runs never see a partial file
+    bool writeAtomically(const std::string& path, llvm::StringRef data) {
+        int fd;
+        llvm::SmallString<128> temp;
+        if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temp)) return false;
+        {
+            llvm::raw_fd_ostream out(fd, true);
+            out << data;
+            if (out.has_error()) { out.clear_error(); llvm::sys::fs::remove(temp); return false; }
+        }
+        if (llvm::sys::fs::rename(temp, path)) { llvm::sys::fs::remove(temp); return false; }
+        return true;
+    }
+
+    // Identifies the compiler build: LLVM version plus size and timestamp of this executable
+    std::string compilerIdentity() {
+        static int anchor;
+        std::string exe = llvm::sys::fs::getMainExecutable(nullptr, &anchor);
+        std::string id = LLVM_VERSION_STRING;
+
+        llvm::sys::fs::file_status status;
+        if (!exe.empty() && !llvm::sys::fs::status(exe, status)) {
+            id += " " + std::to_string(status.getSize()) + " " +
+                  std::to_string(status.getLastModificationTime().time_since_epoch().count());
+        }
+        return id;
+    }
+}
+
+DiskObjectCache::DiskObjectCache(const std::string& directory, uint64_t limitBytes) : directory(directory), limitBytes(limitBytes) {
+    if (auto ec = llvm::sys::fs::create_directories(directory)) {
+        std::cerr << "Can't create cache directory " << directory << ": " << ec.message() << std::endl;
+    }
+}
+
+std::string DiskObjectCache::defaultDirectory() {
+    llvm::SmallString<128> path;
+    if (!llvm::sys::path::cache_directory(path)) return ".crunch-cache";
+    llvm::sys::path::append(path, "crunch");
+    return path.str().str();
+}
+
+std::string DiskObjectCache::key(llvm::StringRef source, const OptimizerOptions& opts) {
+    llvm::StringMap<bool> features;
+    llvm::sys::getHostCPUFeatures(features);
+    std::vector<std::string> enabled;
+    for (auto& f : features) {
+        if (f.getValue()) enabled.push_back(f.getKey().str());
+    }
+    std::sort(enabled.begin(), enabled.end()); // StringMap order is unspecified
+
+    // Fields are separated by NUL so they can't run into each other
+    llvm::SHA1 hash;
+    auto field = [&](llvm::StringRef s) { hash.update(s); hash.update(llvm::StringRef("\0", 1)); };
+    field(source);
+    field(compilerIdentity());
+    field(std::to_string(opts.level));
+    field(opts.pipeline);
+    field(opts.vecLib);
+    field(std::to_string(opts.loops.vectorizeWidth) + " " + std::to_string(opts.loops.unrollCount));
+    field(llvm::sys::getProcessTriple());
+    field(llvm::sys::getHostCPUName());
+    for (auto& f : enabled) field(f);
+
+    return llvm::toHex(hash.final(), true);
+}
+
+std::string DiskObjectCache::objectPath(const std::string& key) const {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, key + ".o");
+    return path.str().str();
+}
+
+std::string DiskObjectCache::statsPath() const {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, "stats");
+    return path.str().str();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::load(const std::string& key) const {
+    auto buffer = llvm::MemoryBuffer::getFile(objectPath(key), false, false);
+    if (!buffer) return nullptr;
+    return std::move(*buffer);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::lookup(const std::string& key) {
+    std::unique_ptr<llvm::MemoryBuffer> object = load(key);
+    if (!object) {
+        run.misses++;
+        return nullptr;
+    }
+
+    run.hits++;
+    run.bytesSaved += object->getBufferSize();
+
+    // Modification time doubles as the last use for LRU eviction
+    int fd;
+    if (!llvm::sys::fs::openFileForWrite(objectPath(key), fd, llvm::sys::fs::CD_OpenExisting, llvm::sys::fs::OF_Append)) {
+        llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+        llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+    }
+    return object;
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) {
+    if (!writeAtomically(objectPath(module->getModuleIdentifier()), object.getBuffer())) {
+        std::cerr << "Can't write to cache directory " << directory << std::endl;
+        return;
+    }
+    evict();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::getObject(const llvm::Module* module) {
+    // lookup() already counted this program, this is only the compiler asking again
+    return load(module->getModuleIdentifier());
+}
+
+void DiskObjectCache::evict() {
+    std::vector<CachedFile> files = listObjects(directory);
+
+    uint64_t total = 0;
+    for (auto& f : files) total += f.size;
+    if (total <= limitBytes) return;
+
+    // Least recently used first
+    std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) { return a.used < b.used; });
+    for (auto& f : files) {
+        if (total <= limitBytes) break;
+        if (llvm::sys::fs::remove(f.path)) continue;
+        total -= f.size;
+        run.evictions++;
+    }
+}
+
+ObjectCacheStats DiskObjectCache::save() {
+    ObjectCacheStats totals;
+    if (auto buffer = llvm::MemoryBuffer::getFile(statsPath())) {
+        std::istringstream in((*buffer)->getBuffer().str());
+        std::string name;
+        uint64_t value;
+        while (in >> name >> value) {
+            if (name == "hits") totals.hits = value;
+            else if (name == "misses") totals.misses = value;
+            else if (name == "evictions") totals.evictions = value;
+            else if (name == "bytes_saved") totals.bytesSaved = value;
+        }
+    }
+
+    // Concurrent runs can lose each other's increments here, the counters are informational
+    totals.hits += run.hits;
+    totals.misses += run.misses;
+    totals.evictions += run.evictions;
+    totals.bytesSaved += run.bytesSaved;
+    run = ObjectCacheStats();
+
+    std::ostringstream out;
+    out << "hits " << totals.hits << "\nmisses " << totals.misses << "\nevictions " << totals.evictions
+        << "\nbytes_saved " << totals.bytesSaved << "\n";
+    writeAtomically(statsPath(), out.str());
+    return totals;
+}
+
+void DiskObjectCache::report(std::ostream& out, const ObjectCacheStats& totals) const {
+    std::vector<CachedFile> files = listObjects(directory);
+    uint64_t size = 0;
+    for (auto& f : files) size += f.size;
+
+    uint64_t lookups = totals.hits + totals.misses;
+    out << "[cache] " << directory << ": " << files.size() << " objects, " << size << " of " << limitBytes << " bytes" << std::endl;
+    out << "[cache] " << totals.hits << " hits, " << totals.misses << " misses ("
+        << (lookups ? 100.0 * totals.hits / lookups : 0.0) << "% hit rate), " << totals.evictions << " evictions, "
+        << totals.bytesSaved << " bytes of machine code reused" << std::endl;
+}
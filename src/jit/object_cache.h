@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include "../opt/optimizer.h"
+
+// On-disk cache of JIT compiled programs, one object file per key
+//
+// The key hashes everything that changes the machine code: source text, the
+// compiler build, optimizer options and the host CPU. Once the directory grows
+// past the size limit the least recently used objects are evicted.
+
+struct ObjectCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytesSaved = 0; // machine code loaded instead of compiled
+};
+
+class DiskObjectCache : public llvm::ObjectCache {
+    private:
+        std::string directory;
+        uint64_t limitBytes;
+        ObjectCacheStats run; // this process only, merged into the stats file by save()
+
+        std::string objectPath(const std::string& key) const;
+        std::string statsPath() const;
+        std::unique_ptr<llvm::MemoryBuffer> load(const std::string& key) const;
+        void evict();
+
+    public:
+        DiskObjectCache(const std::string& directory, uint64_t limitBytes);
+
+        // $XDG_CACHE_HOME/crunch, usually ~/.cache/crunch
+        static std::string defaultDirectory();
+
+        // Cache key (hex SHA1) of a program compiled on this host
+        static std::string key(llvm::StringRef source, const OptimizerOptions& opts);
+
+        // Cached object for key, nullptr on a miss. Counts towards the stats and refreshes LRU order
+        std::unique_ptr<llvm::MemoryBuffer> lookup(const std::string& key);
+
+        // llvm::ObjectCache interface, used by the JIT compiler. Modules are named after their key
+        void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+        std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+
+        // Adds this run's counters to the totals kept in the cache directory, returns the totals
+        ObjectCacheStats save();
+
+        // Totals and the current size of the cache
+        void report(std::ostream& out, const ObjectCacheStats& totals) const;
+};
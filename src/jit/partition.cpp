@@ -0,0 +1,54 @@
+#include "partition.h"
+
+#include <algorithm>
+#include <utility>
+
+std::vector<std::set<std::string>> partitionModule(llvm::Module& module, unsigned count) {
+    for (llvm::GlobalValue& gv : module.global_values()) {
+        if (gv.isDeclaration() || !gv.hasLocalLinkage()) continue;
+        if (!gv.hasName()) gv.setName("crunch.local");
+        gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+
+    std::vector<std::pair<size_t, llvm::Function*>> functions;
+    for (llvm::Function& fn : module) {
+        if (!fn.isDeclaration()) functions.push_back({ fn.getInstructionCount(), &fn });
+    }
+
+    // Largest first, each onto the currently lightest unit
+    std::stable_sort(functions.begin(), functions.end(), [](const std::pair<size_t, llvm::Function*>& a, const std::pair<size_t, llvm::Function*>& b) {
+        return a.first > b.first;
+    });
+
+    count = std::max(1u, std::min<unsigned>(count, functions.size()));
+    std::vector<std::set<std::string>> units(count);
+    std::vector<size_t> load(count, 0);
+    for (auto& f : functions) {
+        size_t lightest = std::min_element(load.begin(), load.end()) - load.begin();
+        units[lightest].insert(f.second->getName().str());
+        load[lightest] += f.first;
+    }
+    return units;
+}
+
+void extractUnit(llvm::Module& module, const std::set<std::string>& owned, bool ownsGlobals) {
+    for (llvm::Function& fn : module) {
+        if (fn.isDeclaration() || owned.count(fn.getName().str())) continue;
+
+        // Function values are always-inline, a body here lets callers in this unit inline them
+        if (fn.hasFnAttribute(llvm::Attribute::AlwaysInline)) {
+            fn.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+            fn.setVisibility(llvm::GlobalValue::DefaultVisibility);
+            continue;
+        }
+        fn.deleteBody();
+    }
+
+    if (ownsGlobals) return;
+    for (llvm::GlobalVariable& gv : module.globals()) {
+        if (gv.isDeclaration()) continue;
+        gv.setInitializer(nullptr);
+        gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include <llvm/IR/Module.h>
+
+// Splitting a module into compilation units that are optimized and compiled on
+// separate threads, each in its own LLVMContext
+//
+// Every unit starts as a full copy of the module (workers parse the same
+// bitcode) and keeps only the definitions it owns. The rest become external
+// declarations resolved when the unit objects are linked together.
+//
+// Units are whole functions. All top level code is in crunch_main and
+// function values are inlined into it, so most scripts are a single unit
+// whatever the job count. Splitting pays off for programs with several large
+// function values, which also get a scalar and a batch entry point each.
+
+// Makes module splittable: local functions and globals become hidden externals so
+// units can refer to each other's. Returns the defined functions of every unit,
+// at most count units, balanced by instruction count
+std::vector<std::set<std::string>> partitionModule(llvm::Module& module, unsigned count);
+
+// Reduces a copy of the module to one unit. Functions outside owned become
+// declarations, except always-inline ones which stay available for inlining. Global
+// variables are defined by the first unit only
+void extractUnit(llvm::Module& module, const std::set<std::string>& owned, bool ownsGlobals);
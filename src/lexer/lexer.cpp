@@ -50,10 +50,25 @@ Lexer::Lexer(const std::string& filename) {
 
 };
 
-Lexer::~Lexer() { if (sourceFile.is_open()) sourceFile.close(); }
+std::unique_ptr<Lexer> Lexer::fromSource(const std::string& text) {
+    std::unique_ptr<Lexer> lexer(new Lexer());
+    lexer->sourceText.str(text);
+    lexer->source = &lexer->sourceText;
+    return lexer;
+}
+
+Lexer::~Lexer() {
+    if (sourceFile.is_open()) sourceFile.close();
+    for (Token* token : tokens) delete token;
+}
 
 void Lexer::tokenize() {
-    std::cout << "Tokenizing..." << std::endl;
+    tokenize(nullptr, 0);
+}
+
+void Lexer::tokenize(const std::function<void(std::vector<Token*>)>& emit, size_t batch) {
+    size_t sent = 0; // tokens handed to emit so far
+    if (debug) std::cout << "Tokenizing..." << std::endl;
 
     std::string line;
     this->ln = 0; // ln reset
@@ -69,11 +84,14 @@ void Lexer::tokenize() {
     //_____________________   + - * / %  = == != < > <= >= &&  ||  ! , ; :  .  (  )  {  }
     std::regex specials( R"([\+\-\*\/\%]|=|==|!=|<|>|<=|>=|&&|\|\||!|,|;|:|\.|\(|\)|\{|\})" );
 
-    while(std::getline(sourceFile, line)) {   
+    while(std::getline(*source, line)) {   
             
         this->col = 0; // col reset
 
-        std::cout << "Line " << ln+1 << std::endl;
+        // CRLF files keep the \r at the end of the line
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        if (debug) std::cout << "Line " << ln+1 << std::endl;
         
         // Convert line to tokens from ruleset and append to tokens vector
         TokenType tok;
@@ -101,21 +119,21 @@ void Lexer::tokenize() {
 
             // Push token to token stream and clear buffer
             Token* new_tok = new Token(t, buf, ln, col);
-            std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
+            if (debug) std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
             tokens.push_back(new_tok);
             buf.clear();
         };
 
         std::string buffer;
         bool str_lit_parse = false;
-        for (std::size_t i = 0; i < line.size() - 1; ++i) {
+        for (std::size_t i = 0; i < line.size(); ++i) {
             
             //std::cout << "Col " << col+1 << " | Word: \"" << word << "\"" << std::endl;
 
             char c = line[i];
-            std::cout << "Char \"" << c << "\"" << std::endl;
+            if (debug) std::cout << "Char \"" << c << "\"" << std::endl;
 
-            if (c == '#') {
+            if (c == '#' && !str_lit_parse) {
                 // Comment, can safely ignore and break for the line
                 break;
             }
@@ -129,7 +147,7 @@ void Lexer::tokenize() {
                 } else if (str_lit_parse) {
                     str_lit_parse = false;
                     buffer.push_back(c);
-                    std::cout << "Current buffer " << buffer << std::endl;
+                    if (debug) std::cout << "Current buffer " << buffer << std::endl;
                     finalize_buffer(buffer);
                     continue;
                 }
@@ -138,17 +156,28 @@ void Lexer::tokenize() {
 
             else if (str_lit_parse) {
                 buffer.push_back(c);
+
+                // Escaped character (\" does not end the literal)
+                if (c == '\\' && i + 1 < line.size()) buffer.push_back(line[++i]);
+                continue;
+            }
+
+            // Decimal point of a double literal (digits on both sides)
+            else if (c == '.' && !buffer.empty() && i + 1 < line.size() && std::isdigit((unsigned char)line[i + 1]) &&
+                std::all_of(buffer.begin(), buffer.end(), [](char d) { return std::isdigit((unsigned char)d); }))
+            {
+                buffer.push_back(c);
                 continue;
             }
 
             // Whitespace after string literals
-            else if (c == ' ' || c == '\n' || c == '\t') {
+            else if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
                 finalize_buffer(buffer);
                 continue;
             }
 
             // single-char operator group that should always be a token by itself
-            else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' ||
+            else if (c == '+' || c == '*' || c == '/' || c == '%' ||
                 c == ',' || c == ';' || c == ':' || c == '.') 
             {
                 finalize_buffer(buffer);
@@ -156,13 +185,13 @@ void Lexer::tokenize() {
                 auto it = lex_rules.find(s);
                 TokenType t = (it != lex_rules.end()) ? it->second : TokenType::UNKNOWN;
                 Token* new_tok = new Token(t, s, ln, col);
-                std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
+                if (debug) std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
                 tokens.push_back(new_tok);
                 continue;
             }
 
-            // characters that can start two-char tokens (==, !=, <=, >=, &&, ||, etc.)
-            else if (c == '=' || c == '!' || c == '<' || c == '>' || c == '&' || c == '|' ||
+            // characters that can start two-char tokens (==, !=, <=, >=, &&, ||, ->, etc.)
+            else if (c == '=' || c == '!' || c == '<' || c == '>' || c == '&' || c == '|' || c == '-' ||
                 c == '(' || c == ')' || c == '{' || c == '}')
             {
                 // try two-char lexeme first (if we have room)
@@ -174,7 +203,7 @@ void Lexer::tokenize() {
                         // found two-char operator
                         finalize_buffer(buffer);
                         Token* new_tok = new Token(it2->second, two, ln, col);
-                        std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
+                        if (debug) std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
                         tokens.push_back(new_tok);
                         ++i; // consume the second char
                         continue;
@@ -187,7 +216,7 @@ void Lexer::tokenize() {
                 auto it1 = lex_rules.find(s);
                 TokenType t = (it1 != lex_rules.end()) ? it1->second : TokenType::UNKNOWN;
                 Token* new_tok = new Token(t, s, ln, col);
-                std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
+                if (debug) std::cout << "Token: " << new_tok->getTypeString() << " | Name: " << new_tok->getLexeme() << std::endl;
                 tokens.push_back(new_tok);
                 continue;
             }
@@ -201,19 +230,26 @@ void Lexer::tokenize() {
         if ( !buffer.empty() ) finalize_buffer(buffer);
 
         this->ln++;
+
+        if (emit && tokens.size() - sent >= batch) {
+            emit(std::vector<Token*>(tokens.begin() + sent, tokens.end()));
+            sent = tokens.size();
+        }
     }
 
     tokens.push_back( new Token(TokenType::END_OF_FILE, "", ln, col) );
-    
+    if (emit) emit(std::vector<Token*>(tokens.begin() + sent, tokens.end()));
+
 }
 
 void Lexer::reset() { 
-    if (sourceFile.is_open()) {
-        sourceFile.clear();
-        sourceFile.seekg(0, std::ios::beg);
+    if (source != &sourceFile || sourceFile.is_open()) {
+        source->clear();
+        source->seekg(0, std::ios::beg);
     }
     ln = 0;
     col = 0;
+    for (Token* token : tokens) delete token;
     tokens.clear();
 }
 
@@ -224,4 +260,4 @@ void Lexer::toString() const {
     std::cout << std::endl;
 }
 
-bool Lexer::isEOF() const { return sourceFile.eof(); }
\ No newline at end of file
+bool Lexer::isEOF() const { return source->eof(); }
\ No newline at end of file
@@ -8,13 +8,20 @@
 #include <vector>
 #include <unordered_map>
 #include <regex>
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <functional>
 
 class Lexer {
     private: 
         std::ifstream sourceFile;
+        std::istringstream sourceText; // fromSource()
+        std::istream* source = &sourceFile;
         std::vector<Token*> tokens;
         int ln = 0;
         int col = 0;
+        bool debug = true; // trace characters and tokens while tokenizing
 
         std::unordered_map<std::string, TokenType> lex_rules = {
             
@@ -77,22 +84,37 @@ class Lexer {
             {"(", TokenType::LPAREN},         
             {")", TokenType::RPAREN},
             {"{", TokenType::LBRACE},
-            {"}", TokenType::RBRACE}
+            {"}", TokenType::RBRACE},
+            {"->", TokenType::ARROW}
         };
 
     public:
         Lexer();
         
         Lexer(const std::string& filename);
+
+        // Lexes program text instead of a file, for expressions given as strings
+        static std::unique_ptr<Lexer> fromSource(const std::string& text);
         
         ~Lexer();
+
+        Lexer(const Lexer&) = delete;
+        Lexer& operator=(const Lexer&) = delete;
         
         void tokenize();
 
+        // Same, handing each batch (at least batch tokens, whole lines) to emit
+        // as soon as it is lexed, the last one ends with END_OF_FILE. The
+        // tokens are still owned by the lexer
+        void tokenize(const std::function<void(std::vector<Token*>)>& emit, size_t batch);
+
+        // Owned by the lexer, valid until it is destroyed or reset
         std::vector<Token*> getTokens() { return this->tokens; }
 
         void toString() const;
 
+        void setDebug(bool debug) { this->debug = debug; }
+
         void reset();
 
         bool isEOF() const;
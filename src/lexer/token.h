@@ -25,6 +25,7 @@ enum class TokenType {
 
     // Delims
     COMMA, SEMICOL, COL, DOT, LPAREN, RPAREN, LBRACE, RBRACE,
+    ARROW, // -> in function literals
 
     // Constants
     PI, EULER,
@@ -54,13 +55,7 @@ class Token {
             // FOR NOW, These tokens are unsupported:
             if 
             (
-                type == TokenType::FUNCTION_MATH ||
-                type == TokenType::DERIV ||
-                type == TokenType::INTEGRAL ||
-                type == TokenType::KW_FOR ||
-                type == TokenType::KW_BRK ||
-                type == TokenType::KW_CONT ||
-                type == TokenType::KW_WHILE
+                type == TokenType::FUNCTION_MATH
             ) 
             { type = TokenType::UNKNOWN; }
             
@@ -126,6 +121,7 @@ class Token {
                 case TokenType::RPAREN: {return ")"; break;}
                 case TokenType::LBRACE: {return "{"; break;}
                 case TokenType::RBRACE: {return "}"; break;}
+                case TokenType::ARROW: {return "->"; break;}
                 case TokenType::PI: {return "pi"; break;}
                 case TokenType::EULER: {return "e"; break;}
                 case TokenType::END_OF_FILE: {return "EOF"; break;}
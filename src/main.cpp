@@ -1,26 +1,585 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include "lexer/lexer.h"
 #include "parser/parser.h"
+#include "jit/jit.h"
+#include "aot/aot.h"
+#include "vm/compiler.h"
+#include "vm/vm.h"
+#include "tier/tier.h"
+#include "columns/columns.h"
+#include "batch/batch.h"
+#include "pipeline/pipeline.h"
+#include "runtime/print.h"
+#include <cstring>
+#include <fstream>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+namespace {
+
+    enum class Mode { Tree, Interp, Tiered, Bytecode, JIT, Object, Executable, Eval };
+
+    struct CacheOptions {
+        bool enabled = false;
+        std::string directory = DiskObjectCache::defaultDirectory();
+        uint64_t limitMB = 256;
+        bool stats = false;
+    };
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool isBytecodeFile(const std::string& path) { return llvm::sys::path::extension(path) == ".crunchc"; }
+
+    void usage() {
+        std::cerr << "Usage: CrunchRunner [options] file.crunch | file.crunchc | file.csv | --batch dir | --batch manifest" << std::endl;
+        std::cerr << "  (no flags)     print the tokens and syntax tree, run a .crunchc in the interpreter" << std::endl;
+        std::cerr << "  --interp       run the program in the bytecode interpreter, no native compilation" << std::endl;
+        std::cerr << "  --tiered       start in the interpreter, compile hot loops and functions in the background" << std::endl;
+        std::cerr << "  --tier-threshold=<n>  back edges or calls before a region is compiled (default 1000)" << std::endl;
+        std::cerr << "  --eval=<expr>  evaluate expr on every row of a .csv file, whose header names the columns" << std::endl;
+        std::cerr << "  --batch        run every .crunch file under dir, or listed in manifest (one per line), on -j threads" << std::endl;
+        std::cerr << "                 with --jit (default) or --interp; output in script order, scripts/s on stderr" << std::endl;
+        std::cerr << "  --compile-bytecode  write precompiled bytecode (file.crunchc unless -o is given)" << std::endl;
+        std::cerr << "  --dump-bytecode  list the bytecode on stderr before running or writing it" << std::endl;
+        std::cerr << "  --jit          compile the program to native code and run it" << std::endl;
+        std::cerr << "  --pipeline     with --jit: lex, parse and generate code on three threads at once, stage use on stderr" << std::endl;
+        std::cerr << "  --emit-obj     write a relocatable object file (file.o unless -o is given)" << std::endl;
+        std::cerr << "  -o <path>      output path, without --emit-obj links an executable" << std::endl;
+        std::cerr << "  -O0 .. -O3     optimization level (default -O2)" << std::endl;
+        std::cerr << "  --passes=<p>   custom pass pipeline (opt syntax), replaces the -O preset" << std::endl;
+        std::cerr << "  -time-passes   report the time spent in each pass" << std::endl;
+        std::cerr << "  -fveclib=<lib> vector math library for vectorized loops: libmvec (default) or none" << std::endl;
+        std::cerr << "  -march=native  generate code for the host CPU" << std::endl;
+        std::cerr << "  -fvectorize-width=<n>  vectorize every loop n wide, also floating point sums (1 disables)" << std::endl;
+        std::cerr << "  -funroll-count=<n>     unroll every loop n times (1 disables)" << std::endl;
+        std::cerr << "  -j <n>         optimize and compile with --jit on n threads, one unit per function group" << std::endl;
+        std::cerr << "                 (top level code is one function, it only helps programs with many function values)," << std::endl;
+        std::cerr << "                 evaluate with --eval and run --batch scripts on n threads (default: all)" << std::endl;
+        std::cerr << "  --cache        reuse machine code from earlier --jit runs of the same program" << std::endl;
+        std::cerr << "  --cache-dir=<d>  cache directory, implies --cache (default ~/.cache/crunch)" << std::endl;
+        std::cerr << "  --cache-limit=<MB>  evict least recently used programs beyond this size (default 256)" << std::endl;
+        std::cerr << "  --cache-stats  report cache hits, misses and reused bytes" << std::endl;
+    }
+
+    std::unique_ptr<Lexer> openLexer(const std::string& src) {
+        try { return std::unique_ptr<Lexer>(new Lexer(src)); }
+        catch (const std::runtime_error& e) { std::cerr << e.what() << std::endl; return nullptr; }
+    }
+
+    // Lex, parse and generate crunch_main into ctx. The parser owns the tree
+    // (and so the function literals the module refers to), nullptr on failure
+    std::unique_ptr<Parser> frontend(Lexer& lexer, codegen_ctx& ctx) {
+        lexer.setDebug(false);
+        lexer.tokenize();
+
+        std::unique_ptr<Parser> parser;
+        try { parser.reset(new Parser(lexer.getTokens())); }
+        catch (const std::runtime_error& e) { std::cerr << "Syntax error: " << e.what() << std::endl; return nullptr; }
+
+        if (!parser->getProgram()->codegenEntry(ctx)) return nullptr;
+        return parser;
+    }
+
+    // Busy time and share of the pipeline's time per stage
+    void reportPipeline(const PipelineStats& stats) {
+        std::cerr << "[pipeline] " << stats.ms << " ms on 3 threads:";
+        for (const PipelineStage* stage : { &stats.lexer, &stats.parser, &stats.codegen }) {
+            std::cerr << " " << stage->name << " " << stage->busyMs() << " ms busy (" << (int)(stats.utilization(*stage) * 100 + 0.5)
+                      << "%, " << stage->items << (stage == &stats.lexer ? " tokens)" : " statements)") << (stage == &stats.codegen ? ";" : ",");
+        }
+        std::cerr << " " << stats.slowest().name << " is the slowest stage";
+        if (stats.regenerated) std::cerr << ", code generated again for a late deriv seed";
+        std::cerr << std::endl;
+    }
+
+    // Compile and run through the JIT, times go to stderr. A cache hit skips
+    // everything up to linking
+    int runProgram(const std::string& src, const OptimizerOptions& opts, DiskObjectCache* cache, unsigned jobs, bool pipelined = false) {
+        auto frontendStart = std::chrono::steady_clock::now();
+
+        std::string key = "crunch";
+        if (cache) {
+            auto source = llvm::MemoryBuffer::getFile(src);
+            if (!source) {
+                std::cerr << "Can't read " << src << ": " << source.getError().message() << std::endl;
+                return 1;
+            }
+            key = DiskObjectCache::key((*source)->getBuffer(), opts);
+
+            if (auto object = cache->lookup(key)) {
+                JITTimings timings;
+                int result = runCachedObject(std::move(object), timings);
+                if (result < 0) return 1;
+
+                std::cerr << "[jit] cache hit, link " << msSince(frontendStart) - timings.execute << " ms, execute "
+                          << timings.execute << " ms" << std::endl;
+                return result;
+            }
+        }
+
+        // The cache files the compiled object under the module name
+        std::unique_ptr<Lexer> lexer;
+        std::unique_ptr<codegen_ctx> ctx;
+        std::unique_ptr<Parser> parser;
+        if (pipelined) {
+            PipelineOptions pipelineOpts;
+            pipelineOpts.loops = opts.loops;
+            PipelineStats stats;
+            PipelinedProgram program;
+            if (!runPipeline(src, key, pipelineOpts, program, stats)) return 1;
+            reportPipeline(stats);
+            ctx = std::move(program.ctx);
+            parser = std::move(program.tree);
+        } else {
+            lexer = openLexer(src);
+            if (!lexer) return 1;
+            ctx.reset(new codegen_ctx(key));
+            ctx->loopHints = opts.loops;
+            parser = frontend(*lexer, *ctx);
+            if (!parser) return 1;
+        }
+        double frontendMs = msSince(frontendStart);
+
+        JITTimings timings;
+        int result = runJIT(*ctx, timings, opts, cache, jobs);
+        if (result < 0) return 1;
+
+        std::cerr << "[jit] compile " << frontendMs + timings.optimize + timings.compile << " ms (frontend " << frontendMs;
+        if (timings.split) {
+            std::cerr << " ms, optimize and codegen of " << timings.units << (timings.units == 1 ? " unit " : " units ")
+                      << timings.optimize << " ms, link " << timings.compile;
+        } else {
+            std::cerr << " ms, optimize " << timings.optimize << " ms, native codegen " << timings.compile;
+        }
+        std::cerr << " ms), execute " << timings.execute << " ms" << std::endl;
+        return result;
+    }
+
+    // Size and hash of src, and its path as seen from output's directory (just
+    // the name when they share it, so the pair can move together), empty if unreadable
+    ImageSource describeSource(const std::string& src, const std::string& output) {
+        ImageSource source;
+        auto buffer = llvm::MemoryBuffer::getFile(src);
+        if (!buffer) return source;
+
+        llvm::SmallString<128> absSource(src), absOutput(output);
+        llvm::sys::fs::make_absolute(absSource);
+        llvm::sys::fs::make_absolute(absOutput);
+        bool together = llvm::sys::path::parent_path(absSource) == llvm::sys::path::parent_path(absOutput);
+        source.path = together ? llvm::sys::path::filename(absSource).str() : absSource.str().str();
+        source.size = (*buffer)->getBufferSize();
+        source.hash = imageHash((*buffer)->getBufferStart(), (*buffer)->getBufferSize());
+        return source;
+    }
+
+    // Lex, parse and compile src into a linked image, nullptr after reporting
+    // the error. BytecodeUnsupported passes through for the caller to decide.
+    // Tiered execution also gets the regions, and the parser that owns the tree they point into
+    std::unique_ptr<BytecodeImage> compileImage(const std::string& src, const ImageSource& source, double& frontendMs, double& bytecodeMs,
+                                                TierRegions* regions = nullptr, std::unique_ptr<Parser>* tree = nullptr) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::unique_ptr<Lexer> lexer = openLexer(src);
+        if (!lexer) return nullptr;
+        lexer->setDebug(false);
+        lexer->tokenize();
+
+        std::unique_ptr<Parser> parser;
+        try { parser.reset(new Parser(lexer->getTokens())); }
+        catch (const std::runtime_error& e) {
+            std::cerr << "Syntax error: " << e.what() << std::endl;
+            return nullptr;
+        }
+        frontendMs = msSince(start);
+
+        auto bytecodeStart = std::chrono::steady_clock::now();
+        std::unique_ptr<BytecodeImage> image;
+        try { image = BytecodeImage::link(compileBytecode(parser->getProgram(), true, regions), source); }
+        catch (const BytecodeUnsupported&) { throw; }
+        catch (const BytecodeError& e) {
+            std::cerr << e.what() << std::endl;
+            std::cerr << "Failed to generate code for program." << std::endl;
+            return nullptr;
+        }
+        bytecodeMs = msSince(bytecodeStart);
+        if (tree) *tree = std::move(parser);
+        return image;
+    }
+
+    // Compile src to bytecode and interpret it, times go to stderr. Programs the
+    // interpreter can't run go to the JIT instead. With refresh the image is also
+    // written there as a .crunchc, for a stale one being replaced
+    int interpretProgram(const std::string& src, bool dump, const OptimizerOptions& opts, unsigned jobs, const std::string& refresh = "") {
+        double frontendMs = 0.0, bytecodeMs = 0.0;
+        std::unique_ptr<BytecodeImage> image;
+        try { image = compileImage(src, refresh.empty() ? ImageSource() : describeSource(src, refresh), frontendMs, bytecodeMs); }
+        catch (const BytecodeUnsupported& e) {
+            std::cerr << "[interp] " << e.what() << ", running with --jit" << std::endl;
+            return runProgram(src, opts, nullptr, jobs);
+        }
+        if (!image) return 1;
+        if (dump) std::cerr << disassemble(*image);
+
+        std::string error;
+        if (!refresh.empty() && !image->write(refresh, error)) std::cerr << "[interp] can't update " << refresh << ": " << error << std::endl;
+
+        auto executeStart = std::chrono::steady_clock::now();
+        int result = VM(*image).run();
+        double executeMs = msSince(executeStart);
+        if (result < 0) return 1;
+
+        std::cerr << "[interp] compile " << frontendMs + bytecodeMs << " ms (frontend " << frontendMs << " ms, bytecode "
+                  << bytecodeMs << " ms), execute " << executeMs << " ms" << std::endl;
+        return result;
+    }
+
+    // --tiered: interpret src while hot loops and functions are compiled in the background
+    int runTiered(const std::string& src, bool dump, const TierOptions& tierOpts, unsigned jobs) {
+        double frontendMs = 0.0, bytecodeMs = 0.0;
+        TierRegions regions;
+        std::unique_ptr<Parser> tree;
+        std::unique_ptr<BytecodeImage> image;
+        try { image = compileImage(src, ImageSource(), frontendMs, bytecodeMs, &regions, &tree); }
+        catch (const BytecodeUnsupported& e) {
+            std::cerr << "[tiered] " << e.what() << ", running with --jit" << std::endl;
+            return runProgram(src, tierOpts.optimizer, nullptr, jobs);
+        }
+        if (!image) return 1;
+        if (dump) std::cerr << disassemble(*image);
+
+        TieredExecution tier(regions, tierOpts);
+        VMOptions options;
+        options.tier = &tier;
+
+        auto executeStart = std::chrono::steady_clock::now();
+        int result = VM(*image, options).run();
+        double executeMs = msSince(executeStart);
+        tier.stop();
+        if (result < 0) return 1;
+
+        TierStats stats = tier.stats();
+        std::cerr << "[tiered] compile " << frontendMs + bytecodeMs << " ms (frontend " << frontendMs << " ms, bytecode "
+                  << bytecodeMs << " ms), execute " << executeMs << " ms; native " << stats.loops << " loops, " << stats.chunks
+                  << " functions in " << stats.compile << " ms on the compiler thread";
+        if (stats.failed) std::cerr << ", " << stats.failed << " kept interpreted";
+        std::cerr << ", " << tier.entries << " loop entries" << std::endl;
+        return result;
+    }
+
+    // Map a .crunchc and run it in place. When its source is still around and
+    // has changed since, the source is compiled again (and the file refreshed)
+    int runBytecodeFile(const std::string& path, bool dump, const OptimizerOptions& opts, unsigned jobs) {
+        auto start = std::chrono::steady_clock::now();
 
-int main() {
-    std::string src = "src/crunch_files/arithmetic.crunch";
+        std::string error;
+        std::unique_ptr<BytecodeImage> image = BytecodeImage::load(path, error);
+        if (!image) {
+            std::cerr << "Can't run " << path << ": " << error << " (compile it again with --compile-bytecode)" << std::endl;
+            return 1;
+        }
+
+        std::string source = image->sourcePath(path);
+        if (!source.empty()) {
+            auto buffer = llvm::MemoryBuffer::getFile(source);
+            if (buffer && ((*buffer)->getBufferSize() != image->header().sourceSize ||
+                           imageHash((*buffer)->getBufferStart(), (*buffer)->getBufferSize()) != image->header().sourceHash)) {
+                std::cerr << "[interp] " << source << " changed since " << path << " was compiled, recompiling" << std::endl;
+                image.reset();
+                return interpretProgram(source, dump, opts, jobs, path);
+            }
+        }
+        double loadMs = msSince(start);
+        if (dump) std::cerr << disassemble(*image);
+
+        auto executeStart = std::chrono::steady_clock::now();
+        int result = VM(*image).run();
+        double executeMs = msSince(executeStart);
+        if (result < 0) return 1;
+
+        std::cerr << "[interp] load " << loadMs << " ms (mapped " << image->size() << " bytes), execute " << executeMs << " ms" << std::endl;
+        return result;
+    }
+
+    // --compile-bytecode: src to a .crunchc at output
+    int writeBytecodeFile(const std::string& src, const std::string& output, bool dump) {
+        auto start = std::chrono::steady_clock::now();
+
+        double frontendMs = 0.0, bytecodeMs = 0.0;
+        std::unique_ptr<BytecodeImage> image;
+        try { image = compileImage(src, describeSource(src, output), frontendMs, bytecodeMs); }
+        catch (const BytecodeUnsupported& e) {
+            std::cerr << e.what() << ", it can't be precompiled to bytecode (run it with --jit)" << std::endl;
+            return 1;
+        }
+        if (!image) return 1;
+        if (dump) std::cerr << disassemble(*image);
+
+        std::string error;
+        if (!image->write(output, error)) {
+            std::cerr << "Can't write " << output << ": " << error << std::endl;
+            return 1;
+        }
+        std::cerr << "[interp] wrote " << output << " (" << image->size() << " bytes) in " << msSince(start) << " ms" << std::endl;
+        return 0;
+    }
+
+    // Comma separated, trimmed
+    std::vector<std::string> splitFields(const std::string& line) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (;;) {
+            size_t end = line.find(',', start);
+            std::string field = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            size_t first = field.find_first_not_of(" \t\r"), last = field.find_last_not_of(" \t\r");
+            fields.push_back(first == std::string::npos ? "" : field.substr(first, last - first + 1));
+            if (end == std::string::npos) return fields;
+            start = end + 1;
+        }
+    }
+
+    // --eval: expression over the columns of a CSV file, one result per line on stdout
+    int evaluateColumns(const std::string& expression, const std::string& path, const OptimizerOptions& opts, unsigned threads) {
+        auto readStart = std::chrono::steady_clock::now();
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Can't read " << path << std::endl;
+            return 1;
+        }
+
+        std::string line;
+        std::getline(file, line);
+        std::vector<std::string> names = splitFields(line);
+        std::vector<std::vector<double>> data(names.size());
+        for (size_t row = 2; std::getline(file, line); ++row) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            std::vector<std::string> fields = splitFields(line);
+            if (fields.size() != names.size()) {
+                std::cerr << path << ":" << row << ": expected " << names.size() << " values, got " << fields.size() << std::endl;
+                return 1;
+            }
+            for (size_t k = 0; k < fields.size(); ++k) {
+                char* end = nullptr;
+                double v = std::strtod(fields[k].c_str(), &end);
+                if (fields[k].empty() || *end) {
+                    std::cerr << path << ":" << row << ": not a number: " << fields[k] << std::endl;
+                    return 1;
+                }
+                data[k].push_back(v);
+            }
+        }
+        size_t rows = data.empty() ? 0 : data[0].size();
+        double readMs = msSince(readStart);
+
+        ColumnOptions options;
+        options.optimizer = opts;
+        options.threads = threads;
+        std::string error;
+        auto kernel = ColumnKernel::compile(expression, names, options, error);
+        if (!kernel) {
+            std::cerr << "Can't evaluate " << expression << ": " << error << std::endl;
+            return 1;
+        }
+
+        std::vector<const double*> cols;
+        for (auto& column : data) cols.push_back(column.data());
+        std::vector<double> out(rows);
+        auto evaluateStart = std::chrono::steady_clock::now();
+        kernel->evaluate(cols.data(), out.data(), rows);
+        double evaluateMs = msSince(evaluateStart);
+
+        // Doubles print like print(...) does
+        for (double& v : out) {
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            crunch_print("%d\n", &bits);
+        }
+        crunch_flush();
+
+        std::cerr << "[eval] " << rows << " rows x " << names.size() << " columns: read " << readMs << " ms, compile "
+                  << kernel->compileMs() << " ms, evaluate " << evaluateMs << " ms (" << (evaluateMs > 0 ? rows / (evaluateMs / 1000.0) : 0.0)
+                  << " rows/s)" << std::endl;
+        return 0;
+    }
+
+    // --batch: every script of target in this process, summary on stderr
+    int runBatchMode(const std::string& target, bool interpret, const OptimizerOptions& opts, unsigned threads) {
+        std::vector<std::string> scripts;
+        std::string error;
+        if (!batchScripts(target, scripts, error)) {
+            std::cerr << "--batch: " << error << std::endl;
+            return 1;
+        }
+
+        BatchOptions options;
+        options.interpret = interpret;
+        options.optimizer = opts;
+        options.threads = threads;
+        BatchStats stats = runBatch(scripts, options, std::cout, std::cerr);
+
+        std::cerr << "[batch] " << stats.scripts << " scripts";
+        if (stats.failed) std::cerr << " (" << stats.failed << " failed)";
+        std::cerr << " on " << stats.threads << (stats.threads == 1 ? " thread" : " threads") << " in " << stats.ms << " ms: "
+                  << (stats.ms > 0 ? stats.scripts / (stats.ms / 1000.0) : 0.0) << " scripts/s, " << stats.steals << " steals" << std::endl;
+        return stats.failed ? 1 : 0;
+    }
+
+    // Compile to an object file, then link it when building an executable
+    int buildProgram(Lexer& lexer, Mode mode, const std::string& output, const AOTOptions& opts) {
+        auto start = std::chrono::steady_clock::now();
+
+        codegen_ctx ctx("crunch");
+        ctx.loopHints = opts.optimizer.loops;
+        std::unique_ptr<Parser> parser = frontend(lexer, ctx);
+        if (!parser) return 1;
+
+        std::string object = mode == Mode::Object ? output : output + ".o";
+        if (!emitObject(ctx, object, opts)) return 1;
+
+        if (mode == Mode::Executable) {
+            bool ok = linkExecutable(object, output, opts);
+            std::remove(object.c_str());
+            if (!ok) return 1;
+        }
+
+        std::cerr << "[aot] wrote " << output << " in " << msSince(start) << " ms" << std::endl;
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string src;
+    std::string output;
+    Mode mode = Mode::Tree;
+    AOTOptions opts;
+    CacheOptions cacheOpts;
+    unsigned jobs = 1;
+    bool dumpBytecode = false;
+    TierOptions tierOpts;
+    std::string expression;
+    unsigned threads = 0; // -j for --eval and --batch, 0 = all
+    bool batch = false;
+    bool pipelined = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jit") mode = Mode::JIT;
+        else if (arg == "--interp") mode = Mode::Interp;
+        else if (arg == "--tiered") mode = Mode::Tiered;
+        else if (arg.compare(0, 17, "--tier-threshold=") == 0) tierOpts.threshold = std::max(1, std::atoi(arg.c_str() + 17));
+        else if (arg.compare(0, 7, "--eval=") == 0) { expression = arg.substr(7); mode = Mode::Eval; }
+        else if (arg == "--batch") batch = true;
+        else if (arg == "--pipeline") pipelined = true;
+        else if (arg == "--compile-bytecode") mode = Mode::Bytecode;
+        else if (arg == "--dump-bytecode") dumpBytecode = true;
+        else if (arg == "--emit-obj") mode = Mode::Object;
+        else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+        else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '3') opts.optimizer.level = arg[2] - '0';
+        else if (arg.compare(0, 9, "--passes=") == 0) opts.optimizer.pipeline = arg.substr(9);
+        else if (arg == "-time-passes") opts.optimizer.timePasses = true;
+        else if (arg == "-fveclib=libmvec" || arg == "-fveclib=none") opts.optimizer.vecLib = arg.substr(9);
+        else if (arg == "-march=native") opts.nativeCPU = true;
+        else if (arg.compare(0, 18, "-fvectorize-width=") == 0) opts.optimizer.loops.vectorizeWidth = std::atoi(arg.c_str() + 18);
+        else if (arg.compare(0, 15, "-funroll-count=") == 0) opts.optimizer.loops.unrollCount = std::atoi(arg.c_str() + 15);
+        else if (arg == "-j" && i + 1 < argc) threads = jobs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--cache") cacheOpts.enabled = true;
+        else if (arg.compare(0, 12, "--cache-dir=") == 0) { cacheOpts.directory = arg.substr(12); cacheOpts.enabled = true; }
+        else if (arg.compare(0, 14, "--cache-limit=") == 0) cacheOpts.limitMB = std::strtoull(arg.c_str() + 14, nullptr, 10);
+        else if (arg == "--cache-stats") cacheOpts.stats = true;
+        else if (arg == "-h" || arg == "--help") { usage(); return 0; }
+        else if (!arg.empty() && arg[0] == '-') { usage(); return 1; }
+        else src = arg;
+    }
+
+    if (src.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (pipelined && (mode != Mode::JIT || batch)) {
+        std::cerr << "--pipeline works with --jit on a single program" << std::endl;
+        return 1;
+    }
+
+    if (batch) {
+        if (mode != Mode::Tree && mode != Mode::JIT && mode != Mode::Interp) {
+            std::cerr << "--batch runs scripts with --jit or --interp" << std::endl;
+            return 1;
+        }
+        return runBatchMode(src, mode == Mode::Interp, opts.optimizer, threads);
+    }
+
+    // --eval reads data, not a program
+    if (mode == Mode::Eval) {
+        if (llvm::sys::path::extension(src) != ".csv") {
+            std::cerr << "--eval needs a .csv file with a header naming the columns" << std::endl;
+            return 1;
+        }
+        return evaluateColumns(expression, src, opts.optimizer, threads);
+    }
+
+    // .crunchc files are precompiled bytecode, they only run in the interpreter
+    if (isBytecodeFile(src)) {
+        if (mode == Mode::Tree) mode = Mode::Interp;
+        if (mode != Mode::Interp) {
+            std::cerr << src << " is precompiled bytecode, it runs with --interp only" << std::endl;
+            return 1;
+        }
+    }
+
+    // -o alone builds an executable, --emit-obj defaults to file.o
+    if (mode == Mode::Tree && !output.empty()) mode = Mode::Executable;
+    if (mode == Mode::Object && output.empty()) output = src.substr(0, src.find_last_of('.')) + ".o";
+    if (mode == Mode::Bytecode && output.empty()) output = src.substr(0, src.find_last_of('.')) + ".crunchc";
+    if ((mode == Mode::JIT || mode == Mode::Interp || mode == Mode::Tiered) && !output.empty()) {
+        std::cerr << "-o can't be used with " << (mode == Mode::JIT ? "--jit" : mode == Mode::Tiered ? "--tiered" : "--interp") << std::endl;
+        return 1;
+    }
+
+    if (mode == Mode::Interp) {
+        if (isBytecodeFile(src)) return runBytecodeFile(src, dumpBytecode, opts.optimizer, jobs);
+        return interpretProgram(src, dumpBytecode, opts.optimizer, jobs);
+    }
+    if (mode == Mode::Tiered) {
+        tierOpts.optimizer = opts.optimizer;
+        return runTiered(src, dumpBytecode, tierOpts, jobs);
+    }
+    if (mode == Mode::Bytecode) return writeBytecodeFile(src, output, dumpBytecode);
+
+    if (mode == Mode::JIT) {
+        std::unique_ptr<DiskObjectCache> cache;
+        if (cacheOpts.enabled) cache = std::make_unique<DiskObjectCache>(cacheOpts.directory, cacheOpts.limitMB << 20);
+
+        int result = runProgram(src, opts.optimizer, cache.get(), jobs, pipelined);
+        if (cache) {
+            ObjectCacheStats totals = cache->save();
+            if (cacheOpts.stats) cache->report(std::cerr, totals);
+        }
+        return result;
+    }
     
-    Lexer* lexer;
+    std::unique_ptr<Lexer> lexer = openLexer(src);
+    if (!lexer) return 1;
 
-    try { lexer = new Lexer(src); } 
-    catch (const std::runtime_error& e) { std::cerr << e.what() << std::endl; return 1; }
+    if (mode != Mode::Tree) return buildProgram(*lexer, mode, output, opts);
 
     lexer->tokenize();
     lexer->toString();
 
-    std::vector<Token*> tokens = lexer->getTokens();
-
-    Parser* parser = new Parser(tokens);
+    std::unique_ptr<Parser> parser;
+    try { parser.reset(new Parser(lexer->getTokens())); }
+    catch (const std::runtime_error& e) {
+        std::cerr << "Syntax error: " << e.what() << std::endl;
+        return 1;
+    }
 
     parser->printTree();
 
-    delete lexer;
-    delete parser;
-
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#include "optimizer.h"
+
+#include <iostream>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Support/Error.h>
+#include <vector>
+
+namespace {
+
+    llvm::OptimizationLevel presetLevel(int level) {
+        switch (level) {
+            case 0: return llvm::OptimizationLevel::O0;
+            case 1: return llvm::OptimizationLevel::O1;
+            case 3: return llvm::OptimizationLevel::O3;
+            default: return llvm::OptimizationLevel::O2;
+        }
+    }
+
+    // glibc's libmvec variants of sin/cos/exp/log/pow. _ZGVb takes its vector in
+    // SSE registers, _ZGVd (4 doubles, 8 floats) in AVX2 registers: those are only
+    // for targets with AVX2, called from SSE code they compute garbage
+    std::vector<llvm::VecDesc> libmvecFunctions(llvm::TargetMachine* machine) {
+        using llvm::ElementCount;
+        const llvm::VecDesc all[] = {
+#define TLI_DEFINE_LIBMVEC_X86_VECFUNCS
+#include <llvm/Analysis/VecFuncs.def>
+        };
+
+        bool avx2 = machine && machine->getMCSubtargetInfo()->checkFeatures("+avx2");
+        std::vector<llvm::VecDesc> usable;
+        for (const llvm::VecDesc& fn : all) {
+            if (avx2 || !fn.VectorFnName.startswith("_ZGVd")) usable.push_back(fn);
+        }
+        return usable;
+    }
+}
+
+bool optimizeModule(llvm::Module& module, const OptimizerOptions& opts, llvm::TargetMachine* machine) {
+
+    // Timing hooks go in before the PassBuilder sees the callbacks. The handler
+    // prints its report when it goes out of scope
+    llvm::PassInstrumentationCallbacks callbacks;
+    llvm::TimePassesHandler timer(opts.timePasses);
+    timer.registerCallbacks(callbacks);
+
+    llvm::PassBuilder builder(machine, llvm::PipelineTuningOptions(), llvm::None, &callbacks);
+
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+
+    // Vector variants of sin/cos/exp/log/pow for the loop vectorizer, the ones the
+    // target can call. Registered before the defaults so it takes precedence
+    llvm::Triple triple(module.getTargetTriple());
+    llvm::TargetLibraryInfoImpl libraryInfo(triple);
+    if (opts.vecLib == "libmvec" && triple.getArch() == llvm::Triple::x86_64) {
+        libraryInfo.addVectorizableFunctions(libmvecFunctions(machine));
+    }
+    fam.registerPass([&] { return llvm::TargetLibraryAnalysis(libraryInfo); });
+
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager passes;
+    if (!opts.pipeline.empty()) {
+        if (llvm::Error err = builder.parsePassPipeline(passes, opts.pipeline)) {
+            std::cerr << "Invalid pass pipeline \"" << opts.pipeline << "\": " << llvm::toString(std::move(err)) << std::endl;
+            return false;
+        }
+    }
+    else if (opts.level == 0) {
+        // Still honors alwaysinline (function values)
+        passes = builder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+    }
+    else {
+        passes = builder.buildPerModuleDefaultPipeline(presetLevel(opts.level));
+    }
+
+    passes.run(module, mam);
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+// IR optimization on the new PassManager, shared by the JIT and AOT paths
+
+// Per loop llvm.loop metadata emitted by codegen, 0 leaves the choice to LLVM's
+// cost models and 1 disables the transformation. A vectorize width also lets the
+// vectorizer reorder floating point reductions (sum += ... loops)
+struct LoopHints {
+    unsigned vectorizeWidth = 0; // -fvectorize-width=
+    unsigned unrollCount = 0; // -funroll-count=
+};
+
+struct OptimizerOptions {
+    int level = 2; // -O0..-O3 preset
+    std::string pipeline; // --passes=..., textual pipeline replacing the preset (opt syntax)
+    bool timePasses = false; // -time-passes: per pass timing report on stderr
+
+    // -fveclib=: vector math library for calls in vectorized loops, "libmvec"
+    // (glibc, x86-64 only) or "none"
+    std::string vecLib = "libmvec";
+
+    LoopHints loops;
+};
+
+// Optimizes module in place. machine supplies target information for cost
+// models (vectorization, inlining), it may be nullptr. Returns false if the
+// pipeline string is invalid.
+bool optimizeModule(llvm::Module& module, const OptimizerOptions& opts, llvm::TargetMachine* machine = nullptr);
@@ -10,46 +10,67 @@ Parser::Parser(std::vector<Token*> tokens) {
     this->tokens = tokens;
     current = 0;
     ast_root = parseProgram();
+    this->tokens.clear(); // borrowed from the lexer, the tree doesn't point into them
+}
+
+Parser::Parser(TokenStream& stream, std::function<void(StmtNode*)> statementParsed)
+    : stream(&stream), statementParsed(std::move(statementParsed)) {
+    current = 0;
+    ast_root = parseProgram();
+    this->tokens.clear();
+    this->stream = nullptr;
 }
 
 Parser::~Parser() {
-    for (auto tok : tokens) { delete tok; }
     delete ast_root;
 }
 
 // Grammar rule based parsing functions
 
 Program* Parser::parseProgram() {
-    Program* program = new Program();
+    std::unique_ptr<Program> program(new Program()); // freed with what was parsed on a syntax error
     while(!isAtEnd()) {
-        StmtNode* stmt = parseStatement();
+        StmtNode* stmt;
+        try { stmt = parseStatement(); }
+        catch (const std::runtime_error&) {
+            if (statementParsed) statementParsed(nullptr); // done with the statements before they are freed
+            throw;
+        }
         
-        if (stmt != nullptr) { program->statements.push_back(stmt); } 
+        if (stmt != nullptr) {
+            program->statements.push_back(stmt);
+            if (statementParsed) statementParsed(stmt);
+        }
         else advance();
     }
-    return program;
+    return program.release();
 }
 
 
 // Statement returns
 StmtNode* Parser::parseStatement() {
     Token* token = peek();
+    StmtNode* stmt;
     switch (token->getType()) {
-        case TokenType::LBRACE: return parseBlock(); break;
+        case TokenType::LBRACE: stmt = parseBlock(); break;
         
-        case TokenType::KW_INT: return parseVarDecl(); break;
-        case TokenType::KW_DBLE: return parseVarDecl(); break;
-        case TokenType::KW_STRING: return parseVarDecl(); break;
-        case TokenType::KW_BOOL: return parseVarDecl(); break;
-        case TokenType::KW_FUNCTION: return parseVarDecl(); break; // Temp Unsupported
+        case TokenType::KW_INT: stmt = parseVarDecl(); break;
+        case TokenType::KW_DBLE: stmt = parseVarDecl(); break;
+        case TokenType::KW_STRING: stmt = parseVarDecl(); break;
+        case TokenType::KW_BOOL: stmt = parseVarDecl(); break;
+        case TokenType::KW_FUNCTION: stmt = parseVarDecl(); break;
         
-        case TokenType::KW_IF: return parseIfStmt(); break;
-        case TokenType::KW_PRINT: return parsePrintStmt(); break;
-        case TokenType::KW_BRK: return parseBreakStmt(); break; // Temp Unsupported
-        case TokenType::KW_CONT: return parseContinueStmt(); break; // Temp Unsupported
+        case TokenType::KW_IF: stmt = parseIfStmt(); break;
+        case TokenType::KW_PRINT: stmt = parsePrintStmt(); break;
+        case TokenType::KW_WHILE: stmt = parseWhileStmt(); break;
+        case TokenType::KW_FOR: stmt = parseForStmt(); break;
+        case TokenType::KW_BRK: stmt = parseBreakStmt(); break;
+        case TokenType::KW_CONT: stmt = parseContinueStmt(); break;
         
-        default: return parseExprStmt(); break;
+        default: stmt = parseExprStmt(); break;
     }
+    if (stmt) stmt->line = token->getLine() + 1;
+    return stmt;
 }
 
 StmtNode* Parser::parseBlock() {
@@ -74,7 +95,13 @@ StmtNode* Parser::parseVarDecl() {
     ExprNode* initializer = nullptr;
     if ( peek()->getType() == TokenType::ASSIGN ) {
         advance(); // Potential Bug
-        initializer = parseExpression();
+
+        // function f = x -> ... | function f = (x, y) -> ...
+        bool literal = 
+            typeTok->getType() == TokenType::KW_FUNCTION &&
+            (peek()->getType() == TokenType::LPAREN || peekNext()->getType() == TokenType::ARROW);
+
+        initializer = literal ? parseFunctionLiteral() : parseExpression();
     }
     consume(TokenType::SEMICOL,"Expected ';' after variable declaration");
     return new VarDeclStmt(typeTok->getType(), name->getLexeme(), initializer);
@@ -97,6 +124,52 @@ StmtNode* Parser::parseIfStmt() {
     return new IfStmt(cond, thenBranch, elseBranch);
 }
 
+StmtNode* Parser::parseWhileStmt() {
+    consume(TokenType::KW_WHILE, "Expected while statement");
+
+    consume(TokenType::LPAREN, "Expected '(' after while");
+    ExprNode* cond = parseExpression();
+    consume(TokenType::RPAREN, "Expected ')'");
+
+    return new WhileStmt(cond, parseStatement());
+}
+
+// for (init; condition; step) body, every part optional
+StmtNode* Parser::parseForStmt() {
+    consume(TokenType::KW_FOR, "Expected for statement");
+    consume(TokenType::LPAREN, "Expected '(' after for");
+
+    StmtNode* init = nullptr;
+    switch (peek()->getType()) {
+        case TokenType::SEMICOL: advance(); break;
+        case TokenType::KW_INT:
+        case TokenType::KW_DBLE:
+        case TokenType::KW_STRING:
+        case TokenType::KW_BOOL: init = parseVarDecl(); break;
+        default: init = parseExprStmt(); break;
+    }
+
+    ExprNode* cond = check(TokenType::SEMICOL) ? nullptr : parseExpression();
+    consume(TokenType::SEMICOL, "Expected ';' after for condition");
+
+    ExprNode* step = check(TokenType::RPAREN) ? nullptr : parseExpression();
+    consume(TokenType::RPAREN, "Expected ')' after for clauses");
+
+    return new ForStmt(init, cond, step, parseStatement());
+}
+
+StmtNode* Parser::parseBreakStmt() {
+    consume(TokenType::KW_BRK, "Expected break statement");
+    consume(TokenType::SEMICOL, "Expected ';' after break");
+    return new BreakStmt();
+}
+
+StmtNode* Parser::parseContinueStmt() {
+    consume(TokenType::KW_CONT, "Expected continue statement");
+    consume(TokenType::SEMICOL, "Expected ';' after continue");
+    return new ContinueStmt();
+}
+
 StmtNode* Parser::parsePrintStmt() {
     consume(TokenType::KW_PRINT, "Expected \"print\" statement.");
     ExprNode* value = parseExpression();
@@ -119,7 +192,7 @@ ExprNode* Parser::parseComma() {
     while ( peek()->getType() == TokenType::COMMA) {
         Token* op = advance();
         ExprNode* right = parseAssignment();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -149,7 +222,7 @@ ExprNode* Parser::parseLogicalOr() {
     while (peek()->getType() == TokenType::OR) {
         Token* op = advance();
         ExprNode* right = parseLogicalAnd();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -159,7 +232,7 @@ ExprNode* Parser::parseLogicalAnd() {
     while ( peek()->getType() == TokenType::AND) {
         Token* op = advance(); //Token* op = previous(); | Potential Bug
         ExprNode* right = parseEquality();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -169,7 +242,7 @@ ExprNode* Parser::parseEquality() {
     while (peek()->getType() == TokenType::EQ || peek()->getType() == TokenType::NEQ) {
         Token* op = advance(); //Token* op = previous(); | Potential Bug
         ExprNode* right = parseComparison();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -185,7 +258,7 @@ ExprNode* Parser::parseComparison() {
     ) {
         Token* op = advance(); //Token* op = previous(); | Potential Bug
         ExprNode* right = parseTerm();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -199,7 +272,7 @@ ExprNode* Parser::parseTerm() {
     ) {
         Token* op = advance(); //Token* op = previous(); | Potential Bug
         ExprNode* right = parseFactor();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -214,7 +287,7 @@ ExprNode* Parser::parseFactor() {
     ) {
         Token* op = advance(); //Token* op = previous(); | Potential Bug
         ExprNode* right = parseUnary();
-        expr = new BinaryExpr(expr, op->getLexeme(), right);
+        expr = new BinaryExpr(expr, binaryOpFromToken(op->getType()), right);
     }
     return expr;
 }
@@ -233,20 +306,28 @@ ExprNode* Parser::parseUnary() {
     ) {
         Token* op = advance(); //Token* op = previous(); | Potential Bug
         ExprNode* right = parseUnary();
-        return new UnaryExpr(op->getLexeme(), right);
+        return new UnaryExpr(unaryOpFromToken(op->getType()), right);
     }
     return parsePrimary();
 }
 
 ExprNode* Parser::parsePrimary() {
     TokenType tok_type = peek()->getType();
-    if (tok_type == TokenType::KW_TRUE)  return new BoolLiteral(true);
-    if (tok_type == TokenType::KW_FALSE) return new BoolLiteral(false);
+    if (tok_type == TokenType::KW_TRUE)  { advance(); return new BoolLiteral(true); }
+    if (tok_type == TokenType::KW_FALSE) { advance(); return new BoolLiteral(false); }
     if (tok_type == TokenType::INT_LIT)  return new IntLiteral(*advance()); // we do a lil dereferencing | USED TO BE "previous()," Potential Bug
     if (tok_type == TokenType::DBLE_LIT) return new DoubleLiteral(*advance());
     if (tok_type == TokenType::STR_LIT)  return new StringLiteral(*advance());
-    if (tok_type == TokenType::BOOL_LIT) return new BoolLiteral(true); // placeholder handling for BOOL_LIT
-    if (tok_type == TokenType::IDENTIFIER) return new IdentifierExpr(*advance());
+    if (tok_type == TokenType::BOOL_LIT) return new BoolLiteral(advance()->getLexeme() == "true");
+    if (tok_type == TokenType::IDENTIFIER) {
+        ExprNode* id = new IdentifierExpr(*advance());
+        if (peek()->getType() == TokenType::LPAREN) return parseCall(id);
+        return id;
+    }
+    if (tok_type == TokenType::PI) { advance(); return new DoubleLiteral(3.14159265358979323846); }
+    if (tok_type == TokenType::EULER) { advance(); return new DoubleLiteral(2.71828182845904523536); }
+    if (tok_type == TokenType::DERIV) return parseDeriv();
+    if (tok_type == TokenType::INTEGRAL) return parseIntegral();
 
     if (tok_type == TokenType::LPAREN) {
         advance(); // Potential Bug
@@ -259,6 +340,82 @@ ExprNode* Parser::parsePrimary() {
     throw std::runtime_error("Expected expression");
 }
 
+// deriv(expression, variable)
+ExprNode* Parser::parseDeriv() {
+    consume(TokenType::DERIV, "Expected \"deriv\"");
+    consume(TokenType::LPAREN, "Expected '(' after deriv");
+    
+    // Not parseExpression(), the comma separates the variable
+    ExprNode* expr = parseAssignment();
+    consume(TokenType::COMMA, "Expected ',' after deriv expression");
+    
+    Token* var = consume(TokenType::IDENTIFIER, "Expected variable to differentiate with respect to");
+    consume(TokenType::RPAREN, "Expected ')' after deriv variable");
+    
+    return new DerivExpr(expr, var->getLexeme());
+}
+
+// integral(expression, variable, lower, upper)
+ExprNode* Parser::parseIntegral() {
+    consume(TokenType::INTEGRAL, "Expected \"integral\"");
+    consume(TokenType::LPAREN, "Expected '(' after integral");
+    
+    ExprNode* expr = parseAssignment();
+    consume(TokenType::COMMA, "Expected ',' after integrand");
+    
+    Token* var = consume(TokenType::IDENTIFIER, "Expected integration variable");
+    consume(TokenType::COMMA, "Expected ',' after integration variable");
+    
+    ExprNode* lower = parseAssignment();
+    consume(TokenType::COMMA, "Expected ',' after lower bound");
+    
+    ExprNode* upper = parseAssignment();
+    consume(TokenType::RPAREN, "Expected ')' after upper bound");
+    
+    return new IntegralExpr(expr, var->getLexeme(), lower, upper);
+}
+
+// x -> expression | (x, y, ...) -> expression
+ExprNode* Parser::parseFunctionLiteral() {
+    std::vector<std::string> params;
+    
+    if (peek()->getType() == TokenType::LPAREN) {
+        advance();
+        if (peek()->getType() != TokenType::RPAREN) {
+            params.push_back(consume(TokenType::IDENTIFIER, "Expected parameter name")->getLexeme());
+            while (peek()->getType() == TokenType::COMMA) {
+                advance();
+                params.push_back(consume(TokenType::IDENTIFIER, "Expected parameter name")->getLexeme());
+            }
+        }
+        consume(TokenType::RPAREN, "Expected ')' after parameters");
+    } else {
+        params.push_back(consume(TokenType::IDENTIFIER, "Expected parameter name")->getLexeme());
+    }
+    
+    consume(TokenType::ARROW, "Expected '->' after function parameters");
+    
+    ExprNode* body = parseAssignment();
+    return new FunctionLiteral(params, body);
+}
+
+// callee(arg, ...)
+ExprNode* Parser::parseCall(ExprNode* callee) {
+    std::vector<ExprNode*> args;
+    
+    consume(TokenType::LPAREN, "Expected '(' for call");
+    if (peek()->getType() != TokenType::RPAREN) {
+        args.push_back(parseAssignment());
+        while (peek()->getType() == TokenType::COMMA) {
+            advance();
+            args.push_back(parseAssignment());
+        }
+    }
+    consume(TokenType::RPAREN, "Expected ')' after arguments");
+    
+    return new CallExpr(callee, args);
+}
+
 // --- AST printing helpers (file-local) ---
 namespace {
     void printIndent(int indent) {
@@ -272,13 +429,13 @@ namespace {
         if (!expr) { printIndent(indent); std::cout << "<null expr>\n"; return; }
 
         if (auto b = dynamic_cast<BinaryExpr*>(expr)) {
-            printIndent(indent); std::cout << "BinaryExpr op='" << b->op << "'\n";
+            printIndent(indent); std::cout << "BinaryExpr op='" << opName(b->op) << "'\n";
             printExprNode(b->left, indent + 1);
             printExprNode(b->right, indent + 1);
             return;
         }
         if (auto u = dynamic_cast<UnaryExpr*>(expr)) {
-            printIndent(indent); std::cout << "UnaryExpr op='" << u->op << "'\n";
+            printIndent(indent); std::cout << "UnaryExpr op='" << opName(u->op) << "'\n";
             printExprNode(u->operand, indent + 1);
             return;
         }
@@ -298,6 +455,30 @@ namespace {
             for (auto a : c->args) printExprNode(a, indent + 2);
             return;
         }
+        if (auto de = dynamic_cast<DerivExpr*>(expr)) {
+            printIndent(indent); std::cout << "DerivExpr d/d" << de->var << "\n";
+            printExprNode(de->expr, indent + 1);
+            printIndent(indent+1); std::cout << "Derivative:\n";
+            try { printExprNode(de->getDerivative(), indent + 2); }
+            catch (const std::runtime_error& e) { printIndent(indent+2); std::cout << "<" << e.what() << ">\n"; }
+            return;
+        }
+        if (auto fl = dynamic_cast<FunctionLiteral*>(expr)) {
+            printIndent(indent); std::cout << "FunctionLiteral params=(";
+            for (size_t k = 0; k < fl->params.size(); ++k) std::cout << (k ? ", " : "") << fl->params[k];
+            std::cout << ")\n";
+            printExprNode(fl->body, indent + 1);
+            return;
+        }
+        if (auto ie = dynamic_cast<IntegralExpr*>(expr)) {
+            printIndent(indent); std::cout << "IntegralExpr d" << ie->var << "\n";
+            printExprNode(ie->expr, indent + 1);
+            printIndent(indent+1); std::cout << "From:\n";
+            printExprNode(ie->lower, indent + 2);
+            printIndent(indent+1); std::cout << "To:\n";
+            printExprNode(ie->upper, indent + 2);
+            return;
+        }
         if (auto b = dynamic_cast<BoolLiteral*>(expr)) {
             printIndent(indent); std::cout << "BoolLiteral " << (b->value ? "true" : "false") << "\n"; return;
         }
@@ -368,6 +549,25 @@ namespace {
             printExprNode(ps->value, indent + 1);
             return;
         }
+        if (auto ws = dynamic_cast<WhileStmt*>(stmt)) {
+            printIndent(indent); std::cout << "WhileStmt\n";
+            printIndent(indent+1); std::cout << "Condition:\n";
+            printExprNode(ws->condition, indent + 2);
+            printIndent(indent+1); std::cout << "Body:\n";
+            printStmtNode(ws->body, indent + 2);
+            return;
+        }
+        if (auto fs = dynamic_cast<ForStmt*>(stmt)) {
+            printIndent(indent); std::cout << "ForStmt\n";
+            if (fs->init) { printIndent(indent+1); std::cout << "Init:\n"; printStmtNode(fs->init, indent + 2); }
+            if (fs->condition) { printIndent(indent+1); std::cout << "Condition:\n"; printExprNode(fs->condition, indent + 2); }
+            if (fs->step) { printIndent(indent+1); std::cout << "Step:\n"; printExprNode(fs->step, indent + 2); }
+            printIndent(indent+1); std::cout << "Body:\n";
+            printStmtNode(fs->body, indent + 2);
+            return;
+        }
+        if (dynamic_cast<BreakStmt*>(stmt)) { printIndent(indent); std::cout << "BreakStmt\n"; return; }
+        if (dynamic_cast<ContinueStmt*>(stmt)) { printIndent(indent); std::cout << "ContinueStmt\n"; return; }
 
         printIndent(indent); std::cout << "<unknown StmtNode>\n";
     }
@@ -1,27 +1,61 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include "../lexer/lexer.h"
 #include "../ast/ast.h"
 
+// Tokens that arrive while the parser runs, in batches (see pipeline/pipeline.h)
+class TokenStream {
+    public:
+        virtual ~TokenStream() = default;
+
+        // Appends the next batch to tokens, false when there are no more
+        virtual bool read(std::vector<Token*>& tokens) = 0;
+};
+
 class Parser {
     private:
         std::vector<Token*> tokens;
         size_t current;
         Program* ast_root = nullptr;
+        TokenStream* stream = nullptr;
+        std::function<void(StmtNode*)> statementParsed;
+
+        // Waits for streamed tokens up to index i, false past the end
+        bool has(size_t i) {
+            while (i >= tokens.size() && stream && stream->read(tokens)) {}
+            return i < tokens.size();
+        }
 
     public:
         Parser();
         
+        // Parses the whole program, throws std::runtime_error on syntax errors. The
+        // tokens stay with the lexer
         Parser(std::vector<Token*> tokens);
+
+        // Parses tokens as they arrive from stream, each top level statement is
+        // handed to statementParsed once it is complete (it stays in the tree).
+        // Throws like the above, after statementParsed(nullptr), when whoever
+        // got statements has to let go of them
+        Parser(TokenStream& stream, std::function<void(StmtNode*)> statementParsed);
         
         ~Parser();
 
+        Parser(const Parser&) = delete;
+        Parser& operator=(const Parser&) = delete;
+
+        // Root of the parsed program, owned by the parser
+        Program* getProgram() { return ast_root; }
+
         // Helper functions
         
         bool isAtEnd() { return peek()->getType() == TokenType::END_OF_FILE; }
-        Token* peek() { return tokens.at(current); }
+        Token* peek() { has(current); return tokens.at(current); }
+        Token* peekNext() { return has(current + 1) ? tokens.at(current + 1) : tokens.back(); }
         Token* previous() const { return tokens.at(current - 1); }
         Token* advance() { if (!isAtEnd()) current++; return previous(); }
         bool check(TokenType type) { return !isAtEnd() && peek()->getType() == type; }
@@ -48,9 +82,13 @@ class Parser {
 
         StmtNode* parsePrintStmt();
 
-        StmtNode* parseBreakStmt() { return nullptr; } // Unsupported
+        StmtNode* parseWhileStmt();
+
+        StmtNode* parseForStmt();
 
-        StmtNode* parseContinueStmt() { return nullptr; } // Unsupported
+        StmtNode* parseBreakStmt();
+
+        StmtNode* parseContinueStmt();
 
         StmtNode* parseExprStmt();
 
@@ -78,6 +116,14 @@ class Parser {
 
         ExprNode* parsePrimary();
 
+        ExprNode* parseDeriv();
+
+        ExprNode* parseIntegral();
+
+        ExprNode* parseFunctionLiteral();
+
+        ExprNode* parseCall(ExprNode* callee);
+
         // Print Tree
         void printTree();
 
@@ -0,0 +1,142 @@
+#include "pipeline.h"
+#include "spsc_queue.h"
+#include "../calculus/dual.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Thrown out of Lexer::tokenize once the parser stopped taking tokens
+    struct LexingCancelled {};
+
+    // The parser's end of the token queue
+    class QueuedTokens : public TokenStream {
+        public:
+            explicit QueuedTokens(SpscQueue<std::vector<Token*>>& queue) : queue(queue) {}
+
+            bool read(std::vector<Token*>& tokens) override {
+                if (!queue.pop(batch)) return false;
+                tokens.insert(tokens.end(), batch.begin(), batch.end());
+                return true;
+            }
+
+        private:
+            SpscQueue<std::vector<Token*>>& queue;
+            std::vector<Token*> batch;
+    };
+}
+
+const PipelineStage& PipelineStats::slowest() const {
+    const PipelineStage* stage = &lexer;
+    if (parser.busyMs() > stage->busyMs()) stage = &parser;
+    if (codegen.busyMs() > stage->busyMs()) stage = &codegen;
+    return *stage;
+}
+
+bool runPipeline(const std::string& src, const std::string& moduleName, const PipelineOptions& opts,
+                 PipelinedProgram& program, PipelineStats& stats) {
+    std::unique_ptr<Lexer> lexer;
+    try { lexer.reset(new Lexer(src)); }
+    catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    lexer->setDebug(false);
+
+    auto start = std::chrono::steady_clock::now();
+    SpscQueue<std::vector<Token*>> tokens(opts.queueDepth);
+    SpscQueue<StmtNode*> statements(opts.queueDepth);
+
+    std::thread lexing([&]() {
+        try {
+            lexer->tokenize([&](std::vector<Token*> batch) {
+                stats.lexer.items += batch.size();
+                if (!tokens.push(std::move(batch))) throw LexingCancelled();
+            }, opts.tokenBatch);
+        } catch (const LexingCancelled&) {}
+        tokens.finish();
+        stats.lexer.ms = msSince(start);
+        stats.lexer.waitMs = tokens.pushWaitMs();
+    });
+
+    // On a syntax error the parser frees the statements it handed out, after
+    // the codegen thread has let go of them
+    std::atomic<bool> abandoned{false};
+    std::promise<void> codegenDone;
+    std::shared_future<void> codegenStopped = codegenDone.get_future().share();
+
+    std::string syntaxError;
+    std::thread parsing([&]() {
+        QueuedTokens stream(tokens);
+        try {
+            program.tree.reset(new Parser(stream, [&](StmtNode* stmt) {
+                if (!stmt) {
+                    abandoned = true;
+                    statements.finish();
+                    codegenStopped.wait();
+                    return;
+                }
+                stats.parser.items++;
+                statements.push(stmt);
+            }));
+        } catch (const std::runtime_error& e) {
+            syntaxError = e.what();
+            tokens.close();
+        }
+        statements.finish();
+        stats.parser.ms = msSince(start);
+        stats.parser.waitMs = tokens.popWaitMs() + statements.pushWaitMs();
+    });
+
+    llvm::Function* entry = nullptr;
+    bool failed = false;
+    std::thread generating([&]() {
+        program.ctx.reset(new codegen_ctx(moduleName));
+        program.ctx->loopHints = opts.loops;
+        entry = Program::beginEntry(*program.ctx);
+
+        std::vector<std::string> seeds;
+        StmtNode* stmt = nullptr;
+        while (statements.pop(stmt) && !abandoned) {
+            // A seed after statements were generated without it, the rest only waits for the tree
+            calculus::collectDerivVars(stmt, seeds);
+            if (seeds.size() != program.ctx->adSeeds.size()) {
+                if (stats.codegen.items) stats.regenerated = true;
+                else program.ctx->adSeeds = seeds;
+            }
+            if (stats.regenerated) continue;
+
+            if (!stmt->codegen(*program.ctx)) failed = true;
+            stats.codegen.items++;
+        }
+        stats.codegen.waitMs = statements.popWaitMs();
+        codegenDone.set_value();
+    });
+
+    lexing.join();
+    parsing.join();
+    generating.join();
+
+    if (!syntaxError.empty()) {
+        std::cerr << "Syntax error: " << syntaxError << std::endl;
+        return false;
+    }
+
+    if (stats.regenerated) {
+        program.ctx.reset(new codegen_ctx(moduleName));
+        program.ctx->loopHints = opts.loops;
+        entry = program.tree->getProgram()->codegenEntry(*program.ctx);
+    } else {
+        entry = Program::finishEntry(*program.ctx, entry, failed);
+    }
+    stats.codegen.ms = stats.ms = msSince(start);
+    return entry != nullptr;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "../parser/parser.h"
+
+// Pipelined front end (--pipeline): lexing, parsing and code generation of one
+// program on three threads, so the stages overlap instead of running one after
+// another
+//
+//     lexer  --token batches-->  parser  --top level statements-->  codegen
+//
+// connected by lock-free single producer, single consumer queues
+// (spsc_queue.h). The lexer hands over tokens a batch of lines at a time, the
+// parser each top level statement as soon as it is complete, and the codegen
+// thread emits it into crunch_main right away (Program::beginEntry).
+//
+// Statement codegen depends on the program's AD seeds (calculus/dual.h), which
+// are only known once all of it is parsed. Codegen goes ahead with the seeds
+// of the statements seen so far; when a later statement adds one, the module
+// is generated again from the whole tree once parsing is done.
+
+struct PipelineOptions {
+    size_t tokenBatch = 256; // tokens per batch, at least (whole lines)
+    size_t queueDepth = 64; // batches or statements in flight between two stages
+    LoopHints loops;
+};
+
+struct PipelineStage {
+    const char* name = "";
+    size_t items = 0; // tokens lexed, statements parsed, statements generated
+    double ms = 0.0; // from the pipeline's start to the stage's end
+    double waitMs = 0.0; // waiting on its queues, for input or for room
+
+    double busyMs() const { return ms - waitMs; }
+};
+
+struct PipelineStats {
+    PipelineStage lexer, parser, codegen;
+    double ms = 0.0; // start to crunch_main generated
+    bool regenerated = false; // a late AD seed, the module was generated again
+
+    PipelineStats() { lexer.name = "lex"; parser.name = "parse"; codegen.name = "codegen"; }
+
+    // Busy time over the pipeline's time, 1 when a stage never waits
+    double utilization(const PipelineStage& stage) const { return ms > 0 ? stage.busyMs() / ms : 0.0; }
+    const PipelineStage& slowest() const;
+};
+
+// crunch_main generated into ctx. The parser owns the tree, which the module
+// refers to (function literals)
+struct PipelinedProgram {
+    std::unique_ptr<Parser> tree;
+    std::unique_ptr<codegen_ctx> ctx;
+};
+
+// Runs the front end on src into program, the module named moduleName. False
+// after reporting syntax or codegen errors on stderr
+bool runPipeline(const std::string& src, const std::string& moduleName, const PipelineOptions& opts,
+                 PipelinedProgram& program, PipelineStats& stats);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Bounded single producer, single consumer queue without locks: a ring of
+// slots, one thread pushes and one other thread pops. Only the producer writes
+// the tail and only the consumer the head, each reads the other's index with
+// acquire, so an item is complete by the time its slot index is visible. Each
+// side keeps a copy of the other's index and only rereads it when the ring
+// looks full (or empty).
+//
+// push and pop wait, yielding the CPU, while the ring is full or empty, and
+// add up the time spent waiting (pushWaitMs() on the producer's side,
+// popWaitMs() on the consumer's).
+template <typename T>
+class SpscQueue {
+    public:
+        // capacity is rounded up to a power of two
+        explicit SpscQueue(size_t capacity) {
+            size_t n = 2;
+            while (n < capacity) n <<= 1;
+            slots.resize(n);
+            mask = n - 1;
+        }
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // Producer. False if the consumer closed the queue, item is dropped
+        bool push(T item) {
+            size_t tail = tailIndex.load(std::memory_order_relaxed);
+            if (tail - headCopy == slots.size()) {
+                auto start = std::chrono::steady_clock::now();
+                while (tail - (headCopy = headIndex.load(std::memory_order_acquire)) == slots.size()) {
+                    if (closed.load(std::memory_order_acquire)) return false;
+                    std::this_thread::yield();
+                }
+                pushWait += std::chrono::steady_clock::now() - start;
+            }
+            slots[tail & mask] = std::move(item);
+            tailIndex.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Producer: nothing more is coming
+        void finish() { finished.store(true, std::memory_order_release); }
+
+        // Consumer. False once the producer finished and every item was popped
+        bool pop(T& item) {
+            size_t head = headIndex.load(std::memory_order_relaxed);
+            if (head == tailCopy) {
+                auto start = std::chrono::steady_clock::now();
+                while (head == (tailCopy = tailIndex.load(std::memory_order_acquire))) {
+                    // Items pushed before finish() are visible once it is
+                    if (finished.load(std::memory_order_acquire) && head == (tailCopy = tailIndex.load(std::memory_order_acquire))) {
+                        popWait += std::chrono::steady_clock::now() - start;
+                        return false;
+                    }
+                    std::this_thread::yield();
+                }
+                popWait += std::chrono::steady_clock::now() - start;
+            }
+            item = std::move(slots[head & mask]);
+            headIndex.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer: stops taking items, a waiting or later push returns false
+        void close() { closed.store(true, std::memory_order_release); }
+
+        double pushWaitMs() const { return std::chrono::duration<double, std::milli>(pushWait).count(); }
+        double popWaitMs() const { return std::chrono::duration<double, std::milli>(popWait).count(); }
+
+    private:
+        std::vector<T> slots;
+        size_t mask = 0;
+
+        // Producer's and consumer's lines apart, so the two sides don't share a cache line
+        alignas(64) std::atomic<size_t> tailIndex{0};
+        size_t headCopy = 0;
+        std::chrono::steady_clock::duration pushWait{0};
+
+        alignas(64) std::atomic<size_t> headIndex{0};
+        size_t tailCopy = 0;
+        std::chrono::steady_clock::duration popWait{0};
+
+        alignas(64) std::atomic<bool> finished{false};
+        std::atomic<bool> closed{false};
+};
@@ -0,0 +1,43 @@
+#include "error.h"
+#include "print.h"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+    // Where crunch_runtime_error goes back to on this thread, nullptr to exit.
+    // Only generated code runs between it and the fault, nothing with destructors
+    thread_local std::jmp_buf* recovery = nullptr;
+}
+
+extern "C" const char* crunch_fault_message(int32_t kind) {
+    return kind == CRUNCH_DIVISION_OVERFLOW ? "integer overflow in division" : "integer division by zero";
+}
+
+extern "C" void crunch_runtime_error(int32_t line, int32_t kind) {
+    crunch_flush();
+    std::cerr << "Runtime error";
+    if (line > 0) std::cerr << " at line " << line;
+    std::cerr << ": " << crunch_fault_message(kind) << std::endl;
+
+    if (recovery) std::longjmp(*recovery, 1);
+    std::exit(1);
+}
+
+extern "C" int crunch_run_main(int (*main)()) {
+    std::jmp_buf here;
+    std::jmp_buf* outer = recovery;
+    if (setjmp(here)) {
+        recovery = outer;
+        return -1;
+    }
+    recovery = &here;
+    int result = main();
+    recovery = outer;
+    return result;
+}
+
+UnrecoverableErrors::UnrecoverableErrors() : saved(recovery) { recovery = nullptr; }
+
+UnrecoverableErrors::~UnrecoverableErrors() { recovery = saved; }
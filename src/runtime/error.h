@@ -0,0 +1,42 @@
+#pragma once
+
+#include <csetjmp>
+#include <cstdint>
+
+// Runtime errors of generated code, reported the way the bytecode VM reports
+// them: "Runtime error at line N: <message>" on stderr, after this thread's
+// print output is flushed
+extern "C" {
+
+    enum crunch_fault {
+        CRUNCH_DIVISION_BY_ZERO = 0,
+        CRUNCH_DIVISION_OVERFLOW = 1, // INT32_MIN / -1
+    };
+
+    // Called from generated code on an int division fault. line is 1-based, 0
+    // when unknown. Reports the error, then abandons the program running under
+    // crunch_run_main on this thread, or exits with status 1 without one
+    [[noreturn]] void crunch_runtime_error(int32_t line, int32_t kind);
+
+    // Calls a program's entry point (crunch_main) and returns its result, or
+    // -1 once a runtime error stopped it. Lets one process run many programs (--batch)
+    int crunch_run_main(int (*main)());
+
+    // What crunch_runtime_error reports for kind
+    const char* crunch_fault_message(int32_t kind);
+
+}
+
+// While one is alive, a runtime error on this thread exits the process even
+// under crunch_run_main: for runtime code whose frames can't be skipped
+class UnrecoverableErrors {
+    public:
+        UnrecoverableErrors();
+        ~UnrecoverableErrors();
+
+        UnrecoverableErrors(const UnrecoverableErrors&) = delete;
+        UnrecoverableErrors& operator=(const UnrecoverableErrors&) = delete;
+
+    private:
+        std::jmp_buf* saved;
+};
@@ -0,0 +1,118 @@
+#include "print.h"
+#include "str.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+    // Worst case for one formatted number, shortest double is at most 24 chars
+    const size_t MAX_NUMBER = 32;
+
+    class OutputBuffer {
+        private:
+            static const size_t SIZE = 64 * 1024;
+            char data[SIZE];
+            size_t used = 0;
+            crunch_output sink = nullptr; // stdout when null
+            void* target = nullptr;
+
+            void emit(const char* s, size_t n) {
+                if (sink) { sink(target, s, n); return; }
+                std::fwrite(s, 1, n, stdout);
+                std::fflush(stdout);
+            }
+
+        public:
+            ~OutputBuffer() { flush(); }
+
+            void flush() {
+                if (!used) return;
+                emit(data, used);
+                used = 0;
+            }
+
+            void redirect(crunch_output write, void* to) {
+                flush();
+                sink = write;
+                target = to;
+            }
+
+            void write(const char* s, size_t n) {
+                if (used + n > SIZE) {
+                    flush();
+                    // Too big to buffer, goes out directly
+                    if (n > SIZE) { emit(s, n); return; }
+                }
+                std::memcpy(data + used, s, n);
+                used += n;
+            }
+
+            // Room for one number, formatters write straight into the buffer
+            char* reserve() {
+                if (used + MAX_NUMBER > SIZE) flush();
+                return data + used;
+            }
+            void commit(char* end) { used = end - data; }
+    };
+
+    thread_local OutputBuffer out;
+
+    // to_chars without a format is the shortest representation that parses
+    // back to the same double (Ryu in libstdc++), 0.1 prints as 0.1 not 0.10000000000000001
+    void printDouble(double value) {
+        char* p = out.reserve();
+        out.commit(crunch_format_double(p, p + MAX_NUMBER, value));
+    }
+
+    void printInt(int32_t value) {
+        char* p = out.reserve();
+        out.commit(std::to_chars(p, p + MAX_NUMBER, value).ptr);
+    }
+}
+
+extern "C" void crunch_print(const char* format, const uint64_t* args) {
+    const char* text = format;
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%') continue;
+
+        out.write(text, p - text);
+        switch (*++p) {
+            case 'i': printInt((int32_t)*args++); break;
+            case 'd': {
+                double d;
+                std::memcpy(&d, args++, sizeof d);
+                printDouble(d);
+                break;
+            }
+            case 'b': {
+                bool b = *args++ != 0;
+                out.write(b ? "true" : "false", b ? 4 : 5);
+                break;
+            }
+            case 's': {
+                crunch_string s;
+                std::memcpy(&s, args, sizeof s);
+                args += 2;
+                out.write(crunch_string_chars(s), crunch_string_length(s));
+                break;
+            }
+            case '%': out.write("%", 1); break;
+            default: return; // malformed, codegen never emits this
+        }
+        text = p + 1;
+    }
+    out.write(text, std::strlen(text));
+}
+
+extern "C" void crunch_flush() { out.flush(); }
+
+extern "C" void crunch_set_output(crunch_output write, void* target) { out.redirect(write, target); }
+
+extern "C" char* crunch_format_double(char* first, char* last, double value) {
+    if (std::isnan(value)) value = std::numeric_limits<double>::quiet_NaN();
+    return std::to_chars(first, last, value).ptr;
+}
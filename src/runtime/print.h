@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Output runtime behind print(...), called from generated code
+//
+// Output goes through a thread-local buffer that is written to stdout when it
+// fills up, on crunch_flush() and when the thread (or the program) exits.
+// A thread can send its output somewhere else with crunch_set_output().
+extern "C" {
+
+    typedef void (*crunch_output)(void* target, const char* data, size_t size);
+
+    // One call per print statement. format is the text to print with one
+    // directive per argument: %i int32, %d double, %b bool, %s string, %% a
+    // literal percent sign. args holds one 8 byte slot per directive, ints and
+    // bools sign extended, doubles as their bits. Strings take two slots, the
+    // two halves of the crunch_string (see str.h).
+    void crunch_print(const char* format, const uint64_t* args);
+
+    // Writes this thread's buffer out (stdout unless redirected)
+    void crunch_flush();
+
+    // This thread's output goes to write(target, ...) from now on, or back to
+    // stdout with a null write. What is buffered goes to the old destination first
+    void crunch_set_output(crunch_output write, void* target);
+
+    // Writes value the way print(...) does into [first, last), returns the end.
+    // Every NaN is "nan": its sign bit depends on how it was computed, which
+    // differs between the interpreter and the JIT
+    char* crunch_format_double(char* first, char* last, double value);
+
+}
@@ -0,0 +1,297 @@
+#include "quadrature.h"
+#include "error.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    // Kronrod abscissae, xgk[1], xgk[3], xgk[5] and the center are the Gauss points
+    const double xgk[8] = {
+        0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+    };
+
+    const double wgk[8] = {
+        0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+    };
+
+    const double wg[4] = {
+        0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+        0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+    };
+
+    const int NODES = 15;
+
+    struct Interval {
+        double a, b;
+        double value, error;
+
+        bool operator<(const Interval& other) const { return error < other.error; }
+    };
+
+    // Node layout per interval: center, then center -/+ h * xgk[j] for j in [0, 7)
+    void fillNodes(double a, double b, double* xs) {
+        double c = 0.5 * (a + b);
+        double h = 0.5 * (b - a);
+        xs[0] = c;
+        for (int j = 0; j < 7; ++j) {
+            xs[1 + j] = c - h * xgk[j];
+            xs[8 + j] = c + h * xgk[j];
+        }
+    }
+
+    // QUADPACK qk15 rule applied to pre-evaluated nodes
+    Interval applyRule(double a, double b, const double* ys) {
+        const double epmach = std::numeric_limits<double>::epsilon();
+        const double uflow = std::numeric_limits<double>::min();
+
+        double h = 0.5 * (b - a);
+        double dh = std::fabs(h);
+
+        double fc = ys[0];
+        double resg = fc * wg[3];
+        double resk = fc * wgk[7];
+        double resabs = std::fabs(resk);
+
+        for (int j = 0; j < 7; ++j) {
+            double f1 = ys[1 + j], f2 = ys[8 + j];
+            double fsum = f1 + f2;
+            resk += wgk[j] * fsum;
+            resabs += wgk[j] * (std::fabs(f1) + std::fabs(f2));
+            if (j % 2 == 1) resg += wg[j / 2] * fsum;
+        }
+
+        double reskh = resk * 0.5;
+        double resasc = wgk[7] * std::fabs(fc - reskh);
+        for (int j = 0; j < 7; ++j) {
+            resasc += wgk[j] * (std::fabs(ys[1 + j] - reskh) + std::fabs(ys[8 + j] - reskh));
+        }
+
+        Interval iv;
+        iv.a = a;
+        iv.b = b;
+        iv.value = resk * h;
+        resabs *= dh;
+        resasc *= dh;
+
+        double err = std::fabs((resk - resg) * h);
+        if (resasc != 0.0 && err != 0.0) err = resasc * std::min(1.0, std::pow(200.0 * err / resasc, 1.5));
+        if (resabs > uflow / (50.0 * epmach)) err = std::max(epmach * 50.0 * resabs, err);
+        iv.error = err;
+        return iv;
+    }
+
+    // setIntegralThreads, 1 on the workers and while a parallel round runs on the caller
+    thread_local unsigned integralThreads = 0;
+
+    // Restores integralThreads when a round's chunk is done
+    class SerialIntegrals {
+        public:
+            SerialIntegrals() : saved(integralThreads) { integralThreads = 1; }
+            ~SerialIntegrals() { integralThreads = saved; }
+
+        private:
+            unsigned saved;
+    };
+
+    // Workers for parallel refinement rounds, shared by every integral of the
+    // process and never stopped: a fault in an integrand exits from whatever
+    // thread it is on, which can't wait for the others to join
+    class RoundWorkers {
+        public:
+            static RoundWorkers& get() {
+                static RoundWorkers* workers = new RoundWorkers();
+                return *workers;
+            }
+
+            // Calls chunk(i) for every i in [0, count), the caller takes the
+            // first and whatever is still queued. Returns when all are done
+            void run(int count, const std::function<void(int)>& chunk) {
+                std::mutex lock;
+                std::condition_variable finished;
+                int remaining = count - 1;
+
+                {
+                    std::lock_guard<std::mutex> guard(queueLock);
+                    while ((int)threads.size() < count - 1) threads.emplace_back([this]() { work(); });
+                    for (int i = 1; i < count; ++i) {
+                        jobs.push_back([&, i]() {
+                            chunk(i);
+                            std::lock_guard<std::mutex> done(lock);
+                            if (--remaining == 0) finished.notify_one();
+                        });
+                    }
+                }
+                wake.notify_all();
+
+                chunk(0);
+                std::function<void()> job;
+                while (take(job, false)) job();
+
+                std::unique_lock<std::mutex> wait(lock);
+                finished.wait(wait, [&]() { return remaining == 0; });
+            }
+
+        private:
+            std::mutex queueLock;
+            std::condition_variable wake;
+            std::deque<std::function<void()>> jobs;
+            std::vector<std::thread> threads;
+
+            bool take(std::function<void()>& job, bool block) {
+                std::unique_lock<std::mutex> guard(queueLock);
+                if (block) wake.wait(guard, [this]() { return !jobs.empty(); });
+                if (jobs.empty()) return false;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                return true;
+            }
+
+            void work() {
+                integralThreads = 1;
+                std::function<void()> job;
+                while (take(job, true)) job();
+            }
+    };
+
+    // Evaluates the nodes of count consecutive subintervals, split across worker threads
+    void evaluate(crunch_integrand f, const double* env, const double* xs, double* ys, int count, unsigned threads) {
+        if (threads <= 1 || count <= 1) {
+            f(xs, ys, (int64_t)count * NODES, env);
+            return;
+        }
+
+        int chunks = (int)std::min<unsigned>(threads, count);
+        int per = (count + chunks - 1) / chunks;
+        chunks = (count + per - 1) / per;
+
+        RoundWorkers::get().run(chunks, [=](int c) {
+            SerialIntegrals serial;
+            int first = c * per;
+            int last = std::min(count, first + per);
+            f(xs + first * NODES, ys + first * NODES, (int64_t)(last - first) * NODES, env);
+        });
+    }
+}
+
+void setIntegralThreads(unsigned threads) {
+    integralThreads = threads;
+}
+
+QuadratureResult integrateGK15(crunch_integrand f, const double* env, double a, double b, const QuadratureOptions& opts) {
+    QuadratureResult result;
+
+    if (a == b) {
+        result.converged = true;
+        return result;
+    }
+
+    unsigned threads = opts.threads ? opts.threads : integralThreads;
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<double> xs(NODES), ys(NODES);
+
+    // First interval doubles as the cost probe for the parallel decision
+    fillNodes(a, b, xs.data());
+    auto start = std::chrono::steady_clock::now();
+    f(xs.data(), ys.data(), NODES, env);
+    double probe = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.parallel = threads > 1 && probe > opts.parallelThreshold;
+    unsigned width = result.parallel ? threads : 1; // intervals bisected per round
+
+    std::priority_queue<Interval> active;
+    std::vector<Interval> finished; // too narrow to bisect any further
+
+    Interval whole = applyRule(a, b, ys.data());
+    active.push(whole);
+    result.evaluations = NODES;
+
+    double total = whole.value;
+    double error = whole.error;
+    int intervals = 1;
+
+    std::vector<Interval> picked;
+    while (!active.empty() && intervals < opts.maxIntervals) {
+        double tolerance = std::max(opts.epsabs, opts.epsrel * std::fabs(total));
+        if (error <= tolerance) break;
+
+        // Worst intervals first
+        picked.clear();
+        while (!active.empty() && picked.size() < width && intervals + (int)picked.size() < opts.maxIntervals) {
+            Interval iv = active.top();
+            active.pop();
+
+            double mid = 0.5 * (iv.a + iv.b);
+            if (mid <= std::min(iv.a, iv.b) || mid >= std::max(iv.a, iv.b) ||
+                std::fabs(iv.b - iv.a) <= 4.0 * std::numeric_limits<double>::epsilon() * std::fabs(mid)) {
+                finished.push_back(iv);
+                continue;
+            }
+            picked.push_back(iv);
+        }
+        if (picked.empty()) break;
+
+        // Bisect, one batch for every node of the round
+        int count = (int)picked.size() * 2;
+        xs.resize(count * NODES);
+        ys.resize(count * NODES);
+        for (size_t i = 0; i < picked.size(); ++i) {
+            double mid = 0.5 * (picked[i].a + picked[i].b);
+            fillNodes(picked[i].a, mid, &xs[(2 * i) * NODES]);
+            fillNodes(mid, picked[i].b, &xs[(2 * i + 1) * NODES]);
+        }
+
+        evaluate(f, env, xs.data(), ys.data(), count, result.parallel ? threads : 1);
+        result.evaluations += (long)count * NODES;
+
+        for (size_t i = 0; i < picked.size(); ++i) {
+            double mid = 0.5 * (picked[i].a + picked[i].b);
+            Interval left = applyRule(picked[i].a, mid, &ys[(2 * i) * NODES]);
+            Interval right = applyRule(mid, picked[i].b, &ys[(2 * i + 1) * NODES]);
+
+            total += left.value + right.value - picked[i].value;
+            error += left.error + right.error - picked[i].error;
+            active.push(left);
+            active.push(right);
+            intervals++;
+        }
+    }
+
+    // Re-sum to get rid of the drift from incremental updates
+    total = 0.0;
+    error = 0.0;
+    for (auto& iv : finished) { total += iv.value; error += iv.error; }
+    while (!active.empty()) {
+        total += active.top().value;
+        error += active.top().error;
+        active.pop();
+    }
+
+    result.value = total;
+    result.error = error;
+    result.intervals = intervals;
+    result.converged = error <= std::max(opts.epsabs, opts.epsrel * std::fabs(total));
+    return result;
+}
+
+extern "C" double crunch_integrate(crunch_integrand f, const double* env, double a, double b) {
+    // A fault in the integrand can't skip the worker threads' frames
+    UnrecoverableErrors exit;
+    return integrateGK15(f, env, a, b).value;
+}
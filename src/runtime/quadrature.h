@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+// Native adaptive Gauss-Kronrod (G7K15) quadrature backing integral(expr, var, a, b)
+//
+// Compiled integrands are batch functions: they evaluate the integrand at n
+// abscissae in one call, so the 15 nodes of an interval (or the nodes of a
+// whole refinement round) go through a single vectorizable loop.
+
+extern "C" {
+
+    // ys[i] = f(xs[i]) for i in [0, n), env holds the captured script variables
+    typedef void (*crunch_integrand)(const double* xs, double* ys, int64_t n, const double* env);
+
+    // Entry point called from generated code, default tolerances
+    double crunch_integrate(crunch_integrand f, const double* env, double a, double b);
+
+}
+
+struct QuadratureOptions {
+    double epsabs = 1e-10;
+    double epsrel = 1e-10;
+    int maxIntervals = 4096;
+
+    // 0 = the calling thread's share, see setIntegralThreads
+    unsigned threads = 0;
+
+    // Refinement rounds go parallel once a single 15 node batch takes longer than this (seconds)
+    double parallelThreshold = 20e-6;
+};
+
+struct QuadratureResult {
+    double value = 0.0;
+    double error = 0.0;
+    int intervals = 0;
+    long evaluations = 0;
+    bool converged = false;
+    bool parallel = false;
+};
+
+// Threads the integrals started on the calling thread may use, 0 (the default)
+// = std::thread::hardware_concurrency(). Parallel callers (--batch scripts,
+// --eval blocks) give each worker its share; integrands running on quadrature
+// workers always integrate serially. Refinement rounds run on one process-wide
+// set of workers, started on first use
+void setIntegralThreads(unsigned threads);
+
+QuadratureResult integrateGK15(crunch_integrand f, const double* env, double a, double b, const QuadratureOptions& opts = QuadratureOptions());
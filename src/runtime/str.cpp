@@ -0,0 +1,163 @@
+#include "str.h"
+#include "print.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+    struct Buffer {
+        Buffer* next; // the thread's buffers, newest first
+        uint32_t capacity;
+        uint32_t used; // chars written, the end of the longest string in the buffer
+        bool marked; // reachable from the roots of a collection
+        char data[];
+    };
+
+    // Collections wait for this much, or as much as the last one kept, so
+    // their cost per allocated byte stays constant
+    const size_t MIN_COLLECTION = 1 << 20;
+
+    struct Arena {
+        Buffer* buffers = nullptr;
+        size_t allocated = 0; // bytes since the last collection
+        size_t live = 0; // bytes the last collection kept
+
+        ~Arena() { reset(); }
+
+        Buffer* allocate(size_t capacity) {
+            Buffer* buf = (Buffer*)std::malloc(sizeof(Buffer) + capacity);
+            if (!buf) { std::fputs("crunch: out of memory\n", stderr); std::abort(); }
+            buf->next = buffers;
+            buf->capacity = (uint32_t)capacity;
+            buf->marked = false;
+            buffers = buf;
+            allocated += capacity;
+            return buf;
+        }
+
+        // Frees the unmarked buffers, unmarks the rest
+        void sweep() {
+            live = 0;
+            for (Buffer** link = &buffers; *link;) {
+                Buffer* buf = *link;
+                if (buf->marked) {
+                    buf->marked = false;
+                    live += buf->capacity;
+                    link = &buf->next;
+                } else {
+                    *link = buf->next;
+                    std::free(buf);
+                }
+            }
+            allocated = 0;
+        }
+
+        void reset() {
+            while (buffers) {
+                Buffer* buf = buffers;
+                buffers = buf->next;
+                std::free(buf);
+            }
+            allocated = live = 0;
+        }
+    };
+
+    thread_local Arena arena;
+
+    Buffer* bufferOf(const crunch_string& s) {
+        return (Buffer*)(s.heap.data - offsetof(Buffer, data));
+    }
+
+    crunch_string heapString(Buffer* buf, size_t length) {
+        crunch_string s = {};
+        s.heap.data = buf->data;
+        s.heap.length = (uint32_t)length;
+        s.heap.tag = CRUNCH_STRING_BUFFER;
+        return s;
+    }
+
+    crunch_string makeString(const char* chars, size_t length) {
+        if (length <= CRUNCH_STRING_INLINE_MAX) {
+            crunch_string s = {};
+            std::memcpy(s.chars, chars, length);
+            s.heap.tag = (uint8_t)length;
+            return s;
+        }
+
+        Buffer* buf = arena.allocate(length);
+        buf->used = (uint32_t)length;
+        std::memcpy(buf->data, chars, length);
+        return heapString(buf, length);
+    }
+}
+
+extern "C" crunch_string crunch_str_concat(crunch_string a, crunch_string b) {
+    size_t la = crunch_string_length(a), lb = crunch_string_length(b);
+    if (lb == 0) return a;
+    if (la == 0) return b;
+
+    size_t total = la + lb;
+    if (total > UINT32_MAX / 2) { std::fputs("crunch: string too long\n", stderr); std::abort(); }
+
+    if (total <= CRUNCH_STRING_INLINE_MAX) {
+        crunch_string s = {};
+        std::memcpy(s.chars, crunch_string_chars(a), la);
+        std::memcpy(s.chars + la, crunch_string_chars(b), lb);
+        s.heap.tag = (uint8_t)total;
+        return s;
+    }
+
+    // Nothing was appended after a yet, its buffer can take b in place
+    if (a.heap.tag == CRUNCH_STRING_BUFFER) {
+        Buffer* buf = bufferOf(a);
+        if (buf->used == la && total <= buf->capacity) {
+            std::memcpy(buf->data + la, crunch_string_chars(b), lb);
+            buf->used = (uint32_t)total;
+            return heapString(buf, total);
+        }
+    }
+
+    // Doubling leaves room for the next appends
+    size_t capacity = total < 32 ? 32 : 2 * total;
+    Buffer* buf = arena.allocate(capacity);
+    buf->used = (uint32_t)total;
+    std::memcpy(buf->data, crunch_string_chars(a), la);
+    std::memcpy(buf->data + la, crunch_string_chars(b), lb);
+    return heapString(buf, total);
+}
+
+extern "C" int32_t crunch_str_equal(crunch_string a, crunch_string b) {
+    size_t la = crunch_string_length(a);
+    return la == crunch_string_length(b) && std::memcmp(crunch_string_chars(a), crunch_string_chars(b), la) == 0;
+}
+
+extern "C" crunch_string crunch_str_from_int(int32_t value) {
+    char chars[16];
+    return makeString(chars, std::to_chars(chars, chars + sizeof chars, value).ptr - chars);
+}
+
+extern "C" crunch_string crunch_str_from_double(double value) {
+    char chars[32];
+    return makeString(chars, crunch_format_double(chars, chars + sizeof chars, value) - chars);
+}
+
+extern "C" crunch_string crunch_str_from_bool(int32_t value) {
+    return value ? makeString("true", 4) : makeString("false", 5);
+}
+
+extern "C" int32_t crunch_str_collect_due() { return arena.allocated >= std::max(MIN_COLLECTION, arena.live); }
+
+extern "C" void crunch_str_collect(const crunch_string* roots, int64_t count) {
+    if (!crunch_str_collect_due()) return;
+
+    for (int64_t i = 0; i < count; ++i) {
+        if (roots[i].heap.tag == CRUNCH_STRING_BUFFER) bufferOf(roots[i])->marked = true;
+    }
+    arena.sweep();
+}
+
+extern "C" void crunch_str_reset() { arena.reset(); }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Script string values, called from generated code
+//
+// A string is 16 bytes, passed and returned in two registers. Up to 15 chars
+// are stored inline with the length in the last byte, so all zero bytes is the
+// empty string. Longer strings point to their chars: either a literal the
+// compiler emitted as an interned constant, or a runtime buffer. Strings are
+// immutable and not NUL terminated.
+//
+// Buffers grow by doubling. s + t appends in place when s ends where its
+// buffer's used part ends, so building a string from N pieces is O(N) while
+// every earlier value stays valid. Buffers belong to the thread that made
+// them and must not be shared between threads.
+//
+// Buffers are reclaimed by crunch_str_collect, which generated code calls at
+// the back edge of loops that make strings, with the string variables in
+// scope as roots (nothing else holds a string there), and all at once by
+// crunch_str_reset after a program ran.
+
+struct crunch_string {
+    union {
+        char chars[16];
+        struct {
+            const char* data;
+            uint32_t length;
+            uint8_t reserved[3];
+            uint8_t tag;
+        } heap;
+    };
+};
+
+const uint8_t CRUNCH_STRING_INLINE_MAX = 15;
+const uint8_t CRUNCH_STRING_LITERAL = 0x80; // tag of long literals, tags below are inline lengths
+const uint8_t CRUNCH_STRING_BUFFER = 0x81;
+
+inline size_t crunch_string_length(const crunch_string& s) {
+    return s.heap.tag < CRUNCH_STRING_LITERAL ? s.heap.tag : s.heap.length;
+}
+
+inline const char* crunch_string_chars(const crunch_string& s) {
+    return s.heap.tag < CRUNCH_STRING_LITERAL ? s.chars : s.heap.data;
+}
+
+// String over chars that outlive it, no copy for long strings (codegen builds
+// the same constants for literals)
+inline crunch_string crunch_string_literal(const char* chars, size_t length) {
+    crunch_string s = {};
+    if (length <= CRUNCH_STRING_INLINE_MAX) {
+        for (size_t i = 0; i < length; ++i) s.chars[i] = chars[i];
+        s.heap.tag = (uint8_t)length;
+        return s;
+    }
+    s.heap.data = chars;
+    s.heap.length = (uint32_t)length;
+    s.heap.tag = CRUNCH_STRING_LITERAL;
+    return s;
+}
+
+extern "C" {
+
+    crunch_string crunch_str_concat(crunch_string a, crunch_string b);
+    int32_t crunch_str_equal(crunch_string a, crunch_string b);
+
+    // Same text print(...) produces for the value
+    crunch_string crunch_str_from_int(int32_t value);
+    crunch_string crunch_str_from_double(double value);
+    crunch_string crunch_str_from_bool(int32_t value);
+
+    // Frees this thread's buffers none of roots[0, count) points to, once
+    // enough was allocated since the last collection to be worth it
+    void crunch_str_collect(const crunch_string* roots, int64_t count);
+
+    // Nonzero when crunch_str_collect would collect, for callers that pay to gather the roots
+    int32_t crunch_str_collect_due();
+
+    // Frees every buffer of this thread, no string made on it is used again
+    void crunch_str_reset();
+
+}
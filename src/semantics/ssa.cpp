@@ -0,0 +1,94 @@
+#include "ssa.h"
+
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+
+SSAVariable* SSABuilder::declare(llvm::Type* type, const std::string& name) {
+    variables.push_back({name, type});
+    return &variables.back();
+}
+
+void SSABuilder::write(SSAVariable* var, llvm::BasicBlock* block, llvm::Value* value) {
+    currentDef[var][block] = value;
+}
+
+llvm::Value* SSABuilder::read(SSAVariable* var, llvm::BasicBlock* block) {
+    auto& defs = currentDef[var];
+    auto it = defs.find(block);
+    if (it != defs.end() && it->second) return it->second;
+    return readRecursive(var, block);
+}
+
+llvm::Value* SSABuilder::readRecursive(SSAVariable* var, llvm::BasicBlock* block) {
+    auto newPhi = [&]() {
+        llvm::Instruction* first = block->getFirstNonPHI();
+        return first ? llvm::PHINode::Create(var->type, 0, var->name, first) : llvm::PHINode::Create(var->type, 0, var->name, block);
+    };
+
+    llvm::Value* val;
+    if (unsealed.count(block)) {
+        // More predecessors to come, operands are filled in by seal()
+        llvm::PHINode* phi = newPhi();
+        incompletePhis[block].push_back({var, phi});
+        val = phi;
+    } else if (llvm::BasicBlock* pred = block->getSinglePredecessor()) {
+        val = read(var, pred); // no phi needed
+    } else if (llvm::pred_empty(block)) {
+        val = llvm::UndefValue::get(var->type); // read before any write
+    } else {
+        // Recorded before the operands so loops in the CFG end at this phi
+        llvm::PHINode* phi = newPhi();
+        write(var, block, phi);
+        val = addPhiOperands(var, phi);
+    }
+
+    write(var, block, val);
+    return val;
+}
+
+llvm::Value* SSABuilder::addPhiOperands(SSAVariable* var, llvm::PHINode* phi) {
+    for (llvm::BasicBlock* pred : llvm::predecessors(phi->getParent())) {
+        phi->addIncoming(read(var, pred), pred);
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+// A phi whose operands are all the same value (or the phi itself) is that value
+llvm::Value* SSABuilder::tryRemoveTrivialPhi(llvm::PHINode* phi) {
+    llvm::Value* same = nullptr;
+    for (llvm::Value* op : phi->incoming_values()) {
+        if (op == same || op == phi) continue;
+        if (same) return phi; // merges at least two values
+        same = op;
+    }
+    if (!same) same = llvm::UndefValue::get(phi->getType()); // unreachable or only reads itself
+
+    // Phis using this one may become trivial in turn. WeakVH drops them if they are removed first
+    std::vector<llvm::WeakVH> users;
+    for (llvm::User* user : phi->users()) {
+        if (user != phi && llvm::isa<llvm::PHINode>(user)) users.push_back(user);
+    }
+
+    phi->replaceAllUsesWith(same); // also updates currentDef
+    phi->eraseFromParent();
+
+    for (llvm::WeakVH& user : users) {
+        if (auto userPhi = llvm::dyn_cast_or_null<llvm::PHINode>(user)) tryRemoveTrivialPhi(userPhi);
+    }
+    return same;
+}
+
+void SSABuilder::markUnsealed(llvm::BasicBlock* block) {
+    unsealed.insert(block);
+}
+
+void SSABuilder::seal(llvm::BasicBlock* block) {
+    if (!unsealed.erase(block)) return;
+
+    auto it = incompletePhis.find(block);
+    if (it == incompletePhis.end()) return;
+
+    std::vector<std::pair<SSAVariable*, llvm::PHINode*>> phis = std::move(it->second);
+    incompletePhis.erase(it);
+    for (auto& entry : phis) addPhiOperands(entry.first, entry.second);
+}
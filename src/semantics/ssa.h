@@ -0,0 +1,55 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/ValueHandle.h>
+
+// On-the-fly SSA construction (Braun et al., "Simple and Efficient Construction
+// of Static Single Assignment Form", CC 2013)
+//
+// Variables never live in memory. A write records the value as the variable's
+// definition in the current block, a read looks up the reaching definition through
+// the predecessors and places phis at joins, trivial phis are folded right away.
+//
+// A block is sealed once all of its predecessors are known. Blocks are sealed by
+// default since codegen usually branches into a block before emitting it, loop
+// headers are the exception: markUnsealed() them before the body and seal() once
+// the back edge exists.
+
+struct SSAVariable {
+    std::string name;
+    llvm::Type* type;
+};
+
+class SSABuilder {
+    private:
+        std::deque<SSAVariable> variables; // stable addresses
+
+        // Reaching definition per block. Value handles follow replaceAllUsesWith when phis fold
+        std::unordered_map<const SSAVariable*, llvm::DenseMap<llvm::BasicBlock*, llvm::WeakTrackingVH>> currentDef;
+
+        std::unordered_set<llvm::BasicBlock*> unsealed;
+        std::unordered_map<llvm::BasicBlock*, std::vector<std::pair<SSAVariable*, llvm::PHINode*>>> incompletePhis;
+
+        llvm::Value* readRecursive(SSAVariable* var, llvm::BasicBlock* block);
+        llvm::Value* addPhiOperands(SSAVariable* var, llvm::PHINode* phi);
+        llvm::Value* tryRemoveTrivialPhi(llvm::PHINode* phi);
+
+    public:
+        SSAVariable* declare(llvm::Type* type, const std::string& name);
+
+        void write(SSAVariable* var, llvm::BasicBlock* block, llvm::Value* value);
+
+        // Value of var at the end of what has been emitted into block so far, undef if never written
+        llvm::Value* read(SSAVariable* var, llvm::BasicBlock* block);
+
+        void markUnsealed(llvm::BasicBlock* block);
+        void seal(llvm::BasicBlock* block);
+};
@@ -1,5 +1,7 @@
 #include "symbol_table.h"
 
+#include <algorithm>
+
 SymbolTable::SymbolTable() { pushScope(); } // global scope
 
 // Enter a new scope
@@ -10,21 +12,41 @@ void SymbolTable::popScope() {
     if (!scopes.empty()) scopes.pop_back(); 
 }
 
-// New symbol, returns false if one already exists
-bool SymbolTable::declare(const std::string& name, llvm::Type* type, llvm::AllocaInst* llvmValue) {
+// New variable, returns nullptr if one already exists
+Symbol* SymbolTable::declare(const std::string& name, llvm::Type* type) {
     
     if (scopes.empty()) pushScope();
 
     auto& currentScope = scopes.back();
     if (currentScope.find(name) != currentScope.end()) {
-        return false; // duplicate declaration in same scope
+        return nullptr; // duplicate declaration in same scope
     }
 
-    currentScope[name] = Symbol{name, type, llvmValue};
-    return true;
+    Symbol& sym = currentScope[name];
+    sym = Symbol{name, type, ssaBuilder.declare(type, name)};
+    return &sym;
     
 }
 
+// New function value, returns false if the name already exists in the current scope
+bool SymbolTable::declareFunction(const std::string& name, llvm::Function* function, llvm::Function* batch, FunctionLiteral* literal) {
+    
+    if (scopes.empty()) pushScope();
+
+    auto& currentScope = scopes.back();
+    if (currentScope.find(name) != currentScope.end()) {
+        return false;
+    }
+
+    Symbol sym{name, function->getFunctionType()};
+    sym.function = function;
+    sym.batch = batch;
+    sym.literal = literal;
+    currentScope[name] = sym;
+    return true;
+
+}
+
 // Lookup symbol in all scopes (inner to outer)
 Symbol* SymbolTable::lookup(const std::string& name) {
     for (int i = scopes.size() - 1; i >= 0; --i) {
@@ -32,4 +54,15 @@ Symbol* SymbolTable::lookup(const std::string& name) {
         if (it != scopes[i].end()) return &it->second;
     }
     return nullptr; // not found
-}
\ No newline at end of file
+}
+
+// Symbols of all open scopes, outer to inner
+std::vector<Symbol*> SymbolTable::openSymbols() {
+    std::vector<Symbol*> symbols;
+    for (auto& scope : scopes) {
+        size_t first = symbols.size();
+        for (auto& entry : scope) symbols.push_back(&entry.second);
+        std::sort(symbols.begin() + first, symbols.end(), [](const Symbol* a, const Symbol* b) { return a->name < b->name; });
+    }
+    return symbols;
+}
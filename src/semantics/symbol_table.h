@@ -5,16 +5,30 @@
 #include <vector>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Instructions.h>
+#include "value_range.h"
+#include "ssa.h"
+
+class FunctionLiteral;
 
 struct Symbol {
     std::string name; 
-    llvm::Type* type; // variable type (llvm)
-    llvm::AllocaInst* llvmValue = nullptr; // variable allocation (llvm)
+    llvm::Type* type; // variable type (llvm), function type for function values
+    SSAVariable* variable = nullptr; // value in SSA form, see codegen_ctx::readVariable
+    std::vector<SSAVariable*> tangents; // forward-mode AD, one per seed (see codegen_ctx::adSeeds)
+    ValueRange range; // values the variable can hold at the current point of codegen
+
+    // Function values (function f = x -> ...)
+    llvm::Function* function = nullptr; // scalar entry point
+    llvm::Function* batch = nullptr; // batch entry point over input columns
+    FunctionLiteral* literal = nullptr; // source of the body (for deriv)
+
+    bool isFunction() const { return function != nullptr; }
 };
 
 class SymbolTable {
     private:
         std::vector<std::unordered_map<std::string, Symbol>> scopes;
+        SSABuilder ssaBuilder;
 
     public:
         SymbolTable(); // global scope
@@ -25,10 +39,19 @@ class SymbolTable {
         // Leave current scope
         void popScope();
 
-        // Declare a new symbol in the current scope
-        // Returns false if a symbol with the same name exists in the current scope
-        bool declare(const std::string& name, llvm::Type* type, llvm::AllocaInst* llvmValue = nullptr);
+        // Declare a new variable in the current scope, along with its SSA variable
+        // Returns nullptr if a symbol with the same name exists in the current scope
+        Symbol* declare(const std::string& name, llvm::Type* type);
+
+        // Declare a function value in the current scope, same rules as declare()
+        bool declareFunction(const std::string& name, llvm::Function* function, llvm::Function* batch, FunctionLiteral* literal);
 
         // Lookup symbol in all scopes (inner to outer)
         Symbol* lookup(const std::string& name);
+
+        // Every symbol of the open scopes, shadowed ones too (outer to inner, by name within a scope)
+        std::vector<Symbol*> openSymbols();
+
+        // Definitions of every variable declared through this table
+        SSABuilder& ssa() { return ssaBuilder; }
 };
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "value_range.h"
+
+#include <algorithm>
+#include <cmath>
+
+ValueRange ValueRange::constant(double v, bool integer) {
+    ValueRange r;
+    r.lo = r.hi = v;
+    r.integer = integer;
+    r.maybeNaN = std::isnan(v);
+    if (r.maybeNaN) return fullDouble();
+    return r;
+}
+
+ValueRange ValueRange::fullInt() {
+    ValueRange r;
+    r.lo = INT32_MIN;
+    r.hi = INT32_MAX;
+    r.integer = true;
+    r.maybeNaN = false;
+    return r;
+}
+
+ValueRange ValueRange::fullDouble() { return ValueRange(); }
+
+bool ValueRange::isFinite() const { return !maybeNaN && std::isfinite(lo) && std::isfinite(hi); }
+
+namespace {
+
+    ValueRange make(double lo, double hi, bool integer) {
+        ValueRange r;
+        r.lo = lo;
+        r.hi = hi;
+        r.integer = integer;
+        r.maybeNaN = false;
+        return r;
+    }
+
+    // Min/max over the four corner results of a monotonic (per argument) operation
+    template <typename Op>
+    ValueRange corners(const ValueRange& a, const ValueRange& b, Op op) {
+        double c[4] = { op(a.lo, b.lo), op(a.lo, b.hi), op(a.hi, b.lo), op(a.hi, b.hi) };
+        for (double v : c) {
+            if (std::isnan(v)) return a.integer && b.integer ? ValueRange::fullInt() : ValueRange::fullDouble();
+        }
+        return make(*std::min_element(c, c + 4), *std::max_element(c, c + 4), a.integer && b.integer);
+    }
+
+    // Doubles only stay bounded while every input is finite
+    bool bounded(const ValueRange& a, const ValueRange& b) {
+        return (a.integer || a.isFinite()) && (b.integer || b.isFinite());
+    }
+
+    ValueRange overflowCheck(ValueRange r) {
+        if (!r.integer && !r.isFinite()) return ValueRange::fullDouble();
+        return r;
+    }
+}
+
+namespace ranges {
+
+ValueRange add(const ValueRange& a, const ValueRange& b) {
+    if (!bounded(a, b)) return ValueRange::fullDouble();
+    return overflowCheck(make(a.lo + b.lo, a.hi + b.hi, a.integer && b.integer));
+}
+
+ValueRange sub(const ValueRange& a, const ValueRange& b) {
+    if (!bounded(a, b)) return ValueRange::fullDouble();
+    return overflowCheck(make(a.lo - b.hi, a.hi - b.lo, a.integer && b.integer));
+}
+
+ValueRange mul(const ValueRange& a, const ValueRange& b) {
+    if (!bounded(a, b)) return ValueRange::fullDouble();
+    return overflowCheck(corners(a, b, [](double x, double y) { return x * y; }));
+}
+
+ValueRange neg(const ValueRange& a) {
+    ValueRange r = a;
+    r.lo = -a.hi;
+    r.hi = -a.lo;
+    return r;
+}
+
+ValueRange div(const ValueRange& a, const ValueRange& b) {
+    bool integer = a.integer && b.integer;
+    if (b.contains(0.0) || b.maybeNaN || !bounded(a, b)) return integer ? ValueRange::fullInt() : ValueRange::fullDouble();
+
+    // The quotient is monotonic in each argument once the divisor keeps its sign
+    if (integer) return corners(a, b, [](double x, double y) { return std::trunc(x / y); });
+    return overflowCheck(corners(a, b, [](double x, double y) { return x / y; }));
+}
+
+ValueRange rem(const ValueRange& a, const ValueRange& b) {
+    if (!(a.integer && b.integer)) return ValueRange::fullDouble();
+    if (b.contains(0.0)) return ValueRange::fullInt();
+
+    // |a % b| < |b| and the sign follows a
+    double m = std::max(std::fabs(b.lo), std::fabs(b.hi)) - 1.0;
+    if (a.lo >= 0) return make(0.0, std::min(a.hi, m), true);
+    if (a.hi <= 0) return make(std::max(a.lo, -m), 0.0, true);
+    return make(std::max(a.lo, -m), std::min(a.hi, m), true);
+}
+
+ValueRange sqrt(const ValueRange& a) {
+    if (a.maybeNaN || a.lo < 0.0) return ValueRange::fullDouble();
+    return make(std::sqrt(a.lo), std::sqrt(a.hi), false);
+}
+
+ValueRange log(const ValueRange& a) {
+    if (a.maybeNaN || a.lo <= 0.0) return ValueRange::fullDouble();
+    return make(std::log(a.lo), std::log(a.hi), false);
+}
+
+ValueRange exp(const ValueRange& a) {
+    if (a.maybeNaN) return ValueRange::fullDouble();
+    return make(std::exp(a.lo), std::exp(a.hi), false);
+}
+
+ValueRange sinCos(const ValueRange& a) {
+    if (!a.integer && !a.isFinite()) return ValueRange::fullDouble(); // sin(inf) is NaN
+    return make(-1.0, 1.0, false);
+}
+
+ValueRange hull(const ValueRange& a, const ValueRange& b) {
+    ValueRange r;
+    r.lo = std::min(a.lo, b.lo);
+    r.hi = std::max(a.hi, b.hi);
+    r.integer = a.integer && b.integer;
+    r.maybeNaN = a.maybeNaN || b.maybeNaN;
+    return r;
+}
+
+ValueRange toDouble(const ValueRange& a) {
+    ValueRange r = a;
+    r.integer = false;
+    return r;
+}
+
+ValueRange toInt32(const ValueRange& a) {
+    // Wrapped or truncated out of range values could land anywhere
+    if (a.maybeNaN || !a.fitsInt32()) return ValueRange::fullInt();
+    return make(std::trunc(a.lo), std::trunc(a.hi), true);
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Interval of values an expression can take at runtime, always a superset of
+// the real values. Ints are i32 and wrap, doubles may also be NaN.
+struct ValueRange {
+    double lo = -std::numeric_limits<double>::infinity();
+    double hi = std::numeric_limits<double>::infinity();
+    bool integer = false;
+    bool maybeNaN = true; // doubles only
+
+    static ValueRange constant(double v, bool integer);
+    static ValueRange fullInt();
+    static ValueRange fullDouble();
+
+    bool contains(double v) const { return lo <= v && v <= hi; }
+    bool fitsInt32() const { return lo >= INT32_MIN && hi <= INT32_MAX; }
+    bool isFullInt() const { return lo <= INT32_MIN && hi >= INT32_MAX; }
+    bool isFinite() const;
+};
+
+// Interval arithmetic with the semantics of the generated code
+namespace ranges {
+
+    // Exact results, no wrapping. Int results that do not fit in i32 mean the
+    // operation can overflow: check fitsInt32() then widen with toInt32()
+    ValueRange add(const ValueRange& a, const ValueRange& b);
+    ValueRange sub(const ValueRange& a, const ValueRange& b);
+    ValueRange mul(const ValueRange& a, const ValueRange& b);
+    ValueRange neg(const ValueRange& a);
+
+    // Truncating division and remainder, full range when the divisor may be 0
+    ValueRange div(const ValueRange& a, const ValueRange& b);
+    ValueRange rem(const ValueRange& a, const ValueRange& b);
+
+    // Math functions over doubles, the full range (maybe NaN) outside their domain
+    ValueRange sqrt(const ValueRange& a);
+    ValueRange log(const ValueRange& a);
+    ValueRange exp(const ValueRange& a);
+    ValueRange sinCos(const ValueRange& a);
+
+    // Smallest range containing both (control flow merges)
+    ValueRange hull(const ValueRange& a, const ValueRange& b);
+
+    // Conversions as done by codegen (SIToFP, FPToSI, i32 wrap)
+    ValueRange toDouble(const ValueRange& a);
+    ValueRange toInt32(const ValueRange& a);
+
+}
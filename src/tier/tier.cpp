@@ -0,0 +1,257 @@
+#include "tier.h"
+#include "../calculus/integral.h"
+
+#include <chrono>
+
+namespace {
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    llvm::Type* llvmType(codegen_ctx& ctx, ValueType type) {
+        switch (type) {
+            case ValueType::Int: return ctx.builder.getInt32Ty();
+            case ValueType::Double: return ctx.builder.getDoubleTy();
+            case ValueType::Bool: return ctx.builder.getInt1Ty();
+            case ValueType::String: return ctx.stringType();
+            case ValueType::Function: break;
+        }
+        return nullptr;
+    }
+
+    // NaN-boxed register (see vm/bytecode.h) -> codegen value
+    llvm::Value* unbox(codegen_ctx& ctx, llvm::Value* v, ValueType type) {
+        llvm::IRBuilder<>& B = ctx.builder;
+        switch (type) {
+            case ValueType::Int: return B.CreateTrunc(v, B.getInt32Ty());
+            case ValueType::Double: return B.CreateBitCast(v, B.getDoubleTy());
+            case ValueType::Bool: return B.CreateTrunc(v, B.getInt1Ty());
+            case ValueType::String: {
+                llvm::Value* payload = B.CreateAnd(v, B.getInt64(values::PayloadMask));
+                llvm::Value* s = B.CreateIntToPtr(payload, ctx.stringType()->getPointerTo());
+                return B.CreateLoad(ctx.stringType(), s);
+            }
+            case ValueType::Function: break;
+        }
+        return nullptr;
+    }
+
+    llvm::Value* box(codegen_ctx& ctx, llvm::Value* v, ValueType type) {
+        llvm::IRBuilder<>& B = ctx.builder;
+        switch (type) {
+            case ValueType::Int: return B.CreateOr(B.CreateZExt(v, B.getInt64Ty()), B.getInt64(values::IntTag));
+            case ValueType::Double: return B.CreateBitCast(v, B.getInt64Ty());
+            case ValueType::Bool: return B.CreateOr(B.CreateZExt(v, B.getInt64Ty()), B.getInt64(values::BoolTag));
+            default: return nullptr;
+        }
+    }
+
+    llvm::Value* loadSlot(codegen_ctx& ctx, llvm::Value* base, size_t k) {
+        llvm::Type* i64 = ctx.builder.getInt64Ty();
+        return ctx.builder.CreateLoad(i64, ctx.builder.CreateConstInBoundsGEP1_64(i64, base, k));
+    }
+}
+
+TieredExecution::TieredExecution(const TierRegions& regions, const TierOptions& options)
+    : NativeTier(regions.loops.size(), regions.chunks.size(), options.threshold), regions(regions), options(options) {
+    for (size_t i = 0; i < regions.loops.size(); ++i) loops[i].exit = regions.loops[i].exit;
+    worker = std::thread([this]() { run(); });
+}
+
+TieredExecution::~TieredExecution() {
+    stop();
+}
+
+void TieredExecution::hotLoop(size_t loop) {
+    if (regions.loops[loop].native) enqueue({true, loop});
+}
+
+void TieredExecution::hotChunk(size_t chunk) {
+    if (regions.chunks[chunk].native && regions.chunks[chunk].body) enqueue({false, chunk});
+}
+
+void TieredExecution::enqueue(Request request) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping) return;
+        queue.push_back(request);
+    }
+    wake.notify_one();
+}
+
+void TieredExecution::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        queue.clear();
+    }
+    wake.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+TierStats TieredExecution::stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return counts;
+}
+
+void TieredExecution::run() {
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || !queue.empty(); });
+            if (stopping) return;
+            request = queue.front();
+            queue.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::string error;
+        if (!jit) jit = IncrementalJIT::create(options.optimizer, error);
+        void* code = nullptr;
+        if (jit) code = request.loop ? compileLoop(request.index, error) : compileChunk(request.index, error);
+
+        // Published code is picked up by the interpreter at the next back edge or call
+        if (code && request.loop) {
+            loops[request.index].code.store((LoopCode)code, std::memory_order_release);
+        } else if (code && regions.chunks[request.index].integrand) {
+            chunks[request.index].integrand.store((crunch_integrand)code, std::memory_order_release);
+        } else if (code) {
+            chunks[request.index].function.store((FunctionCode)code, std::memory_order_release);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        counts.compile += msSince(start);
+        if (!code) counts.failed++;
+        else if (request.loop) counts.loops++;
+        else counts.chunks++;
+    }
+}
+
+void* TieredExecution::compileLoop(size_t index, std::string& error) {
+    const TierLoop& region = regions.loops[index];
+    std::string name = "crunch.loop." + std::to_string(index);
+
+    codegen_ctx ctx(name);
+    llvm::IRBuilder<>& B = ctx.builder;
+    llvm::Type* i64Ptr = B.getInt64Ty()->getPointerTo();
+
+    // void crunch.loop.<n>(i64* regs, i64** captures)
+    llvm::FunctionType* type = llvm::FunctionType::get(B.getVoidTy(), {i64Ptr, i64Ptr->getPointerTo()}, false);
+    llvm::Function* fn = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, ctx.module.get());
+    llvm::Argument* regs = fn->getArg(0);
+    llvm::Argument* captures = fn->getArg(1);
+    regs->setName("regs");
+    captures->setName("captures");
+    B.SetInsertPoint(llvm::BasicBlock::Create(ctx.context, "entry", fn));
+
+    // The loop's view of the program, variables come in from their registers
+    std::vector<std::pair<const TierVariable*, Symbol*>> variables;
+    for (const TierVariable& v : region.scope) {
+        if (!v.isFunction()) {
+            Symbol* sym = ctx.symTable->declare(v.name, llvmType(ctx, v.type));
+            ctx.writeVariable(sym->variable, unbox(ctx, loadSlot(ctx, regs, v.reg), v.type));
+            variables.push_back({&v, sym});
+            continue;
+        }
+
+        // Function values are emitted again, from the captures of their Closure
+        const TierChunk& chunk = regions.chunks[v.chunk];
+        llvm::Value* captured = B.CreateLoad(i64Ptr, B.CreateConstInBoundsGEP1_64(i64Ptr, captures, v.chunk), v.name + ".captures");
+        ctx.symTable->pushScope();
+        for (size_t k = 0; k < chunk.captures.size(); ++k) {
+            const TierVariable& cap = chunk.captures[k];
+            Symbol* sym = ctx.symTable->declare(cap.name, llvmType(ctx, cap.type));
+            ctx.writeVariable(sym->variable, unbox(ctx, loadSlot(ctx, captured, k), cap.type));
+        }
+        llvm::Function* scalar = nullptr;
+        llvm::Function* batch = nullptr;
+        FunctionLiteral* literal = const_cast<FunctionLiteral*>(v.literal);
+        bool emitted = literal->emit(ctx, v.name, scalar, batch);
+        ctx.symTable->popScope();
+        if (!emitted || !ctx.symTable->declareFunction(v.name, scalar, batch, literal)) {
+            error = "function " + v.name;
+            return nullptr;
+        }
+    }
+
+    // Faults in the native loop are reported like the VM's, with the loop's lines
+    ctx.line = region.loop->line;
+    ctx.collectStrings = false;
+    llvm::Value* done = nullptr;
+    if (auto s = dynamic_cast<const WhileStmt*>(region.loop)) done = const_cast<WhileStmt*>(s)->codegen(ctx);
+    else if (auto s = dynamic_cast<const ForStmt*>(region.loop)) done = const_cast<ForStmt*>(s)->codegenLoop(ctx);
+    if (!done) {
+        error = "loop";
+        return nullptr;
+    }
+
+    // Strings are never assigned in native loops, they keep their registers
+    for (auto& var : variables) {
+        if (var.first->type == ValueType::String) continue;
+        llvm::Value* value = box(ctx, ctx.readVariable(var.second->variable), var.first->type);
+        B.CreateStore(value, B.CreateConstInBoundsGEP1_64(B.getInt64Ty(), regs, var.first->reg));
+    }
+    B.CreateRetVoid();
+
+    return jit->compile(ctx, name, error);
+}
+
+void* TieredExecution::compileChunk(size_t index, std::string& error) {
+    const TierChunk& chunk = regions.chunks[index];
+    ExprNode* body = const_cast<ExprNode*>(chunk.body);
+
+    std::string name = (chunk.integrand ? "crunch.integrand." : "crunch.chunk.") + std::to_string(index);
+    codegen_ctx ctx(name);
+    llvm::IRBuilder<>& B = ctx.builder;
+
+    if (chunk.integrand) {
+        std::vector<Symbol> captures;
+        for (const TierVariable& cap : chunk.captures) {
+            Symbol sym;
+            sym.name = cap.name;
+            sym.type = llvmType(ctx, cap.type);
+            captures.push_back(sym);
+        }
+        llvm::Function* integrand = calculus::emitIntegrand(ctx, body, chunk.params[0], captures);
+        if (!integrand) {
+            error = "integrand";
+            return nullptr;
+        }
+        integrand->setName(name);
+        integrand->setLinkage(llvm::Function::ExternalLinkage);
+        return jit->compile(ctx, name, error);
+    }
+
+    // double crunch.chunk.<n>(i64* args, i64* captures)
+    llvm::Type* i64Ptr = B.getInt64Ty()->getPointerTo();
+    llvm::FunctionType* type = llvm::FunctionType::get(B.getDoubleTy(), {i64Ptr, i64Ptr}, false);
+    llvm::Function* fn = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, ctx.module.get());
+    llvm::Argument* args = fn->getArg(0);
+    llvm::Argument* captures = fn->getArg(1);
+    args->setName("args");
+    captures->setName("captures");
+    B.SetInsertPoint(llvm::BasicBlock::Create(ctx.context, "entry", fn));
+
+    for (size_t k = 0; k < chunk.params.size(); ++k) {
+        Symbol* sym = ctx.symTable->declare(chunk.params[k], B.getDoubleTy());
+        ctx.writeVariable(sym->variable, unbox(ctx, loadSlot(ctx, args, k), ValueType::Double));
+    }
+    for (size_t k = 0; k < chunk.captures.size(); ++k) {
+        const TierVariable& cap = chunk.captures[k];
+        Symbol* sym = ctx.symTable->declare(cap.name, llvmType(ctx, cap.type));
+        ctx.writeVariable(sym->variable, unbox(ctx, loadSlot(ctx, captures, k), cap.type));
+    }
+
+    ctx.line = chunk.line;
+    llvm::Value* result = body->codegen(ctx);
+    if (result) result = ctx.toDouble(result);
+    if (!result) {
+        error = "function body";
+        return nullptr;
+    }
+    B.CreateRet(result);
+
+    return jit->compile(ctx, name, error);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../jit/jit.h"
+#include "../vm/compiler.h"
+#include "../vm/vm.h"
+
+// Tiered execution (--tiered): the program starts in the bytecode interpreter,
+// which counts loop back edges and function calls. Regions reaching the
+// threshold are compiled with LLVM on a background thread while the
+// interpreter goes on:
+//
+//     loop region     void crunch.loop.<n>(i64* regs, i64** captures)
+//     function chunk  double crunch.chunk.<n>(i64* args, i64* captures)
+//     integrand       crunch_integrand, captures as doubles in env
+//
+// A loop region is the loop's code generated from the tree again, with every
+// variable visible at the loop read from its interpreter register (unboxed)
+// and written back when the loop ends. The interpreter enters it at the next
+// back edge, so the loop continues natively from its condition (on-stack
+// replacement), and resumes after the loop. Function values the loop uses are
+// emitted into it with the captures the interpreter recorded.
+//
+// Native code behaves like --jit, int division by zero traps.
+
+struct TierOptions {
+    uint32_t threshold = 1000; // back edges of a loop, calls or integrand evaluations of a chunk
+    OptimizerOptions optimizer;
+};
+
+struct TierStats {
+    unsigned loops = 0; // compiled regions
+    unsigned chunks = 0;
+    unsigned failed = 0; // regions that stay interpreted
+    double compile = 0.0; // ms spent on the compiler thread
+};
+
+class TieredExecution : public NativeTier {
+    public:
+        // regions must come from compiling the image's program, the program outlives this
+        TieredExecution(const TierRegions& regions, const TierOptions& options = TierOptions());
+        ~TieredExecution();
+
+        void hotLoop(size_t loop) override;
+        void hotChunk(size_t chunk) override;
+
+        // Drops queued requests and waits for the one being compiled
+        void stop();
+
+        // Counts so far, final after stop()
+        TierStats stats();
+
+    private:
+        const TierRegions& regions;
+        TierOptions options;
+        std::unique_ptr<IncrementalJIT> jit; // compiler thread only
+
+        struct Request {
+            bool loop;
+            size_t index;
+        };
+
+        std::thread worker;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::deque<Request> queue;
+        bool stopping = false;
+        TierStats counts;
+
+        void enqueue(Request request);
+        void run();
+
+        // Code address, nullptr when the region can't be compiled
+        void* compileLoop(size_t index, std::string& error);
+        void* compileChunk(size_t index, std::string& error);
+};
@@ -0,0 +1,10 @@
+#include "bytecode.h"
+
+const char* opName(Op op) {
+    static const char* const names[] = {
+#define CRUNCH_OPCODE_NAME(name) #name,
+        CRUNCH_OPCODES(CRUNCH_OPCODE_NAME)
+#undef CRUNCH_OPCODE_NAME
+    };
+    return op < Op::Count ? names[(size_t)op] : "?";
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../runtime/str.h"
+
+// Register based bytecode for the interpreter tier (--interp)
+//
+// Every chunk (the program, a function value or an integrand) has its own
+// register window. Variables are pre-resolved to fixed registers by the
+// compiler, temporaries live above them. Instructions are 8 bytes: an opcode
+// and three 16 bit operands, usually destination and two sources.
+
+enum class ValueType : uint8_t { Int, Double, Bool, String, Function };
+
+// NaN-boxed register contents: a double is its own bit pattern, everything else
+// hides in the negative quiet NaN space above any NaN the hardware produces
+// (crunch never builds NaNs from raw bits, so payloads stay zero):
+//
+//     0xFFF9_0000_iiii_iiii   int, 32 bit payload
+//     0xFFFA_0000_0000_000b   bool
+//     0xFFFB_pppp_pppp_pppp   string, 48 bit crunch_string pointer
+//     0xFFFC_0000_0000_cccc   function handle, chunk index
+//
+// Ints and bools keep their value in the low 32 bits, so numeric reads of
+// either are a truncation and type tests are a compare on the top bits.
+typedef uint64_t Value;
+
+namespace values {
+
+    const uint64_t IntTag = 0xFFF9000000000000ull;
+    const uint64_t BoolTag = 0xFFFA000000000000ull;
+    const uint64_t StringTag = 0xFFFB000000000000ull;
+    const uint64_t FunctionTag = 0xFFFC000000000000ull;
+    const uint64_t PayloadMask = 0x0000FFFFFFFFFFFFull;
+
+    inline Value real(double d) { Value v; std::memcpy(&v, &d, sizeof(v)); return v; }
+    inline Value integer(int32_t i) { return IntTag | (uint32_t)i; }
+    inline Value boolean(bool b) { return BoolTag | (uint64_t)b; }
+    inline Value string(const crunch_string* s) { return StringTag | (uint64_t)(uintptr_t)s; }
+    inline Value function(uint32_t chunk) { return FunctionTag | chunk; }
+
+    inline bool isDouble(Value v) { return v < IntTag; }
+    inline bool isInt(Value v) { return (v >> 32) == (IntTag >> 32); }
+    inline bool isBool(Value v) { return (v >> 48) == (BoolTag >> 48); }
+    inline bool isString(Value v) { return (v >> 48) == (StringTag >> 48); }
+
+    // One compare for both operands: the larger one decides whether either is boxed
+    inline bool bothDouble(Value a, Value b) { return (a > b ? a : b) < IntTag; }
+    inline bool bothInt(Value a, Value b) { return (((a >> 32) ^ (IntTag >> 32)) | ((b >> 32) ^ (IntTag >> 32))) == 0; }
+
+    inline ValueType type(Value v) {
+        static const ValueType boxed[] = { ValueType::Int, ValueType::Bool, ValueType::String, ValueType::Function };
+        return isDouble(v) ? ValueType::Double : boxed[(v >> 48) - (IntTag >> 48)];
+    }
+
+    inline double toDouble(Value v) { double d; std::memcpy(&d, &v, sizeof(d)); return d; }
+    inline int32_t toInt(Value v) { return (int32_t)(uint32_t)v; } // ints and bools
+    inline const crunch_string* toString(Value v) { return (const crunch_string*)(uintptr_t)(v & PayloadMask); }
+    inline uint32_t toFunction(Value v) { return (uint32_t)v; }
+
+    // Numeric views with the compiler's promotions, bools count as 0 and 1
+    inline double asDouble(Value v) { return isDouble(v) ? toDouble(v) : (double)toInt(v); }
+    inline bool truthy(Value v) { return isDouble(v) ? toDouble(v) != 0.0 : (uint32_t)v != 0; }
+}
+
+// X(name): the opcode list, in dispatch table order
+#define CRUNCH_OPCODES(X) \
+    X(Move)      /* a = b */ \
+    X(LoadK)     /* a = constants[b] */ \
+    X(LoadS)     /* a = strings[b], string constants live in the program's string table */ \
+    X(Add)       /* a = b + c, numbers or string concatenation */ \
+    X(Sub)       \
+    X(Mul)       \
+    X(Div)       /* int division checks the divisor */ \
+    X(Mod)       \
+    X(Eq)        /* a = b == c, numbers or strings */ \
+    X(Ne)        \
+    X(Lt)        \
+    X(Gt)        \
+    X(Le)        \
+    X(Ge)        \
+    X(Neg)       /* a = -b */ \
+    X(Not)       /* a = !b */ \
+    X(Sin)       /* a = sin(b) */ \
+    X(Cos)       \
+    X(Tan)       \
+    X(Exp)       \
+    X(Log)       \
+    X(Sqrt)      \
+    X(Pow)       /* a = pow(b, c) */ \
+    X(ToInt)     /* a = (int) b */ \
+    X(ToDouble)  /* a = (double) b */ \
+    X(ToBool)    /* a = b != 0 */ \
+    X(Jump)      /* pc = target */ \
+    X(JumpIfFalse) /* if (!a) pc = target */ \
+    X(JumpIfTrue)  /* if (a) pc = target */ \
+    X(Loop)      /* pc = target, back edge of loop a, counted for tiered execution */ \
+    X(Print)     /* crunch_print(strings[a], registers b .. b+c-1) */ \
+    X(Closure)   /* captures of chunk a = registers b .. b+c-1 */ \
+    X(Call)      /* a = chunk b (registers c ..), the arguments are doubles */ \
+    X(Integral)  /* a = integral of chunk b, registers c, c+1 bounds then captures */ \
+    X(Return)    /* return a */ \
+    X(Halt)      /* end of the program */ \
+    /* Quickened: the VM rewrites a generic op in place once it has seen int (II) */ \
+    /* or double (DD) operands, and back if the guess stops holding */ \
+    X(AddII) X(SubII) X(MulII) X(DivII) X(ModII) \
+    X(AddDD) X(SubDD) X(MulDD) X(DivDD) X(ModDD) \
+    X(EqII) X(NeII) X(LtII) X(GtII) X(LeII) X(GeII) \
+    X(EqDD) X(NeDD) X(LtDD) X(GtDD) X(LeDD) X(GeDD) \
+    /* Superinstructions (vm/fuse.h): replace the first op of a sequence, the */ \
+    /* other instructions stay in place for jumps into the middle and are skipped */ \
+    X(AddK) X(SubK) X(MulK) X(DivK) X(ModK) /* LoadK t, k; Op a, b, t */ \
+    X(EqJump) X(NeJump) X(LtJump) X(GtJump) X(LeJump) X(GeJump) /* Cmp t, b, c; JumpIfFalse t */ \
+    X(EqKJump) X(NeKJump) X(LtKJump) X(GtKJump) X(LeKJump) X(GeKJump) /* LoadK u, k; Cmp t, b, u; JumpIfFalse t */ \
+    X(MovePrint) /* Move r, b; Print f, r, 1 */
+
+enum class Op : uint16_t {
+#define CRUNCH_OPCODE_ENUM(name) name,
+    CRUNCH_OPCODES(CRUNCH_OPCODE_ENUM)
+#undef CRUNCH_OPCODE_ENUM
+    Count
+};
+
+const char* opName(Op op);
+
+struct Instr {
+    Op op;
+    uint16_t a, b, c;
+
+    // Jump targets span b and c
+    uint32_t target() const { return b | (uint32_t(c) << 16); }
+    void setTarget(uint32_t t) { b = uint16_t(t); c = uint16_t(t >> 16); }
+};
+
+struct Chunk {
+    std::string name;
+    std::vector<Instr> code;
+    std::vector<Value> constants; // NaN-boxed numbers, strings go through LoadS
+    std::vector<uint32_t> lines; // source line of each instruction, 0 when unknown
+    uint16_t numParams = 0; // registers 0 .. numParams-1 on entry
+    uint16_t numCaptures = 0; // registers after the parameters, set by Closure / Integral
+    uint16_t numRegisters = 0;
+};
+
+// Nothing in here is an address, so a program links into a flat image
+// (vm/image.h) as is
+struct BytecodeProgram {
+    std::vector<Chunk> chunks; // chunks[0] is the program
+    std::vector<std::string> strings; // string constants and print formats
+};
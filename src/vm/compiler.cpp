@@ -0,0 +1,724 @@
+#include "compiler.h"
+#include "fuse.h"
+#include "../calculus/deriv.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+
+namespace {
+
+    struct Operand {
+        uint16_t reg;
+        ValueType type;
+    };
+
+    // A name in scope: a variable in a fixed register or a function value
+    struct Local {
+        uint16_t reg = 0;
+        ValueType type = ValueType::Int;
+        bool declared = false; // by a declaration in this chunk, not a parameter or capture
+        int chunk = -1; // function values
+        const FunctionLiteral* literal = nullptr;
+        uint32_t order = 0; // declaration sequence number
+
+        bool isFunction() const { return chunk >= 0; }
+    };
+
+    struct LoopJumps {
+        size_t region; // operand of the Loop back edge
+        std::vector<size_t> breaks, continues;
+    };
+
+    // Chunk being compiled. Locals take the registers below localTop in
+    // declaration order, temporaries of the current statement go above
+    struct FunctionState {
+        FunctionState* parent = nullptr; // function values of enclosing chunks stay callable
+        size_t chunk = 0;
+        std::vector<std::unordered_map<std::string, Local>> scopes;
+        std::vector<LoopJumps> loops;
+        uint32_t localTop = 0;
+        uint32_t nextReg = 0;
+        std::map<Value, uint16_t> numbers; // constant pool dedup
+    };
+
+    bool isNumeric(ValueType t) { return t == ValueType::Int || t == ValueType::Double || t == ValueType::Bool; }
+
+    // print(a, b, c) parses as the comma expression ((a, b), c)
+    void flattenCommas(const ExprNode* expr, std::vector<const ExprNode*>& items) {
+        auto b = dynamic_cast<const BinaryExpr*>(expr);
+        if (b && b->op == BinaryOp::Comma) {
+            flattenCommas(b->left, items);
+            flattenCommas(b->right, items);
+            return;
+        }
+        items.push_back(expr);
+    }
+
+    bool hasAssignment(const ExprNode* expr) {
+        if (!expr) return false;
+        if (dynamic_cast<const AssignmentExpr*>(expr)) return true;
+        if (auto b = dynamic_cast<const BinaryExpr*>(expr)) return hasAssignment(b->left) || hasAssignment(b->right);
+        if (auto u = dynamic_cast<const UnaryExpr*>(expr)) return hasAssignment(u->operand);
+        if (auto c = dynamic_cast<const CallExpr*>(expr)) {
+            for (auto arg : c->args) if (hasAssignment(arg)) return true;
+            return false;
+        }
+        if (auto i = dynamic_cast<const IntegralExpr*>(expr)) return hasAssignment(i->lower) || hasAssignment(i->upper);
+        return false;
+    }
+
+    class BytecodeCompiler {
+        public:
+            BytecodeCompiler(BytecodeProgram& program, TierRegions* regions) : program(program), regions(regions) {}
+
+            void compile(const Program* root) {
+                FunctionState main;
+                main.chunk = newChunk("main", 0);
+                main.scopes.emplace_back();
+                fs = &main;
+
+                for (auto stmt : root->statements) statement(stmt);
+                emit(Op::Halt);
+                finish();
+            }
+
+        private:
+            BytecodeProgram& program;
+            TierRegions* regions;
+            FunctionState* fs = nullptr;
+            std::map<std::string, uint16_t> strings;
+            uint32_t line = 0; // of the statement being compiled
+            uint32_t declarations = 0;
+            size_t loopCount = 0;
+
+            [[noreturn]] void fail(const std::string& message) { throw BytecodeError(message); }
+
+            Chunk& chunk() { return program.chunks[fs->chunk]; }
+
+            size_t newChunk(const std::string& name, size_t params) {
+                program.chunks.emplace_back();
+                program.chunks.back().name = name;
+                program.chunks.back().numParams = (uint16_t)params;
+                if (regions) regions->chunks.emplace_back();
+                return program.chunks.size() - 1;
+            }
+
+            void finish() {
+                chunk().numRegisters = (uint16_t)std::max<uint32_t>(chunk().numRegisters, fs->nextReg);
+            }
+
+            size_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+                chunk().code.push_back(Instr{op, (uint16_t)a, (uint16_t)b, (uint16_t)c});
+                chunk().lines.push_back(line);
+                return chunk().code.size() - 1;
+            }
+
+            size_t here() { return chunk().code.size(); }
+
+            void patch(size_t jump, size_t target) { chunk().code[jump].setTarget((uint32_t)target); }
+
+            // Registers
+
+            uint16_t temp(uint32_t count = 1) {
+                uint32_t reg = fs->nextReg;
+                fs->nextReg += count;
+                if (fs->nextReg > 0xFFFF) fail("Too many registers in " + chunk().name + ".");
+                chunk().numRegisters = (uint16_t)std::max<uint32_t>(chunk().numRegisters, fs->nextReg);
+                return (uint16_t)reg;
+            }
+
+            uint16_t target(int dst) { return dst >= 0 ? (uint16_t)dst : temp(); }
+
+            Operand into(Operand v, int dst) {
+                if (dst >= 0 && dst != v.reg) {
+                    emit(Op::Move, dst, v.reg);
+                    v.reg = (uint16_t)dst;
+                }
+                return v;
+            }
+
+            // Converts v to type (int <-> double, anything to itself) in register dst
+            Operand convert(Operand v, ValueType type, int dst, const std::string& error) {
+                if (v.type == type) return into(v, dst);
+                if (type == ValueType::Double && isNumeric(v.type)) {
+                    emit(Op::ToDouble, target(dst), v.reg);
+                } else if (type == ValueType::Int && v.type == ValueType::Double) {
+                    emit(Op::ToInt, target(dst), v.reg);
+                } else {
+                    fail(error);
+                }
+                return Operand{chunk().code.back().a, type};
+            }
+
+            // Constants
+
+            // Boxed bits identify type and value
+            uint16_t constant(Value v) {
+                auto it = fs->numbers.find(v);
+                if (it != fs->numbers.end()) return it->second;
+                return fs->numbers[v] = addConstant(v);
+            }
+
+            // String constants and print formats share the program's string table
+            uint16_t string(const std::string& s) {
+                auto it = strings.find(s);
+                if (it != strings.end()) return it->second;
+
+                if (program.strings.size() >= 0xFFFF) fail("Too many strings in the program.");
+                program.strings.push_back(s);
+                return strings[s] = (uint16_t)(program.strings.size() - 1);
+            }
+
+            uint16_t addConstant(Value v) {
+                if (chunk().constants.size() >= 0xFFFF) fail("Too many constants in " + chunk().name + ".");
+                chunk().constants.push_back(v);
+                return (uint16_t)(chunk().constants.size() - 1);
+            }
+
+            Operand load(Value v, int dst) {
+                uint16_t reg = target(dst);
+                emit(Op::LoadK, reg, constant(v));
+                return Operand{reg, values::type(v)};
+            }
+
+            // Names
+
+            Local* lookup(const std::string& name) {
+                for (auto scope = fs->scopes.rbegin(); scope != fs->scopes.rend(); ++scope) {
+                    auto it = scope->find(name);
+                    if (it != scope->end()) return &it->second;
+                }
+                return nullptr;
+            }
+
+            // Function values of enclosing chunks are visible too, their variables are not
+            Local* lookupFunction(const std::string& name) {
+                for (FunctionState* f = fs; f; f = f->parent) {
+                    for (auto scope = f->scopes.rbegin(); scope != f->scopes.rend(); ++scope) {
+                        auto it = scope->find(name);
+                        if (it != scope->end()) return it->second.isFunction() || f == fs ? &it->second : nullptr;
+                    }
+                }
+                return nullptr;
+            }
+
+            void declare(const std::string& name, Local local) {
+                local.order = ++declarations;
+                if (!fs->scopes.back().emplace(name, local).second) fail("Variable already declared in scope: " + name);
+            }
+
+            // Tiered execution compiles chunks that call function values as part of loops only
+            void callsFunctions() {
+                if (regions && fs->chunk != 0) regions->chunks[fs->chunk].native = false;
+            }
+
+            // Names visible here (the innermost of each), in declaration order
+            std::vector<TierVariable> visible() {
+                std::vector<std::pair<uint32_t, TierVariable>> found;
+                std::set<std::string> seen;
+                for (auto scope = fs->scopes.rbegin(); scope != fs->scopes.rend(); ++scope) {
+                    for (auto& entry : *scope) {
+                        if (!seen.insert(entry.first).second) continue;
+                        const Local& l = entry.second;
+                        TierVariable v;
+                        v.name = entry.first;
+                        v.type = l.type;
+                        v.reg = l.reg;
+                        v.chunk = l.chunk;
+                        v.literal = l.literal;
+                        found.push_back({l.order, v});
+                    }
+                }
+                std::sort(found.begin(), found.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+
+                std::vector<TierVariable> result;
+                for (auto& f : found) result.push_back(f.second);
+                return result;
+            }
+
+            uint16_t allocLocal() {
+                uint16_t reg = temp();
+                fs->localTop = fs->nextReg;
+                return reg;
+            }
+
+            void pushScope() { fs->scopes.emplace_back(); }
+
+            void popScope(uint32_t localTop) {
+                fs->scopes.pop_back();
+                fs->localTop = fs->nextReg = localTop;
+            }
+
+            // Statements
+
+            void statement(const StmtNode* stmt) {
+                // Nested statements set their own line, what follows them (loop back edges) is the outer one's
+                uint32_t outer = line;
+                if (stmt->line > 0) line = (uint32_t)stmt->line;
+
+                if (auto s = dynamic_cast<const VarDeclStmt*>(stmt)) varDecl(s);
+                else if (auto s = dynamic_cast<const ExprStmt*>(stmt)) expr(s->expr, -1);
+                else if (auto s = dynamic_cast<const PrintStmt*>(stmt)) print(s);
+                else if (auto s = dynamic_cast<const BlockStmt*>(stmt)) {
+                    uint32_t mark = fs->localTop;
+                    pushScope();
+                    for (auto inner : s->statements) statement(inner);
+                    popScope(mark);
+                }
+                else if (auto s = dynamic_cast<const IfStmt*>(stmt)) ifStmt(s);
+                else if (auto s = dynamic_cast<const WhileStmt*>(stmt)) loop(s, s->condition, nullptr, s->body);
+                else if (auto s = dynamic_cast<const ForStmt*>(stmt)) {
+                    uint32_t mark = fs->localTop;
+                    pushScope();
+                    if (s->init) statement(s->init);
+                    loop(s, s->condition, s->step, s->body);
+                    popScope(mark);
+                }
+                else if (dynamic_cast<const BreakStmt*>(stmt)) {
+                    if (fs->loops.empty()) fail("break outside of a loop.");
+                    fs->loops.back().breaks.push_back(emit(Op::Jump));
+                }
+                else if (dynamic_cast<const ContinueStmt*>(stmt)) {
+                    if (fs->loops.empty()) fail("continue outside of a loop.");
+                    fs->loops.back().continues.push_back(emit(Op::Jump));
+                }
+                else fail("Unsupported statement.");
+
+                // Temporaries die with the statement
+                fs->nextReg = fs->localTop;
+                line = outer;
+            }
+
+            // Branch bodies get their own scope, even without braces
+            void scoped(const StmtNode* stmt) {
+                uint32_t mark = fs->localTop;
+                pushScope();
+                statement(stmt);
+                popScope(mark);
+            }
+
+            void varDecl(const VarDeclStmt* s) {
+                if (s->type == TokenType::KW_FUNCTION) return functionDecl(s);
+
+                ValueType type;
+                switch (s->type) {
+                    case TokenType::KW_INT: type = ValueType::Int; break;
+                    case TokenType::KW_DBLE: type = ValueType::Double; break;
+                    case TokenType::KW_BOOL: type = ValueType::Bool; break;
+                    case TokenType::KW_STRING: type = ValueType::String; break;
+                    default: fail("Unsupported variable type");
+                }
+                if (fs->scopes.back().count(s->name)) fail("Variable already declared in scope: " + s->name);
+
+                uint16_t reg = allocLocal();
+                if (s->init) {
+                    Operand v = expr(s->init, reg);
+                    convert(v, type, reg, "Type mismatch in variable initialization for variable: " + s->name);
+                } else if (type == ValueType::String) {
+                    emit(Op::LoadS, reg, string(std::string()));
+                } else {
+                    Value zero = type == ValueType::Double ? values::real(0.0) : type == ValueType::Bool ? values::boolean(false) : values::integer(0);
+                    load(zero, reg);
+                }
+
+                Local local;
+                local.reg = reg;
+                local.type = type;
+                local.declared = true;
+                declare(s->name, local);
+            }
+
+            void functionDecl(const VarDeclStmt* s) {
+                Local local;
+
+                // function g = f; names an existing function value
+                if (auto id = dynamic_cast<const IdentifierExpr*>(s->init)) {
+                    Local* f = lookupFunction(id->name);
+                    if (!f || !f->isFunction()) fail("Undefined function: " + id->name);
+                    local = *f;
+                }
+                else if (auto literal = dynamic_cast<const FunctionLiteral*>(s->init)) {
+                    if (fs->scopes.back().count(s->name)) fail("Variable already declared in scope: " + s->name);
+                    std::vector<uint16_t> captures;
+                    local.chunk = (int)closure(literal->body, literal->params, calculus::freeVariables(literal), s->name,
+                        "Unsupported type for variable used in function " + s->name + ": ",
+                        "Failed to generate code for function " + s->name + ".", captures);
+
+                    uint16_t base = temp((uint32_t)captures.size());
+                    for (size_t k = 0; k < captures.size(); ++k) emit(Op::Move, base + k, captures[k]);
+                    emit(Op::Closure, local.chunk, base, captures.size());
+                    local.literal = literal;
+                }
+                else fail("Function declaration needs a function literal (x -> expr): " + s->name);
+
+                declare(s->name, local);
+            }
+
+            // Compiles body as a chunk taking params (doubles) and captures (the free
+            // variables besides the params, int or double), whose registers in this
+            // chunk are returned in captured
+            size_t closure(const ExprNode* body, const std::vector<std::string>& params, const std::vector<std::string>& free,
+                           const std::string& name, const std::string& captureError, const std::string& bodyError,
+                           std::vector<uint16_t>& captured) {
+                std::vector<std::pair<std::string, Local>> captures;
+                for (const std::string& var : free) {
+                    if (std::find(params.begin(), params.end(), var) != params.end()) continue;
+                    Local* l = lookup(var);
+                    if (!l) fail("Undefined variable: " + var);
+                    if (l->isFunction() || (l->type != ValueType::Int && l->type != ValueType::Double)) fail(captureError + var);
+                    captures.push_back({var, *l});
+                }
+
+                FunctionState inner;
+                inner.parent = fs;
+                inner.chunk = newChunk(name, params.size());
+                inner.scopes.emplace_back();
+                program.chunks[inner.chunk].numCaptures = (uint16_t)captures.size();
+                if (regions) {
+                    TierChunk& region = regions->chunks[inner.chunk];
+                    region.body = body;
+                    region.params = params;
+                    region.line = (int)line;
+                    for (auto& cap : captures) {
+                        TierVariable v;
+                        v.name = cap.first;
+                        v.type = cap.second.type;
+                        region.captures.push_back(v);
+                    }
+                }
+
+                FunctionState* outer = fs;
+                fs = &inner;
+                for (const std::string& param : params) {
+                    Local l;
+                    l.reg = allocLocal();
+                    l.type = ValueType::Double;
+                    if (!fs->scopes.back().emplace(param, l).second) fail("Duplicate parameter in function " + name + ": " + param);
+                }
+                for (auto& cap : captures) {
+                    Local l;
+                    l.reg = allocLocal();
+                    l.type = cap.second.type;
+                    fs->scopes.back()[cap.first] = l;
+                }
+
+                // Inner scope so body variables can't clash with the parameters
+                pushScope();
+                Operand result = expr(body, -1);
+                if (!isNumeric(result.type)) fail(bodyError);
+                result = convert(result, ValueType::Double, -1, bodyError);
+                emit(Op::Return, result.reg);
+                finish();
+                fs = outer;
+
+                for (auto& cap : captures) captured.push_back(cap.second.reg);
+                return inner.chunk;
+            }
+
+            void ifStmt(const IfStmt* s) {
+                Operand cond = expr(s->condition, -1);
+                if (!isNumeric(cond.type)) fail("Unsupported condition in if statement.");
+                size_t skipThen = emit(Op::JumpIfFalse, cond.reg);
+                fs->nextReg = fs->localTop;
+
+                scoped(s->thenBranch);
+                if (s->elseBranch) {
+                    size_t skipElse = emit(Op::Jump);
+                    patch(skipThen, here());
+                    scoped(s->elseBranch);
+                    patch(skipElse, here());
+                } else {
+                    patch(skipThen, here());
+                }
+            }
+
+            // while and for: condition at the top, continue jumps to the step and the
+            // back edge is a Loop, where tiered execution enters native code
+            void loop(const StmtNode* stmt, const ExprNode* condition, const ExprNode* step, const StmtNode* body) {
+                if (loopCount >= 0xFFFF) fail("Too many loops.");
+                size_t region = loopCount++;
+                if (regions) {
+                    regions->loops.emplace_back();
+                    regions->loops.back().loop = stmt;
+                    regions->loops.back().scope = visible();
+                }
+
+                size_t top = here();
+                size_t exit = SIZE_MAX;
+                if (condition) {
+                    Operand cond = expr(condition, -1);
+                    if (!isNumeric(cond.type)) fail("Unsupported loop condition.");
+                    exit = emit(Op::JumpIfFalse, cond.reg);
+                    fs->nextReg = fs->localTop;
+                }
+
+                fs->loops.emplace_back();
+                fs->loops.back().region = region;
+                scoped(body);
+                LoopJumps jumps = fs->loops.back();
+                fs->loops.pop_back();
+
+                for (size_t j : jumps.continues) patch(j, here());
+                if (step) {
+                    expr(step, -1);
+                    fs->nextReg = fs->localTop;
+                }
+                patch(emit(Op::Loop, region), top);
+
+                if (exit != SIZE_MAX) patch(exit, here());
+                for (size_t j : jumps.breaks) patch(j, here());
+                if (regions) regions->loops[region].exit = (uint32_t)here();
+            }
+
+            void print(const PrintStmt* s) {
+                std::vector<const ExprNode*> items;
+                flattenCommas(s->value, items);
+
+                // Values go to consecutive registers, string literals into the format
+                size_t count = 0;
+                for (auto item : items) if (!dynamic_cast<const StringLiteral*>(item)) ++count;
+                uint16_t base = temp((uint32_t)count);
+
+                std::string format;
+                size_t k = 0;
+                for (auto item : items) {
+                    if (auto str = dynamic_cast<const StringLiteral*>(item)) {
+                        for (char c : str->value) format += c == '%' ? "%%" : std::string(1, c);
+                        continue;
+                    }
+                    Operand v = into(expr(item, base + k), base + k);
+                    ++k;
+                    switch (v.type) {
+                        case ValueType::Int: format += "%i"; break;
+                        case ValueType::Double: format += "%d"; break;
+                        case ValueType::Bool: format += "%b"; break;
+                        case ValueType::String: format += "%s"; break;
+                        case ValueType::Function: fail("Unsupported type in print statement.");
+                    }
+                }
+
+                // print("x = ", x, "\n") already ends the line
+                auto last = dynamic_cast<const StringLiteral*>(items.back());
+                if (!last || last->value.empty() || last->value.back() != '\n') format += '\n';
+
+                emit(Op::Print, string(format), base, count);
+            }
+
+            // Expressions, the result lands in dst when it is a register (>= 0),
+            // otherwise wherever is cheapest (a variable's register for a read)
+
+            Operand expr(const ExprNode* e, int dst) {
+                if (auto n = dynamic_cast<const IntLiteral*>(e)) return load(values::integer(n->value), dst);
+                if (auto n = dynamic_cast<const DoubleLiteral*>(e)) return load(values::real(n->value), dst);
+                if (auto n = dynamic_cast<const BoolLiteral*>(e)) return load(values::boolean(n->value), dst);
+                if (auto n = dynamic_cast<const StringLiteral*>(e)) {
+                    uint16_t reg = target(dst);
+                    emit(Op::LoadS, reg, string(n->value));
+                    return Operand{reg, ValueType::String};
+                }
+                if (auto n = dynamic_cast<const IdentifierExpr*>(e)) {
+                    Local* l = lookup(n->name);
+                    if (!l) fail("Undefined variable: " + n->name);
+                    if (l->isFunction()) fail("Function " + n->name + " can only be called.");
+                    return into(Operand{l->reg, l->type}, dst);
+                }
+                if (auto n = dynamic_cast<const AssignmentExpr*>(e)) return assign(n, dst);
+                if (auto n = dynamic_cast<const BinaryExpr*>(e)) return binary(n, dst);
+                if (auto n = dynamic_cast<const UnaryExpr*>(e)) return unary(n, dst);
+                if (auto n = dynamic_cast<const CallExpr*>(e)) return call(n, dst);
+                if (auto n = dynamic_cast<const DerivExpr*>(e)) return deriv(n, dst);
+                if (auto n = dynamic_cast<const IntegralExpr*>(e)) return integral(n, dst);
+                if (dynamic_cast<const FunctionLiteral*>(e)) fail("Function literals are only allowed in function declarations.");
+                fail("Unsupported expression.");
+            }
+
+            Operand assign(const AssignmentExpr* n, int dst) {
+                Local* l = lookup(n->name);
+                if (!l) fail("Undefined variable: " + n->name);
+                if (l->isFunction()) fail("Cannot assign to function " + n->name + ".");
+                Local var = *l;
+                if (regions && var.type == ValueType::String) {
+                    for (const LoopJumps& open : fs->loops) regions->loops[open.region].native = false;
+                }
+
+                Operand v = expr(n->expr, var.reg);
+                convert(v, var.type, var.reg, "Type mismatch in assignment to variable: " + n->name);
+                return into(Operand{var.reg, var.type}, dst);
+            }
+
+            Operand binary(const BinaryExpr* n, int dst) {
+                if (n->op == BinaryOp::Comma) {
+                    expr(n->left, -1);
+                    return expr(n->right, dst);
+                }
+                if (n->op == BinaryOp::And || n->op == BinaryOp::Or) return logical(n, dst);
+
+                // The right side may assign the variable read on the left
+                Operand l = expr(n->left, -1);
+                if (hasAssignment(n->right) && l.reg < fs->localTop) l = into(l, temp());
+                Operand r = expr(n->right, -1);
+
+                static const Op ops[] = { Op::Add, Op::Sub, Op::Mul, Op::Div, Op::Mod, Op::Eq, Op::Ne, Op::Lt, Op::Gt, Op::Le, Op::Ge };
+                size_t index = (size_t)n->op;
+                if (index >= sizeof(ops) / sizeof(ops[0]) || (!isArithmetic(n->op) && !isComparison(n->op))) {
+                    fail(std::string("Unsupported binary operator: ") + opName(n->op));
+                }
+
+                ValueType type;
+                if (l.type == ValueType::String || r.type == ValueType::String) {
+                    if (n->op == BinaryOp::Add) type = ValueType::String;
+                    else if ((n->op == BinaryOp::Eq || n->op == BinaryOp::Ne) && l.type == r.type) type = ValueType::Bool;
+                    else fail(std::string("Unsupported operator for strings: ") + opName(n->op));
+                } else if (isComparison(n->op)) {
+                    type = ValueType::Bool;
+                } else {
+                    type = l.type == ValueType::Double || r.type == ValueType::Double ? ValueType::Double : ValueType::Int;
+                }
+
+                uint16_t reg = target(dst);
+                emit(ops[index], reg, l.reg, r.reg);
+                return Operand{reg, type};
+            }
+
+            // a && b: a to bool in the result register, skip b when that decides it
+            Operand logical(const BinaryExpr* n, int dst) {
+                bool isAnd = n->op == BinaryOp::And;
+                std::string error = std::string("Unsupported operand for logical operator: ") + opName(n->op);
+
+                // Not dst itself: it may be a variable the right side reads
+                uint16_t result = temp();
+                Operand l = expr(n->left, -1);
+                if (!isNumeric(l.type)) fail(error);
+                emit(Op::ToBool, result, l.reg);
+                size_t skip = emit(isAnd ? Op::JumpIfFalse : Op::JumpIfTrue, result);
+
+                Operand r = expr(n->right, -1);
+                if (!isNumeric(r.type)) fail(error);
+                emit(Op::ToBool, result, r.reg);
+                patch(skip, here());
+                return into(Operand{result, ValueType::Bool}, dst);
+            }
+
+            Operand unary(const UnaryExpr* n, int dst) {
+                if (BinaryExpr* args = n->powerArgs()) {
+                    Operand base = expr(args->left, -1);
+                    Operand exponent = expr(args->right, -1);
+                    if (!isNumeric(base.type) || !isNumeric(exponent.type)) fail("Failed to generate code for power operands.");
+                    uint16_t reg = target(dst);
+                    emit(Op::Pow, reg, base.reg, exponent.reg);
+                    return Operand{reg, ValueType::Double};
+                }
+
+                Operand v = expr(n->operand, -1);
+                uint16_t reg;
+                switch (n->op) {
+                    case UnaryOp::Neg:
+                        if (!isNumeric(v.type)) fail("Unsupported type for unary negation.");
+                        emit(Op::Neg, reg = target(dst), v.reg);
+                        return Operand{reg, v.type};
+                    case UnaryOp::Not:
+                        if (!isNumeric(v.type)) fail("Unsupported type for logical NOT.");
+                        emit(Op::Not, reg = target(dst), v.reg);
+                        return Operand{reg, ValueType::Bool};
+                    default: break;
+                }
+
+                Op op;
+                switch (n->op) {
+                    case UnaryOp::Sin: op = Op::Sin; break;
+                    case UnaryOp::Cos: op = Op::Cos; break;
+                    case UnaryOp::Tan: op = Op::Tan; break;
+                    case UnaryOp::Exp: op = Op::Exp; break;
+                    case UnaryOp::Log: op = Op::Log; break;
+                    case UnaryOp::Sqrt: op = Op::Sqrt; break;
+                    default: fail(std::string("Unsupported unary operator: ") + opName(n->op));
+                }
+                if (!isNumeric(v.type)) fail(std::string("Unsupported type for ") + opName(n->op) + ".");
+                emit(op, reg = target(dst), v.reg);
+                return Operand{reg, ValueType::Double};
+            }
+
+            Operand call(const CallExpr* n, int dst) {
+                auto id = dynamic_cast<const IdentifierExpr*>(n->callee);
+                if (!id) fail("Only named functions can be called.");
+
+                Local* l = lookupFunction(id->name);
+                if (!l) fail("Undefined function: " + id->name);
+                if (!l->isFunction()) fail(id->name + " is not a function.");
+                callsFunctions();
+                const Chunk& callee = program.chunks[l->chunk];
+                if (callee.numParams != n->args.size()) {
+                    fail("Function " + id->name + " expects " + std::to_string(callee.numParams) +
+                         " arguments, got " + std::to_string(n->args.size()) + ".");
+                }
+                int chunkIndex = l->chunk;
+
+                uint16_t base = temp((uint32_t)n->args.size());
+                for (size_t k = 0; k < n->args.size(); ++k) {
+                    Operand v = expr(n->args[k], base + k);
+                    if (!isNumeric(v.type)) fail("Failed to generate code for argument of " + id->name + ".");
+                    convert(v, ValueType::Double, base + k, "");
+                }
+
+                uint16_t reg = target(dst);
+                emit(Op::Call, reg, chunkIndex, base);
+                return Operand{reg, ValueType::Double};
+            }
+
+            // Symbolic only: the derivative tree is compiled in place of the deriv
+            Operand deriv(const DerivExpr* n, int dst) {
+                for (const std::string& name : calculus::freeVariables(n->expr)) {
+                    Local* l = name == n->var ? nullptr : lookup(name);
+                    if (l && l->declared && l->type == ValueType::Double) {
+                        throw BytecodeUnsupported("deriv(..., " + n->var + ") reads " + name + ", which carries a derivative (forward-mode AD)");
+                    }
+                }
+
+                std::unique_ptr<ExprNode> derivative;
+                try {
+                    std::unique_ptr<ExprNode> inlined(calculus::inlineCalls(n->expr, [this](const std::string& name) -> const FunctionLiteral* {
+                        Local* f = lookupFunction(name);
+                        if (f && f->isFunction()) callsFunctions();
+                        return f && f->isFunction() ? f->literal : nullptr;
+                    }));
+                    derivative.reset(calculus::differentiate(inlined.get(), n->var));
+                }
+                catch (const std::runtime_error& e) {
+                    fail("Failed to differentiate with respect to " + n->var + ": " + e.what());
+                }
+                return expr(derivative.get(), dst);
+            }
+
+            Operand integral(const IntegralExpr* n, int dst) {
+                std::vector<std::string> free;
+                for (const std::string& name : calculus::freeVariables(n->expr)) if (name != n->var) free.push_back(name);
+
+                std::vector<uint16_t> captures;
+                size_t integrand = closure(n->expr, {n->var}, free, "integrand",
+                    "Unsupported type for variable used in integral: ", "Failed to generate code for integrand.", captures);
+                if (regions) regions->chunks[integrand].integrand = true;
+
+                // Bounds, then the captures, passed with every evaluation
+                uint16_t base = temp(2 + (uint32_t)captures.size());
+                Operand a = expr(n->lower, base);
+                Operand b = expr(n->upper, base + 1);
+                if (!isNumeric(a.type) || !isNumeric(b.type)) fail("Integral bounds must be numeric.");
+                convert(a, ValueType::Double, base, "");
+                convert(b, ValueType::Double, base + 1, "");
+                for (size_t k = 0; k < captures.size(); ++k) emit(Op::Move, base + 2 + k, captures[k]);
+
+                uint16_t reg = target(dst);
+                emit(Op::Integral, reg, integrand, base);
+                return Operand{reg, ValueType::Double};
+            }
+    };
+}
+
+BytecodeProgram compileBytecode(const Program* program, bool superinstructions, TierRegions* regions) {
+    BytecodeProgram result;
+    BytecodeCompiler(result, regions).compile(program);
+    if (superinstructions) fuseSuperinstructions(result);
+    return result;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdexcept>
+#include "bytecode.h"
+#include "../ast/ast.h"
+
+// Program -> bytecode for the interpreter tier, no LLVM involved
+//
+// Accepts the same programs as codegen with the same diagnostics, thrown as
+// BytecodeError. Valid programs the interpreter can't run throw
+// BytecodeUnsupported, the JIT can still run those: deriv(...) of variables
+// that carry derivatives (forward-mode AD) is the only such case.
+
+struct BytecodeError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct BytecodeUnsupported : BytecodeError {
+    using BytecodeError::BytecodeError;
+};
+
+// What tiered execution (tier/tier.h) needs to compile parts of a program to
+// native code: the source of every loop and chunk and the registers its
+// variables live in. The tree pointers belong to the compiled Program
+struct TierVariable {
+    std::string name;
+    ValueType type = ValueType::Int;
+    uint16_t reg = 0; // chunk 0 register, for variables
+    int chunk = -1; // function values
+    const FunctionLiteral* literal = nullptr;
+
+    bool isFunction() const { return chunk >= 0; }
+};
+
+// A while or for loop of chunk 0, region a of its Loop back edge
+struct TierLoop {
+    const StmtNode* loop = nullptr; // entered at its condition, a for's init has run
+    uint32_t exit = 0; // pc after the loop
+    std::vector<TierVariable> scope; // visible names at the loop, in declaration order
+    bool native = true; // false when it assigns strings, which only the interpreter allocates
+};
+
+// Function literal or integrand chunk, chunk 0 has no body
+struct TierChunk {
+    const ExprNode* body = nullptr;
+    std::vector<std::string> params;
+    std::vector<TierVariable> captures; // name and type, in capture register order
+    bool integrand = false;
+    bool native = true; // false when the body calls function values
+    int line = 0; // of the declaring statement, runtime errors in the body report it
+};
+
+struct TierRegions {
+    std::vector<TierLoop> loops;
+    std::vector<TierChunk> chunks;
+};
+
+// Superinstructions are fused in (vm/fuse.h) unless turned off. regions, when
+// given, receives the loops and chunks for tiered execution
+BytecodeProgram compileBytecode(const Program* program, bool superinstructions = true, TierRegions* regions = nullptr);
@@ -0,0 +1,84 @@
+#include "fuse.h"
+
+namespace {
+
+    // Generic op -> its superinstruction, Halt for none
+    Op withConstant(Op op) {
+        switch (op) {
+            case Op::Add: return Op::AddK;
+            case Op::Sub: return Op::SubK;
+            case Op::Mul: return Op::MulK;
+            case Op::Div: return Op::DivK;
+            case Op::Mod: return Op::ModK;
+            default: return Op::Halt;
+        }
+    }
+
+    Op withJump(Op op) {
+        switch (op) {
+            case Op::Eq: return Op::EqJump;
+            case Op::Ne: return Op::NeJump;
+            case Op::Lt: return Op::LtJump;
+            case Op::Gt: return Op::GtJump;
+            case Op::Le: return Op::LeJump;
+            case Op::Ge: return Op::GeJump;
+            default: return Op::Halt;
+        }
+    }
+
+    Op withConstantJump(Op op) {
+        switch (op) {
+            case Op::Eq: return Op::EqKJump;
+            case Op::Ne: return Op::NeKJump;
+            case Op::Lt: return Op::LtKJump;
+            case Op::Gt: return Op::GtKJump;
+            case Op::Le: return Op::LeKJump;
+            case Op::Ge: return Op::GeKJump;
+            default: return Op::Halt;
+        }
+    }
+
+    // Cmp t, ..; JumpIfFalse t
+    bool branchesOn(const Instr& cmp, const Instr& jump) {
+        return withJump(cmp.op) != Op::Halt && jump.op == Op::JumpIfFalse && jump.a == cmp.a;
+    }
+}
+
+unsigned superinstructionLength(Op op) {
+    if (op >= Op::AddK && op <= Op::ModK) return 2;
+    if (op >= Op::EqJump && op <= Op::GeJump) return 2;
+    if (op >= Op::EqKJump && op <= Op::GeKJump) return 3;
+    if (op == Op::MovePrint) return 2;
+    return 1;
+}
+
+size_t fuseSuperinstructions(BytecodeProgram& program) {
+    size_t fused = 0;
+    for (Chunk& chunk : program.chunks) {
+        std::vector<Instr>& code = chunk.code;
+
+        // Longest match first, a fused sequence is not fused again from its middle
+        for (size_t i = 0; i + 1 < code.size(); ) {
+            Instr& in = code[i];
+            const Instr& next = code[i + 1];
+            Op op = Op::Halt;
+
+            if (in.op == Op::LoadK && next.c == in.a) {
+                if (i + 2 < code.size() && branchesOn(next, code[i + 2])) op = withConstantJump(next.op);
+                else op = withConstant(next.op);
+            }
+            else if (branchesOn(in, next)) {
+                op = withJump(in.op);
+            }
+            else if (in.op == Op::Move && next.op == Op::Print && next.c == 1 && next.b == in.a) {
+                op = Op::MovePrint;
+            }
+
+            if (op == Op::Halt) { ++i; continue; }
+            in.op = op;
+            i += superinstructionLength(op);
+            ++fused;
+        }
+    }
+    return fused;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "bytecode.h"
+
+// Superinstructions: frequent opcode sequences fused into one dispatch
+//
+// The sequences come from pair counts over the src/crunch_files corpus and
+// typical loop code (DispatchBench --pairs): a constant right operand loaded
+// just for one op, a comparison feeding a branch (if and loop conditions, often
+// against a constant), and print of a single variable. The fused op replaces
+// the first instruction and reads its other operands from the instructions
+// after it, which stay unchanged, so code size and jump targets don't move and
+// a jump into the middle of a sequence runs the plain ops.
+
+// Fuses the sequences of every chunk, returns the number of superinstructions
+size_t fuseSuperinstructions(BytecodeProgram& program);
+
+// Instructions covered by the superinstruction op, counting itself (1 for other ops)
+unsigned superinstructionLength(Op op);
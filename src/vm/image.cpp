@@ -0,0 +1,383 @@
+#include "image.h"
+#include "fuse.h"
+
+#include <sstream>
+#include <vector>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace {
+
+    size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+    bool inside(uint64_t offset, uint64_t bytes, uint64_t size) {
+        return offset <= size && bytes <= size - offset && offset % 8 == 0;
+    }
+
+    // Directives of a print format, one register each (runtime/print.h)
+    size_t printDirectives(const char* format) {
+        size_t n = 0;
+        for (const char* p = format; *p; ++p) {
+            if (*p != '%') continue;
+            char d = *++p;
+            if (d == 'i' || d == 'd' || d == 'b' || d == 's') ++n;
+            else if (d != '%') break; // crunch_print stops at a malformed one
+        }
+        return n;
+    }
+
+    // The registers, constants, strings, chunks and jump targets the
+    // instruction at pc uses are in bounds, also those of the instructions a
+    // superinstruction reads after it
+    bool operandsValid(const BytecodeImage& image, size_t chunk, size_t pc) {
+        const ChunkRecord& c = image.chunk(chunk);
+        const Instr* code = image.code(chunk);
+        const Instr& in = code[pc];
+        if (pc + superinstructionLength(in.op) > c.codeCount) return false;
+        const Instr* next = code + pc + 1;
+
+        auto reg = [&](uint32_t r, uint32_t count) { return r + count <= c.numRegisters; };
+        auto regs = [&](const Instr& i) { return reg(i.a, 1) && reg(i.b, 1) && reg(i.c, 1); };
+        auto target = [&](const Instr& i) { return i.target() < c.codeCount; };
+        auto constant = [&](uint32_t k) { return k < c.constantCount; };
+        auto format = [&](uint32_t s, uint32_t count) { return s < image.stringCount() && printDirectives(image.string(s)) == count; };
+        auto callee = [&](uint32_t b) { return b < image.chunkCount(); };
+
+        switch (in.op) {
+            case Op::Move: case Op::Neg: case Op::Not:
+            case Op::Sin: case Op::Cos: case Op::Tan: case Op::Exp: case Op::Log: case Op::Sqrt:
+            case Op::ToInt: case Op::ToDouble: case Op::ToBool:
+                return reg(in.a, 1) && reg(in.b, 1);
+            case Op::LoadK:
+                return reg(in.a, 1) && constant(in.b);
+            case Op::LoadS:
+                return reg(in.a, 1) && in.b < image.stringCount();
+            case Op::Jump:
+            case Op::Loop: // a indexes the tier's loops, which only programs compiled in this process have
+                return target(in);
+            case Op::JumpIfFalse:
+            case Op::JumpIfTrue:
+                return reg(in.a, 1) && target(in);
+            case Op::Print:
+                return format(in.a, in.c) && reg(in.b, in.c);
+            case Op::Closure:
+                return callee(in.a) && in.c == image.chunk(in.a).numCaptures && reg(in.b, in.c);
+            case Op::Call:
+                return reg(in.a, 1) && callee(in.b) && reg(in.c, image.chunk(in.b).numParams);
+            case Op::Integral:
+                // Integrands take x, the bounds and captures come from the caller's registers
+                return reg(in.a, 1) && callee(in.b) && image.chunk(in.b).numParams == 1 &&
+                       reg(in.c, 2 + image.chunk(in.b).numCaptures);
+            case Op::Return:
+                return reg(in.a, 1);
+            case Op::Halt:
+                return true;
+            case Op::AddK: case Op::SubK: case Op::MulK: case Op::DivK: case Op::ModK:
+                return reg(in.a, 1) && constant(in.b) && regs(next[0]);
+            case Op::EqJump: case Op::NeJump: case Op::LtJump:
+            case Op::GtJump: case Op::LeJump: case Op::GeJump:
+                return regs(in) && target(next[0]);
+            case Op::EqKJump: case Op::NeKJump: case Op::LtKJump:
+            case Op::GtKJump: case Op::LeKJump: case Op::GeKJump:
+                return reg(in.a, 1) && constant(in.b) && regs(next[0]) && target(next[1]);
+            case Op::MovePrint:
+                return reg(in.a, 1) && reg(in.b, 1) && format(next[0].a, 1) && reg(next[0].b, 1);
+            default: // binary ops, generic and quickened
+                return regs(in);
+        }
+    }
+
+    void printValue(std::ostream& out, Value v) {
+        switch (values::type(v)) {
+            case ValueType::Int: out << values::toInt(v); break;
+            case ValueType::Double: out << values::toDouble(v); break;
+            case ValueType::Bool: out << (values::toInt(v) ? "true" : "false"); break;
+            default: out << "?"; break; // constants are numbers
+        }
+    }
+
+    void printString(std::ostream& out, const char* chars, size_t length) {
+        out << "\"";
+        for (size_t i = 0; i < length; ++i) out << (chars[i] == '\n' ? std::string("\\n") : std::string(1, chars[i]));
+        out << "\"";
+    }
+}
+
+uint64_t imageHash(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+BytecodeImage::~BytecodeImage() = default;
+
+std::unique_ptr<BytecodeImage> BytecodeImage::link(const BytecodeProgram& program, const ImageSource& source) {
+    // String table: the program's strings, then chunk names and the source path
+    std::vector<const std::string*> strings;
+    for (const std::string& s : program.strings) strings.push_back(&s);
+    for (const Chunk& chunk : program.chunks) strings.push_back(&chunk.name);
+    if (!source.path.empty()) strings.push_back(&source.path);
+
+    size_t size = align8(sizeof(ImageHeader));
+    size_t chunkTable = size;
+    size += align8(program.chunks.size() * sizeof(ChunkRecord));
+    size_t stringTable = size;
+    size += align8(strings.size() * sizeof(StringRecord));
+    size_t chunkData = size;
+    for (const Chunk& chunk : program.chunks) {
+        size += chunk.code.size() * sizeof(Instr) + chunk.constants.size() * sizeof(Value);
+        size += align8(chunk.code.size() * sizeof(uint32_t));
+    }
+    size_t stringData = size;
+    for (const std::string* s : strings) size += s->size() + 1;
+    size = align8(size);
+
+    std::unique_ptr<BytecodeImage> image(new BytecodeImage());
+    image->owned.reset(new uint64_t[size / 8]());
+    image->base = (uint8_t*)image->owned.get();
+    image->length = size;
+    uint8_t* base = image->base;
+
+    ImageHeader& header = *(ImageHeader*)base;
+    std::memcpy(header.magic, CRUNCHC_MAGIC, sizeof(header.magic));
+    header.version = CRUNCHC_VERSION;
+    header.byteOrder = CRUNCHC_BYTE_ORDER;
+    header.opcodeCount = (uint32_t)Op::Count;
+    header.size = size;
+    header.sourceSize = source.size;
+    header.sourceHash = source.hash;
+    header.sourcePath = source.path.empty() ? CRUNCHC_NO_STRING : (uint32_t)strings.size() - 1;
+    header.chunkCount = (uint32_t)program.chunks.size();
+    header.stringCount = (uint32_t)strings.size();
+    header.chunks = chunkTable;
+    header.strings = stringTable;
+
+    size_t at = chunkData;
+    for (size_t i = 0; i < program.chunks.size(); ++i) {
+        const Chunk& chunk = program.chunks[i];
+        ChunkRecord& record = ((ChunkRecord*)(base + chunkTable))[i];
+        record.codeCount = (uint32_t)chunk.code.size();
+        record.constantCount = (uint32_t)chunk.constants.size();
+        record.name = (uint32_t)(program.strings.size() + i);
+        record.numParams = chunk.numParams;
+        record.numCaptures = chunk.numCaptures;
+        record.numRegisters = chunk.numRegisters;
+
+        record.code = at;
+        std::memcpy(base + at, chunk.code.data(), chunk.code.size() * sizeof(Instr));
+        at += chunk.code.size() * sizeof(Instr);
+        record.constants = at;
+        std::memcpy(base + at, chunk.constants.data(), chunk.constants.size() * sizeof(Value));
+        at += chunk.constants.size() * sizeof(Value);
+        record.lines = at;
+        for (size_t pc = 0; pc < chunk.code.size(); ++pc) ((uint32_t*)(base + at))[pc] = pc < chunk.lines.size() ? chunk.lines[pc] : 0;
+        at += align8(chunk.code.size() * sizeof(uint32_t));
+    }
+
+    at = stringData;
+    for (size_t i = 0; i < strings.size(); ++i) {
+        StringRecord& record = ((StringRecord*)(base + stringTable))[i];
+        record.offset = at;
+        record.length = strings[i]->size();
+        std::memcpy(base + at, strings[i]->data(), strings[i]->size());
+        at += strings[i]->size() + 1;
+    }
+
+    header.checksum = imageHash(base + sizeof(ImageHeader), size - sizeof(ImageHeader));
+    return image;
+}
+
+std::unique_ptr<BytecodeImage> BytecodeImage::load(const std::string& path, std::string& error) {
+    auto file = llvm::sys::fs::openNativeFileForRead(path);
+    if (!file) {
+        error = llvm::toString(file.takeError());
+        return nullptr;
+    }
+
+    uint64_t size = 0;
+    std::error_code ec;
+    llvm::sys::fs::file_status status;
+    if (!(ec = llvm::sys::fs::status(*file, status))) size = status.getSize();
+    if (!ec && size < sizeof(ImageHeader)) error = "not a bytecode file";
+
+    // Private: quickening writes to copies of the pages it touches, not to the file
+    std::unique_ptr<BytecodeImage> image(new BytecodeImage());
+    if (!ec && error.empty()) {
+        image->mapping.reset(new llvm::sys::fs::mapped_file_region(*file, llvm::sys::fs::mapped_file_region::priv, size, 0, ec));
+    }
+    llvm::sys::fs::closeFile(*file);
+    if (ec) error = ec.message();
+    if (!error.empty()) return nullptr;
+
+    image->base = (uint8_t*)image->mapping->data();
+    image->length = size;
+    if (!image->validate(error)) return nullptr;
+    return image;
+}
+
+bool BytecodeImage::validate(std::string& error) const {
+    const ImageHeader& h = header();
+    if (std::memcmp(h.magic, CRUNCHC_MAGIC, sizeof(h.magic)) != 0) { error = "not a bytecode file"; return false; }
+    if (h.byteOrder != CRUNCHC_BYTE_ORDER) { error = "written on a host with the other byte order"; return false; }
+    if (h.version != CRUNCHC_VERSION || h.opcodeCount != (uint32_t)Op::Count) {
+        error = "bytecode version " + std::to_string(h.version) + "." + std::to_string(h.opcodeCount) + ", this build runs " +
+                std::to_string(CRUNCHC_VERSION) + "." + std::to_string((uint32_t)Op::Count);
+        return false;
+    }
+    if (h.size != length) { error = "truncated"; return false; }
+    if (h.checksum != imageHash(base + sizeof(ImageHeader), length - sizeof(ImageHeader))) { error = "checksum mismatch"; return false; }
+
+    // The checksum catches damage, these keep bogus tables from pointing outside the file
+    if (h.chunkCount == 0 || !inside(h.chunks, (uint64_t)h.chunkCount * sizeof(ChunkRecord), length) ||
+        !inside(h.strings, (uint64_t)h.stringCount * sizeof(StringRecord), length) ||
+        (h.sourcePath != CRUNCHC_NO_STRING && h.sourcePath >= h.stringCount)) {
+        error = "bad tables";
+        return false;
+    }
+    for (size_t i = 0; i < h.stringCount; ++i) {
+        const StringRecord& s = strings()[i];
+        if (s.offset >= length || s.length >= length - s.offset || base[s.offset + s.length] != '\0') { error = "bad string table"; return false; }
+    }
+    for (size_t i = 0; i < h.chunkCount; ++i) {
+        const ChunkRecord& c = chunk(i);
+        if (!inside(c.code, (uint64_t)c.codeCount * sizeof(Instr), length) ||
+            !inside(c.constants, (uint64_t)c.constantCount * sizeof(Value), length) ||
+            !inside(c.lines, (uint64_t)c.codeCount * sizeof(uint32_t), length) || c.name >= h.stringCount) {
+            error = "bad chunk " + std::to_string(i);
+            return false;
+        }
+        for (size_t pc = 0; pc < c.codeCount; ++pc) {
+            if (code(i)[pc].op >= Op::Count) { error = "bad opcode in chunk " + std::to_string(i); return false; }
+        }
+    }
+
+    // Then what the instructions index, so the VM can trust its operands. Frames
+    // hold their parameters and captures (none for the program), and chunks end
+    // in Halt or Return instead of running off their code
+    for (size_t i = 0; i < h.chunkCount; ++i) {
+        const ChunkRecord& c = chunk(i);
+        Op last = c.codeCount ? code(i)[c.codeCount - 1].op : Op::Count;
+        if (c.numParams + c.numCaptures > c.numRegisters || (i == 0 && c.numParams + c.numCaptures > 0) ||
+            (last != Op::Halt && last != Op::Return)) {
+            error = "bad chunk " + std::to_string(i);
+            return false;
+        }
+        for (size_t pc = 0; pc < c.codeCount; ++pc) {
+            if (!operandsValid(*this, i, pc)) {
+                error = "bad operands in chunk " + std::to_string(i) + " at " + std::to_string(pc);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool BytecodeImage::write(const std::string& path, std::string& error) const {
+    // Through a temporary file and a rename, a running program may have the old one mapped
+    int fd;
+    llvm::SmallString<128> temp;
+    if (auto ec = llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temp)) {
+        error = ec.message();
+        return false;
+    }
+    {
+        llvm::raw_fd_ostream out(fd, true);
+        out.write((const char*)base, length);
+        if (out.has_error()) {
+            error = out.error().message();
+            out.clear_error();
+            llvm::sys::fs::remove(temp);
+            return false;
+        }
+    }
+    if (auto ec = llvm::sys::fs::rename(temp, path)) {
+        error = ec.message();
+        llvm::sys::fs::remove(temp);
+        return false;
+    }
+    return true;
+}
+
+std::string BytecodeImage::sourcePath(const std::string& imagePath) const {
+    if (header().sourcePath == CRUNCHC_NO_STRING) return "";
+    std::string source = string(header().sourcePath);
+    if (llvm::sys::path::is_absolute(source)) return source;
+
+    llvm::SmallString<128> path(llvm::sys::path::parent_path(imagePath));
+    llvm::sys::path::append(path, source);
+    return path.str().str();
+}
+
+std::string disassemble(const BytecodeImage& image) {
+    std::ostringstream out;
+    for (size_t c = 0; c < image.chunkCount(); ++c) {
+        const ChunkRecord& chunk = image.chunk(c);
+        const Instr* code = image.code(c);
+        const Value* constants = image.constants(c);
+        const uint32_t* lines = image.lines(c);
+        out << "chunk " << c << " " << image.string(chunk.name) << ": " << chunk.numParams << " params, "
+            << chunk.numCaptures << " captures, " << chunk.numRegisters << " registers\n";
+
+        for (size_t pc = 0; pc < chunk.codeCount; ++pc) {
+            const Instr& in = code[pc];
+            out << "  " << pc << "\t";
+            if (pc == 0 || lines[pc] != lines[pc - 1]) out << "line " << lines[pc];
+            out << "\t" << opName(in.op) << "\t";
+            switch (in.op) {
+                case Op::LoadK:
+                case Op::AddK: case Op::SubK: case Op::MulK: case Op::DivK: case Op::ModK:
+                case Op::EqKJump: case Op::NeKJump: case Op::LtKJump:
+                case Op::GtKJump: case Op::LeKJump: case Op::GeKJump:
+                    out << "r" << in.a << ", k" << in.b << " (";
+                    printValue(out, constants[in.b]);
+                    out << ")";
+                    break;
+                case Op::LoadS:
+                    out << "r" << in.a << ", s" << in.b << " (";
+                    printString(out, image.string(in.b), image.stringLength(in.b));
+                    out << ")";
+                    break;
+                case Op::Jump:
+                    out << "-> " << in.target();
+                    break;
+                case Op::JumpIfFalse:
+                case Op::JumpIfTrue:
+                    out << "r" << in.a << " -> " << in.target();
+                    break;
+                case Op::Loop:
+                    out << "loop " << in.a << " -> " << in.target();
+                    break;
+                case Op::Print:
+                    printString(out, image.string(in.a), image.stringLength(in.a));
+                    out << ", r" << in.b << " x" << in.c;
+                    break;
+                case Op::Move: case Op::MovePrint: case Op::Neg: case Op::Not:
+                case Op::Sin: case Op::Cos: case Op::Tan: case Op::Exp: case Op::Log: case Op::Sqrt:
+                case Op::ToInt: case Op::ToDouble: case Op::ToBool:
+                    out << "r" << in.a << ", r" << in.b;
+                    break;
+                case Op::Closure:
+                    out << "chunk " << in.a << ", r" << in.b << " x" << in.c;
+                    break;
+                case Op::Call:
+                case Op::Integral:
+                    out << "r" << in.a << ", chunk " << in.b << ", r" << in.c;
+                    break;
+                case Op::Return:
+                    out << "r" << in.a;
+                    break;
+                case Op::Halt:
+                    break;
+                default:
+                    out << "r" << in.a << ", r" << in.b << ", r" << in.c;
+            }
+            out << "\n";
+        }
+    }
+    return out.str();
+}
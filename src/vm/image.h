@@ -0,0 +1,128 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "bytecode.h"
+
+namespace llvm { namespace sys { namespace fs { class mapped_file_region; } } }
+
+// Bytecode images: a linked BytecodeProgram in one flat, position independent
+// block of memory. The VM runs images only, linked in memory after compiling or
+// mapped from a .crunchc file (--compile-bytecode), which loads without parsing
+// or fixups: the file is mapped copy-on-write and executed in place.
+//
+// Layout, every section 8 byte aligned and addressed by its offset from the start:
+//
+//     ImageHeader
+//     ChunkRecord[chunkCount]
+//     StringRecord[stringCount]
+//     per chunk: Instr code[codeCount], Value constants[constantCount], uint32_t lines[codeCount]
+//     string bytes, each NUL terminated
+//
+// Constants are numbers only and strings are referred to by index (LoadS,
+// Print), so nothing in the image is a pointer. Multi-byte fields are in host
+// byte order, the header's byteOrder rejects images from the other kind of host.
+
+const char CRUNCHC_MAGIC[8] = { 'C', 'R', 'U', 'N', 'C', 'H', 'C', '\0' };
+const uint32_t CRUNCHC_VERSION = 2; // bump on layout or opcode semantics changes
+const uint32_t CRUNCHC_BYTE_ORDER = 0x01020304;
+const uint32_t CRUNCHC_NO_STRING = 0xFFFFFFFF;
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t opcodeCount; // Op::Count of the writer, opcodes are numbered in CRUNCH_OPCODES order
+    uint32_t flags;
+    uint64_t size; // of the whole image
+    uint64_t checksum; // FNV-1a of everything after the header
+    uint64_t sourceSize; // the source the image was compiled from, for the stale check
+    uint64_t sourceHash;
+    uint32_t sourcePath; // string index, relative to the image's directory, or CRUNCHC_NO_STRING
+    uint32_t chunkCount;
+    uint32_t stringCount;
+    uint32_t reserved;
+    uint64_t chunks; // ChunkRecord table
+    uint64_t strings; // StringRecord table
+};
+
+struct ChunkRecord {
+    uint64_t code;
+    uint64_t constants;
+    uint64_t lines;
+    uint32_t codeCount;
+    uint32_t constantCount;
+    uint32_t name; // string index
+    uint16_t numParams;
+    uint16_t numCaptures;
+    uint16_t numRegisters;
+    uint16_t reserved[3];
+};
+
+struct StringRecord {
+    uint64_t offset;
+    uint64_t length; // without the NUL
+};
+
+// FNV-1a 64
+uint64_t imageHash(const void* data, size_t size);
+
+// Where the program came from, recorded for the stale check
+struct ImageSource {
+    std::string path; // as stored, relative to the image's directory
+    uint64_t size = 0;
+    uint64_t hash = 0;
+};
+
+class BytecodeImage {
+    public:
+        ~BytecodeImage();
+
+        // Lays the program out in a heap buffer
+        static std::unique_ptr<BytecodeImage> link(const BytecodeProgram& program, const ImageSource& source = ImageSource());
+
+        // Maps a .crunchc file. nullptr with the reason in error when the file
+        // can't be read, is damaged or comes from another version
+        static std::unique_ptr<BytecodeImage> load(const std::string& path, std::string& error);
+
+        bool write(const std::string& path, std::string& error) const;
+
+        const ImageHeader& header() const { return *(const ImageHeader*)base; }
+        size_t size() const { return length; }
+        bool mapped() const { return (bool)mapping; }
+
+        size_t chunkCount() const { return header().chunkCount; }
+        const ChunkRecord& chunk(size_t i) const { return ((const ChunkRecord*)(base + header().chunks))[i]; }
+
+        // Writable, quickening rewrites instructions. Mapped images are private
+        // copy-on-write mappings, the file never changes
+        Instr* code(size_t i) { return (Instr*)(base + chunk(i).code); }
+        const Instr* code(size_t i) const { return (const Instr*)(base + chunk(i).code); }
+        const Value* constants(size_t i) const { return (const Value*)(base + chunk(i).constants); }
+        const uint32_t* lines(size_t i) const { return (const uint32_t*)(base + chunk(i).lines); }
+
+        size_t stringCount() const { return header().stringCount; }
+        const char* string(size_t i) const { return (const char*)base + strings()[i].offset; }
+        size_t stringLength(size_t i) const { return strings()[i].length; }
+
+        // Where the recorded source is for an image at imagePath, empty if none was recorded
+        std::string sourcePath(const std::string& imagePath) const;
+
+    private:
+        uint8_t* base = nullptr;
+        size_t length = 0;
+        std::unique_ptr<uint64_t[]> owned; // linked images, 8 byte aligned
+        std::unique_ptr<llvm::sys::fs::mapped_file_region> mapping; // loaded ones
+
+        BytecodeImage() = default;
+        BytecodeImage(const BytecodeImage&) = delete;
+        BytecodeImage& operator=(const BytecodeImage&) = delete;
+
+        const StringRecord* strings() const { return (const StringRecord*)(base + header().strings); }
+
+        // Offsets and counts stay inside the image, operands inside their frame and pools
+        bool validate(std::string& error) const;
+};
+
+// Human readable listing, one instruction per line
+std::string disassemble(const BytecodeImage& image);
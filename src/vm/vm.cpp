@@ -0,0 +1,563 @@
+#include "vm.h"
+#include "../runtime/error.h"
+#include "../runtime/print.h"
+#include "../runtime/quadrature.h"
+#include "../runtime/str.h"
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#if defined(__GNUC__)
+#define CRUNCH_COMPUTED_GOTO 1
+#else
+#define CRUNCH_COMPUTED_GOTO 0
+#endif
+
+using namespace values;
+
+namespace {
+
+    struct RuntimeError : std::runtime_error {
+        using std::runtime_error::runtime_error;
+        RuntimeError(const std::string& message, int line) : std::runtime_error(message), line(line) {}
+
+        int line = -1; // of the failing instruction, 0 when unknown
+    };
+
+    // Quickening rewrites code, which integrands evaluated in parallel share
+    thread_local bool inIntegrand = false;
+
+    // Strings made between two collections of the VM's string slots, at least
+    const size_t MIN_STRING_COLLECTION = 64 * 1024;
+
+    // Int arithmetic wraps like the JIT's i32 ops
+    int32_t wrap(uint32_t v) { return (int32_t)v; }
+
+    // Int division errors come back as values in the unused 0xFFFD tag, for the
+    // handler to report with its line (a try around the dispatch loop slows it down)
+    const Value DivisionByZero = 0xFFFD000000000000ull;
+    const Value DivisionOverflow = 0xFFFD000000000001ull;
+
+    inline bool isFault(Value v) { return (v >> 48) == 0xFFFD; }
+    const char* faultMessage(Value v) { return crunch_fault_message(v == DivisionByZero ? CRUNCH_DIVISION_BY_ZERO : CRUNCH_DIVISION_OVERFLOW); }
+
+    inline bool badDivisor(int32_t l, int32_t r) { return r == 0 || (l == INT32_MIN && r == -1); }
+    inline Value divisionFault(int32_t r) { return r == 0 ? DivisionByZero : DivisionOverflow; }
+
+    // fptosi, out of range values give INT_MIN like x86 does
+    int32_t doubleToInt(double d) {
+        return d > -2147483649.0 && d < 2147483648.0 ? (int32_t)d : INT32_MIN;
+    }
+
+    // The generic binary ops on two ints (or bools) and on two doubles. Called
+    // with a constant op from the handlers, so the switch folds away
+    inline Value intOp(Op op, int32_t l, int32_t r) {
+        switch (op) {
+            case Op::Add: return integer(wrap((uint32_t)l + (uint32_t)r));
+            case Op::Sub: return integer(wrap((uint32_t)l - (uint32_t)r));
+            case Op::Mul: return integer(wrap((uint32_t)l * (uint32_t)r));
+            case Op::Div: return badDivisor(l, r) ? divisionFault(r) : integer(l / r);
+            case Op::Mod: return badDivisor(l, r) ? divisionFault(r) : integer(l % r);
+            case Op::Eq: return boolean(l == r);
+            case Op::Ne: return boolean(l != r);
+            case Op::Lt: return boolean(l < r);
+            case Op::Gt: return boolean(l > r);
+            case Op::Le: return boolean(l <= r);
+            case Op::Ge: return boolean(l >= r);
+            default: throw RuntimeError("bad binary opcode");
+        }
+    }
+
+    inline Value doubleOp(Op op, double l, double r) {
+        switch (op) {
+            case Op::Add: return real(l + r);
+            case Op::Sub: return real(l - r);
+            case Op::Mul: return real(l * r);
+            case Op::Div: return real(l / r);
+            case Op::Mod: return real(std::fmod(l, r));
+            case Op::Eq: return boolean(l == r);
+            case Op::Ne: return boolean(l != r); // unordered, like fcmp une
+            case Op::Lt: return boolean(l < r);
+            case Op::Gt: return boolean(l > r);
+            case Op::Le: return boolean(l <= r);
+            case Op::Ge: return boolean(l >= r);
+            default: throw RuntimeError("bad binary opcode");
+        }
+    }
+
+    crunch_string printed(Value v) {
+        switch (type(v)) {
+            case ValueType::Int: return crunch_str_from_int(toInt(v));
+            case ValueType::Double: return crunch_str_from_double(toDouble(v));
+            case ValueType::Bool: return crunch_str_from_bool(toInt(v));
+            case ValueType::String: return *values::toString(v);
+            case ValueType::Function: break;
+        }
+        return crunch_string();
+    }
+
+    // The slot layout of runtime/print.h, strings take two
+    void print(const char* format, const Value* regs, uint16_t count) {
+        uint64_t small[16];
+        std::vector<uint64_t> large;
+        uint64_t* slots = small;
+        if (2u * count > 16) {
+            large.resize(2u * count);
+            slots = large.data();
+        }
+        size_t n = 0;
+        for (uint16_t i = 0; i < count; ++i) {
+            Value v = regs[i];
+            if (isDouble(v)) slots[n++] = v;
+            else if (isString(v)) { std::memcpy(&slots[n], values::toString(v), sizeof(crunch_string)); n += 2; }
+            else slots[n++] = (uint64_t)(int64_t)toInt(v);
+        }
+        crunch_print(format, slots);
+    }
+}
+
+// Passed to the quadrature through its env pointer
+struct IntegrandEnv {
+    VM* vm;
+    size_t chunk;
+    const Value* captures;
+    std::atomic<bool> failed{false};
+    std::mutex lock;
+    std::string error;
+    int line = -1;
+
+    // crunch_integrand, possibly on several quadrature threads at once. Errors
+    // can't unwind through the runtime, they are reported after it returns
+    static void evaluate(const double* xs, double* ys, int64_t n, const double* env) {
+        IntegrandEnv* self = (IntegrandEnv*)env;
+        if (NativeTier* tier = self->vm->options.tier) {
+            uint32_t before = tier->chunks[self->chunk].count.fetch_add((uint32_t)n, std::memory_order_relaxed);
+            if (before < tier->threshold && before + n >= tier->threshold) tier->hotChunk(self->chunk);
+        }
+        bool nested = inIntegrand;
+        inIntegrand = true;
+        for (int64_t i = 0; i < n; ++i) {
+            if (self->failed) { ys[i] = 0.0; continue; }
+            try {
+                Value x = real(xs[i]);
+                ys[i] = asDouble(self->vm->call(self->chunk, &x, self->captures));
+            } catch (const std::runtime_error& e) {
+                std::lock_guard<std::mutex> guard(self->lock);
+                if (!self->failed) {
+                    self->error = e.what();
+                    if (auto r = dynamic_cast<const RuntimeError*>(&e)) self->line = r->line;
+                }
+                self->failed = true;
+                ys[i] = 0.0;
+            }
+        }
+        inIntegrand = nested;
+    }
+};
+
+VM::VM(BytecodeImage& image, const VMOptions& options)
+    : image(image), options(options), captures(image.chunkCount()), captureTable(image.chunkCount()) {
+    literals.reserve(image.stringCount());
+    for (size_t i = 0; i < image.stringCount(); ++i) literals.push_back(crunch_string_literal(image.string(i), image.stringLength(i)));
+}
+
+int VM::run() {
+    owner = std::this_thread::get_id();
+    int status = 0;
+    try {
+        call(0, nullptr, nullptr);
+    } catch (const RuntimeError& e) {
+        crunch_flush();
+        std::cerr << "Runtime error";
+        if (e.line > 0) std::cerr << " at line " << e.line;
+        std::cerr << ": " << e.what() << std::endl;
+        status = -1;
+    }
+    crunch_flush();
+
+    // The program is over, its strings with it
+    strings.clear();
+    freeStrings.clear();
+    crunch_str_reset();
+    return status;
+}
+
+Value VM::call(size_t index, const Value* args, const Value* captured) {
+    const ChunkRecord& chunk = image.chunk(index);
+
+    // Small frames stay on the native stack, the compiler writes every register before reading it
+    Value small[32];
+    std::vector<Value> large;
+    Value* regs = small;
+    if (chunk.numRegisters > 32) {
+        large.resize(chunk.numRegisters);
+        regs = large.data();
+    }
+    // Except that string collections scan chunk 0's, which must not look like strings before
+    if (index == 0) std::fill(regs, regs + chunk.numRegisters, Value(0));
+    std::copy(args, args + chunk.numParams, regs);
+    std::copy(captured, captured + chunk.numCaptures, regs + chunk.numParams);
+
+    if (options.profile && std::this_thread::get_id() == owner) return execute<true>(index, regs);
+    return execute<false>(index, regs);
+}
+
+crunch_string* VM::newString() {
+    stringsMade++;
+    if (freeStrings.empty()) {
+        strings.emplace_back();
+        return &strings.back();
+    }
+    crunch_string* s = freeStrings.back();
+    freeStrings.pop_back();
+    return s;
+}
+
+void VM::collectStrings(const Value* regs, size_t count) {
+    std::unordered_set<const crunch_string*> held;
+    std::vector<crunch_string> roots;
+    for (size_t i = 0; i < count; ++i) {
+        if (!isString(regs[i])) continue;
+        const crunch_string* s = values::toString(regs[i]);
+        roots.push_back(*s);
+        held.insert(s);
+    }
+
+    // Freed slots are emptied, a stale register still pointing there reads ""
+    freeStrings.clear();
+    for (crunch_string& s : strings) {
+        if (held.count(&s)) continue;
+        s = crunch_string();
+        freeStrings.push_back(&s);
+    }
+    stringsKept = strings.size() - freeStrings.size();
+    stringsMade = 0;
+    crunch_str_collect(roots.data(), (int64_t)roots.size());
+}
+
+Value VM::binary(Op op, Value x, Value y) {
+    if (isString(x) || isString(y)) {
+        if (op == Op::Add) {
+            crunch_string* s = newString();
+            *s = crunch_str_concat(printed(x), printed(y));
+            return string(s);
+        }
+        bool equal = crunch_str_equal(*values::toString(x), *values::toString(y)) != 0;
+        return boolean(op == Op::Eq ? equal : !equal);
+    }
+    if (isDouble(x) || isDouble(y)) return doubleOp(op, asDouble(x), asDouble(y));
+    return intOp(op, toInt(x), toInt(y));
+}
+
+template<bool Profile>
+Value VM::execute(size_t chunk, Value* regs) {
+    Instr* const code = image.code(chunk);
+    const Value* const k = image.constants(chunk);
+    const uint32_t* const lines = image.lines(chunk);
+    Instr* ip = code;
+    const bool rewrite = options.quicken && !inIntegrand;
+    size_t prev = (size_t)Op::Count;
+
+// Profile: per op and per pair counts, compiled out of the normal loop
+#define VM_COUNT() \
+    if (Profile) { \
+        DispatchProfile& p = *options.profile; \
+        size_t o = (size_t)in->op; \
+        p.total++; \
+        p.ops[o]++; \
+        if (prev < (size_t)Op::Count) p.pairs[prev][o]++; \
+        prev = o; \
+    }
+
+#if CRUNCH_COMPUTED_GOTO
+#define CRUNCH_OPCODE_LABEL(name) &&op_##name,
+    static void* const labels[] = { CRUNCH_OPCODES(CRUNCH_OPCODE_LABEL) };
+#undef CRUNCH_OPCODE_LABEL
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() do { in = ip++; VM_COUNT() goto *labels[(size_t)in->op]; } while (0)
+    Instr* in;
+    VM_NEXT();
+#else
+#define VM_CASE(name) case Op::name: op_##name:
+#define VM_NEXT() continue
+    for (;;) {
+    Instr* in = ip++;
+    VM_COUNT()
+    switch (in->op) {
+#endif
+
+#define LINE_OF(i) ((int)lines[(i) - code])
+#define LINE LINE_OF(in)
+#define A regs[in->a]
+#define B regs[in->b]
+#define C regs[in->c]
+
+// x op y: both ints, both doubles, then everything else
+#define VM_BINARY(op, x, y) \
+    (bothInt(x, y) ? intOp(op, toInt(x), toInt(y)) : bothDouble(x, y) ? doubleOp(op, toDouble(x), toDouble(y)) : binary(op, x, y))
+
+// Int division results can be faults, for other ops the check folds away. at
+// is the division's instruction, its line can differ from a fused LoadK's
+#define VM_CHECK(name, r, at) \
+    if ((Op::name == Op::Div || Op::name == Op::Mod) && isFault(r)) throw RuntimeError(faultMessage(r), LINE_OF(at));
+
+// Generic op, quickens to the II or DD variant from the operands it sees
+#define VM_GENERIC(name) \
+    VM_CASE(name) { \
+        Value x = B, y = C; \
+        if (bothInt(x, y)) { \
+            Value r = intOp(Op::name, toInt(x), toInt(y)); \
+            VM_CHECK(name, r, in) \
+            A = r; \
+            if (rewrite) in->op = Op::name##II; \
+        } else if (bothDouble(x, y)) { \
+            A = doubleOp(Op::name, toDouble(x), toDouble(y)); \
+            if (rewrite) in->op = Op::name##DD; \
+        } else { \
+            Value r = binary(Op::name, x, y); \
+            VM_CHECK(name, r, in) \
+            A = r; \
+        } \
+        VM_NEXT(); \
+    }
+
+// Quickened op, a failed guard turns it back into the generic one
+#define VM_QUICK(name) \
+    VM_CASE(name##II) { \
+        Value x = B, y = C; \
+        if (!bothInt(x, y)) { if (rewrite) in->op = Op::name; goto op_##name; } \
+        Value r = intOp(Op::name, toInt(x), toInt(y)); \
+        VM_CHECK(name, r, in) \
+        A = r; \
+        VM_NEXT(); \
+    } \
+    VM_CASE(name##DD) { \
+        Value x = B, y = C; \
+        if (!bothDouble(x, y)) { if (rewrite) in->op = Op::name; goto op_##name; } \
+        A = doubleOp(Op::name, toDouble(x), toDouble(y)); \
+        VM_NEXT(); \
+    }
+
+// LoadK t, k; Op a, b, t
+#define VM_FUSED_K(name) \
+    VM_CASE(name##K) { \
+        A = k[in->b]; \
+        Instr* op = ip++; \
+        Value x = regs[op->b], y = regs[op->c]; \
+        Value r = VM_BINARY(Op::name, x, y); \
+        VM_CHECK(name, r, op) \
+        regs[op->a] = r; \
+        VM_NEXT(); \
+    }
+
+// Cmp t, b, c; JumpIfFalse t
+#define VM_FUSED_JUMP(name) \
+    VM_CASE(name##Jump) { \
+        Value x = B, y = C; \
+        Value r = VM_BINARY(Op::name, x, y); \
+        A = r; \
+        Instr* jump = ip++; \
+        if (!toInt(r)) ip = code + jump->target(); \
+        VM_NEXT(); \
+    }
+
+// LoadK u, k; Cmp t, b, u; JumpIfFalse t
+#define VM_FUSED_KJUMP(name) \
+    VM_CASE(name##KJump) { \
+        A = k[in->b]; \
+        Instr* cmp = ip; \
+        Instr* jump = ip + 1; \
+        Value x = regs[cmp->b], y = regs[cmp->c]; \
+        Value r = VM_BINARY(Op::name, x, y); \
+        regs[cmp->a] = r; \
+        ip += 2; \
+        if (!toInt(r)) ip = code + jump->target(); \
+        VM_NEXT(); \
+    }
+
+#define VM_MATH(name, fn) \
+    VM_CASE(name) { A = real(fn(asDouble(B))); VM_NEXT(); }
+
+    VM_CASE(Move) { A = B; VM_NEXT(); }
+    VM_CASE(LoadK) { A = k[in->b]; VM_NEXT(); }
+    VM_CASE(LoadS) { A = string(&literals[in->b]); VM_NEXT(); }
+
+    VM_GENERIC(Add)
+    VM_GENERIC(Sub)
+    VM_GENERIC(Mul)
+    VM_GENERIC(Div)
+    VM_GENERIC(Mod)
+    VM_GENERIC(Eq)
+    VM_GENERIC(Ne)
+    VM_GENERIC(Lt)
+    VM_GENERIC(Gt)
+    VM_GENERIC(Le)
+    VM_GENERIC(Ge)
+
+    VM_CASE(Neg) {
+        Value x = B;
+        if (isDouble(x)) A = real(-toDouble(x));
+        else if (isInt(x)) A = integer(wrap(0u - (uint32_t)x));
+        else A = x; // -true is true in i1
+        VM_NEXT();
+    }
+    VM_CASE(Not) { A = boolean(!truthy(B)); VM_NEXT(); }
+
+    VM_MATH(Sin, std::sin)
+    VM_MATH(Cos, std::cos)
+    VM_MATH(Tan, std::tan)
+    VM_MATH(Exp, std::exp)
+    VM_MATH(Log, std::log)
+    VM_MATH(Sqrt, std::sqrt)
+    VM_CASE(Pow) { A = real(std::pow(asDouble(B), asDouble(C))); VM_NEXT(); }
+
+    VM_CASE(ToInt) { A = integer(isDouble(B) ? doubleToInt(toDouble(B)) : toInt(B)); VM_NEXT(); }
+    VM_CASE(ToDouble) { A = real(asDouble(B)); VM_NEXT(); }
+    VM_CASE(ToBool) { A = boolean(truthy(B)); VM_NEXT(); }
+
+    VM_CASE(Jump) { ip = code + in->target(); VM_NEXT(); }
+    VM_CASE(JumpIfFalse) { if (!truthy(A)) ip = code + in->target(); VM_NEXT(); }
+    VM_CASE(JumpIfTrue) { if (truthy(A)) ip = code + in->target(); VM_NEXT(); }
+
+    // Back edge: loop code runs the rest of the loop, then the interpreter goes on after it
+    VM_CASE(Loop) {
+        if (NativeTier* tier = options.tier) {
+            NativeTier::LoopSlot& slot = tier->loops[in->a];
+            if (NativeTier::LoopCode native = slot.code.load(std::memory_order_acquire)) {
+                tier->entries++;
+                native(regs, captureTable.data());
+                ip = code + slot.exit;
+                VM_NEXT();
+            }
+            if (++slot.count == tier->threshold) tier->hotLoop(in->a);
+        }
+        // Loops are only in chunk 0. Once enough slots or buffer bytes were used since the last time
+        if (chunk == 0 && stringsMade && (stringsMade >= std::max<size_t>(MIN_STRING_COLLECTION, stringsKept) || crunch_str_collect_due())) {
+            collectStrings(regs, image.chunk(0).numRegisters);
+        }
+        ip = code + in->target();
+        VM_NEXT();
+    }
+
+    VM_CASE(Print) {
+        print(image.string(in->a), regs + in->b, in->c);
+        VM_NEXT();
+    }
+
+    VM_CASE(Closure) {
+        captures[in->a].assign(regs + in->b, regs + in->b + in->c);
+        captureTable[in->a] = captures[in->a].data();
+        VM_NEXT();
+    }
+    VM_CASE(Call) {
+        if (NativeTier* tier = options.tier) {
+            NativeTier::ChunkSlot& slot = tier->chunks[in->b];
+            if (NativeTier::FunctionCode native = slot.function.load(std::memory_order_acquire)) {
+                A = real(native(regs + in->c, captures[in->b].data()));
+                VM_NEXT();
+            }
+            if (slot.count.fetch_add(1, std::memory_order_relaxed) + 1 == tier->threshold) tier->hotChunk(in->b);
+        }
+        A = call(in->b, regs + in->c, captures[in->b].data());
+        VM_NEXT();
+    }
+    VM_CASE(Integral) {
+        if (NativeTier* tier = options.tier) {
+            if (crunch_integrand native = tier->chunks[in->b].integrand.load(std::memory_order_acquire)) {
+                // Native integrands take their captures as doubles
+                uint16_t count = image.chunk(in->b).numCaptures;
+                double small[16];
+                std::vector<double> large;
+                double* env = small;
+                if (count > 16) {
+                    large.resize(count);
+                    env = large.data();
+                }
+                for (uint16_t k = 0; k < count; ++k) env[k] = asDouble(regs[in->c + 2 + k]);
+                A = real(crunch_integrate(native, env, toDouble(regs[in->c]), toDouble(regs[in->c + 1])));
+                VM_NEXT();
+            }
+        }
+        IntegrandEnv env;
+        env.vm = this;
+        env.chunk = in->b;
+        env.captures = regs + in->c + 2;
+        double r = crunch_integrate(&IntegrandEnv::evaluate, (const double*)&env, toDouble(regs[in->c]), toDouble(regs[in->c + 1]));
+        if (env.failed) throw RuntimeError(env.error, env.line >= 0 ? env.line : LINE);
+        A = real(r);
+        VM_NEXT();
+    }
+
+    VM_CASE(Return) { return A; }
+    VM_CASE(Halt) { return 0; }
+
+    VM_QUICK(Add)
+    VM_QUICK(Sub)
+    VM_QUICK(Mul)
+    VM_QUICK(Div)
+    VM_QUICK(Mod)
+    VM_QUICK(Eq)
+    VM_QUICK(Ne)
+    VM_QUICK(Lt)
+    VM_QUICK(Gt)
+    VM_QUICK(Le)
+    VM_QUICK(Ge)
+
+    VM_FUSED_K(Add)
+    VM_FUSED_K(Sub)
+    VM_FUSED_K(Mul)
+    VM_FUSED_K(Div)
+    VM_FUSED_K(Mod)
+
+    VM_FUSED_JUMP(Eq)
+    VM_FUSED_JUMP(Ne)
+    VM_FUSED_JUMP(Lt)
+    VM_FUSED_JUMP(Gt)
+    VM_FUSED_JUMP(Le)
+    VM_FUSED_JUMP(Ge)
+
+    VM_FUSED_KJUMP(Eq)
+    VM_FUSED_KJUMP(Ne)
+    VM_FUSED_KJUMP(Lt)
+    VM_FUSED_KJUMP(Gt)
+    VM_FUSED_KJUMP(Le)
+    VM_FUSED_KJUMP(Ge)
+
+    // Move r, b; Print f, r, 1
+    VM_CASE(MovePrint) {
+        A = B;
+        Instr* p = ip++;
+        print(image.string(p->a), regs + p->b, 1);
+        VM_NEXT();
+    }
+
+#if !CRUNCH_COMPUTED_GOTO
+    default:
+        throw RuntimeError("bad opcode", LINE);
+    }
+    }
+#endif
+
+#undef VM_MATH
+#undef VM_FUSED_KJUMP
+#undef VM_FUSED_JUMP
+#undef VM_FUSED_K
+#undef VM_QUICK
+#undef VM_GENERIC
+#undef VM_CHECK
+#undef VM_BINARY
+#undef LINE
+#undef LINE_OF
+#undef A
+#undef B
+#undef C
+#undef VM_NEXT
+#undef VM_CASE
+#undef VM_COUNT
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "image.h"
+#include "../runtime/quadrature.h"
+
+// Bytecode interpreter for the --interp tier, runs a linked image (vm/image.h)
+//
+// Dispatch is direct threaded (computed goto) where the compiler supports it,
+// a switch otherwise. Runtime errors (int division by zero) stop the program
+// with a message and the source line on stderr, like the JIT's traps but
+// recoverable.
+//
+// Generic arithmetic and comparisons quicken: after seeing their operand types
+// they rewrite themselves in place into the int or double variant, so the
+// image's code is modified while it runs.
+
+// Executed instructions per opcode and per (previous, next) opcode pair within a chunk
+struct DispatchProfile {
+    uint64_t total = 0;
+    uint64_t ops[(size_t)Op::Count] = {};
+    uint64_t pairs[(size_t)Op::Count][(size_t)Op::Count] = {};
+};
+
+// Native code for hot parts of the program, filled in by tiered execution
+// (tier/tier.h). The VM counts loop back edges (Loop) and chunk calls and asks
+// for code once a count reaches the threshold. Code is published through the
+// atomics whenever it is ready, the VM keeps interpreting until then and
+// enters loops at their next back edge (on-stack replacement)
+class NativeTier {
+    public:
+        // Runs loop region from its condition to its end on the registers of
+        // chunk 0, captures are the Closure values of every chunk
+        typedef void (*LoopCode)(Value* regs, const Value* const* captures);
+
+        // A function chunk, args are its parameters
+        typedef double (*FunctionCode)(const Value* args, const Value* captures);
+
+        struct LoopSlot {
+            uint32_t count = 0; // back edges taken, VM thread only
+            uint32_t exit = 0; // pc after the loop
+            std::atomic<LoopCode> code{nullptr};
+        };
+
+        struct ChunkSlot {
+            std::atomic<uint32_t> count{0}; // calls and integrand evaluations, quadrature threads too
+            std::atomic<FunctionCode> function{nullptr};
+            std::atomic<crunch_integrand> integrand{nullptr};
+        };
+
+        NativeTier(size_t loopCount, size_t chunkCount, uint32_t threshold)
+            : threshold(threshold), loops(new LoopSlot[loopCount]), chunks(new ChunkSlot[chunkCount]) {}
+        virtual ~NativeTier() = default;
+
+        const uint32_t threshold;
+        std::unique_ptr<LoopSlot[]> loops;
+        std::unique_ptr<ChunkSlot[]> chunks;
+        uint64_t entries = 0; // loop code entered, VM thread only
+
+        // Called once per region when its count reaches the threshold, hotChunk
+        // also from quadrature threads. Must not block on compilation
+        virtual void hotLoop(size_t loop) = 0;
+        virtual void hotChunk(size_t chunk) = 0;
+};
+
+struct VMOptions {
+    bool quicken = true;
+
+    // Loops and chunks go native when hot, the image must come from a program
+    // compiled with TierRegions (vm/compiler.h)
+    NativeTier* tier = nullptr;
+
+    // Counts every dispatch on the running thread when set (integrands evaluated
+    // on quadrature threads aren't counted), a slower copy of the dispatch loop
+    DispatchProfile* profile = nullptr;
+};
+
+class VM {
+    public:
+        explicit VM(BytecodeImage& image, const VMOptions& options = VMOptions());
+
+        // Runs chunk 0 and flushes the print buffer. 0 on success, -1 after a runtime error
+        int run();
+
+    private:
+        BytecodeImage& image;
+        VMOptions options;
+        std::thread::id owner; // thread that profiles
+        std::vector<std::vector<Value>> captures; // per chunk, set by Closure
+        std::vector<const Value*> captureTable; // their data, for loop code
+        std::vector<crunch_string> literals; // per image string, LoadS points here, long ones into the image
+        std::deque<crunch_string> strings; // results of string operations, Values point here
+        std::vector<crunch_string*> freeStrings; // slots of strings no register held at the last collection
+        size_t stringsMade = 0; // since the last collection
+        size_t stringsKept = 0; // by it
+
+        // A slot for a new string, reused or appended
+        crunch_string* newString();
+
+        // At a back edge of chunk 0, the only frame then: frees the strings
+        // and buffers none of its registers holds
+        void collectStrings(const Value* regs, size_t count);
+
+        // Runs chunk with its registers in regs (parameters and captures already set),
+        // returns the Return value. Reentrant: calls and integrands get their own registers
+        template<bool Profile>
+        Value execute(size_t chunk, Value* regs);
+
+        // Calls chunk with the given parameters and its captures
+        Value call(size_t chunk, const Value* args, const Value* captured);
+
+        // Arithmetic and comparisons outside the fast paths: mixed types, bools, strings
+        Value binary(Op op, Value x, Value y);
+
+        friend struct IntegrandEnv;
+};
@@ -0,0 +1,125 @@
+// .crunchc images are only accepted when every operand is in bounds: a
+// program using each kind of operand loads and runs as compiled, and the same
+// program with one operand pointing outside its frame, constants, strings,
+// chunks or code is rejected on load. The images are linked from the damaged
+// program, so their checksums are right and only the operand checks can tell.
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/runtime/print.h"
+#include "../src/vm/compiler.h"
+#include "../src/vm/image.h"
+#include "../src/vm/vm.h"
+
+namespace {
+
+    // Constants, strings, closures, calls, an integral, a fused loop and prints
+    const char* PROGRAM =
+        "double scale = 2.0;\n"
+        "function f = (x) -> x * scale;\n"
+        "function g = (a, b) -> a + b;\n"
+        "string label = \"sum \";\n"
+        "int total = 0;\n"
+        "for (int i = 0; i < 10; i = i + 1) {\n"
+        "    total = total + i * 3;\n"
+        "}\n"
+        "print(label, total);\n"
+        "double area = integral(x * scale, x, 0, 1);\n"
+        "print(f(3.0), \" \", g(1.0, 2.0), \" \", area);\n"
+        "print(total);\n";
+
+    const char* EXPECTED = "sum 135\n6 3 1\n135\n";
+
+    void appendOutput(void* target, const char* data, size_t size) {
+        static_cast<std::string*>(target)->append(data, size);
+    }
+
+    // First instruction op in the program
+    Instr& find(BytecodeProgram& program, Op op) {
+        for (Chunk& chunk : program.chunks)
+            for (Instr& in : chunk.code)
+                if (in.op == op) return in;
+        throw std::runtime_error(std::string("no ") + opName(op) + " in the program");
+    }
+
+    // Writes the program's image to path and maps it again, nullptr with the reason in error
+    std::unique_ptr<BytecodeImage> roundTrip(const BytecodeProgram& program, const std::string& path, std::string& error) {
+        if (!BytecodeImage::link(program)->write(path, error)) return nullptr;
+        return BytecodeImage::load(path, error);
+    }
+
+    struct Damage {
+        const char* name;
+        std::function<void(BytecodeProgram&)> apply;
+    };
+
+    const Damage damages[] = {
+        { "LoadK constant", [](BytecodeProgram& p) { find(p, Op::LoadK).b = 0xFFFF; } },
+        { "LoadS string", [](BytecodeProgram& p) { find(p, Op::LoadS).b = 0xFFFF; } },
+        { "Move source", [](BytecodeProgram& p) { find(p, Op::Move).b = 10; } },
+        { "Print format", [](BytecodeProgram& p) { find(p, Op::Print).a = 0xFFFF; } },
+        { "Print count", [](BytecodeProgram& p) { find(p, Op::Print).c = 3; } },
+        { "Print registers", [](BytecodeProgram& p) { find(p, Op::Print).b = 9; } },
+        { "Closure chunk", [](BytecodeProgram& p) { find(p, Op::Closure).a = 0xFFFF; } },
+        { "Closure captures", [](BytecodeProgram& p) { find(p, Op::Closure).c = 2; } },
+        { "Call chunk", [](BytecodeProgram& p) { find(p, Op::Call).b = 0xFFFF; } },
+        { "Call arguments", [](BytecodeProgram& p) { find(p, Op::Call).c = 10; } },
+        { "Integral of a two parameter chunk", [](BytecodeProgram& p) { find(p, Op::Integral).b = 2; } },
+        { "Integral bounds", [](BytecodeProgram& p) { find(p, Op::Integral).c = 8; } },
+        { "JumpIfFalse target", [](BytecodeProgram& p) { find(p, Op::JumpIfFalse).setTarget(1000); } },
+        { "Loop target", [](BytecodeProgram& p) { find(p, Op::Loop).setTarget(1000); } },
+        { "LtKJump constant", [](BytecodeProgram& p) { find(p, Op::LtKJump).b = 0xFFFF; } },
+        { "Return register", [](BytecodeProgram& p) { find(p, Op::Return).a = 0xFFFF; } },
+        { "frame without room for its registers", [](BytecodeProgram& p) { p.chunks[1].numRegisters = 2; } },
+        { "frame without room for its captures", [](BytecodeProgram& p) { p.chunks[1].numCaptures = 3; } },
+        { "chunk running off its code", [](BytecodeProgram& p) { p.chunks[1].code.back().op = Op::Move; } },
+        { "program with parameters", [](BytecodeProgram& p) { p.chunks[0].numParams = 1; } },
+    };
+}
+
+int main() {
+    llvm::SmallString<128> path;
+    if (llvm::sys::fs::createTemporaryFile("bytecode_image_test", "crunchc", path)) {
+        std::printf("FAIL no temporary file\n");
+        return 1;
+    }
+
+    std::unique_ptr<Lexer> lexer = Lexer::fromSource(PROGRAM);
+    lexer->setDebug(false);
+    lexer->tokenize();
+    Parser parser(lexer->getTokens());
+    const BytecodeProgram compiled = compileBytecode(parser.getProgram());
+    bool ok = true;
+
+    // Intact
+    std::string error, output;
+    std::unique_ptr<BytecodeImage> image = roundTrip(compiled, path.str().str(), error);
+    if (image) {
+        crunch_set_output(appendOutput, &output);
+        int result = VM(*image).run();
+        crunch_set_output(nullptr, nullptr);
+        ok = result == 0 && output == EXPECTED;
+    } else {
+        ok = false;
+    }
+    std::printf("%s intact: %s\n", ok ? "ok  " : "FAIL", image ? "loaded" : error.c_str());
+    if (image && output != EXPECTED) std::printf("     printed \"%s\", expected \"%s\"\n", output.c_str(), EXPECTED);
+    image.reset();
+
+    for (const Damage& damage : damages) {
+        BytecodeProgram program = compiled;
+        damage.apply(program);
+        error.clear();
+        bool rejected = !roundTrip(program, path.str().str(), error) && error.compare(0, 4, "bad ") == 0;
+        std::printf("%s %s: %s\n", rejected ? "ok  " : "FAIL", damage.name, error.empty() ? "accepted" : error.c_str());
+        ok &= rejected;
+    }
+
+    llvm::sys::fs::remove(path);
+    return ok ? 0 : 1;
+}
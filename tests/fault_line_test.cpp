@@ -0,0 +1,63 @@
+// Int division faults in the interpreter report the division's line, also when
+// superinstructions fused it with a LoadK from the statement before.
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/runtime/print.h"
+#include "../src/vm/compiler.h"
+#include "../src/vm/image.h"
+#include "../src/vm/vm.h"
+
+namespace {
+
+    void appendOutput(void* target, const char* data, size_t size) {
+        static_cast<std::string*>(target)->append(data, size);
+    }
+
+    struct Case {
+        const char* name;
+        const char* program;
+        const char* fused; // superinstruction the division must be part of
+        const char* error;
+    };
+
+    const Case cases[] = {
+        { "div", "int a = 5;\nprint(\"before\");\nint b = 0;\nprint(a / b);\n", "DivK",
+          "Runtime error at line 4: integer division by zero\n" },
+        { "mod", "int a = 5;\nint b = 0;\n\nprint(a % b);\n", "ModK",
+          "Runtime error at line 4: integer division by zero\n" },
+    };
+
+    bool check(const Case& test) {
+        std::unique_ptr<Lexer> lexer = Lexer::fromSource(test.program);
+        lexer->setDebug(false);
+        lexer->tokenize();
+        Parser parser(lexer->getTokens());
+        std::unique_ptr<BytecodeImage> image = BytecodeImage::link(compileBytecode(parser.getProgram()));
+
+        std::string output;
+        std::ostringstream errors;
+        std::streambuf* stderrBuffer = std::cerr.rdbuf(errors.rdbuf());
+        crunch_set_output(appendOutput, &output);
+        int result = VM(*image).run();
+        crunch_set_output(nullptr, nullptr);
+        std::cerr.rdbuf(stderrBuffer);
+
+        bool fused = disassemble(*image).find(test.fused) != std::string::npos;
+        bool ok = fused && result < 0 && errors.str() == test.error;
+        std::printf("%s %s: %s", ok ? "ok  " : "FAIL", test.name, errors.str().c_str());
+        if (!fused) std::printf("     no %s in the bytecode\n", test.fused);
+        if (errors.str() != test.error) std::printf("     expected %s", test.error);
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = true;
+    for (const Case& test : cases) ok &= check(test);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+// Parallel refinement rounds: integrals forced onto several threads agree with
+// the serial ones, integrals inside a parallel round's integrand run serially,
+// and several threads integrating at once share the workers.
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "../src/runtime/quadrature.h"
+
+namespace {
+
+    const double PI = 3.14159265358979323846;
+
+    void sine(const double* xs, double* ys, int64_t n, const double*) {
+        for (int64_t i = 0; i < n; ++i) ys[i] = std::sin(xs[i]);
+    }
+
+    // Needs many rounds: 1 / (0.01^2 + x^2)
+    void peak(const double* xs, double* ys, int64_t n, const double*) {
+        for (int64_t i = 0; i < n; ++i) ys[i] = 1.0 / (1e-4 + xs[i] * xs[i]);
+    }
+
+    std::atomic<int> nestedParallel{0};
+
+    void inner(const double* ys, double* out, int64_t n, const double* x) {
+        for (int64_t i = 0; i < n; ++i) out[i] = *x * ys[i];
+    }
+
+    // x * integral(x * y, y, 0, 1), the inner integral started on a round's thread
+    void outer(const double* xs, double* ys, int64_t n, const double*) {
+        QuadratureOptions opts;
+        opts.parallelThreshold = 0.0;
+        for (int64_t i = 0; i < n; ++i) {
+            QuadratureResult r = integrateGK15(inner, &xs[i], 0.0, 1.0, opts);
+            if (r.parallel) nestedParallel++;
+            ys[i] = r.value;
+        }
+    }
+
+    QuadratureOptions forced(unsigned threads) {
+        QuadratureOptions opts;
+        opts.threads = threads;
+        opts.parallelThreshold = 0.0;
+        return opts;
+    }
+
+    bool check(const char* name, bool ok, double value, double expected) {
+        std::printf("%s %s: %.15g (expected %.15g)\n", ok ? "ok  " : "FAIL", name, value, expected);
+        return ok;
+    }
+
+    bool close(double value, double expected, double tolerance) {
+        return std::fabs(value - expected) <= tolerance * std::max(1.0, std::fabs(expected));
+    }
+
+    bool agree(const char* name, crunch_integrand f, double a, double b, double expected) {
+        QuadratureResult serial = integrateGK15(f, nullptr, a, b, forced(1));
+        QuadratureResult parallel = integrateGK15(f, nullptr, a, b, forced(4));
+        bool ok = parallel.parallel && !serial.parallel && parallel.converged &&
+                  close(parallel.value, expected, 1e-9) && close(parallel.value, serial.value, 1e-9);
+        return check(name, ok, parallel.value, expected);
+    }
+}
+
+int main() {
+    bool ok = true;
+    ok &= agree("sine", sine, 0.0, PI, 2.0);
+    ok &= agree("peak", peak, -1.0, 1.0, 200.0 * std::atan(100.0));
+
+    QuadratureResult nested = integrateGK15(outer, nullptr, 0.0, 1.0, forced(4));
+    ok &= check("nested", nested.parallel && nestedParallel == 0 && close(nested.value, 0.25, 1e-9), nested.value, 0.25);
+    if (nestedParallel) std::printf("     %d inner integrals went parallel\n", nestedParallel.load());
+
+    // The calling thread's share
+    setIntegralThreads(1);
+    QuadratureOptions share;
+    share.parallelThreshold = 0.0;
+    QuadratureResult one = integrateGK15(peak, nullptr, -1.0, 1.0, share);
+    setIntegralThreads(3);
+    QuadratureResult three = integrateGK15(peak, nullptr, -1.0, 1.0, share);
+    setIntegralThreads(0);
+    ok &= check("share", !one.parallel && three.parallel && close(three.value, one.value, 1e-9), three.value, one.value);
+
+    // Callers at once
+    std::vector<double> values(4);
+    std::vector<std::thread> callers;
+    for (size_t t = 0; t < values.size(); ++t) {
+        callers.emplace_back([&values, t]() {
+            values[t] = integrateGK15(peak, nullptr, -1.0, 1.0 + t, forced(4)).value;
+        });
+    }
+    for (auto& caller : callers) caller.join();
+    for (size_t t = 0; t < values.size(); ++t) {
+        double expected = 100.0 * (std::atan(100.0 * (1.0 + t)) + std::atan(100.0));
+        ok &= check("concurrent", close(values[t], expected, 1e-9), values[t], expected);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+// String buffers are reclaimed while a program runs: loops building millions of
+// strings (and a string prepended to 20000 times, a new buffer every step) stay
+// within a fixed amount of memory under the JIT and the interpreter, and the
+// strings that are still referenced keep their text.
+
+#include <cstdio>
+#include <string>
+#include <sys/resource.h>
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/jit/jit.h"
+#include "../src/runtime/print.h"
+#include "../src/vm/compiler.h"
+#include "../src/vm/vm.h"
+
+namespace {
+
+    // Growth of the peak RSS a run may cause. Without reclaiming, the programs
+    // below take 180 MB (rows) and 300 MB (prepend)
+    const long MAX_GROWTH_KB = 48 * 1024;
+
+    const char* ROWS =
+        "string s = \"\";\n"
+        "string first = \"kept since the start: \" + 1;\n"
+        "for (int i = 0; i < ITERATIONS; i = i + 1) {\n"
+        "    s = \"row number \" + i + \" value \" + (i * 2) + \" and more text\";\n"
+        "}\n"
+        "print(s, \"|\", first);\n";
+
+    const char* PREPEND =
+        "string t = \"\";\n"
+        "int n = 0;\n"
+        "while (n < ITERATIONS) { t = \"x\" + t; n = n + 1; }\n"
+        "string tail = \"\" + t;\n"
+        "print(n, \" \", tail == t);\n";
+
+    long peakKb() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    void appendOutput(void* target, const char* data, size_t size) {
+        static_cast<std::string*>(target)->append(data, size);
+    }
+
+    std::string withIterations(const char* program, int iterations) {
+        std::string src = program;
+        size_t at = src.find("ITERATIONS");
+        return src.replace(at, 10, std::to_string(iterations));
+    }
+
+    // Runs src, its output in output. False if it didn't compile or failed
+    bool run(const std::string& src, bool interpret, std::string& output) {
+        std::unique_ptr<Lexer> lexer = Lexer::fromSource(src);
+        lexer->setDebug(false);
+        lexer->tokenize();
+        Parser parser(lexer->getTokens());
+
+        output.clear();
+        crunch_set_output(appendOutput, &output);
+        int result;
+        if (interpret) {
+            std::unique_ptr<BytecodeImage> image = BytecodeImage::link(compileBytecode(parser.getProgram()));
+            result = VM(*image).run();
+        } else {
+            codegen_ctx ctx("string_memory");
+            if (!parser.getProgram()->codegenEntry(ctx)) return false;
+            JITTimings timings;
+            result = runJIT(ctx, timings);
+        }
+        crunch_set_output(nullptr, nullptr);
+        return result == 0;
+    }
+
+    bool check(const char* name, const char* program, int iterations, bool interpret, const std::string& expected) {
+        const char* mode = interpret ? "interp" : "jit";
+        std::string output;
+
+        // A short run first, so what compiling takes is in the baseline
+        if (!run(withIterations(program, 10), interpret, output)) {
+            std::printf("FAIL %s %s: didn't run\n", name, mode);
+            return false;
+        }
+        long before = peakKb();
+        if (!run(withIterations(program, iterations), interpret, output)) {
+            std::printf("FAIL %s %s: didn't run\n", name, mode);
+            return false;
+        }
+        long growth = peakKb() - before;
+
+        bool ok = output == expected && growth <= MAX_GROWTH_KB;
+        std::printf("%s %s %s: peak RSS grew %ld KB (at most %ld)\n", ok ? "ok  " : "FAIL", name, mode, growth, MAX_GROWTH_KB);
+        if (output != expected) std::printf("     printed \"%s\", expected \"%s\"\n", output.c_str(), expected.c_str());
+        return ok;
+    }
+}
+
+// Usage: StringMemoryTest [rows|prepend] [jit|interp]  (default: all of them)
+// The peak only goes up, a case run after another that leaked can't tell, so ctest runs one per process
+int main(int argc, char** argv) {
+    std::string only = argc > 1 ? argv[1] : "", mode = argc > 2 ? argv[2] : "";
+    bool ok = true;
+    for (bool interpret : {false, true}) {
+        if (!mode.empty() && mode != (interpret ? "interp" : "jit")) continue;
+        if (only.empty() || only == "rows") {
+            ok &= check("rows", ROWS, 2000000, interpret, "row number 1999999 value 3999998 and more text|kept since the start: 1\n");
+        }
+        if (only.empty() || only == "prepend") ok &= check("prepend", PREPEND, 20000, interpret, "20000 true\n");
+    }
+    return ok ? 0 : 1;
+}